@@ -0,0 +1,83 @@
+/**
+ * @file breakpoint.h
+ * @author Min Kang
+ * @brief Hardware breakpoints through the FPB headers
+ */
+#ifndef BREAKPOINT_H
+#define BREAKPOINT_H
+
+#include <stdint.h>
+
+// Most comparators any FPB has that are used, FPv2 allows up to 127
+#define BP_MAX 15
+
+/**
+ * @brief Read FP_CTRL to find the comparators
+ *
+ * Keeps the breakpoint table, but every comparator is written again on the
+ * next bp_sync(), which also clears whatever an earlier session left.
+ *
+ * @return ACK of request
+ */
+uint8_t bp_init();
+
+/**
+ * @brief Set a breakpoint on an instruction address
+ *
+ * @param addr Address of the instruction
+ *
+ * @return ACK of request, or SWD_ACK_FAULT if every comparator is in use
+ */
+uint8_t bp_set(uint32_t addr);
+
+/**
+ * @brief Remove the breakpoint on an instruction address
+ *
+ * @param addr Address the breakpoint was set on
+ *
+ * @return ACK of request, or SWD_ACK_FAULT if there was none
+ */
+uint8_t bp_clear(uint32_t addr);
+
+/**
+ * @brief Remove every breakpoint
+ *
+ * @return ACK of request
+ */
+uint8_t bp_clear_all();
+
+/**
+ * @brief Write every comparator that changed since the last sync
+ *
+ * Called before the core runs. Does nothing if no breakpoint was ever set.
+ *
+ * @return ACK of request
+ */
+uint8_t bp_sync();
+
+/**
+ * @brief Forget what the comparators hold, for after a reset
+ */
+void bp_invalidate();
+
+/**
+ * @brief Get the FPB's comparator count and revision
+ *
+ * @param num Where the number of comparators is stored
+ * @param rev Where FP_CTRL.REV is stored, 0 for FPv1 and 1 for FPv2
+ *
+ * @return ACK of request
+ */
+uint8_t bp_get_info(uint8_t* num, uint8_t* rev);
+
+/**
+ * @brief Get a breakpoint from the table
+ *
+ * @param i Comparator number
+ * @param addr Where the breakpoint's address is stored
+ *
+ * @return 1 if comparator i holds a breakpoint
+ */
+uint8_t bp_get(uint8_t i, uint32_t* addr);
+
+#endif
@@ -0,0 +1,37 @@
+/**
+ * @file console.h
+ * @author Min Kang
+ * @brief stdio on the console USB CDC port
+ */
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stdint.h>
+
+/**
+ * @brief Bring up USB and make the console port the stdio driver
+ *
+ * Must be called after stdio_init_all().
+ */
+void console_init();
+
+/**
+ * @brief Get a received byte without waiting
+ *
+ * @return Byte received, or -1 if there is none
+ */
+int console_getc();
+
+/**
+ * @brief Number of received bytes waiting to be read
+ *
+ * @return Bytes waiting
+ */
+uint32_t console_available();
+
+/**
+ * @brief Send whatever output is buffered
+ */
+void console_flush();
+
+#endif
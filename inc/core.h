@@ -0,0 +1,171 @@
+/**
+ * @file core.h
+ * @author Min Kang
+ * @brief Core debug headers: DHCSR polling and core register transfers
+ */
+#ifndef CORE_H
+#define CORE_H
+
+#include <stdint.h>
+
+/**
+ * @brief How long a kind of DHCSR poll has taken
+ */
+typedef struct {
+    uint32_t count;
+    uint32_t last_us;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t timeouts;
+} core_latency_t;
+
+/**
+ * @brief Register reads answered from the cache, and ones that went to the
+ * TARGET
+ */
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+} core_reg_cache_stats_t;
+
+/**
+ * @brief Latency of every kind of status poll
+ */
+typedef struct {
+    core_latency_t regrdy;
+    core_latency_t halt;
+    core_latency_t step;
+    core_latency_t reset;
+} core_latency_stats_t;
+
+/**
+ * @brief Poll DHCSR until the bits in mask match value
+ *
+ * @param mask Bits to check
+ * @param value What those bits should be
+ * @param timeout_us How long to poll for
+ * @param dhcsr Where the last DHCSR value read is stored, may be NULL
+ *
+ * @return ACK of request, or SWD_ERR_TIMEOUT
+ */
+uint8_t core_poll_dhcsr(uint32_t mask, uint32_t value, uint32_t timeout_us, uint32_t* dhcsr);
+
+/**
+ * @brief Read a core register through DCRSR and DCRDR
+ *
+ * Waits for DHCSR.S_REGRDY before reading DCRDR.
+ *
+ * @param regsel DCRSR.REGSEL of the register
+ * @param value Where the register value is stored
+ *
+ * @return ACK of request, or SWD_ERR_TIMEOUT
+ */
+uint8_t core_reg_read(uint8_t regsel, uint32_t* value);
+
+/**
+ * @brief Write a core register through DCRDR and DCRSR
+ *
+ * Waits for DHCSR.S_REGRDY before returning.
+ *
+ * @param regsel DCRSR.REGSEL of the register
+ * @param value Value to write
+ *
+ * @return ACK of request, or SWD_ERR_TIMEOUT
+ */
+uint8_t core_reg_write(uint8_t regsel, uint32_t value);
+
+/**
+ * @brief Halt the core and wait for DHCSR.S_HALT
+ *
+ * @return ACK of request, or SWD_ERR_TIMEOUT
+ */
+uint8_t core_halt();
+
+/**
+ * @brief Let the core run
+ *
+ * Breakpoints and watchpoints that changed while halted are written to
+ * the FPB and DWT first.
+ *
+ * @return ACK of request
+ */
+uint8_t core_continue();
+
+/**
+ * @brief Step one instruction and wait for DHCSR.S_HALT
+ *
+ * @return ACK of request, or SWD_ERR_TIMEOUT
+ */
+uint8_t core_step();
+
+/**
+ * @brief Step one instruction and read the new PC, in one batch
+ *
+ * The step, the PC transfer and the DHCSR read that shows both finished
+ * go out back to back. A step takes a few core clocks, far less than one
+ * SWD transaction, so S_HALT and S_REGRDY are checked after the fact and
+ * the slow path is only taken when one of them is clear.
+ *
+ * @param pc Where the new PC is stored
+ *
+ * @return ACK of request, or SWD_ERR_TIMEOUT
+ */
+uint8_t core_step_pc(uint32_t* pc);
+
+/**
+ * @brief Reset the system and wait for the core to halt on the reset vector
+ *
+ * Sets DEMCR.VC_CORERESET, requests a reset through AIRCR, then waits for
+ * DHCSR.S_RESET_ST and DHCSR.S_HALT. DEMCR goes back to what it was
+ * afterwards, so TRCENA survives and a reset the TARGET asks for itself
+ * doesn't stop it.
+ *
+ * @return ACK of request, or SWD_ERR_TIMEOUT
+ */
+uint8_t core_reset_halt();
+
+/**
+ * @brief Get the observed polling latencies
+ *
+ * @return Pointer to the latencies
+ */
+const core_latency_stats_t* core_get_latency();
+
+/**
+ * @brief Zero the observed polling latencies
+ */
+void core_reset_latency();
+
+/**
+ * @brief Read a set of core registers into the cache in pipelined batches
+ *
+ * Registers already cached are skipped. The core must be halted.
+ *
+ * @param regsels DCRSR.REGSEL of each register
+ * @param n Number of registers
+ *
+ * @return ACK of request, SWD_ACK_FAULT if the core isn't halted
+ */
+uint8_t core_reg_snapshot(const uint8_t* regsels, uint32_t n);
+
+/**
+ * @brief Forget every cached register
+ *
+ * For anything that may have changed the core behind core.c's back, like
+ * raw transfers from a host tool.
+ */
+void core_reg_cache_invalidate();
+
+/**
+ * @brief Get the register cache counters
+ *
+ * @return Pointer to the counters
+ */
+const core_reg_cache_stats_t* core_reg_cache_get_stats();
+
+/**
+ * @brief Zero the register cache counters
+ */
+void core_reg_cache_reset_stats();
+
+#endif
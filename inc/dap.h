@@ -0,0 +1,62 @@
+/**
+ * @file dap.h
+ * @author Min Kang
+ * @brief CMSIS-DAP command processor headers
+ *
+ * Takes a CMSIS-DAP request packet and builds the response packet. It
+ * doesn't know or care which transport the packets came in on.
+ */
+#ifndef DAP_H
+#define DAP_H
+
+#include <stdint.h>
+
+// Largest packet in either direction, what a full speed HID report holds
+#define DAP_PACKET_SIZE 64
+
+// Command IDs
+#define ID_DAP_Info              0x00
+#define ID_DAP_HostStatus        0x01
+#define ID_DAP_Connect           0x02
+#define ID_DAP_Disconnect        0x03
+#define ID_DAP_TransferConfigure 0x04
+#define ID_DAP_Transfer          0x05
+#define ID_DAP_TransferBlock     0x06
+#define ID_DAP_TransferAbort     0x07
+#define ID_DAP_WriteABORT        0x08
+#define ID_DAP_Delay             0x09
+#define ID_DAP_ResetTarget       0x0A
+#define ID_DAP_SWJ_Pins          0x10
+#define ID_DAP_SWJ_Clock         0x11
+#define ID_DAP_SWJ_Sequence      0x12
+#define ID_DAP_SWD_Configure     0x13
+#define ID_DAP_Invalid           0xFF
+
+#define DAP_OK    0x00
+#define DAP_ERROR 0xFF
+
+// DAP_Transfer request bits
+#define DAP_TRANSFER_APnDP     (1 << 0)
+#define DAP_TRANSFER_RnW       (1 << 1)
+#define DAP_TRANSFER_A2        (1 << 2)
+#define DAP_TRANSFER_A3        (1 << 3)
+#define DAP_TRANSFER_MATCH_VALUE (1 << 4)
+#define DAP_TRANSFER_MATCH_MASK  (1 << 5)
+#define DAP_TRANSFER_TIMESTAMP   (1 << 7)
+
+// DAP_Transfer response bits, on top of the ACK
+#define DAP_TRANSFER_ERROR    (1 << 3)
+#define DAP_TRANSFER_MISMATCH (1 << 4)
+
+/**
+ * @brief Run one CMSIS-DAP command
+ *
+ * @param req Request packet, starting with the command ID
+ * @param req_len Length of the request packet
+ * @param resp Where the response is built, DAP_PACKET_SIZE bytes
+ *
+ * @return Length of the response
+ */
+uint32_t dap_process(const uint8_t* req, uint32_t req_len, uint8_t* resp);
+
+#endif
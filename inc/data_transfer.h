@@ -9,7 +9,107 @@
 #include <stdint.h>
 #include "swd_request.h"
 
+/**
+ * @brief Backends that can clock SWD
+ */
+typedef enum {
+    SWD_BACKEND_BITBANG, // GPIO toggled by the CPU
+    SWD_BACKEND_PIO,     // Whole phases shifted by a PIO state machine
+} swd_backend_t;
+
+/**
+ * @brief Transfer errors seen since the counters were last reset
+ */
+typedef struct {
+    uint32_t parity; // Read data that didn't match its parity bit
+    uint32_t wait;   // WAIT ACKs, including the ones retried away
+    uint32_t fault;  // FAULT ACKs
+    uint32_t no_ack; // Anything that wasn't OK, WAIT or FAULT
+} swd_error_stats_t;
+
 // ------------------------- MAIN INTERFACE ------------------------- //
+/**
+ * @brief Run a single SWD transaction
+ *
+ * Writes that wouldn't change SELECT, CSW or TAR are dropped without
+ * touching the wire, see swd_cache.h.
+ *
+ * WAIT is retried with a bounded backoff, and the AP transaction is
+ * aborted if it never completes. FAULT clears the sticky errors so the
+ * next transaction can go through. A missing ACK resyncs the line and
+ * tries once more.
+ *
+ * Read data is checked against its parity bit. DP reads have no side
+ * effects, so a bad one is read again. An AP read has already started the
+ * next access, so SWD_ERR_PARITY is returned and the caller decides.
+ *
+ * Once the SWD engine is running, calls from core0 are run on core1.
+ *
+ * @param req Request built with SWD_REQ()
+ * @param data Data to write, or where read data is stored
+ *
+ * @return ACK of request
+ */
+uint8_t swd_transfer(uint8_t req, uint32_t* data);
+
+/**
+ * @brief Clear sticky errors through DP ABORT
+ *
+ * Clears STICKYERR, STICKYCMP, STICKYORUN and WDATAERR, and forgets the
+ * shadowed SELECT, CSW and TAR.
+ *
+ * @return ACK of the ABORT write
+ */
+uint8_t swd_clear_errors();
+
+/**
+ * @brief Count a transfer that didn't ACK OK
+ *
+ * swd_transfer() counts its own, this is for transactions that bypass it.
+ *
+ * @param ack ACK of the transfer, or SWD_ERR_PARITY
+ */
+void swd_count_error(uint8_t ack);
+
+/**
+ * @brief Get the transfer error counters
+ *
+ * @return Pointer to the counters
+ */
+const swd_error_stats_t* swd_get_error_stats();
+
+/**
+ * @brief Zero the transfer error counters
+ */
+void swd_reset_error_stats();
+
+/**
+ * @brief Line reset and IDCODE read to get back in step with the TARGET
+ *
+ * @return ACK of the IDCODE read
+ */
+uint8_t swd_resync();
+
+/**
+ * @brief Turn CTRL/STAT.ORUNDETECT on or off
+ *
+ * With overrun detection on, every transaction has the same shape whatever
+ * the ACK, so transactions can be queued without waiting for each ACK. An
+ * error sets STICKYORUN and the rest of the queue is ignored by the TARGET.
+ *
+ * @param enable 1 to turn overrun detection on
+ *
+ * @return ACK of request
+ */
+uint8_t swd_set_overrun_detect(uint8_t enable);
+
+/**
+ * @brief Whether CTRL/STAT.ORUNDETECT is on
+ *
+ * @return 1 if overrun detection is on
+ */
+uint8_t swd_get_overrun_detect();
+
 /**
  * @brief Read request to DP
  *
@@ -50,6 +150,45 @@ uint8_t SWD_AP_read(uint8_t A, uint32_t* data);
  */
 uint8_t SWD_AP_write(uint8_t A, uint32_t data);
 
+// ------------------------- BACKEND ------------------------- //
+
+/**
+ * @brief Select which backend clocks SWCLK and SWDIO
+ *
+ * Hands the pins over to PIO or back to plain GPIO. SWD should be
+ * reinitialized after switching.
+ *
+ * @param backend SWD_BACKEND_PIO or SWD_BACKEND_BITBANG
+ */
+void swd_select_backend(swd_backend_t backend);
+
+/**
+ * @brief Get the backend currently clocking SWD
+ *
+ * @return Current backend
+ */
+swd_backend_t swd_get_backend();
+
+/**
+ * @brief Set the SWCLK frequency of the current backend
+ *
+ * The request is kept and reapplied when the backend changes. Requests
+ * outside SWD_MIN_FREQ_HZ to SWD_MAX_FREQ_HZ are clamped, and anything above
+ * what the backend can do runs at its fastest.
+ *
+ * @param freq_hz Requested SWCLK frequency in Hz
+ *
+ * @return Frequency actually achieved in Hz
+ */
+uint32_t swd_set_clock(uint32_t freq_hz);
+
+/**
+ * @brief Get the SWCLK frequency the current backend is running at
+ *
+ * @return Achieved frequency in Hz
+ */
+uint32_t swd_get_clock();
+
 // ------------------------- HELPERS ------------------------- //
 
 /**
@@ -58,19 +197,23 @@ uint8_t SWD_AP_write(uint8_t A, uint32_t data);
 void single_pulse();
 
 /**
- * @prief Pulse the clock a certain number of times
+ * @prief Pulse the clock a certain number of times with SWDIO released
  * 
  * Useful for resetting DP
  */
 void pulse_clock(uint32_t num_pulses);
 
 /**
- * @brief Sends data while pulsing clock
- * 
- * @param data Data to be sent
- * @param len Length of data in bits
+ * @brief Release SWDIO and pulse the clock once
+ *
+ * Gives the TARGET a cycle to take control of SWDIO, or to give it back.
  */
-void send_data(uint16_t data, uint8_t len);
+void turnaround();
+
+/**
+ * @brief Take back control of SWDIO and idle it high
+ */
+void take_swdio();
 
 /**
  * @brief Sends data lsb first
@@ -78,7 +221,7 @@ void send_data(uint16_t data, uint8_t len);
  * SWD protocol uses little endian, so this is used frequently.
  *
  * @param data Data to be sent
- * @param len Length of data in bits
+ * @param len Length of data in bits, max 32
  */
 void send_data_lsb(uint32_t data, uint8_t len);
 
@@ -89,32 +232,4 @@ void send_data_lsb(uint32_t data, uint8_t len);
  */
 uint32_t read_data(uint8_t len);
 
-/**
- * @brief Creates an swd packet
- *
- * Automatically calculates parity
- * 
- * @param APnDP 1 bit, selects AP or DP. 0 for DP, 1 for AP.
- * @param RnW 1 bit, selects a read or write request. 0 for write, 1 for read.
- * @param A 2 bit register selector (for most types of requests).
- */
-swd_req_t create_swd_packet(uint8_t APnDP, uint8_t RnW, uint8_t A);
-
-/**
- * @brief Converts an swd_req_t into a binary format
- *
- * @param swd_req_t An SWD request struct
- * @return The request packet in binary 
- */
-uint8_t conv_swd_packet_to_bin(swd_req_t packet);
-
-/**
- * @brief Creates an SWD packet and sends it over SWDIO
- * 
- * @param APnDP 1 bit, selects AP or DP. 0 for DP, 1 for AP.
- * @param RnW 1 bit, selects a read or write request. 0 for write, 1 for read.
- * @param A 2 bit register selector (for most types of requests).
- */
-void send_swd_packet(uint8_t APnDP, uint8_t RnW, uint8_t A);
-
 #endif
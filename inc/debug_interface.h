@@ -13,8 +13,17 @@
  */
 uint8_t show_help();
 
-// TODO: Add Documentation
-uint8_t debug_initialize_swd();
+/**
+ * @brief Attach to the TARGET over SWD
+ *
+ * Usage: init [auto]
+ *
+ * With auto, the fastest working SWCLK frequency is searched for first and
+ * the link is left running with a safety margin below it.
+ *
+ * @return ACK from SWD request
+ */
+uint8_t debug_initialize_swd(char** args, uint8_t num_args);
 
 /**
  * @brief Show debug status
@@ -54,31 +63,30 @@ uint8_t reset_core();
 uint8_t read_pc();
 
 /**
- * @brief Performs a single step of instruction
+ * @brief Step instructions on the probe, recording every PC
  *
- * @return ACK from SWD request
- */
-uint8_t single_step();
-
-/**
- * @brief Verify written file integrity
+ * Usage: step [count]
+ *        step until <address>
+ *        step while <start> <end>
+ *        step trace
  *
- * @param bin_arr Hex dump array of program
- * @param bin_len Length of array
+ * A plain step steps once and prints the PC. Anything longer runs as a
+ * background job that records the PCs and prints them when it stops.
+ * while keeps stepping as long as the PC is in [start, end). trace prints
+ * the PCs from the last job again, including one that was cancelled.
  *
- * @return ACK from SWD request
+ * @return ACK from SWD request, or 1 for bad arguments
  */
-uint8_t verify_file(unsigned char* bin_arr, unsigned int bin_len);
+uint8_t single_step(char** args, uint8_t num_args);
 
 /**
- * @brief Write file to RAM, set PC, and reset TARGET
+ * @brief Report the core halting on its own, run from the main loop
  *
- * @param bin_arr Hex dump array of program
- * @param bin_len Length of array
+ * Only watches the core after continue, so an idle link sees no traffic.
  *
  * @return ACK from SWD request
  */
-uint8_t load_file(unsigned char* bin_arr, unsigned int bin_len);
+uint8_t poll_halt();
 
 /**
  * @brief Set PC, stack pointer, and VTable
@@ -90,10 +98,116 @@ uint8_t load_file(unsigned char* bin_arr, unsigned int bin_len);
  */
 uint8_t init_file_execution(uint32_t pc, uint32_t msp);
 
+/**
+ * @brief Load a precompiled program, verify it and get it ready to run
+ *
+ * Usage: load [blink|simple]
+ *
+ * Runs as a background job, see jobs for progress and Ctrl-C to cancel.
+ *
+ * @return 0 if the job started
+ */
 uint8_t load_file_and_run(char** args, uint8_t num_args);
 
-uint8_t set_mem(uint32_t address, uint32_t value);
+uint8_t set_mem(uint32_t address, uint32_t value, uint8_t size);
 uint8_t interface_set_mem(char** args, uint8_t num_args);
-uint8_t read_mem(uint32_t address, uint32_t* data);
+uint8_t read_mem(uint32_t address, uint32_t* data, uint8_t size);
 uint8_t interface_read_mem(char** args, uint8_t num_args);
+int32_t str_to_int(char* str);
+
+/**
+ * @brief Show or switch the SWD backend
+ *
+ * Usage: backend [pio|bitbang]
+ *
+ * @return 0 for success, 1 for bad arguments
+ */
+uint8_t interface_select_backend(char** args, uint8_t num_args);
+
+/**
+ * @brief Time back to back IDCODE reads on the current backend
+ *
+ * Usage: bench [count]
+ *
+ * @return ACK of the last SWD request
+ */
+uint8_t interface_bench(char** args, uint8_t num_args);
+
+/**
+ * @brief Show or set the SWCLK frequency
+ *
+ * Usage: clock [hz]
+ *
+ * @return 0 for success, 1 for bad arguments
+ */
+uint8_t interface_set_clock(char** args, uint8_t num_args);
+
+/**
+ * @brief Show or reset SWD traffic counters
+ *
+ * Usage: stats [reset]
+ *
+ * @return 0 for success
+ */
+uint8_t interface_stats(char** args, uint8_t num_args);
+
+/**
+ * @brief Show or switch SWD overrun detection
+ *
+ * Usage: overrun [on|off]
+ *
+ * @return ACK of SWD request
+ */
+uint8_t interface_overrun(char** args, uint8_t num_args);
+/**
+ * @brief Set a hardware breakpoint
+ *
+ * Usage: break <address>
+ *
+ * The FPB is only written when the core next runs.
+ *
+ * @return ACK from SWD request, or 1 for bad arguments
+ */
+uint8_t interface_break(char** args, uint8_t num_args);
+
+/**
+ * @brief Remove one hardware breakpoint, or all of them
+ *
+ * Usage: delete [address]
+ *
+ * @return ACK from SWD request, or 1 for bad arguments
+ */
+uint8_t interface_delete(char** args, uint8_t num_args);
+
+/**
+ * @brief Set a data watchpoint
+ *
+ * Usage: watch <address> [len] [r|w|rw] [value]
+ *
+ * Watches len bytes, 4 by default, for writes by default. With a value,
+ * only accesses of that value trigger it, which needs len of 1, 2 or 4.
+ * The DWT is only written when the core next runs.
+ *
+ * @return ACK from SWD request, or 1 for bad arguments
+ */
+uint8_t interface_watch(char** args, uint8_t num_args);
+
+/**
+ * @brief Remove one data watchpoint, or all of them
+ *
+ * Usage: unwatch [address]
+ *
+ * @return ACK from SWD request, or 1 for bad arguments
+ */
+uint8_t interface_unwatch(char** args, uint8_t num_args);
+
+/**
+ * @brief Show information about the TARGET
+ *
+ * Usage: info reg|break|watch
+ *
+ * @return 0 for success, 1 for bad arguments
+ */
+uint8_t interface_info(char** args, uint8_t num_args);
+
 #endif
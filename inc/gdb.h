@@ -0,0 +1,66 @@
+/**
+ * @file gdb.h
+ * @author Min Kang
+ * @brief GDB remote serial protocol stub headers
+ */
+#ifndef GDB_H
+#define GDB_H
+
+#include <stdint.h>
+
+// Largest packet GDB may send, reported through qSupported
+#define GDB_PACKET_SIZE 8192
+// How often a running core is checked for a halt
+#define GDB_POLL_INTERVAL_US 1000
+
+/**
+ * @brief Start a GDB session on a port
+ *
+ * Halts the core and sets up the FPB. The session is open even if that
+ * fails, GDB then sees errors for whatever it asks.
+ *
+ * @param p One of the USB_CDC_* ports
+ *
+ * @return ACK of halting the core
+ */
+uint8_t gdb_attach(uint8_t p);
+
+/**
+ * @brief Whether a GDB session is open
+ *
+ * @return 1 until GDB detaches or kills the session
+ */
+uint8_t gdb_active();
+
+/**
+ * @brief Feed one byte from GDB to the packet parser
+ *
+ * A complete packet is answered before this returns, except a continue,
+ * whose answer comes from gdb_poll() once the core halts.
+ *
+ * @param c Byte received on the session's port
+ */
+void gdb_feed(uint8_t c);
+
+/**
+ * @brief Check whether a running core has halted, and tell GDB if so
+ *
+ * Only reads DHCSR every GDB_POLL_INTERVAL_US, so it can be called as
+ * often as convenient.
+ *
+ * @return 0
+ */
+uint8_t gdb_poll();
+
+/**
+ * @brief Serve GDB on the console until it detaches or kills the session
+ *
+ * Halts the core and speaks RSP on the console. Connect with
+ * `target remote /dev/ttyACM0` after running the gdb command. GDB can
+ * also just connect to the host port, without this command.
+ *
+ * @return 0
+ */
+uint8_t gdb_server_run();
+
+#endif
@@ -0,0 +1,22 @@
+/**
+ * @file host_port.h
+ * @author Min Kang
+ * @brief Host CDC port headers
+ */
+#ifndef HOST_PORT_H
+#define HOST_PORT_H
+
+#include <stdint.h>
+
+/**
+ * @brief Serve whatever has arrived on the host port, run from the main loop
+ *
+ * Frames starting with PROTO_SOF go to the binary protocol, and a '$'
+ * between frames starts a GDB session, which then has the port until GDB
+ * detaches.
+ *
+ * @return 0
+ */
+uint8_t host_port_task();
+
+#endif
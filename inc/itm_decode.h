@@ -0,0 +1,69 @@
+/**
+ * @file itm_decode.h
+ * @author Min Kang
+ * @brief ITM and DWT trace packet decoder headers
+ *
+ * Plain C with no hardware dependencies, so it builds anywhere and can be
+ * fed recorded SWO captures as well as live ones.
+ */
+#ifndef ITM_DECODE_H
+#define ITM_DECODE_H
+
+#include <stdint.h>
+
+typedef enum {
+    ITM_PKT_SYNC,
+    ITM_PKT_OVERFLOW,
+    ITM_PKT_TIMESTAMP,     // Local timestamp, value is the delta
+    ITM_PKT_GLOBAL_TS,     // Global timestamp, value holds its low bits
+    ITM_PKT_EXTENSION,
+    ITM_PKT_STIMULUS,      // Software write to ITM_STIMn, port is n
+    ITM_PKT_EVENT_COUNTER, // DWT counter wrap bits
+    ITM_PKT_EXCEPTION,     // Exception number and entry, exit or return
+    ITM_PKT_PC_SAMPLE,     // Periodic PC, size is 1 while the core sleeps
+    ITM_PKT_DATA_TRACE,    // DWT comparator match, port is the hardware ID
+    ITM_PKT_HARDWARE,      // Any other hardware source, port is the ID
+    ITM_PKT_TYPES,
+} itm_packet_type_t;
+
+typedef struct {
+    itm_packet_type_t type;
+    uint8_t port;   // Stimulus port or hardware source ID
+    uint8_t size;   // Payload bytes
+    uint32_t value; // Payload, little endian
+} itm_packet_t;
+
+typedef enum {
+    ITM_STATE_HEADER,
+    ITM_STATE_PAYLOAD,
+    ITM_STATE_CONTINUATION,
+    ITM_STATE_SYNC,
+} itm_state_t;
+
+typedef struct {
+    itm_state_t state;
+    itm_packet_t packet; // Packet being put together
+    uint8_t remaining;   // Payload bytes still to come
+    uint8_t shift;       // Bits of value filled in so far
+    uint8_t zeros;       // Zero bytes in a row, while looking for a sync
+} itm_decoder_t;
+
+/**
+ * @brief Start decoding from scratch
+ *
+ * @param d Decoder state
+ */
+void itm_decoder_init(itm_decoder_t* d);
+
+/**
+ * @brief Feed one byte of trace to the decoder
+ *
+ * @param d Decoder state
+ * @param byte Next byte of trace
+ * @param out Where a finished packet is stored
+ *
+ * @return 1 if the byte finished a packet
+ */
+uint8_t itm_decode_byte(itm_decoder_t* d, uint8_t byte, itm_packet_t* out);
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ * @file jobs.h
+ * @author Min Kang
+ * @brief Cooperative scheduler for long running operations
+ */
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdint.h>
+
+// Jobs that can run at the same time
+#define JOBS_MAX 4
+// How often a running job reports how far it got
+#define JOB_PROGRESS_INTERVAL_US 1000000
+
+typedef enum {
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_FAILED,
+} job_status_t;
+
+typedef struct job job_t;
+
+/**
+ * @brief A long operation cut into small steps
+ *
+ * Each call to step does a small piece of the work and returns, so the
+ * console keeps answering commands while the job runs. The job keeps its
+ * own progress in state, done and total.
+ */
+struct job {
+    const char* name;
+    job_status_t (*step)(job_t* job);
+    uint32_t state;  // Free for the job's own state machine
+    uint32_t done;   // Progress so far, in whatever units the job likes
+    uint32_t total;  // Progress when finished, 0 if unknown
+    uint64_t start_us;
+    uint64_t report_us;
+    uint8_t active;
+};
+
+/**
+ * @brief Start running a job in the background
+ *
+ * The job's state, done and total are left as the caller set them.
+ *
+ * @param job Job to start, must stay valid until it finishes
+ *
+ * @return 1 if started, 0 if it is already running or there is no room
+ */
+uint8_t job_start(job_t* job);
+
+/**
+ * @brief Run one step of every job, run from the main loop
+ *
+ * @return Number of jobs still running
+ */
+uint8_t job_run();
+
+/**
+ * @brief Stop every running job where it is
+ *
+ * @return Number of jobs cancelled
+ */
+uint8_t job_cancel_all();
+
+/**
+ * @brief Print a message from a job without mangling the line being typed
+ *
+ * @param job Job the message is from
+ * @param fmt printf() format
+ */
+void job_printf(job_t* job, const char* fmt, ...);
+
+/**
+ * @brief List the running jobs and how far they got
+ *
+ * @return 0
+ */
+uint8_t show_jobs();
+
+#endif
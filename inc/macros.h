@@ -12,14 +12,158 @@
 #define CORE_VTOR 0xe000ed08
 #define NVIC_AIRCR 0xe000ed0c
 
+// Flash Patch and Breakpoint unit
+#define FP_CTRL  0xe0002000
+#define FP_COMP0 0xe0002008
+#define FP_CTRL_KEY    (1 << 1)
+#define FP_CTRL_ENABLE (1 << 0)
 
+// Data Watchpoint and Trace unit, comparator n is 16 bytes past the last
+#define DWT_CTRL      0xe0001000
+#define DWT_COMP0     0xe0001020
+#define DWT_MASK0     0xe0001024
+#define DWT_FUNCTION0 0xe0001028
+#define DWT_DEVARCH   0xe0001fbc
+// Samples the PC of a running core, all ones while halted
+#define DWT_PCSR      0xe000101c
+// DWT_DEVARCH of an ARMv8-M DWT
+#define DWT_DEVARCH_V8M 0x47701a02
+#define DWT_FUNCTION_MATCHED (1 << 24)
+#define DWT_CTRL_CYCCNTENA  (1 << 0)
+#define DWT_CTRL_POSTPRESET (0xF << 1)
+#define DWT_CTRL_CYCTAP     (1 << 9)
+#define DWT_CTRL_PCSAMPLENA (1 << 12)
 
-#define CLOCK_DELAY 100
+// Instrumentation Trace Macrocell
+#define ITM_TER0 0xe0000e00
+#define ITM_TPR  0xe0000e40
+#define ITM_TCR  0xe0000e80
+#define ITM_LAR  0xe0000fb0
+#define ITM_LAR_KEY 0xc5acce55
+#define ITM_TCR_ITMENA  (1 << 0)
+#define ITM_TCR_SYNCENA (1 << 2)
+#define ITM_TCR_TXENA   (1 << 3)
+#define ITM_TCR_TRACEBUSID(id) ((id) << 16)
+
+// Trace Port Interface Unit
+#define TPIU_CSPSR 0xe0040004
+#define TPIU_ACPR  0xe0040010
+#define TPIU_SPPR  0xe00400f0
+#define TPIU_FFCR  0xe0040304
+#define TPIU_SPPR_NRZ 2
+// Formatter off, ITM and DWT packets go out as they are
+#define TPIU_FFCR_TRIGIN (1 << 8)
+
+// Debug Fault Status Register, says why the core halted
+#define CORE_DFSR 0xe000ed30
+#define DFSR_HALTED  (1 << 0)
+#define DFSR_BKPT    (1 << 1)
+#define DFSR_DWTTRAP (1 << 2)
+
+// TARGET memory layout, reported to GDB as its memory map
+#define TARGET_FLASH_BASE  0x00000000
+#define TARGET_FLASH_SIZE  0x00100000
+#define TARGET_FLASH_BLOCK 0x1000
+#define TARGET_RAM_BASE    0x20000000
+#define TARGET_RAM_SIZE    0x00040000
+
+// DHCSR bits
+#define DHCSR_DBGKEY    0xa05f0000
+#define DHCSR_C_DEBUGEN (1 << 0)
+#define DHCSR_C_HALT    (1 << 1)
+#define DHCSR_C_STEP    (1 << 2)
+#define DHCSR_C_MASKINTS (1 << 3)
+#define DHCSR_S_REGRDY  (1 << 16)
+#define DHCSR_S_HALT    (1 << 17)
+#define DHCSR_S_SLEEP   (1 << 18)
+#define DHCSR_S_LOCKUP  (1 << 19)
+#define DHCSR_S_RESET_ST (1 << 25)
+
+#define DCRSR_REGWnR (1 << 16)
+// DCRSR.REGSEL values past r0-r15
+#define CORE_REGSEL_PC      0x0f
+#define CORE_REGSEL_XPSR    0x10
+#define CORE_REGSEL_MSP     0x11
+#define CORE_REGSEL_PSP     0x12
+// CONTROL, FAULTMASK, BASEPRI and PRIMASK, one byte each from the top
+#define CORE_REGSEL_CONTROL 0x14
+#define CORE_REGSEL_FPSCR   0x21
+#define CORE_REGSEL_S0      0x40
+#define CORE_REGSEL_COUNT   0x60
+// Reads as 0 on a core without an FPU
+#define CORE_MVFR0 0xe000ef40
+#define DEMCR_VC_CORERESET (1 << 0)
+// Powers the DWT and ITM
+#define DEMCR_TRCENA (1 << 24)
+#define AIRCR_SYSRESETREQ 0x05fa0004
+
+// How long to poll DHCSR before giving up
+#define REGRDY_TIMEOUT_US 1000
+#define HALT_TIMEOUT_US 100000
+#define POWERUP_TIMEOUT_US 100000
+#define RESET_TIMEOUT_US 500000
+// How often the main loop checks whether a running core has halted
+#define HALT_POLL_INTERVAL_US 20000
+
+
+
+#define SWD_DEFAULT_FREQ_HZ 4000000
+#define SWD_MIN_FREQ_HZ 1000
+#define SWD_MAX_FREQ_HZ 50000000
+
+// Clock negotiation at attach, see negotiate_swd_clock()
+#define SWD_NEGOTIATE_START_HZ 100000
+#define SWD_NEGOTIATE_ROUNDS 8
+#define SWD_NEGOTIATE_MARGIN_PCT 75
+#define SWD_NEGOTIATE_RAM_ADDR 0x20000000
+
+// WAIT is retried with a doubling delay, capped at SWD_WAIT_BACKOFF_MAX_US
+#define SWD_WAIT_RETRIES 16
+#define SWD_WAIT_BACKOFF_MAX_US 64
+// DP reads with bad parity are simply read again, up to this many times
+#define SWD_PARITY_RETRIES 3
+
+// MEM-AP CSW fields
+#define CSW_SIZE_MASK      0x00000007
+#define CSW_SIZE_BYTE      0x00000000
+#define CSW_SIZE_HALF      0x00000001
+#define CSW_SIZE_WORD      0x00000002
+#define CSW_ADDRINC_MASK   0x00000030
+#define CSW_ADDRINC_SINGLE 0x00000010
+#define CSW_ADDRINC_PACKED 0x00000020
+// Privileged master access over AHB, the rest of CSW is built on this
+#define CSW_BASE           0x22000000
+
+// MEM-AP CSW: privileged master access, 32-bit, with and without TAR auto
+// increment. Single accesses leave TAR alone so polling one register never
+// has to rewrite it.
+#define CSW_WORD_INC (CSW_BASE | CSW_ADDRINC_SINGLE | CSW_SIZE_WORD)
+#define CSW_WORD     (CSW_BASE | CSW_SIZE_WORD)
+
+// TAR auto increment is only guaranteed within a 1 KB block
+#define TAR_AUTOINC_BLOCK 0x400
+// DRW accesses per batch by the block transfers in mem.c
+#define MEM_BLOCK_BATCH 64
+
+#define LOAD_ADDR 0x20000000
+// Cancels background jobs at the console
+#define CTRL_C 0x03
+// Bytes the load job writes or verifies per step, one block batch
+#define LOAD_CHUNK (MEM_BLOCK_BATCH * 4)
+// Longest the console and host port can hold off bulk work
+#define BULK_MAX_DEFER_US 10000
+// Steps the step job takes per pass of the main loop
+#define STEP_BATCH 32
+// PCs the step job remembers, a power of two
+#define STEP_TRACE_LEN 1024
+#define SWD_DEFAULT_BACKEND SWD_BACKEND_PIO
 #define DELAY_MS 3
 #define SMALL_DELAY_MS 10
 
 #define SWDIO 19
 #define SWCLK 20
+// TARGET's SWO, received by PIO
+#define SWO_PIN 21
 
 #define BUTTON_PIN 26
 
@@ -27,6 +171,8 @@
 #define CHECK_ACK(error_message) do { \
     if (ack != 1) { \
         if (ack == 0b010) { error("WAIT received"); } \
+        if (ack == 0b1000) { error("Timed out waiting for TARGET"); } \
+        if (ack == 0b10000) { error("Parity error in read data"); } \
         error_ack(error_message, ack); \
     } \
 } while (0)
@@ -34,6 +180,8 @@
 #define CHECK_ACK_GT(error_message) do { \
     if (ack != 1) { \
         if (ack == 0b010) { error("WAIT received"); } \
+        if (ack == 0b1000) { error("Timed out waiting for TARGET"); } \
+        if (ack == 0b10000) { error("Parity error in read data"); } \
         error_ack(error_message, ack); \
         goto LOOP; \
     } \
@@ -42,6 +190,8 @@
 #define CHECK_ACK_RT(error_message) do { \
     if (ack != 1) { \
         if (ack == 0b010) { error("WAIT received"); } \
+        if (ack == 0b1000) { error("Timed out waiting for TARGET"); } \
+        if (ack == 0b10000) { error("Parity error in read data"); } \
         error_ack(error_message, ack); \
         return ack; \
     } \
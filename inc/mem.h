@@ -7,6 +7,15 @@
 #define MEM_H
 #include <stdint.h>
 
+/**
+ * @brief What the MEM-AP supports beyond 32-bit single accesses
+ */
+typedef struct {
+    uint8_t probed;   // Set once mem_probe_caps() has run
+    uint8_t sub_word; // Byte and halfword sizes
+    uint8_t packed;   // Packed transfers
+} mem_caps_t;
+
 /**
  * @brief Read from address of TARGET
  *
@@ -50,4 +59,137 @@ uint8_t mem_write(uint32_t addr, uint32_t data);
  */
 uint8_t mem_write_db(uint32_t addr, uint32_t data, char* reg_name);
 
+/**
+ * @brief Read consecutive words from TARGET
+ *
+ * Streams through DRW with TAR auto increment and posted reads. TAR is only
+ * rewritten when the transfer crosses a 1 KB auto increment boundary.
+ *
+ * @param addr Word aligned address to start reading from
+ * @param buf Where the words are read into
+ * @param n Number of words
+ *
+ * @return ACK of request
+ */
+uint8_t mem_read_block(uint32_t addr, uint32_t* buf, uint32_t n);
+
+/**
+ * @brief Write consecutive words to TARGET
+ *
+ * Streams through DRW with TAR auto increment. TAR is only rewritten when
+ * the transfer crosses a 1 KB auto increment boundary.
+ *
+ * @param addr Word aligned address to start writing to
+ * @param buf Words to write
+ * @param n Number of words
+ *
+ * @return ACK of request
+ */
+uint8_t mem_write_block(uint32_t addr, const uint32_t* buf, uint32_t n);
+
+/**
+ * @brief Find out which access sizes and increment modes the MEM-AP has
+ *
+ * Writes CSW asking for byte size and packed increment and reads it back.
+ * A MEM-AP that lacks either leaves the field at something else.
+ *
+ * @return ACK of request
+ */
+uint8_t mem_probe_caps();
+
+/**
+ * @brief Get what the MEM-AP was found to support
+ *
+ * Until mem_probe_caps() runs, byte and halfword accesses are assumed to
+ * work and packed transfers are not.
+ *
+ * @return Pointer to the capabilities
+ */
+const mem_caps_t* mem_get_caps();
+
+/**
+ * @brief Read a byte, halfword or word from TARGET
+ *
+ * The value is taken off the byte lanes the address selects.
+ *
+ * @param addr Address to read from, aligned to size
+ * @param data Where the value is stored, zero extended
+ * @param size Access size in bytes, 1, 2 or 4
+ *
+ * @return ACK of request
+ */
+uint8_t mem_read_sized(uint32_t addr, uint32_t* data, uint8_t size);
+
+/**
+ * @brief Write a byte, halfword or word to TARGET
+ *
+ * The value is put on the byte lanes the address selects, only those bytes
+ * are written.
+ *
+ * @param addr Address to write to, aligned to size
+ * @param data Value to write
+ * @param size Access size in bytes, 1, 2 or 4
+ *
+ * @return ACK of request
+ */
+uint8_t mem_write_sized(uint32_t addr, uint32_t data, uint8_t size);
+
+/**
+ * @brief Read bytes from TARGET at any alignment
+ *
+ * Unaligned heads and tails use byte and halfword accesses, and never touch
+ * memory outside the range. Whole words in between are streamed.
+ *
+ * @param addr Address to start reading from
+ * @param buf Where the bytes are read into
+ * @param len Number of bytes
+ *
+ * @return ACK of request
+ */
+uint8_t mem_read_bytes(uint32_t addr, uint8_t* buf, uint32_t len);
+
+/**
+ * @brief Write bytes to TARGET at any alignment
+ *
+ * Unaligned heads and tails use byte and halfword accesses, so nothing
+ * outside the range is written. Whole words in between are streamed.
+ *
+ * @param addr Address to start writing to
+ * @param buf Bytes to write
+ * @param len Number of bytes
+ *
+ * @return ACK of request
+ */
+uint8_t mem_write_bytes(uint32_t addr, const uint8_t* buf, uint32_t len);
+
+/**
+ * @brief Read consecutive bytes, halfwords or words, each at its own size
+ *
+ * For registers that care about access size. Packed transfers are used
+ * when the MEM-AP has them, so a word of elements costs one access.
+ *
+ * @param addr Address to start reading from, aligned to size
+ * @param buf Where the elements are read into
+ * @param n Number of elements
+ * @param size Access size in bytes, 1, 2 or 4
+ *
+ * @return ACK of request
+ */
+uint8_t mem_read_sized_block(uint32_t addr, void* buf, uint32_t n, uint8_t size);
+
+/**
+ * @brief Write consecutive bytes, halfwords or words, each at its own size
+ *
+ * For registers that care about access size. Packed transfers are used
+ * when the MEM-AP has them, so a word of elements costs one access.
+ *
+ * @param addr Address to start writing to, aligned to size
+ * @param buf Elements to write
+ * @param n Number of elements
+ * @param size Access size in bytes, 1, 2 or 4
+ *
+ * @return ACK of request
+ */
+uint8_t mem_write_sized_block(uint32_t addr, const void* buf, uint32_t n, uint8_t size);
+
 #endif
@@ -0,0 +1,34 @@
+/**
+ * @file profile.h
+ * @author Min Kang
+ * @brief PC sampling profiler headers
+ */
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+// Histogram entries, the memory budget is 8 bytes each
+#define PROFILE_BUCKETS 512
+// Most samples taken per step of the profile job
+#define PROFILE_BATCH 64
+#define PROFILE_DEFAULT_HZ 10000
+#define PROFILE_DEFAULT_BUCKET 16
+// Hottest buckets printed on the console
+#define PROFILE_TOP 10
+
+/**
+ * @brief Profile the running core by sampling its PC
+ *
+ * Usage: profile <ms> [hz] [bucket]
+ *
+ * Samples DWT_PCSR, or halts the core for each sample where there is no
+ * PCSR, into a histogram of bucket byte ranges. Runs as a background job.
+ * At the end the hottest buckets are printed, and the whole histogram is
+ * sent on the stream port as PROTO_EVT_PROFILE frames, see proto.h.
+ *
+ * @return 0 if the job started, 1 for bad arguments
+ */
+uint8_t profile_run(char** args, uint8_t num_args);
+
+#endif
@@ -0,0 +1,132 @@
+/**
+ * @file proto.h
+ * @author Min Kang
+ * @brief Framed binary host protocol headers
+ *
+ * A lower overhead alternative to the text console for tools driving the
+ * probe. Every frame, in either direction, is:
+ *
+ *   SOF(0xA5) LEN(2) CMD(1) PAYLOAD(LEN) CRC(2)
+ *
+ * Multi-byte fields are little endian. LEN counts the payload only. CRC is
+ * CRC-16/CCITT-FALSE over LEN, CMD and PAYLOAD. A response has the same
+ * CMD with PROTO_RESPONSE set, and its payload starts with a status byte.
+ *
+ * The host CDC port always speaks this protocol, or GDB's. On the console,
+ * sending PROTO_ESCAPE at the start of a line, or running the proto
+ * command, switches to binary mode. PROTO_CMD_EXIT switches back. Bytes
+ * outside a frame, like error text, should be skipped by the host.
+ */
+#ifndef PROTO_H
+#define PROTO_H
+
+#include <stdint.h>
+
+#define PROTO_SOF    0xA5
+#define PROTO_ESCAPE 0x02
+#define PROTO_VERSION 1
+
+// Largest payload in either direction
+#define PROTO_MAX_PAYLOAD 1024
+// Largest number of accesses in one PROTO_CMD_TRANSFER
+#define PROTO_MAX_OPS 128
+// A frame that stalls for this long is dropped
+#define PROTO_BYTE_TIMEOUT_US 100000
+
+/*
+ * Commands, payloads are listed request -> response (after the status)
+ *
+ * PING      any bytes                      -> version(1) same bytes
+ * INIT      [hz(4), 0 negotiates]          -> hz(4)
+ * CLOCK     hz(4)                          -> hz(4)
+ * TRANSFER  { req(1) [data(4) if write] }  -> { ack(1) [data(4) if read] }
+ * READ      { addr(4) len(2) }             -> bytes of every range
+ * WRITE     { addr(4) len(2) bytes(len) }  -> nothing
+ * DAP       CMSIS-DAP request packet       -> CMSIS-DAP response packet
+ * EXIT      nothing                        -> nothing
+ *
+ * Events are frames the probe sends unprompted on the stream port, with
+ * PROTO_EVENT set in CMD and no status byte:
+ *
+ * PROFILE   first(2) total(2) shift(1) samples(4) { bucket(4) count(4) }
+ *           One piece of a profile histogram, entries first to first plus
+ *           however many fit. bucket is the address shifted right by shift.
+ */
+#define PROTO_CMD_PING     0x00
+#define PROTO_CMD_INIT     0x01
+#define PROTO_CMD_CLOCK    0x02
+#define PROTO_CMD_TRANSFER 0x10
+#define PROTO_CMD_READ     0x11
+#define PROTO_CMD_WRITE    0x12
+#define PROTO_CMD_DAP      0x20
+#define PROTO_CMD_EXIT     0x7F
+#define PROTO_RESPONSE     0x80
+#define PROTO_EVENT        0x40
+#define PROTO_EVT_PROFILE  (PROTO_EVENT | 0x00)
+
+// Status bytes
+#define PROTO_OK      0x00
+#define PROTO_ERR_CRC 0x01
+#define PROTO_ERR_CMD 0x02
+#define PROTO_ERR_LEN 0x03
+// OR'd with the ACK of the SWD access that failed
+#define PROTO_ERR_SWD 0x80
+
+/**
+ * @brief CRC-16/CCITT-FALSE
+ *
+ * @param data Bytes to checksum
+ * @param len Number of bytes
+ *
+ * @return CRC of the bytes
+ */
+uint16_t proto_crc16(const uint8_t* data, uint32_t len);
+
+/**
+ * @brief Drop any partly received frame
+ */
+void proto_reset();
+
+/**
+ * @brief Choose the port responses are sent on
+ *
+ * @param port One of the USB_CDC_* ports
+ */
+void proto_set_port(uint8_t port);
+
+/**
+ * @brief Frame and send an event
+ *
+ * @param port One of the USB_CDC_* ports
+ * @param cmd One of the PROTO_EVT_* commands
+ * @param payload Bytes of the event
+ * @param len Number of bytes, at most PROTO_MAX_PAYLOAD
+ */
+void proto_send_event(uint8_t port, uint8_t cmd, const uint8_t* payload, uint16_t len);
+
+/**
+ * @brief Whether the parser is between frames
+ *
+ * @return 1 if no frame is partly received
+ */
+uint8_t proto_idle();
+
+/**
+ * @brief Feed one received byte to the frame parser
+ *
+ * A complete frame is checked, run, and answered before this returns.
+ *
+ * @param byte Byte received from the host
+ *
+ * @return 1 once the host has asked to leave binary mode, 0 otherwise
+ */
+uint8_t proto_feed(uint8_t byte);
+
+/**
+ * @brief Run binary mode on the console until the host sends PROTO_CMD_EXIT
+ *
+ * @return 0
+ */
+uint8_t proto_run();
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * @file rtt.h
+ * @author Min Kang
+ * @brief RTT host side headers
+ */
+#ifndef RTT_H
+#define RTT_H
+
+#include <stdint.h>
+
+// Start of the control block, the rest of its 16 bytes are zeros
+#define RTT_ID "SEGGER RTT"
+#define RTT_ID_LEN 16
+// More rings in each direction than any real TARGET configures, a
+// control block claiming more is garbage
+#define RTT_MAX_RINGS 32
+// Bytes of RAM the find job reads per step, a multiple of 4, see macros.h
+#define RTT_SCAN_CHUNK (MEM_BLOCK_BATCH * 4)
+// Most bytes moved in one read or write of a ring
+#define RTT_CHUNK 256
+// Polling backs off from RTT_POLL_MIN_US to RTT_POLL_MAX_US while idle
+#define RTT_POLL_MIN_US 100
+#define RTT_POLL_MAX_US 20000
+
+typedef struct {
+    uint32_t bytes_up;   // Drained from the TARGET
+    uint32_t bytes_down; // Written to the TARGET
+    uint32_t polls;      // Times the write offsets were read
+    uint32_t idle_polls; // Polls that found nothing new
+} rtt_stats_t;
+
+/**
+ * @brief Poll the up channel and feed the down channel, run from the main loop
+ *
+ * Only does anything once the control block is found, and only when the
+ * poll interval is up.
+ *
+ * @return 0
+ */
+uint8_t rtt_task();
+
+/**
+ * @brief Get the RTT counters
+ *
+ * @return Pointer to the counters
+ */
+const rtt_stats_t* rtt_get_stats();
+
+/**
+ * @brief Log the TARGET's RTT channel to the stream port
+ *
+ * Usage: rtt start [address] [size] [channel]
+ *        rtt stop
+ *        rtt
+ *
+ * start looks for the control block in size bytes from address, the
+ * TARGET's RAM by default, then moves up channel bytes to the stream port
+ * and stream port input to the down channel of the same number. Without
+ * arguments, shows the counters.
+ *
+ * @return 0 for success, 1 for bad arguments
+ */
+uint8_t rtt_run(char** args, uint8_t num_args);
+
+#endif
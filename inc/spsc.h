@@ -0,0 +1,67 @@
+/**
+ * @file spsc.h
+ * @author Min Kang
+ * @brief Lock-free single producer, single consumer queue of pointers
+ *
+ * One side only ever pushes and the other only ever pops, so head and tail
+ * each have a single writer and no lock is needed. Nothing in here is Pico
+ * specific, it only needs the GCC atomic builtins.
+ */
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Slots in a queue, must be a power of two
+#define SPSC_SIZE 8
+
+typedef struct {
+    void* slots[SPSC_SIZE];
+    uint32_t head; // Written only by the producer
+    uint32_t tail; // Written only by the consumer
+} spsc_queue_t;
+
+/**
+ * @brief Empty a queue, only while neither side is using it
+ */
+static inline void spsc_init(spsc_queue_t* q) {
+    q->head = 0;
+    q->tail = 0;
+}
+
+/**
+ * @brief Add an item, producer side only
+ *
+ * The item is published with release ordering, so everything written
+ * before the push is visible to whoever pops it.
+ *
+ * @return 1 if pushed, 0 if the queue is full
+ */
+static inline uint8_t spsc_push(spsc_queue_t* q, void* item) {
+    uint32_t head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    if (head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == SPSC_SIZE) {
+        return 0;
+    }
+    q->slots[head & (SPSC_SIZE - 1)] = item;
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/**
+ * @brief Take the oldest item, consumer side only
+ *
+ * @return The item, or NULL if the queue is empty
+ */
+static inline void* spsc_pop(spsc_queue_t* q) {
+    uint32_t tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    void* item;
+    if (tail == __atomic_load_n(&q->head, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    item = q->slots[tail & (SPSC_SIZE - 1)];
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+    return item;
+}
+
+#endif
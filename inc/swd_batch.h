@@ -0,0 +1,45 @@
+/**
+ * @file swd_batch.h
+ * @author Min Kang
+ * @brief Batched SWD transfer headers
+ */
+#ifndef SWD_BATCH_H
+#define SWD_BATCH_H
+
+#include <stdint.h>
+#include "swd_request.h"
+
+/**
+ * @brief One DP or AP access in a batch
+ */
+typedef struct {
+    uint8_t req;   // Request built with SWD_REQ(), DP_READ() and friends
+    uint8_t ack;   // ACK of the access, 0 if it never ran
+    uint32_t data; // Data to write, or data read back
+} swd_op_t;
+
+/**
+ * @brief Run a list of DP and AP accesses back to back
+ *
+ * AP reads are posted: each one returns the result of the AP read before
+ * it, so a run of AP reads costs one transaction per read plus a single
+ * RDBUFF read where the run ends. Results always land in the op that asked
+ * for them.
+ *
+ * With overrun detection on and the PIO backend, the whole batch is
+ * streamed without waiting for each ACK. Otherwise every access goes
+ * through swd_transfer() and gets its WAIT retries there.
+ *
+ * The batch stops at the first access that doesn't ACK OK. That op holds
+ * the bad ACK, and ops after it are left with an ACK of 0.
+ *
+ * Once the SWD engine is running, calls from core0 are run on core1.
+ *
+ * @param ops Accesses to run, read data is stored back into them
+ * @param num_ops Number of accesses
+ *
+ * @return SWD_ACK_OK if every access succeeded, otherwise the failing ACK
+ */
+uint8_t swd_transfer_batch(swd_op_t* ops, uint32_t num_ops);
+
+#endif
@@ -0,0 +1,63 @@
+/**
+ * @file swd_cache.h
+ * @author Min Kang
+ * @brief SWD register shadow cache headers
+ */
+#ifndef SWD_CACHE_H
+#define SWD_CACHE_H
+
+#include <stdint.h>
+
+/**
+ * @brief Writes the cache has dropped because they wouldn't change anything
+ */
+typedef struct {
+    uint32_t select_skipped;
+    uint32_t csw_skipped;
+    uint32_t tar_skipped;
+    uint32_t invalidations;
+} swd_cache_stats_t;
+
+/**
+ * @brief Check whether a write would leave the TARGET unchanged
+ *
+ * @param req Request built with SWD_REQ()
+ * @param data Data about to be written
+ *
+ * @return 1 if the write can be dropped
+ */
+uint8_t swd_cache_write_redundant(uint8_t req, uint32_t data);
+
+/**
+ * @brief Update the shadows after a transaction went out on the wire
+ *
+ * Tracks SELECT, CSW and TAR writes and predicts TAR auto increment on DRW
+ * accesses. Everything is forgotten on FAULT or a protocol error.
+ *
+ * @param req Request built with SWD_REQ()
+ * @param data Data written or read
+ * @param ack ACK of the transaction
+ */
+void swd_cache_update(uint8_t req, uint32_t data, uint8_t ack);
+
+/**
+ * @brief Forget every shadow
+ *
+ * Must be called whenever the DP or AP state can't be trusted, like after
+ * a line reset.
+ */
+void swd_cache_invalidate();
+
+/**
+ * @brief Get the skipped write counters
+ *
+ * @return Pointer to the counters
+ */
+const swd_cache_stats_t* swd_cache_get_stats();
+
+/**
+ * @brief Zero the skipped write counters
+ */
+void swd_cache_reset_stats();
+
+#endif
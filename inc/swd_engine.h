@@ -0,0 +1,69 @@
+/**
+ * @file swd_engine.h
+ * @author Min Kang
+ * @brief SWD engine on core1 headers
+ */
+#ifndef SWD_ENGINE_H
+#define SWD_ENGINE_H
+
+#include <stdint.h>
+#include "swd_batch.h"
+
+/**
+ * @brief A list of accesses handed to core1
+ */
+typedef struct {
+    swd_op_t* ops;
+    uint32_t num_ops;
+    uint8_t raw;           // 1 to run every op through swd_transfer() as is
+    uint8_t ack;           // Result of the job, valid once done
+    volatile uint8_t done; // Set once the job is back from core1
+} swd_job_t;
+
+/**
+ * @brief Start running SWD transfers on core1
+ *
+ * From here on swd_transfer() and swd_transfer_batch() called on core0 are
+ * handed over to core1 and wait for it.
+ */
+void swd_engine_start();
+
+/**
+ * @brief Whether an SWD call on this core should go to core1
+ *
+ * @return 1 on core0 once the engine is running
+ */
+uint8_t swd_engine_forward();
+
+/**
+ * @brief Queue a job for core1 without waiting for it
+ *
+ * Jobs run in the order they are submitted. Without the engine the job runs
+ * before this returns. Nothing else may touch the SWD link until every
+ * submitted job is done.
+ *
+ * @param job Job to run, must stay valid until it is done
+ */
+void swd_engine_submit(swd_job_t* job);
+
+/**
+ * @brief Wait for a submitted job to come back
+ *
+ * @param job Job to wait for
+ *
+ * @return ACK of the job
+ */
+uint8_t swd_engine_wait(swd_job_t* job);
+
+/**
+ * @brief Run a batch on core1 and wait for it
+ *
+ * @param ops Accesses to run, see swd_transfer_batch()
+ * @param num_ops Number of accesses
+ * @param raw 1 to run every op through swd_transfer() as is
+ *
+ * @return ACK of the batch
+ */
+uint8_t swd_engine_run(swd_op_t* ops, uint32_t num_ops, uint8_t raw);
+
+#endif
@@ -24,4 +24,16 @@ void initialize_swd();
  */
 uint8_t setup_dp_and_mem_ap();
 
+/**
+ * @brief Find the fastest SWCLK frequency the link survives
+ *
+ * Attaches at SWD_NEGOTIATE_START_HZ, then steps the clock up until
+ * IDCODE reads, CTRL/STAT round trips or a RAM readback pattern fail.
+ * The clock is left at SWD_NEGOTIATE_MARGIN_PCT percent of the fastest
+ * frequency that passed, and the link is reinitialized there.
+ *
+ * @return Frequency settled on in Hz, or 0 if the TARGET can't be reached
+ */
+uint32_t negotiate_swd_clock();
+
 #endif
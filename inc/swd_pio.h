@@ -0,0 +1,93 @@
+/**
+ * @file swd_pio.h
+ * @author Min Kang
+ * @brief PIO SWD backend headers
+ */
+#ifndef SWD_PIO_H
+#define SWD_PIO_H
+
+#include <stdint.h>
+
+// Fields of a command word, see swd.pio
+#define SWD_PIO_CMD_LEN_MASK 0xFF
+#define SWD_PIO_CMD_HOST_DRIVES (1 << 8)
+#define SWD_PIO_CMD_ROUTINE_SHIFT 9
+#define SWD_PIO_CMD_ROUTINE_MASK 0x1F
+
+/**
+ * @brief Build a command word for the state machine
+ *
+ * @param len Number of bits in the phase, 1 to 32
+ * @param host_drives 1 if HOST drives SWDIO for the phase
+ * @param pc Address of write_cmd or read_cmd in instruction memory
+ *
+ * @return Command word
+ */
+static inline uint32_t swd_pio_cmd_word(uint8_t len, uint8_t host_drives, uint32_t pc) {
+    return ((len - 1) & SWD_PIO_CMD_LEN_MASK) |
+           (host_drives ? SWD_PIO_CMD_HOST_DRIVES : 0) |
+           ((pc & SWD_PIO_CMD_ROUTINE_MASK) << SWD_PIO_CMD_ROUTINE_SHIFT);
+}
+
+/**
+ * @brief Load the SWD program and hand SWCLK and SWDIO over to PIO
+ *
+ * @param freq_hz SWCLK frequency in Hz
+ *
+ * @return Frequency actually achieved in Hz
+ */
+uint32_t swd_pio_init(uint32_t freq_hz);
+
+/**
+ * @brief Set the SWCLK frequency through the state machine clock divider
+ *
+ * The divider has 8 fractional bits, so the result is the closest frequency
+ * clk_sys / (4 * divider) can produce.
+ *
+ * @param freq_hz Requested SWCLK frequency in Hz
+ *
+ * @return Frequency actually achieved in Hz
+ */
+uint32_t swd_pio_set_freq(uint32_t freq_hz);
+
+/**
+ * @brief Stop the state machine and give SWCLK and SWDIO back to SIO
+ */
+void swd_pio_deinit();
+
+/**
+ * @brief Shift bits out on SWDIO, LSB first
+ *
+ * @param data Data to be sent
+ * @param len Length of data in bits, 1 to 32
+ */
+void swd_pio_write_bits(uint32_t data, uint8_t len);
+
+/**
+ * @brief Shift bits in from SWDIO, LSB first
+ *
+ * SWDIO is released for the whole phase, so a read of 1 bit doubles as a
+ * turnaround cycle.
+ *
+ * @param len Length of read, 1 to 32
+ *
+ * @return Data read
+ */
+uint32_t swd_pio_read_bits(uint8_t len);
+
+/**
+ * @brief Run transactions without waiting for each ACK
+ *
+ * Only valid with CTRL/STAT.ORUNDETECT on. Every transaction then has the
+ * same shape whatever the ACK, so the whole list is fed to the state
+ * machine while ACKs and data are collected from the RX FIFO behind it.
+ * A read whose data fails its parity check gets SWD_ERR_PARITY as its ACK.
+ *
+ * @param reqs Requests built with SWD_REQ()
+ * @param data Data to write, or where read data is stored
+ * @param acks Where the ACK of every transaction is stored
+ * @param n Number of transactions
+ */
+void swd_pio_transfer_stream(const uint8_t* reqs, uint32_t* data, uint8_t* acks, uint32_t n);
+
+#endif
@@ -1,22 +1,89 @@
+/**
+ * @file swd_request.h
+ * @author Min Kang
+ * @brief SWD request encoding and ACK values
+ */
 #ifndef SWD_REQUEST_H
 #define SWD_REQUEST_H
 
 #include <stdint.h>
 
-typedef struct _swd_req
-{
-    uint8_t start : 1;  // Always 1
-    uint8_t APnDP : 1;  // Selects DPACC or APACC, 0 for DPACC, 1 for APACC
-    uint8_t RnW : 1;    // Selects read or write, 0 for write, 1 for read
-    uint8_t A : 2;      // Different meaning based on APnDP
-    uint8_t parity : 1; // Parity check on APnDP,RnW,A bits, if num of 1's are even, parity is 0
-    uint8_t stop : 1;   // Must always be 0 unless SWD is async which is never
-    uint8_t park : 1;   // Always 1
-} swd_req_t;
-
-union Packet {
-    swd_req_t req;
-    uint16_t asInt;
-};
+/*
+ * A request is packed into 4 bits so it can index swd_req_headers:
+ *
+ *   bit 0    APnDP, 0 for DPACC, 1 for APACC
+ *   bit 1    RnW, 0 for write, 1 for read
+ *   bits 2-3 A, the same 2 bit register selector SWD_DP_read and friends take
+ */
+#define SWD_REQ_APnDP (1 << 0)
+#define SWD_REQ_RnW   (1 << 1)
+#define SWD_REQ_A_SHIFT 2
+#define SWD_REQ(APnDP, RnW, A) (((APnDP) & 1) | (((RnW) & 1) << 1) | (((A) & 0b11) << SWD_REQ_A_SHIFT))
+
+#define DP_READ(A)   SWD_REQ(0, 1, A)
+#define DP_WRITE(A)  SWD_REQ(0, 0, A)
+#define AP_READ(A)   SWD_REQ(1, 1, A)
+#define AP_WRITE(A)  SWD_REQ(1, 0, A)
+
+// DP registers, as A values. A[3:2] of the address, sent A[2] first.
+#define DP_ABORT     0b00 // Write only
+#define DP_IDCODE    0b00 // Read only
+#define DP_CTRL_STAT 0b10
+#define DP_SELECT    0b01
+#define DP_RDBUFF    0b11
+
+// MEM-AP registers in bank 0, as A values
+#define AP_CSW 0b00
+#define AP_TAR 0b10
+#define AP_DRW 0b11
+
+#define SWD_ACK_OK    0b001
+#define SWD_ACK_WAIT  0b010
+#define SWD_ACK_FAULT 0b100
+// Not an ACK, returned when polling the TARGET for a status gives up
+#define SWD_ERR_TIMEOUT 0b1000
+// Not an ACK, returned when read data doesn't match its parity bit
+#define SWD_ERR_PARITY 0b10000
+
+// DP ABORT bits
+#define ABORT_DAPABORT   (1 << 0)
+#define ABORT_STKCMPCLR  (1 << 1)
+#define ABORT_STKERRCLR  (1 << 2)
+#define ABORT_WDERRCLR   (1 << 3)
+#define ABORT_ORUNERRCLR (1 << 4)
+#define ABORT_CLEAR_ALL  (ABORT_STKCMPCLR | ABORT_STKERRCLR | ABORT_WDERRCLR | ABORT_ORUNERRCLR)
+
+// DP CTRL/STAT bits
+#define CTRL_STAT_ORUNDETECT (1 << 0)
+#define CTRL_STAT_STICKYORUN (1 << 1)
+#define CTRL_STAT_STICKYCMP  (1 << 4)
+#define CTRL_STAT_STICKYERR  (1 << 5)
+#define CTRL_STAT_WDATAERR   (1 << 7)
+#define CTRL_STAT_CDBGPWRUPREQ (1 << 28)
+#define CTRL_STAT_CDBGPWRUPACK (1 << 29)
+#define CTRL_STAT_CSYSPWRUPREQ (1 << 30)
+#define CTRL_STAT_CSYSPWRUPACK (1 << 31)
+
+/*
+ * The 8 bit header in the order it goes on the wire, LSB first:
+ *
+ *   start(1) APnDP RnW A[1] A[0] parity stop(0) park(1)
+ *
+ * Parity covers APnDP, RnW and A, and is 0 if the number of 1's is even.
+ */
+#define SWD_HEADER(APnDP, RnW, A) ( \
+    (1 << 0) | \
+    (((APnDP) & 1) << 1) | \
+    (((RnW) & 1) << 2) | \
+    ((((A) >> 1) & 1) << 3) | \
+    (((A) & 1) << 4) | \
+    ((((APnDP) ^ (RnW) ^ ((A) >> 1) ^ (A)) & 1) << 5) | \
+    (0 << 6) | \
+    (1 << 7))
+
+/**
+ * @brief Every possible request header, indexed by SWD_REQ()
+ */
+extern const uint8_t swd_req_headers[16];
 
 #endif
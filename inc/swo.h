@@ -0,0 +1,91 @@
+/**
+ * @file swo.h
+ * @author Min Kang
+ * @brief SWO trace capture headers
+ */
+#ifndef SWO_H
+#define SWO_H
+
+#include <stdint.h>
+#include "itm_decode.h"
+
+// DMA ring the receiver writes into, a power of two, aligned to its size
+#define SWO_RING_BITS 12
+#define SWO_RING_SIZE (1 << SWO_RING_BITS)
+// Bytes swo_task() handles per call, so a flood can't stall the main loop
+#define SWO_TASK_MAX 1024
+// How often the main loop empties the ring
+#define SWO_POLL_INTERVAL_US 1000
+#define SWO_DEFAULT_BAUD 1000000
+
+typedef struct {
+    uint32_t bytes;                   // Received
+    uint32_t overruns;                // Times the ring filled up before it was emptied
+    uint32_t packets[ITM_PKT_TYPES];  // Decoded, by itm_packet_type_t
+} swo_stats_t;
+
+/**
+ * @brief Set up the TARGET's TPIU, ITM and DWT to send trace over SWO
+ *
+ * UART (NRZ) encoding with the formatter off, every stimulus port enabled.
+ *
+ * @param baud SWO bit rate
+ * @param trace_hz Frequency of the TARGET's trace clock, usually its core clock
+ * @param pc_sampling 1 to also send periodic PC samples
+ *
+ * @return ACK of request
+ */
+uint8_t swo_target_setup(uint32_t baud, uint32_t trace_hz, uint8_t pc_sampling);
+
+/**
+ * @brief Start receiving SWO on SWO_PIN
+ *
+ * @param baud SWO bit rate
+ */
+void swo_capture_start(uint32_t baud);
+
+/**
+ * @brief Stop receiving SWO and free the state machine and DMA channel
+ */
+void swo_capture_stop();
+
+/**
+ * @brief Choose whether trace is decoded on the probe or passed on raw
+ *
+ * Decoded, only stimulus port data reaches the stream port. Raw, every
+ * byte does, for a decoder on the host.
+ *
+ * @param raw 1 to pass bytes through as they are
+ */
+void swo_set_raw(uint8_t raw);
+
+/**
+ * @brief Move received trace to the stream port, run from the main loop
+ *
+ * @return 0
+ */
+uint8_t swo_task();
+
+/**
+ * @brief Get the capture counters
+ *
+ * @return Pointer to the counters
+ */
+const swo_stats_t* swo_get_stats();
+
+/**
+ * @brief Capture SWO trace from the TARGET
+ *
+ * Usage: swo start <trace hz> [baud] [pc]
+ *        swo stop|raw|decode
+ *        swo
+ *
+ * start sets up the TARGET and starts receiving, pc adds periodic PC
+ * samples. Trace goes to the stream port. Without arguments, shows the
+ * capture counters.
+ *
+ * @return ACK from SWD request, or 1 for bad arguments
+ */
+uint8_t swo_run(char** args, uint8_t num_args);
+
+#endif
@@ -0,0 +1,32 @@
+/**
+ * @file tusb_config.h
+ * @author Min Kang
+ * @brief TinyUSB configuration: a composite device of USB_CDC_PORTS CDCs
+ */
+#ifndef TUSB_CONFIG_H
+#define TUSB_CONFIG_H
+
+#ifndef CFG_TUSB_MCU
+#error CFG_TUSB_MCU must be defined
+#endif
+
+#define CFG_TUSB_RHPORT0_MODE OPT_MODE_DEVICE
+
+#ifndef CFG_TUSB_OS
+#define CFG_TUSB_OS OPT_OS_PICO
+#endif
+
+#define CFG_TUD_ENDPOINT0_SIZE 64
+
+// Console, host protocol or GDB, and TARGET output, see usb_cdc.h
+#define CFG_TUD_CDC    3
+#define CFG_TUD_MSC    0
+#define CFG_TUD_HID    0
+#define CFG_TUD_MIDI   0
+#define CFG_TUD_VENDOR 0
+
+#define CFG_TUD_CDC_RX_BUFSIZE 256
+#define CFG_TUD_CDC_TX_BUFSIZE 1024
+#define CFG_TUD_CDC_EP_BUFSIZE 64
+
+#endif
@@ -0,0 +1,68 @@
+/**
+ * @file usb_cdc.h
+ * @author Min Kang
+ * @brief USB CDC ports headers
+ */
+#ifndef USB_CDC_H
+#define USB_CDC_H
+
+#include <stdint.h>
+
+// One CDC interface each
+#define USB_CDC_CONSOLE 0 // Human console, stdio goes here
+#define USB_CDC_HOST    1 // Binary host protocol or GDB
+#define USB_CDC_STREAM  2 // TARGET output such as SWO and RTT
+#define USB_CDC_PORTS   3
+
+// Buffered bytes per port and direction, must be powers of two
+#define USB_CDC_RX_SIZE 512
+#define USB_CDC_TX_SIZE 2048
+
+// How often TinyUSB is serviced from the timer interrupt
+#define USB_TASK_INTERVAL_US 1000
+
+/**
+ * @brief Bring up TinyUSB and start servicing it in the background
+ */
+void usb_cdc_init();
+
+/**
+ * @brief Get a received byte without waiting
+ *
+ * @param port USB_CDC_CONSOLE, USB_CDC_HOST or USB_CDC_STREAM
+ *
+ * @return Byte received, or -1 if there is none
+ */
+int usb_cdc_getc(uint8_t port);
+
+/**
+ * @brief Number of received bytes waiting to be read
+ *
+ * @param port USB_CDC_CONSOLE, USB_CDC_HOST or USB_CDC_STREAM
+ *
+ * @return Bytes waiting
+ */
+uint32_t usb_cdc_available(uint8_t port);
+
+/**
+ * @brief Queue bytes to send
+ *
+ * Waits for room while the host has the port open. With nobody listening
+ * the bytes are dropped, so output never hangs the probe.
+ *
+ * @param port USB_CDC_CONSOLE, USB_CDC_HOST or USB_CDC_STREAM
+ * @param buf Bytes to send
+ * @param len Number of bytes
+ */
+void usb_cdc_write(uint8_t port, const void* buf, uint32_t len);
+
+/**
+ * @brief Whether the host has the port open
+ *
+ * @param port USB_CDC_CONSOLE, USB_CDC_HOST or USB_CDC_STREAM
+ *
+ * @return 1 if DTR is set
+ */
+uint8_t usb_cdc_connected(uint8_t port);
+
+#endif
@@ -45,10 +45,24 @@ char get_keypress();
 /**
  * @brief Get a line of text from user
  * 
- * Receive text from user until new line is received
- * Can also handle backspaces
+ * Takes whatever has been received so far without waiting, so it is called
+ * again and again until a new line is received. The same buffer must be
+ * passed every time. Can also handle backspaces
+ *
+ * PROTO_ESCAPE at the start of a line is returned on its own without being
+ * echoed, so the caller can switch to binary mode. Ctrl-C cancels whatever
+ * jobs are running.
+ *
+ * @return 1 once a whole line is in buf, 0 otherwise
+ */
+uint8_t get_line(char* buf, int8_t buf_size);
+
+/**
+ * @brief Print the prompt and the line being edited again
+ *
+ * For background work that printed something in the middle of a line.
  */
-void get_line(char* buf, int8_t buf_size);
+void redraw_line();
 
 /**
  * @brief Calculate parity of data
@@ -0,0 +1,116 @@
+/**
+ * @file watchpoint.h
+ * @author Min Kang
+ * @brief Data watchpoints through the DWT headers
+ */
+#ifndef WATCHPOINT_H
+#define WATCHPOINT_H
+
+#include <stdint.h>
+
+// Most comparators a DWT has, DWT_CTRL.NUMCOMP is four bits
+#define DWT_MAX 15
+// Most watchpoints at a time, each takes one or two comparators
+#define WP_MAX 8
+
+typedef enum {
+    WP_READ = 1,
+    WP_WRITE = 2,
+    WP_ACCESS = 3,
+} wp_type_t;
+
+typedef struct {
+    uint32_t addr;
+    uint32_t len;
+    uint32_t value;      // Only with match_value
+    wp_type_t type;
+    uint8_t match_value;
+    uint16_t comps;      // Comparators used, one bit each
+} wp_t;
+
+/**
+ * @brief Read the DWT's comparator count and what each can match
+ *
+ * Keeps the watchpoint table, but every comparator is written again on
+ * the next wp_sync(), which also clears whatever an earlier session left.
+ *
+ * @return ACK of request
+ */
+uint8_t wp_init();
+
+/**
+ * @brief Set a data watchpoint
+ *
+ * @param addr First byte watched
+ * @param len Bytes watched, 1, 2 or 4 to match a value
+ * @param type Accesses that trigger it
+ * @param match_value Only trigger when the value accessed is value
+ * @param value Value to match, len bytes of it
+ *
+ * @return ACK of request, or SWD_ACK_FAULT if the DWT can't do it
+ */
+uint8_t wp_set(uint32_t addr, uint32_t len, wp_type_t type, uint8_t match_value, uint32_t value);
+
+/**
+ * @brief Remove the watchpoint on an address
+ *
+ * @param addr Address the watchpoint was set on
+ *
+ * @return ACK of request, or SWD_ACK_FAULT if there was none
+ */
+uint8_t wp_clear(uint32_t addr);
+
+/**
+ * @brief Remove every watchpoint
+ *
+ * @return ACK of request
+ */
+uint8_t wp_clear_all();
+
+/**
+ * @brief Write every comparator that changed since the last sync
+ *
+ * Called before the core runs. Does nothing if no watchpoint was ever set.
+ *
+ * @return ACK of request
+ */
+uint8_t wp_sync();
+
+/**
+ * @brief Forget what the comparators hold, for after a reset
+ */
+void wp_invalidate();
+
+/**
+ * @brief Find the watchpoint that halted the core
+ *
+ * Reads and clears DFSR.DWTTRAP, then looks for the comparator that
+ * matched. The core halts an instruction or so after the access.
+ *
+ * @param hit Where the watchpoint is copied
+ *
+ * @return 1 if a watchpoint halted the core
+ */
+uint8_t wp_hit(wp_t* hit);
+
+/**
+ * @brief Get the DWT's comparator count and architecture
+ *
+ * @param num Where the number of comparators is stored
+ * @param v8m Where 1 is stored for an ARMv8-M DWT, 0 for ARMv7-M
+ *
+ * @return ACK of request
+ */
+uint8_t wp_get_info(uint8_t* num, uint8_t* v8m);
+
+/**
+ * @brief Get a watchpoint from the table
+ *
+ * @param i Watchpoint number
+ * @param wp Where the watchpoint is copied
+ *
+ * @return 1 if there is a watchpoint i
+ */
+uint8_t wp_get(uint8_t i, wp_t* wp);
+
+#endif
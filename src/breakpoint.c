@@ -0,0 +1,207 @@
+/**
+ * @file breakpoint.c
+ * @author Min Kang
+ * @brief Hardware breakpoints through the FPB
+ *
+ * The FPB comparator format depends on its revision. FPv1 only matches
+ * code below 0x20000000 and picks a halfword with REPLACE, FPv2 takes the
+ * address as is.
+ *
+ * Breakpoints only change the table kept here. The comparators that
+ * changed are written by bp_sync() when the core is about to run, so
+ * setting and removing breakpoints while halted costs no SWD traffic.
+ */
+#include "breakpoint.h"
+#include "mem.h"
+#include "macros.h"
+#include "swd_request.h"
+#include <string.h>
+
+// FP_CTRL.NUM_CODE is split in two
+#define FP_CTRL_NUM_CODE(ctrl) ((((ctrl) >> 8) & 0x70) | (((ctrl) >> 4) & 0xF))
+#define FP_CTRL_REV(ctrl) (((ctrl) >> 28) & 0xF)
+
+static uint8_t bp_num;
+static uint8_t bp_rev;
+static uint8_t bp_probed;
+// Address of each comparator's breakpoint, valid where bp_used is set
+static uint32_t bp_addr[BP_MAX];
+static uint8_t bp_used[BP_MAX];
+// Comparators that differ from the table, and whether FP_CTRL needs enabling
+static uint16_t bp_dirty;
+static uint8_t bp_ctrl_dirty;
+
+/**
+ * @brief Build the FP_COMP value that breaks on an address
+ */
+static uint32_t bp_comp(uint32_t addr) {
+    if (bp_rev == 0) {
+        // REPLACE picks the halfword within the word
+        return (addr & 0x1FFFFFFC) | ((addr & 2) ? (2u << 30) : (1u << 30)) | 1;
+    }
+    return (addr & ~1u) | 1;
+}
+
+/**
+ * @brief Read FP_CTRL to find the comparators
+ *
+ * Keeps the breakpoint table, but every comparator is written again on the
+ * next bp_sync(), which also clears whatever an earlier session left.
+ *
+ * @return ACK of request
+ */
+uint8_t bp_init() {
+    uint32_t ctrl;
+    uint8_t ack, i;
+    if ((ack = mem_read(FP_CTRL, &ctrl)) != SWD_ACK_OK) {
+        return ack;
+    }
+    bp_num = FP_CTRL_NUM_CODE(ctrl);
+    if (bp_num > BP_MAX) {
+        bp_num = BP_MAX;
+    }
+    bp_rev = FP_CTRL_REV(ctrl);
+    // A different TARGET may have fewer comparators
+    for (i = bp_num; i < BP_MAX; ++i) {
+        bp_used[i] = 0;
+    }
+    bp_probed = 1;
+    bp_invalidate();
+    return ack;
+}
+
+/**
+ * @brief Set a breakpoint on an instruction address
+ *
+ * @param addr Address of the instruction
+ *
+ * @return ACK of request, or SWD_ACK_FAULT if every comparator is in use
+ */
+uint8_t bp_set(uint32_t addr) {
+    uint8_t i, ack, free = BP_MAX;
+    if (!bp_probed && (ack = bp_init()) != SWD_ACK_OK) {
+        return ack;
+    }
+    for (i = 0; i < bp_num; ++i) {
+        if (bp_used[i] && bp_addr[i] == addr) {
+            return SWD_ACK_OK;
+        }
+        if (!bp_used[i] && free == BP_MAX) {
+            free = i;
+        }
+    }
+    if (free == BP_MAX || (bp_rev == 0 && addr >= 0x20000000)) {
+        return SWD_ACK_FAULT;
+    }
+    bp_addr[free] = addr;
+    bp_used[free] = 1;
+    bp_dirty |= 1u << free;
+    return SWD_ACK_OK;
+}
+
+/**
+ * @brief Remove the breakpoint on an instruction address
+ *
+ * @param addr Address the breakpoint was set on
+ *
+ * @return ACK of request, or SWD_ACK_FAULT if there was none
+ */
+uint8_t bp_clear(uint32_t addr) {
+    uint8_t i;
+    for (i = 0; i < bp_num; ++i) {
+        if (bp_used[i] && bp_addr[i] == addr) {
+            bp_used[i] = 0;
+            bp_dirty |= 1u << i;
+            return SWD_ACK_OK;
+        }
+    }
+    return SWD_ACK_FAULT;
+}
+
+/**
+ * @brief Remove every breakpoint
+ *
+ * @return ACK of request
+ */
+uint8_t bp_clear_all() {
+    uint8_t i;
+    for (i = 0; i < bp_num; ++i) {
+        if (bp_used[i]) {
+            bp_used[i] = 0;
+            bp_dirty |= 1u << i;
+        }
+    }
+    return SWD_ACK_OK;
+}
+
+/**
+ * @brief Write every comparator that changed since the last sync
+ *
+ * Called before the core runs. Does nothing if no breakpoint was ever set.
+ *
+ * @return ACK of request
+ */
+uint8_t bp_sync() {
+    uint8_t i, ack;
+    if (!bp_probed) {
+        return SWD_ACK_OK;
+    }
+    for (i = 0; i < bp_num; ++i) {
+        if (!(bp_dirty & (1u << i))) {
+            continue;
+        }
+        if ((ack = mem_write(FP_COMP0 + 4 * i, bp_used[i] ? bp_comp(bp_addr[i]) : 0)) != SWD_ACK_OK) {
+            return ack;
+        }
+        bp_dirty &= ~(1u << i);
+    }
+    if (bp_ctrl_dirty) {
+        if ((ack = mem_write(FP_CTRL, FP_CTRL_KEY | FP_CTRL_ENABLE)) != SWD_ACK_OK) {
+            return ack;
+        }
+        bp_ctrl_dirty = 0;
+    }
+    return SWD_ACK_OK;
+}
+
+/**
+ * @brief Forget what the comparators hold, for after a reset
+ */
+void bp_invalidate() {
+    bp_dirty = (1u << bp_num) - 1;
+    bp_ctrl_dirty = 1;
+}
+
+/**
+ * @brief Get the FPB's comparator count and revision
+ *
+ * @param num Where the number of comparators is stored
+ * @param rev Where FP_CTRL.REV is stored, 0 for FPv1 and 1 for FPv2
+ *
+ * @return ACK of request
+ */
+uint8_t bp_get_info(uint8_t* num, uint8_t* rev) {
+    uint8_t ack;
+    if (!bp_probed && (ack = bp_init()) != SWD_ACK_OK) {
+        return ack;
+    }
+    *num = bp_num;
+    *rev = bp_rev;
+    return SWD_ACK_OK;
+}
+
+/**
+ * @brief Get a breakpoint from the table
+ *
+ * @param i Comparator number
+ * @param addr Where the breakpoint's address is stored
+ *
+ * @return 1 if comparator i holds a breakpoint
+ */
+uint8_t bp_get(uint8_t i, uint32_t* addr) {
+    if (i >= bp_num || !bp_used[i]) {
+        return 0;
+    }
+    *addr = bp_addr[i];
+    return 1;
+}
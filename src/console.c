@@ -0,0 +1,67 @@
+/**
+ * @file console.c
+ * @author Min Kang
+ * @brief stdio on the console USB CDC port
+ *
+ * A stdio driver on USB_CDC_CONSOLE, so printf() and getchar() go through
+ * the rings in usb_cdc.c. Received bytes are collected in the background
+ * even while a command is busy, and output is queued and sent by the USB
+ * timer interrupt a full packet at a time instead of one printf() at a time.
+ */
+#include "console.h"
+#include "usb_cdc.h"
+#include "pico/stdlib.h"
+#include "pico/stdio/driver.h"
+
+static void console_out_chars(const char* buf, int len) {
+    usb_cdc_write(USB_CDC_CONSOLE, buf, len);
+}
+
+static int console_in_chars(char* buf, int len) {
+    int n = 0, c;
+    while (n < len && (c = usb_cdc_getc(USB_CDC_CONSOLE)) >= 0) {
+        buf[n++] = c;
+    }
+    return n ? n : PICO_ERROR_NO_DATA;
+}
+
+static stdio_driver_t console_driver = {
+    .out_chars = console_out_chars,
+    .in_chars = console_in_chars,
+    .crlf_enabled = PICO_STDIO_DEFAULT_CRLF,
+};
+
+/**
+ * @brief Bring up USB and make the console port the stdio driver
+ *
+ * Must be called after stdio_init_all().
+ */
+void console_init() {
+    usb_cdc_init();
+    stdio_set_driver_enabled(&console_driver, true);
+}
+
+/**
+ * @brief Get a received byte without waiting
+ *
+ * @return Byte received, or -1 if there is none
+ */
+int console_getc() {
+    return usb_cdc_getc(USB_CDC_CONSOLE);
+}
+
+/**
+ * @brief Number of received bytes waiting to be read
+ *
+ * @return Bytes waiting
+ */
+uint32_t console_available() {
+    return usb_cdc_available(USB_CDC_CONSOLE);
+}
+
+/**
+ * @brief Send whatever output is buffered
+ */
+void console_flush() {
+    stdio_flush();
+}
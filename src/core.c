@@ -0,0 +1,432 @@
+/**
+ * @file core.c
+ * @author Min Kang
+ * @brief Core debug: DHCSR polling and core register transfers
+ *
+ * Every operation that takes time on the TARGET waits for the status bit
+ * that says it's done, instead of sleeping for a fixed amount of time.
+ *
+ * Core registers are cached while the core is halted. Anything that lets
+ * the core run throws the cache away, so repeated reads of a halted core
+ * cost no SWD traffic at all.
+ */
+#include "core.h"
+#include "breakpoint.h"
+#include "watchpoint.h"
+#include "mem.h"
+#include "macros.h"
+#include "swd_request.h"
+#include "swd_batch.h"
+#include "pico/time.h"
+#include <stddef.h>
+#include <string.h>
+
+static core_latency_stats_t latency;
+
+// Register cache, indexed by DCRSR.REGSEL
+static uint32_t reg_cache[CORE_REGSEL_COUNT];
+static uint32_t reg_valid[(CORE_REGSEL_COUNT + 31) / 32];
+static core_reg_cache_stats_t reg_stats;
+
+// Ops per register in a snapshot: DCRSR write, DHCSR read, DCRDR read,
+// each a TAR write and a DRW access
+#define SNAPSHOT_OPS_PER_REG 6
+// Registers per snapshot batch
+#define SNAPSHOT_BATCH 8
+static swd_op_t snapshot_ops[1 + SNAPSHOT_OPS_PER_REG * SNAPSHOT_BATCH];
+
+static inline uint8_t reg_is_cached(uint8_t regsel) {
+    return regsel < CORE_REGSEL_COUNT && (reg_valid[regsel / 32] >> (regsel % 32)) & 1;
+}
+
+static inline void reg_store(uint8_t regsel, uint32_t value) {
+    if (regsel < CORE_REGSEL_COUNT) {
+        reg_cache[regsel] = value;
+        reg_valid[regsel / 32] |= 1u << (regsel % 32);
+    }
+}
+
+/**
+ * @brief Record how long a poll took
+ */
+static void record_latency(core_latency_t* l, uint64_t start_us, uint8_t ack) {
+    uint32_t us = (uint32_t)(time_us_64() - start_us);
+    if (ack == SWD_ERR_TIMEOUT) {
+        l->timeouts++;
+        return;
+    }
+    l->count++;
+    l->last_us = us;
+    l->total_us += us;
+    if (us > l->max_us) {
+        l->max_us = us;
+    }
+}
+
+/**
+ * @brief Poll DHCSR until the bits in mask match value
+ *
+ * @param mask Bits to check
+ * @param value What those bits should be
+ * @param timeout_us How long to poll for
+ * @param dhcsr Where the last DHCSR value read is stored, may be NULL
+ *
+ * @return ACK of request, or SWD_ERR_TIMEOUT
+ */
+uint8_t core_poll_dhcsr(uint32_t mask, uint32_t value, uint32_t timeout_us, uint32_t* dhcsr) {
+    uint64_t start = time_us_64();
+    uint32_t data;
+    uint8_t ack;
+    do {
+        if ((ack = mem_read(CORE_DHCSR, &data)) != SWD_ACK_OK) {
+            return ack;
+        }
+        if (dhcsr) {
+            *dhcsr = data;
+        }
+        if ((data & mask) == value) {
+            return ack;
+        }
+    } while (time_us_64() - start < timeout_us);
+    return SWD_ERR_TIMEOUT;
+}
+
+/**
+ * @brief Poll for a DHCSR bit and record how long it took
+ */
+static uint8_t wait_for(core_latency_t* l, uint32_t bit, uint32_t timeout_us) {
+    uint64_t start = time_us_64();
+    uint8_t ack = core_poll_dhcsr(bit, bit, timeout_us, NULL);
+    record_latency(l, start, ack);
+    return ack;
+}
+
+/**
+ * @brief Read a core register through DCRSR and DCRDR
+ *
+ * Waits for DHCSR.S_REGRDY before reading DCRDR.
+ *
+ * @param regsel DCRSR.REGSEL of the register
+ * @param value Where the register value is stored
+ *
+ * @return ACK of request, or SWD_ERR_TIMEOUT
+ */
+uint8_t core_reg_read(uint8_t regsel, uint32_t* value) {
+    uint8_t ack;
+    if (reg_is_cached(regsel)) {
+        reg_stats.hits++;
+        *value = reg_cache[regsel];
+        return SWD_ACK_OK;
+    }
+    reg_stats.misses++;
+    if ((ack = mem_write(CORE_DCRSR, regsel)) != SWD_ACK_OK) {
+        return ack;
+    }
+    if ((ack = wait_for(&latency.regrdy, DHCSR_S_REGRDY, REGRDY_TIMEOUT_US)) != SWD_ACK_OK) {
+        return ack;
+    }
+    if ((ack = mem_read(CORE_DCRDR, value)) == SWD_ACK_OK) {
+        reg_store(regsel, *value);
+    }
+    return ack;
+}
+
+/**
+ * @brief Write a core register through DCRDR and DCRSR
+ *
+ * Waits for DHCSR.S_REGRDY before returning.
+ *
+ * @param regsel DCRSR.REGSEL of the register
+ * @param value Value to write
+ *
+ * @return ACK of request, or SWD_ERR_TIMEOUT
+ */
+uint8_t core_reg_write(uint8_t regsel, uint32_t value) {
+    uint8_t ack;
+    // Reserved bits may not stick, so the value is read back when needed.
+    // The stack pointers and CONTROL.SPSEL change what r13 means.
+    if (regsel == 13 || regsel == CORE_REGSEL_MSP || regsel == CORE_REGSEL_PSP ||
+        regsel == CORE_REGSEL_CONTROL) {
+        core_reg_cache_invalidate();
+    } else if (regsel < CORE_REGSEL_COUNT) {
+        reg_valid[regsel / 32] &= ~(1u << (regsel % 32));
+    }
+    if ((ack = mem_write(CORE_DCRDR, value)) != SWD_ACK_OK) {
+        return ack;
+    }
+    if ((ack = mem_write(CORE_DCRSR, DCRSR_REGWnR | regsel)) != SWD_ACK_OK) {
+        return ack;
+    }
+    return wait_for(&latency.regrdy, DHCSR_S_REGRDY, REGRDY_TIMEOUT_US);
+}
+
+/**
+ * @brief Halt the core and wait for DHCSR.S_HALT
+ *
+ * @return ACK of request, or SWD_ERR_TIMEOUT
+ */
+uint8_t core_halt() {
+    uint8_t ack;
+    core_reg_cache_invalidate();
+    if ((ack = mem_write(CORE_DHCSR, DHCSR_DBGKEY | DHCSR_C_HALT | DHCSR_C_DEBUGEN)) != SWD_ACK_OK) {
+        return ack;
+    }
+    return wait_for(&latency.halt, DHCSR_S_HALT, HALT_TIMEOUT_US);
+}
+
+/**
+ * @brief Let the core run
+ *
+ * Breakpoints and watchpoints that changed while halted are written to
+ * the FPB and DWT first.
+ *
+ * @return ACK of request
+ */
+uint8_t core_continue() {
+    uint8_t ack;
+    core_reg_cache_invalidate();
+    if ((ack = bp_sync()) != SWD_ACK_OK || (ack = wp_sync()) != SWD_ACK_OK) {
+        return ack;
+    }
+    return mem_write(CORE_DHCSR, DHCSR_DBGKEY | DHCSR_C_DEBUGEN);
+}
+
+/**
+ * @brief Step one instruction and wait for DHCSR.S_HALT
+ *
+ * @return ACK of request, or SWD_ERR_TIMEOUT
+ */
+uint8_t core_step() {
+    uint8_t ack;
+    core_reg_cache_invalidate();
+    if ((ack = mem_write(CORE_DHCSR, DHCSR_DBGKEY | DHCSR_C_STEP | DHCSR_C_DEBUGEN)) != SWD_ACK_OK) {
+        return ack;
+    }
+    return wait_for(&latency.step, DHCSR_S_HALT, HALT_TIMEOUT_US);
+}
+
+/**
+ * @brief Step one instruction and read the new PC, in one batch
+ *
+ * The step, the PC transfer and the DHCSR read that shows both finished
+ * go out back to back. A step takes a few core clocks, far less than one
+ * SWD transaction, so S_HALT and S_REGRDY are checked after the fact and
+ * the slow path is only taken when one of them is clear.
+ *
+ * @param pc Where the new PC is stored
+ *
+ * @return ACK of request, or SWD_ERR_TIMEOUT
+ */
+uint8_t core_step_pc(uint32_t* pc) {
+    swd_op_t* ops = snapshot_ops;
+    uint32_t dhcsr;
+    uint8_t ack;
+
+    core_reg_cache_invalidate();
+    ops[0].req = AP_WRITE(AP_CSW);
+    ops[0].data = CSW_WORD;
+    ops[1].req = AP_WRITE(AP_TAR);
+    ops[1].data = CORE_DHCSR;
+    ops[2].req = AP_WRITE(AP_DRW);
+    ops[2].data = DHCSR_DBGKEY | DHCSR_C_STEP | DHCSR_C_DEBUGEN;
+    ops[3].req = AP_WRITE(AP_TAR);
+    ops[3].data = CORE_DCRSR;
+    ops[4].req = AP_WRITE(AP_DRW);
+    ops[4].data = CORE_REGSEL_PC;
+    ops[5].req = AP_WRITE(AP_TAR);
+    ops[5].data = CORE_DHCSR;
+    ops[6].req = AP_READ(AP_DRW);
+    ops[6].data = 0;
+    ops[7].req = AP_WRITE(AP_TAR);
+    ops[7].data = CORE_DCRDR;
+    ops[8].req = AP_READ(AP_DRW);
+    ops[8].data = 0;
+
+    ack = swd_transfer_batch(ops, 9);
+    if (ack != SWD_ACK_OK) {
+        return ack;
+    }
+    dhcsr = ops[6].data;
+    if ((dhcsr & (DHCSR_S_HALT | DHCSR_S_REGRDY)) == (DHCSR_S_HALT | DHCSR_S_REGRDY)) {
+        *pc = ops[8].data;
+        reg_store(CORE_REGSEL_PC, *pc);
+        return SWD_ACK_OK;
+    }
+    // Took longer than the batch, the PC request may have been lost
+    if ((ack = wait_for(&latency.step, DHCSR_S_HALT, HALT_TIMEOUT_US)) != SWD_ACK_OK) {
+        return ack;
+    }
+    return core_reg_read(CORE_REGSEL_PC, pc);
+}
+
+/**
+ * @brief Reset the system and wait for the core to halt on the reset vector
+ *
+ * Sets DEMCR.VC_CORERESET, requests a reset through AIRCR, then waits for
+ * DHCSR.S_RESET_ST and DHCSR.S_HALT. DEMCR goes back to what it was
+ * afterwards, so TRCENA survives and a reset the TARGET asks for itself
+ * doesn't stop it.
+ *
+ * @return ACK of request, or SWD_ERR_TIMEOUT
+ */
+uint8_t core_reset_halt() {
+    uint64_t start;
+    uint32_t dhcsr, demcr;
+    uint8_t ack, restore;
+
+    core_reg_cache_invalidate();
+    bp_invalidate();
+    wp_invalidate();
+    // Enable halt on reset, leaving the other bits alone
+    if ((ack = mem_read(CORE_DEMCR, &demcr)) != SWD_ACK_OK) {
+        return ack;
+    }
+    if ((ack = mem_write(CORE_DEMCR, demcr | DEMCR_VC_CORERESET)) != SWD_ACK_OK) {
+        return ack;
+    }
+    // S_RESET_ST is sticky, read it once so it only shows the new reset
+    if ((ack = mem_read(CORE_DHCSR, &dhcsr)) != SWD_ACK_OK) {
+        return ack;
+    }
+
+    start = time_us_64();
+    if ((ack = mem_write(NVIC_AIRCR, AIRCR_SYSRESETREQ)) != SWD_ACK_OK) {
+        return ack;
+    }
+    ack = core_poll_dhcsr(DHCSR_S_RESET_ST, DHCSR_S_RESET_ST, RESET_TIMEOUT_US, &dhcsr);
+    if (ack == SWD_ACK_OK && !(dhcsr & DHCSR_S_HALT)) {
+        ack = core_poll_dhcsr(DHCSR_S_HALT, DHCSR_S_HALT, HALT_TIMEOUT_US, NULL);
+    }
+    record_latency(&latency.reset, start, ack);
+    // Even if it never halted, only this reset should stop the core
+    restore = mem_write(CORE_DEMCR, demcr);
+    return ack != SWD_ACK_OK ? ack : restore;
+}
+
+/**
+ * @brief Get the observed polling latencies
+ *
+ * @return Pointer to the latencies
+ */
+const core_latency_stats_t* core_get_latency() {
+    return &latency;
+}
+
+/**
+ * @brief Zero the observed polling latencies
+ */
+void core_reset_latency() {
+    memset(&latency, 0, sizeof(latency));
+}
+
+/**
+ * @brief Read a batch of registers into the cache
+ *
+ * Every register costs a DCRSR write, a DHCSR read and a DCRDR read, all
+ * pipelined in one batch. The core moves a register into DCRDR far faster
+ * than SWD can ask for it, so S_REGRDY is checked in the DHCSR value after
+ * the fact. A register that wasn't ready is read the slow way.
+ */
+static uint8_t snapshot_batch(const uint8_t* regsels, uint32_t n) {
+    uint32_t num_ops = 0, i;
+    uint32_t value;
+    uint8_t ack;
+
+    snapshot_ops[num_ops].req = AP_WRITE(AP_CSW);
+    snapshot_ops[num_ops++].data = CSW_WORD;
+    for (i = 0; i < n; ++i) {
+        snapshot_ops[num_ops].req = AP_WRITE(AP_TAR);
+        snapshot_ops[num_ops++].data = CORE_DCRSR;
+        snapshot_ops[num_ops].req = AP_WRITE(AP_DRW);
+        snapshot_ops[num_ops++].data = regsels[i];
+        snapshot_ops[num_ops].req = AP_WRITE(AP_TAR);
+        snapshot_ops[num_ops++].data = CORE_DHCSR;
+        snapshot_ops[num_ops].req = AP_READ(AP_DRW);
+        snapshot_ops[num_ops++].data = 0;
+        snapshot_ops[num_ops].req = AP_WRITE(AP_TAR);
+        snapshot_ops[num_ops++].data = CORE_DCRDR;
+        snapshot_ops[num_ops].req = AP_READ(AP_DRW);
+        snapshot_ops[num_ops++].data = 0;
+    }
+
+    ack = swd_transfer_batch(snapshot_ops, num_ops);
+    if (ack == SWD_ERR_PARITY) {
+        ack = swd_transfer_batch(snapshot_ops, num_ops);
+    }
+    if (ack != SWD_ACK_OK) {
+        return ack;
+    }
+
+    for (i = 0; i < n; ++i) {
+        uint32_t dhcsr = snapshot_ops[1 + i * SNAPSHOT_OPS_PER_REG + 3].data;
+        value = snapshot_ops[1 + i * SNAPSHOT_OPS_PER_REG + 5].data;
+        if (!(dhcsr & DHCSR_S_HALT)) {
+            // Registers of a running core mean nothing
+            return SWD_ACK_FAULT;
+        }
+        if (dhcsr & DHCSR_S_REGRDY) {
+            reg_store(regsels[i], value);
+        } else if ((ack = core_reg_read(regsels[i], &value)) != SWD_ACK_OK) {
+            return ack;
+        }
+    }
+    return SWD_ACK_OK;
+}
+
+/**
+ * @brief Read a set of core registers into the cache in pipelined batches
+ *
+ * Registers already cached are skipped. The core must be halted.
+ *
+ * @param regsels DCRSR.REGSEL of each register
+ * @param n Number of registers
+ *
+ * @return ACK of request, SWD_ACK_FAULT if the core isn't halted
+ */
+uint8_t core_reg_snapshot(const uint8_t* regsels, uint32_t n) {
+    uint8_t todo[SNAPSHOT_BATCH];
+    uint32_t count = 0, i;
+    uint8_t ack;
+
+    for (i = 0; i < n; ++i) {
+        if (reg_is_cached(regsels[i])) {
+            reg_stats.hits++;
+            continue;
+        }
+        reg_stats.misses++;
+        todo[count++] = regsels[i];
+        if (count == SNAPSHOT_BATCH) {
+            if ((ack = snapshot_batch(todo, count)) != SWD_ACK_OK) {
+                return ack;
+            }
+            count = 0;
+        }
+    }
+    return count ? snapshot_batch(todo, count) : SWD_ACK_OK;
+}
+
+/**
+ * @brief Forget every cached register
+ *
+ * For anything that may have changed the core behind core.c's back, like
+ * raw transfers from a host tool.
+ */
+void core_reg_cache_invalidate() {
+    memset(reg_valid, 0, sizeof(reg_valid));
+}
+
+/**
+ * @brief Get the register cache counters
+ *
+ * @return Pointer to the counters
+ */
+const core_reg_cache_stats_t* core_reg_cache_get_stats() {
+    return &reg_stats;
+}
+
+/**
+ * @brief Zero the register cache counters
+ */
+void core_reg_cache_reset_stats() {
+    memset(&reg_stats, 0, sizeof(reg_stats));
+}
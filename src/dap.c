@@ -0,0 +1,363 @@
+/**
+ * @file dap.c
+ * @author Min Kang
+ * @brief CMSIS-DAP command processor
+ *
+ * Only SWD is supported. Transfers run through swd_transfer_batch(), so AP
+ * reads are pipelined and WAIT, FAULT and parity are handled the same way
+ * as for the console.
+ */
+#include "dap.h"
+#include "data_transfer.h"
+#include "swd_batch.h"
+#include "swd_cache.h"
+#include "macros.h"
+#include "hardware/gpio.h"
+#include "pico/time.h"
+#include <string.h>
+
+// Accesses handed to swd_transfer_batch() at a time
+#define DAP_MAX_OPS 64
+
+#define DAP_FW_VERSION "2.1.0"
+#define DAP_PRODUCT    "Pico SWD Debugger CMSIS-DAP"
+#define DAP_CAP_SWD    (1 << 0)
+
+static swd_op_t ops[DAP_MAX_OPS];
+
+// Set by DAP_TransferConfigure and DAP_Transfer
+static uint16_t match_retry;
+static uint32_t match_mask = 0xFFFFFFFF;
+
+static inline uint32_t get_u32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint16_t get_u16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline void put_u32(uint8_t* p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+/**
+ * @brief Turn a DAP transfer request into one built with SWD_REQ()
+ *
+ * DAP has A2 in bit 2 and A3 in bit 3. SWD_REQ() wants A[2] as the high
+ * bit of its A, so the two swap.
+ */
+static inline uint8_t dap_to_swd_req(uint8_t r) {
+    return SWD_REQ(r & DAP_TRANSFER_APnDP, (r & DAP_TRANSFER_RnW) >> 1,
+                   ((r & DAP_TRANSFER_A2) ? 0b10 : 0) | ((r & DAP_TRANSFER_A3) ? 0b01 : 0));
+}
+
+/**
+ * @brief Turn an ACK into the DAP response bits
+ */
+static inline uint8_t dap_ack(uint8_t ack) {
+    return ack == SWD_ERR_PARITY ? DAP_TRANSFER_ERROR : ack & 0b111;
+}
+
+static uint32_t dap_info(const uint8_t* req, uint32_t req_len, uint8_t* resp) {
+    const char* str = NULL;
+    if (req_len < 2) {
+        resp[1] = 0;
+        return 2;
+    }
+    switch (req[1]) {
+    case 0x02:
+        str = DAP_PRODUCT;
+        break;
+    case 0x04:
+        str = DAP_FW_VERSION;
+        break;
+    case 0xF0:
+        resp[1] = 1;
+        resp[2] = DAP_CAP_SWD;
+        return 3;
+    case 0xFE:
+        resp[1] = 1;
+        resp[2] = 1;
+        return 3;
+    case 0xFF:
+        resp[1] = 2;
+        resp[2] = DAP_PACKET_SIZE & 0xFF;
+        resp[3] = DAP_PACKET_SIZE >> 8;
+        return 4;
+    default:
+        // Vendor, serial and anything else we don't have
+        resp[1] = 0;
+        return 2;
+    }
+    resp[1] = strlen(str) + 1;
+    memcpy(&resp[2], str, resp[1]);
+    return 2 + resp[1];
+}
+
+/**
+ * @brief DAP_Transfer: a list of DP and AP accesses
+ *
+ * Runs of plain accesses go out as one batch. Reads with value match are
+ * retried up to match_retry times.
+ */
+static uint32_t dap_transfer(const uint8_t* req, uint32_t req_len, uint8_t* resp) {
+    uint32_t pos = 3, out = 3, done = 0, count, n, i;
+    uint8_t ack = 0, flags = 0, r;
+
+    if (req_len < 3) {
+        resp[1] = 0;
+        resp[2] = DAP_TRANSFER_ERROR;
+        return 3;
+    }
+    count = req[2];
+
+    while (done < count) {
+        // Collect plain accesses until a match, running out or filling up
+        uint32_t reads = 0;
+        for (n = 0; done + n < count && n < DAP_MAX_OPS && pos < req_len; ++n) {
+            r = req[pos];
+            if (r & (DAP_TRANSFER_MATCH_VALUE | DAP_TRANSFER_MATCH_MASK)) {
+                break;
+            }
+            if (r & DAP_TRANSFER_RnW) {
+                if (out + 4 * (reads + 1) > DAP_PACKET_SIZE) {
+                    break;
+                }
+                reads++;
+                ops[n].data = 0;
+                pos++;
+            } else {
+                if (pos + 5 > req_len) {
+                    break;
+                }
+                ops[n].data = get_u32(&req[pos + 1]);
+                pos += 5;
+            }
+            ops[n].req = dap_to_swd_req(r);
+        }
+
+        if (n) {
+            ack = swd_transfer_batch(ops, n);
+            for (i = 0; i < n && ops[i].ack == SWD_ACK_OK; ++i) {
+                if (ops[i].req & SWD_REQ_RnW) {
+                    put_u32(&resp[out], ops[i].data);
+                    out += 4;
+                }
+            }
+            done += i;
+            if (ack != SWD_ACK_OK) {
+                break;
+            }
+            continue;
+        }
+
+        if (pos + 5 > req_len || !(req[pos] & (DAP_TRANSFER_MATCH_VALUE | DAP_TRANSFER_MATCH_MASK))) {
+            // Cut short, or no room left for read data
+            ack = 0;
+            flags = DAP_TRANSFER_ERROR;
+            break;
+        }
+        r = req[pos];
+        if (r & DAP_TRANSFER_MATCH_MASK) {
+            match_mask = get_u32(&req[pos + 1]);
+            pos += 5;
+            ack = SWD_ACK_OK;
+            done++;
+            continue;
+        }
+
+        // Read until the masked value matches
+        uint32_t match = get_u32(&req[pos + 1]);
+        uint16_t retry = match_retry;
+        pos += 5;
+        ops[0].req = dap_to_swd_req(r);
+        do {
+            ack = swd_transfer_batch(ops, 1);
+        } while (ack == SWD_ACK_OK && (ops[0].data & match_mask) != match && retry--);
+        if (ack != SWD_ACK_OK) {
+            break;
+        }
+        if ((ops[0].data & match_mask) != match) {
+            flags = DAP_TRANSFER_MISMATCH;
+            break;
+        }
+        done++;
+    }
+
+    resp[1] = done;
+    resp[2] = dap_ack(ack) | flags;
+    return out;
+}
+
+/**
+ * @brief DAP_TransferBlock: the same access to one register many times
+ */
+static uint32_t dap_transfer_block(const uint8_t* req, uint32_t req_len, uint8_t* resp) {
+    uint32_t out = 4, pos = 5, done = 0, count, n, i;
+    uint8_t ack = 0, swd_req;
+
+    if (req_len < 5) {
+        resp[1] = resp[2] = 0;
+        resp[3] = DAP_TRANSFER_ERROR;
+        return 4;
+    }
+    count = get_u16(&req[2]);
+    swd_req = dap_to_swd_req(req[4]);
+
+    // Whatever doesn't fit in the packets is cut off
+    if (swd_req & SWD_REQ_RnW) {
+        if (count > (DAP_PACKET_SIZE - 4) / 4) {
+            count = (DAP_PACKET_SIZE - 4) / 4;
+        }
+    } else if (count > (req_len - 5) / 4) {
+        count = (req_len - 5) / 4;
+    }
+
+    while (done < count) {
+        n = count - done;
+        if (n > DAP_MAX_OPS) {
+            n = DAP_MAX_OPS;
+        }
+        for (i = 0; i < n; ++i) {
+            ops[i].req = swd_req;
+            ops[i].data = (swd_req & SWD_REQ_RnW) ? 0 : get_u32(&req[pos + 4 * i]);
+        }
+        ack = swd_transfer_batch(ops, n);
+        for (i = 0; i < n && ops[i].ack == SWD_ACK_OK; ++i) {
+            if (swd_req & SWD_REQ_RnW) {
+                put_u32(&resp[out], ops[i].data);
+                out += 4;
+            }
+        }
+        done += i;
+        pos += 4 * n;
+        if (ack != SWD_ACK_OK) {
+            break;
+        }
+    }
+
+    resp[1] = done & 0xFF;
+    resp[2] = done >> 8;
+    resp[3] = dap_ack(ack);
+    return out;
+}
+
+/**
+ * @brief DAP_SWJ_Sequence: raw bits on SWDIO, LSB first
+ */
+static uint32_t dap_swj_sequence(const uint8_t* req, uint32_t req_len, uint8_t* resp) {
+    uint32_t bits, i;
+    if (req_len < 2) {
+        resp[1] = DAP_ERROR;
+        return 2;
+    }
+    bits = req[1] ? req[1] : 256;
+    if (req_len < 2 + (bits + 7) / 8) {
+        resp[1] = DAP_ERROR;
+        return 2;
+    }
+    for (i = 0; i < bits; i += 8) {
+        send_data_lsb(req[2 + i / 8], bits - i < 8 ? bits - i : 8);
+    }
+    // Line resets and JTAG-to-SWD switches go through here
+    swd_cache_invalidate();
+    resp[1] = DAP_OK;
+    return 2;
+}
+
+/**
+ * @brief Run one CMSIS-DAP command
+ *
+ * @param req Request packet, starting with the command ID
+ * @param req_len Length of the request packet
+ * @param resp Where the response is built, DAP_PACKET_SIZE bytes
+ *
+ * @return Length of the response
+ */
+uint32_t dap_process(const uint8_t* req, uint32_t req_len, uint8_t* resp) {
+    uint32_t value;
+
+    if (req_len == 0) {
+        return 0;
+    }
+    resp[0] = req[0];
+
+    switch (req[0]) {
+    case ID_DAP_Info:
+        return dap_info(req, req_len, resp);
+    case ID_DAP_HostStatus:
+        if (req_len >= 3 && req[1] == 0) {
+            // Connected LED
+            gpio_put(PICO_DEFAULT_LED_PIN, req[2] & 1);
+        }
+        resp[1] = DAP_OK;
+        return 2;
+    case ID_DAP_Connect:
+        // Only SWD, which is also the default
+        resp[1] = (req_len < 2 || req[1] <= 1) ? 1 : 0;
+        return 2;
+    case ID_DAP_Disconnect:
+        resp[1] = DAP_OK;
+        return 2;
+    case ID_DAP_TransferConfigure:
+        // Idle cycles aren't supported and WAIT retries are swd_transfer()'s
+        if (req_len < 6) {
+            resp[1] = DAP_ERROR;
+            return 2;
+        }
+        match_retry = get_u16(&req[4]);
+        resp[1] = DAP_OK;
+        return 2;
+    case ID_DAP_Transfer:
+        return dap_transfer(req, req_len, resp);
+    case ID_DAP_TransferBlock:
+        return dap_transfer_block(req, req_len, resp);
+    case ID_DAP_TransferAbort:
+        // Transfers always run to completion, nothing to abort
+        return 0;
+    case ID_DAP_WriteABORT:
+        if (req_len < 6) {
+            resp[1] = DAP_ERROR;
+            return 2;
+        }
+        value = get_u32(&req[2]);
+        resp[1] = swd_transfer(DP_WRITE(DP_ABORT), &value) == SWD_ACK_OK ? DAP_OK : DAP_ERROR;
+        return 2;
+    case ID_DAP_Delay:
+        if (req_len >= 3) {
+            busy_wait_us_32(get_u16(&req[1]));
+        }
+        resp[1] = DAP_OK;
+        return 2;
+    case ID_DAP_ResetTarget:
+        // No device specific reset sequence
+        resp[1] = DAP_OK;
+        resp[2] = 0;
+        return 3;
+    case ID_DAP_SWJ_Pins:
+        // The pins belong to the SWD backend, only report them
+        resp[1] = (gpio_get(SWCLK) << 0) | (gpio_get(SWDIO) << 1);
+        return 2;
+    case ID_DAP_SWJ_Clock:
+        if (req_len < 5 || (value = get_u32(&req[1])) == 0) {
+            resp[1] = DAP_ERROR;
+            return 2;
+        }
+        swd_set_clock(value);
+        resp[1] = DAP_OK;
+        return 2;
+    case ID_DAP_SWJ_Sequence:
+        return dap_swj_sequence(req, req_len, resp);
+    case ID_DAP_SWD_Configure:
+        // Only a one cycle turnaround
+        resp[1] = (req_len >= 2 && (req[1] & 0b11) == 0) ? DAP_OK : DAP_ERROR;
+        return 2;
+    default:
+        resp[0] = ID_DAP_Invalid;
+        return 1;
+    }
+}
@@ -5,121 +5,443 @@
  */
 #include "data_transfer.h"
 #include "pico/stdlib.h"
+#include "hardware/structs/sio.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
 #include "macros.h"
 #include "utils.h"
+#include "setup.h"
+#include "swd_pio.h"
+#include "swd_cache.h"
+#include "swd_engine.h"
+#include <string.h>
+
+#define SWCLK_MASK (1u << SWCLK)
+#define SWDIO_MASK (1u << SWDIO)
+
+// Bit-bang clock calibration, see bb_calibrate()
+#define BB_CAL_BITS 8192
+#define BB_CAL_DELAY 64
+
+static swd_backend_t swd_backend = SWD_BACKEND_BITBANG;
+static uint32_t swd_clock_hz = SWD_DEFAULT_FREQ_HZ;
+static uint32_t swd_clock_actual_hz;
+// Set while CTRL/STAT.ORUNDETECT is on, WAIT and FAULT then need a data phase
+static uint8_t swd_data_phase;
+static swd_error_stats_t swd_errors;
+
+// Pins the bit-bang PHY toggles, zeroed while calibrating
+static uint32_t bb_clk_mask = SWCLK_MASK;
+static uint32_t bb_dio_mask = SWDIO_MASK;
+// Extra cycles to wait every half SWCLK period
+static uint32_t bb_half_cycles;
+// Cost of a bit in clk_sys cycles, in 1/16ths: bb_bit_x16 + bb_slope_x16 * 2 * bb_half_cycles
+static uint32_t bb_bit_x16;
+static uint32_t bb_slope_x16;
+
+// ------------------------- BIT-BANG PHY ------------------------- //
 
 /**
- * @brief Read request to DP
+ * @brief Wait half an SWCLK period
+ */
+static inline void bb_half_period() {
+    if (bb_half_cycles) {
+        busy_wait_at_least_cycles(bb_half_cycles);
+    }
+}
+
+/**
+ * @brief Shift bits out on SWDIO, LSB first, through the SIO registers
+ */
+static inline void bb_write_bits(uint32_t data, uint8_t len) {
+    sio_hw->gpio_oe_set = bb_dio_mask;
+    while (len--) {
+        sio_hw->gpio_clr = bb_clk_mask;
+        *((data & 1) ? &sio_hw->gpio_set : &sio_hw->gpio_clr) = bb_dio_mask;
+        data >>= 1;
+        bb_half_period();
+        sio_hw->gpio_set = bb_clk_mask;
+        bb_half_period();
+    }
+}
+
+/**
+ * @brief Shift bits in from SWDIO, LSB first, through the SIO registers
+ */
+static inline uint32_t bb_read_bits(uint8_t len) {
+    uint32_t data = 0;
+    uint8_t i;
+    sio_hw->gpio_oe_clr = bb_dio_mask;
+    for (i = 0; i < len; ++i) {
+        sio_hw->gpio_clr = bb_clk_mask;
+        bb_half_period();
+        // Shift in from the top so each bit costs a shift and an or
+        data = (data >> 1) | (((sio_hw->gpio_in >> SWDIO) & 1) << 31);
+        sio_hw->gpio_set = bb_clk_mask;
+        bb_half_period();
+    }
+    return len ? data >> (32 - len) : 0;
+}
+
+/**
+ * @brief Measure what one bit costs with a given half period delay
  *
- * @param A 2 bits, used to select register
- * @param data Pointer to where data should be read into
- * 
- * @return ACK of request
+ * Runs the write loop with the pin masks zeroed so nothing reaches SWCLK
+ * or SWDIO.
+ *
+ * @param half_cycles Delay to measure with
+ *
+ * @return clk_sys cycles per bit, in 1/16ths
  */
-uint8_t SWD_DP_read(uint8_t A, uint32_t* data) {
-	// Send SWD packet
-    send_swd_packet(0, 1, A);
+static uint32_t bb_measure_bit_x16(uint32_t half_cycles) {
+    uint32_t saved_half_cycles = bb_half_cycles, i;
+    bb_clk_mask = 0;
+    bb_dio_mask = 0;
+    bb_half_cycles = half_cycles;
+
+    uint32_t irq = save_and_disable_interrupts();
+    uint64_t start = time_us_64();
+    for (i = 0; i < BB_CAL_BITS / 32; ++i) {
+        bb_write_bits(0x55555555, 32);
+    }
+    uint64_t elapsed = time_us_64() - start;
+    restore_interrupts(irq);
 
-    // Change GPIO dir of SWDIO to read in ACK
-    gpio_set_dir(SWDIO, GPIO_IN);
+    bb_clk_mask = SWCLK_MASK;
+    bb_dio_mask = SWDIO_MASK;
+    bb_half_cycles = saved_half_cycles;
 
-    // Turnaround cycle while passing control to TARGET
-    single_pulse();
+    return (uint32_t)(elapsed * clock_get_hz(clk_sys) / 1000000 * 16 / BB_CAL_BITS);
+}
 
-    // Read ACK
-    uint8_t ack = read_data(3);
-    // If ACK isn't OK, return Error (indicated by 1)
-    if (ack != 0b001) {
-        return ack;
+/**
+ * @brief Work out how long a bit takes with and without a delay
+ *
+ * Two measurements give the fixed cost of a bit and how much each
+ * busy-wait cycle really adds, so the delay can be solved for exactly.
+ */
+static void bb_calibrate() {
+    bb_bit_x16 = bb_measure_bit_x16(0);
+    uint32_t delayed_x16 = bb_measure_bit_x16(BB_CAL_DELAY);
+    if (delayed_x16 > bb_bit_x16) {
+        bb_slope_x16 = (delayed_x16 - bb_bit_x16) / (2 * BB_CAL_DELAY);
+    }
+    if (bb_slope_x16 == 0) {
+        bb_slope_x16 = 16;
+    }
+}
+
+/**
+ * @brief Solve for the half period delay that gives a frequency
+ *
+ * @param freq_hz Requested SWCLK frequency in Hz
+ *
+ * @return Frequency actually achieved in Hz
+ */
+static uint32_t bb_set_freq(uint32_t freq_hz) {
+    uint64_t sys_hz = clock_get_hz(clk_sys);
+    if (bb_bit_x16 == 0) {
+        bb_calibrate();
     }
+    uint64_t period_x16 = sys_hz * 16 / freq_hz;
+    if (period_x16 <= bb_bit_x16) {
+        bb_half_cycles = 0;
+    } else {
+        bb_half_cycles = (period_x16 - bb_bit_x16 + bb_slope_x16) / (2 * bb_slope_x16);
+    }
+    return (uint32_t)(sys_hz * 16 / (bb_bit_x16 + 2ull * bb_slope_x16 * bb_half_cycles));
+}
 
-    // Read data sent from TARGET
-    *data = read_data(32);
-    // NOTE: Parity isn't being checked so we pulse twice instead of once
-    pulse_clock(2);
+// ------------------------- PHY DISPATCH ------------------------- //
 
-    gpio_set_dir(SWDIO, GPIO_OUT);
-    gpio_put(SWDIO, 1);
+static inline void phy_write_bits(uint32_t data, uint8_t len) {
+    if (swd_backend == SWD_BACKEND_PIO) {
+        swd_pio_write_bits(data, len);
+    } else {
+        bb_write_bits(data, len);
+    }
+}
 
-    return ack;
+static inline uint32_t phy_read_bits(uint8_t len) {
+    if (swd_backend == SWD_BACKEND_PIO) {
+        return swd_pio_read_bits(len);
+    }
+    return bb_read_bits(len);
 }
 
+// ------------------------- MAIN INTERFACE ------------------------- //
+
 /**
- * @brief Write request to DP
- * 
- * @param A 2 bit register selector
- * @param data Data to be written
+ * @brief Put a single transaction on the wire
  *
- * @return ACK of request
+ * Header, turnaround, ACK, data and parity are each shifted as one phase.
  */
-uint8_t SWD_DP_write(uint8_t A, uint32_t data) {
-    // Calculate data parity for later
-    uint8_t data_parity = calc_parity(data);
+static uint8_t transfer_once(uint8_t req, uint32_t* data) {
+    if (swd_backend == SWD_BACKEND_PIO && swd_data_phase) {
+        // Every transaction has the same shape, let PIO run it without stopping
+        uint8_t ack;
+        swd_pio_transfer_stream(&req, data, &ack, 1);
+        return ack;
+    }
 
-	// Send SWD packet
-    send_swd_packet(0, 0, A);
+    phy_write_bits(swd_req_headers[req & 0xF], 8);
+
+    // Turnaround cycle while passing control to TARGET, then ACK
+    uint8_t ack = (phy_read_bits(4) >> 1) & 0b111;
+    if (ack != SWD_ACK_OK) {
+        uint8_t data_phase = swd_data_phase && (ack == SWD_ACK_WAIT || ack == SWD_ACK_FAULT);
+        if (data_phase && (req & SWD_REQ_RnW)) {
+            // Dummy data and parity
+            phy_read_bits(32);
+            phy_read_bits(1);
+        }
+        turnaround();
+        if (data_phase && !(req & SWD_REQ_RnW)) {
+            phy_write_bits(0, 32);
+            phy_write_bits(0, 1);
+        }
+        take_swdio();
+        return ack;
+    }
 
-    // Change GPIO dir of SWDIO to read in ACK
-    gpio_set_dir(SWDIO, GPIO_IN);
+    if (req & SWD_REQ_RnW) {
+        // Read data sent from TARGET, then parity and the turnaround back
+        // to HOST together
+        *data = phy_read_bits(32);
+        uint32_t parity = phy_read_bits(2) & 1;
+        take_swdio();
+        return parity == calc_parity(*data) ? ack : SWD_ERR_PARITY;
+    } else {
+        // Turnaround cycle for control to return back to HOST
+        phy_read_bits(1);
+        phy_write_bits(*data, 32);
+        phy_write_bits(calc_parity(*data), 1);
+    }
 
-    // Turnaround cycle while passing control to TARGET
-    single_pulse();
+    take_swdio();
+    return ack;
+}
 
-    // Read ACK
-    uint8_t ack = read_data(3);
-    // If ACK isn't OK, return Error (indicated by 1)
-    if (ack != 0b001) {
+/**
+ * @brief Run a single SWD transaction
+ *
+ * Writes that wouldn't change SELECT, CSW or TAR are dropped without
+ * touching the wire, see swd_cache.h.
+ *
+ * Once the SWD engine is running, calls from core0 are run on core1.
+ *
+ * @param req Request built with SWD_REQ()
+ * @param data Data to write, or where read data is stored
+ *
+ * @return ACK of request, or SWD_ERR_PARITY
+ */
+uint8_t swd_transfer(uint8_t req, uint32_t* data) {
+    uint32_t backoff_us = 1;
+    uint8_t ack, tries, parity_tries = 0;
+
+    if (swd_engine_forward()) {
+        swd_op_t op = { .req = req, .data = *data };
+        ack = swd_engine_run(&op, 1, 1);
+        *data = op.data;
         return ack;
     }
 
-    // Turnaround cycle for control to return back to HOST
-    single_pulse();
+    if (!(req & SWD_REQ_RnW) && swd_cache_write_redundant(req, *data)) {
+        return SWD_ACK_OK;
+    }
 
-    // Send data to target
-    send_data_lsb(data, 32);
-    send_data(data_parity, 1);
+    for (tries = 0; ; ++tries) {
+        ack = transfer_once(req, data);
+        swd_count_error(ack);
+        if (ack == SWD_ACK_OK || ack == SWD_ACK_FAULT) {
+            break;
+        }
+        if (ack == SWD_ERR_PARITY) {
+            // Reading a DP register again changes nothing, not even RDBUFF
+            if (!(req & SWD_REQ_APnDP) && parity_tries++ < SWD_PARITY_RETRIES) {
+                continue;
+            }
+            break;
+        }
+        if (ack != SWD_ACK_WAIT) {
+            // No ACK or garbage: the TARGET lost track of the protocol.
+            // Resync once and try again.
+            if (tries) {
+                break;
+            }
+            swd_resync();
+            continue;
+        }
+        if (tries >= SWD_WAIT_RETRIES) {
+            // Give up on the stalled AP transaction so the DP is usable
+            uint32_t abort = ABORT_DAPABORT;
+            transfer_once(DP_WRITE(DP_ABORT), &abort);
+            swd_cache_invalidate();
+            return ack;
+        }
+        if (swd_data_phase) {
+            // With overrun detection a WAIT also sets STICKYORUN
+            uint32_t abort = ABORT_ORUNERRCLR;
+            transfer_once(DP_WRITE(DP_ABORT), &abort);
+        }
+        busy_wait_us_32(backoff_us);
+        if (backoff_us < SWD_WAIT_BACKOFF_MAX_US) {
+            backoff_us <<= 1;
+        }
+    }
 
-    gpio_set_dir(SWDIO, GPIO_OUT);
-    gpio_put(SWDIO, 1);
+    swd_cache_update(req, *data, ack);
+    if (ack == SWD_ACK_OK && req == DP_WRITE(DP_CTRL_STAT)) {
+        // Whoever wrote CTRL/STAT decided whether overrun detection is on
+        swd_data_phase = (*data & CTRL_STAT_ORUNDETECT) != 0;
+    }
+    if (ack == SWD_ACK_FAULT) {
+        // The access didn't happen, clear the sticky flag so the next one can
+        swd_clear_errors();
+    }
+    return ack;
+}
 
+/**
+ * @brief Clear sticky errors through DP ABORT
+ *
+ * Clears STICKYERR, STICKYCMP, STICKYORUN and WDATAERR, and forgets the
+ * shadowed SELECT, CSW and TAR.
+ *
+ * @return ACK of the ABORT write
+ */
+uint8_t swd_clear_errors() {
+    uint32_t abort = ABORT_CLEAR_ALL;
+    uint8_t ack = transfer_once(DP_WRITE(DP_ABORT), &abort);
+    swd_cache_invalidate();
     return ack;
 }
 
 /**
- * @brief Read request to AP
+ * @brief Count a transfer that didn't ACK OK
  *
- * @param A 2 bits, used to select register
- * @param data Pointer to where data should be read into
- * 
- * @return ACK of request
+ * swd_transfer() counts its own, this is for transactions that bypass it.
+ *
+ * @param ack ACK of the transfer, or SWD_ERR_PARITY
  */
-uint8_t SWD_AP_read(uint8_t A, uint32_t* data) {
-	// Send SWD packet
-    send_swd_packet(1, 1, A);
+void swd_count_error(uint8_t ack) {
+    switch (ack) {
+    case SWD_ACK_OK:
+        break;
+    case SWD_ACK_WAIT:
+        swd_errors.wait++;
+        break;
+    case SWD_ACK_FAULT:
+        swd_errors.fault++;
+        break;
+    case SWD_ERR_PARITY:
+        swd_errors.parity++;
+        break;
+    default:
+        swd_errors.no_ack++;
+        break;
+    }
+}
+
+/**
+ * @brief Get the transfer error counters
+ *
+ * @return Pointer to the counters
+ */
+const swd_error_stats_t* swd_get_error_stats() {
+    return &swd_errors;
+}
 
-    // Change GPIO dir of SWDIO to read in ACK
-    gpio_set_dir(SWDIO, GPIO_IN);
+/**
+ * @brief Zero the transfer error counters
+ */
+void swd_reset_error_stats() {
+    memset(&swd_errors, 0, sizeof(swd_errors));
+}
 
-    // Turnaround cycle while passing control to TARGET
-    single_pulse();
+/**
+ * @brief Line reset and IDCODE read to get back in step with the TARGET
+ *
+ * @return ACK of the IDCODE read
+ */
+uint8_t swd_resync() {
+    uint32_t idcode;
+    phy_write_bits(0xFFFFFFFF, 32);
+    phy_write_bits(0x0003FFFF, 18);
+    phy_write_bits(0, 12);
+    take_swdio();
+    swd_cache_invalidate();
+    return transfer_once(DP_READ(DP_IDCODE), &idcode);
+}
 
-    // Read ACK
-    uint8_t ack = read_data(3);
-    // If ACK isn't OK, return Error (indicated by 1)
-    if (ack != 0b001) {
-        if (ack == 0b010) single_pulse();
+/**
+ * @brief Turn CTRL/STAT.ORUNDETECT on or off
+ *
+ * With overrun detection on, every transaction has the same shape whatever
+ * the ACK, so transactions can be queued without waiting for each ACK. An
+ * error sets STICKYORUN and the rest of the queue is ignored by the TARGET.
+ *
+ * @param enable 1 to turn overrun detection on
+ *
+ * @return ACK of request
+ */
+uint8_t swd_set_overrun_detect(uint8_t enable) {
+    uint32_t ctrl_stat;
+    uint8_t ack = swd_transfer(DP_READ(DP_CTRL_STAT), &ctrl_stat);
+    if (ack != SWD_ACK_OK) {
         return ack;
     }
+    // Keep the power up requests, drop the write-to-clear status bits
+    ctrl_stat &= 0xF0000F00;
+    if (enable) {
+        ctrl_stat |= CTRL_STAT_ORUNDETECT;
+    }
+    return swd_transfer(DP_WRITE(DP_CTRL_STAT), &ctrl_stat);
+}
 
-    // Read data sent from TARGET
-    *data = read_data(32);
-    // NOTE: Parity isn't being checked so we pulse twice instead of once
-    pulse_clock(2);
+/**
+ * @brief Whether CTRL/STAT.ORUNDETECT is on
+ *
+ * @return 1 if overrun detection is on
+ */
+uint8_t swd_get_overrun_detect() {
+    return swd_data_phase;
+}
 
-    gpio_set_dir(SWDIO, GPIO_OUT);
-    gpio_put(SWDIO, 1);
+/**
+ * @brief Read request to DP
+ *
+ * @param A 2 bits, used to select register
+ * @param data Pointer to where data should be read into
+ * 
+ * @return ACK of request
+ */
+uint8_t SWD_DP_read(uint8_t A, uint32_t* data) {
+    return swd_transfer(SWD_REQ(0, 1, A), data);
+}
 
-    return ack;
+/**
+ * @brief Write request to DP
+ * 
+ * @param A 2 bit register selector
+ * @param data Data to be written
+ *
+ * @return ACK of request
+ */
+uint8_t SWD_DP_write(uint8_t A, uint32_t data) {
+    return swd_transfer(SWD_REQ(0, 0, A), &data);
+}
+
+/**
+ * @brief Read request to AP
+ *
+ * @param A 2 bits, used to select register
+ * @param data Pointer to where data should be read into
+ * 
+ * @return ACK of request
+ */
+uint8_t SWD_AP_read(uint8_t A, uint32_t* data) {
+    return swd_transfer(SWD_REQ(1, 1, A), data);
 }
 
 /**
@@ -131,80 +453,117 @@ uint8_t SWD_AP_read(uint8_t A, uint32_t* data) {
  * @return ACK of request
  */
 uint8_t SWD_AP_write(uint8_t A, uint32_t data) {
-    // Calculate data parity
-    uint8_t data_parity = calc_parity(data);
-
-	// Send SWD packet
-    send_swd_packet(1, 0, A);
-
-    // Change GPIO dir of SWDIO to read in ACK
-    gpio_set_dir(SWDIO, GPIO_IN);
+    return swd_transfer(SWD_REQ(1, 0, A), &data);
+}
 
-    // Turnaround cycle while passing control to TARGET
-    single_pulse();
+// ------------------------- BACKEND ------------------------- //
 
-    // Read ACK
-    uint8_t ack = read_data(3);
-    // If ACK isn't OK, return Error (indicated by 1)
-    if (ack != 0b001) {
-        return ack;
+/**
+ * @brief Select which backend clocks SWCLK and SWDIO
+ *
+ * Hands the pins over to PIO or back to plain GPIO. SWD should be
+ * reinitialized after switching.
+ *
+ * @param backend SWD_BACKEND_PIO or SWD_BACKEND_BITBANG
+ */
+void swd_select_backend(swd_backend_t backend) {
+    if (backend == SWD_BACKEND_PIO) {
+        swd_pio_init(swd_clock_hz);
+    } else {
+        swd_pio_deinit();
+        pin_setup();
     }
+    swd_backend = backend;
+    swd_set_clock(swd_clock_hz);
+    swd_cache_invalidate();
+}
 
-    // Turnaround cycle for control to return back to HOST
-    single_pulse();
-
-    // Send data to target
-    send_data_lsb(data, 32);
-    send_data(data_parity, 1);
+/**
+ * @brief Get the backend currently clocking SWD
+ *
+ * @return Current backend
+ */
+swd_backend_t swd_get_backend() {
+    return swd_backend;
+}
 
-	// Set GPIO dir back to out
-    gpio_set_dir(SWDIO, GPIO_OUT);
-    gpio_put(SWDIO, 1);
+/**
+ * @brief Set the SWCLK frequency of the current backend
+ *
+ * The request is kept and reapplied when the backend changes. Requests
+ * outside SWD_MIN_FREQ_HZ to SWD_MAX_FREQ_HZ are clamped, and anything above
+ * what the backend can do runs at its fastest.
+ *
+ * @param freq_hz Requested SWCLK frequency in Hz
+ *
+ * @return Frequency actually achieved in Hz
+ */
+uint32_t swd_set_clock(uint32_t freq_hz) {
+    if (freq_hz < SWD_MIN_FREQ_HZ) {
+        freq_hz = SWD_MIN_FREQ_HZ;
+    } else if (freq_hz > SWD_MAX_FREQ_HZ) {
+        freq_hz = SWD_MAX_FREQ_HZ;
+    }
+    swd_clock_hz = freq_hz;
+    if (swd_backend == SWD_BACKEND_PIO) {
+        swd_clock_actual_hz = swd_pio_set_freq(freq_hz);
+    } else {
+        swd_clock_actual_hz = bb_set_freq(freq_hz);
+    }
+    return swd_clock_actual_hz;
+}
 
-    return ack;
+/**
+ * @brief Get the SWCLK frequency the current backend is running at
+ *
+ * @return Achieved frequency in Hz
+ */
+uint32_t swd_get_clock() {
+    return swd_clock_actual_hz;
 }
 
+// ------------------------- HELPERS ------------------------- //
+
 /**
  * @brief Send a single clock pulse
  */
 void single_pulse() {
-    gpio_put(SWCLK, 0);
-    sleep_us(CLOCK_DELAY);
-    gpio_put(SWCLK, 1);
-    sleep_us(CLOCK_DELAY);
+    pulse_clock(1);
 }
 
 /**
- * @prief Pulse the clock a certain number of times
+ * @prief Pulse the clock a certain number of times with SWDIO released
  * 
  * Useful for resetting DP
  */
 void pulse_clock(uint32_t num_pulses) {
-    uint32_t i;
-    for (i = 0; i < num_pulses; ++i) {
-        gpio_put(SWCLK, 0);
-        sleep_us(CLOCK_DELAY);
-        gpio_put(SWCLK, 1);
-        sleep_us(CLOCK_DELAY);
+    for (; num_pulses > 32; num_pulses -= 32) {
+        phy_read_bits(32);
+    }
+    if (num_pulses) {
+        phy_read_bits(num_pulses);
     }
 }
 
 /**
- * @brief Sends data while pulsing clock
- * 
- * @param data Data to be sent
- * @param len Length of data in bits
+ * @brief Release SWDIO and pulse the clock once
+ *
+ * Gives the TARGET a cycle to take control of SWDIO, or to give it back.
  */
-void send_data(uint16_t data, uint8_t len) {
-    gpio_set_dir(SWDIO, GPIO_OUT);
-    int8_t pos;
-    for (pos = len - 1; pos >= 0; --pos) {
-        gpio_put(SWCLK, 0);
-        gpio_put(SWDIO, ((data & (1 << pos)) >> pos));
-        sleep_us(CLOCK_DELAY);
-        gpio_put(SWCLK, 1);
-        sleep_us(CLOCK_DELAY);
+void turnaround() {
+    phy_read_bits(1);
+}
+
+/**
+ * @brief Take back control of SWDIO and idle it high
+ */
+void take_swdio() {
+    if (swd_backend == SWD_BACKEND_PIO) {
+        // Direction is part of every PIO command, nothing to do
+        return;
     }
+    sio_hw->gpio_set = SWDIO_MASK;
+    sio_hw->gpio_oe_set = SWDIO_MASK;
 }
 
 /**
@@ -213,20 +572,11 @@ void send_data(uint16_t data, uint8_t len) {
  * SWD protocol uses little endian, so this is used frequently.
  *
  * @param data Data to be sent
- * @param len Length of data in bits
+ * @param len Length of data in bits, max 32
  */
 void send_data_lsb(uint32_t data, uint8_t len) {
-    gpio_set_dir(SWDIO, GPIO_OUT);
-    int i;
-    for (i = 0; i < len; ++i) {
-        gpio_put(SWCLK, 0);
-        gpio_put(SWDIO, data & 1);
-        data >>= 1;
-        sleep_us(CLOCK_DELAY);
-        gpio_put(SWCLK, 1);
-        sleep_us(CLOCK_DELAY);
-    }
-    gpio_put(SWDIO, 1);
+    phy_write_bits(data, len);
+    take_swdio();
 }
 
 /**
@@ -239,75 +589,5 @@ uint32_t read_data(uint8_t len) {
 		error("Attempt to read data larger than 32 bits");
 		return 0;
 	}
-    gpio_set_dir(SWDIO, GPIO_IN);
-    uint32_t data = 0;
-    int8_t pos;
-    for (pos = 0; pos < len; ++pos) {
-        gpio_put(SWCLK, 0);
-        sleep_us(CLOCK_DELAY);
-        data |= (gpio_get(SWDIO) << pos);
-        gpio_put(SWCLK, 1);
-        sleep_us(CLOCK_DELAY);
-    }
-    return data;
-}
-
-/**
- * @brief Creates an swd packet
- *
- * Automatically calculates parity
- * 
- * @param APnDP 1 bit, selects AP or DP. 0 for DP, 1 for AP.
- * @param RnW 1 bit, selects a read or write request. 0 for write, 1 for read.
- * @param A 2 bit register selector (for most types of requests).
- */
-swd_req_t create_swd_packet(uint8_t APnDP, uint8_t RnW, uint8_t A) {
-    // For calculating parity
-    uint8_t num_1s = 0;
-    num_1s += APnDP;
-    num_1s += RnW;
-    num_1s += ((A & (1 << 1)) >> 1) + (A & 1);
-
-    swd_req_t packet = {
-        .start = 1,
-        .APnDP = APnDP,
-        .RnW = RnW,
-        .A = A,
-        .parity = num_1s % 2,
-        .stop = 0,
-        .park = 1,
-    };
-
-    return packet;
-}
-
-/**
- * @brief Converts an swd_req_t into a binary format
- *
- * @param swd_req_t An SWD request struct
- * @return The request packet in binary 
- */
-uint8_t conv_swd_packet_to_bin(swd_req_t packet) {
-    uint8_t data = 0;
-    data |= (packet.start << 7);
-    data |= (packet.APnDP << 6);
-    data |= (packet.RnW << 5);
-    data |= (packet.A << 3);
-    data |= (packet.parity << 2);
-    data |= (packet.stop << 1);
-    data |= (packet.park << 0);
-    return data;
-}
-
-/**
- * @brief Creates an SWD packet and sends it over SWDIO
- * 
- * @param APnDP 1 bit, selects AP or DP. 0 for DP, 1 for AP.
- * @param RnW 1 bit, selects a read or write request. 0 for write, 1 for read.
- * @param A 2 bit register selector (for most types of requests).
- */
-void send_swd_packet(uint8_t APnDP, uint8_t RnW, uint8_t A) {
-    swd_req_t packet = create_swd_packet(APnDP, RnW, A);
-    uint8_t data = conv_swd_packet_to_bin(packet);
-    send_data(data, 8);
+    return phy_read_bits(len);
 }
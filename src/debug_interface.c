@@ -9,38 +9,84 @@
 #include "macros.h"
 #include "utils.h"
 #include "data_transfer.h"
+#include "swd_batch.h"
+#include "swd_cache.h"
+#include "core.h"
+#include "breakpoint.h"
+#include "watchpoint.h"
+#include "jobs.h"
+#include "pico/time.h"
 #include <stdio.h>
 #include <string.h>
 
 #include "blink_bin.h"
 #include "simple_bin.h"
 
+// Set once the console lets the core run, so poll_halt() knows to watch it
+static uint8_t core_running;
+
 /**
  * @brief Print help menu
  */
 uint8_t show_help() {
     printf("DEBUG HELP:\n\n");
-    printf("    init - Initialize SWD Debug (Must be run first)\n");
+    printf("    init [auto] - Initialize SWD Debug (Must be run first), auto finds the fastest SWCLK\n");
     printf("    status - Show debug status\n");
     printf("    halt - Halt core\n");
     printf("    reset - Reset core\n");
-    printf("    step - Single step\n");
-    printf("    load - Load file and initialize execution\n");
+    printf("    step [count] - Single step, or step count times on the probe and print the PCs\n");
+    printf("    step until <address> - step on the probe until the PC reaches address\n");
+    printf("    step while <start> <end> - step on the probe while the PC is in [start, end)\n");
+    printf("    step trace - print the PCs from the last step\n");
     printf("    pc - read current pc\n");
-    printf("    load [program] - load precompiled program\n");
-    printf("    set <address> <value> - set a memory address\n");
-    printf("    read <address> - set a value from memory address\n");
+    printf("    load [program] - load precompiled program in the background\n");
+    printf("    set <address> <value> [8|16|32] - set a memory address\n");
+    printf("    read <address> [8|16|32] [count] - read values from memory address\n");
+    printf("    backend [pio|bitbang] - show or switch how SWD is clocked\n");
+    printf("    bench [count] - time back to back SWD reads\n");
+    printf("    clock [hz] - show or set the SWCLK frequency\n");
+    printf("    stats [reset] - show or reset SWD traffic counters\n");
+    printf("    overrun [on|off] - pipeline transfers without waiting for each ACK\n");
+    printf("    proto - switch to the binary host protocol, see proto.h\n");
+    printf("    gdb - serve GDB on this port until it detaches, GDB can also use the host port\n");
+    printf("    jobs - show background jobs, Ctrl-C cancels them\n");
+    printf("    break <address> - stop when the core reaches address, using the FPB\n");
+    printf("    delete [address] - remove a breakpoint, or all of them\n");
+    printf("    watch <address> [len] [r|w|rw] [value] - stop when the core accesses memory, using the DWT\n");
+    printf("    unwatch [address] - remove a watchpoint, or all of them\n");
+    printf("    profile <ms> [hz] [bucket] - sample the PC of the running core, histogram goes to the stream port\n");
+    printf("    swo start <trace hz> [baud] [pc] - capture SWO trace to the stream port\n");
+    printf("    swo [stop|raw|decode] - show counters, stop, or pass trace on raw or decoded\n");
+    printf("    rtt start [address] [size] [channel] - log the TARGET's RTT channel to the stream port\n");
+    printf("    rtt [stop] - show counters, or stop\n");
+    printf("    info reg|break|watch - show every core register, the breakpoints or the watchpoints\n");
+    return 0;
 }
 
-uint8_t debug_initialize_swd() {
+/**
+ * @brief Attach to the TARGET over SWD
+ *
+ * Usage: init [auto]
+ *
+ * With auto, the fastest working SWCLK frequency is searched for first and
+ * the link is left running with a safety margin below it.
+ *
+ * @return ACK from SWD request
+ */
+uint8_t debug_initialize_swd(char** args, uint8_t num_args) {
     uint8_t ack;
-    initialize_swd();
-    ack = setup_dp_and_mem_ap();
+    if (num_args == 2 && !strcmp(args[1], "auto")) {
+        ack = negotiate_swd_clock() ? SWD_ACK_OK : SWD_ACK_FAULT;
+    } else {
+        initialize_swd();
+        ack = setup_dp_and_mem_ap();
+    }
     if (ack == 0b001) {
-        printf("Debug initialized\n");
+        printf("Debug initialized at %u Hz\n", swd_get_clock());
     } else {
         error("Debug unable to initialize");
     }
+    return ack;
 }
 
 /**
@@ -64,7 +110,7 @@ uint8_t show_debug_status() {
     } else {
         printf("Core currently running\n");
     }
-    delay();
+    return ack;
 }
 
 /**
@@ -74,15 +120,32 @@ uint8_t show_debug_status() {
  */
 uint8_t halt_core() {
     uint8_t ack;
-    uint32_t data;
-    ack = mem_write(CORE_DHCSR, 0xa05f0003);
-    CHECK_ACK_RT("Failed halting core");
-    ack = mem_read(CORE_DHCSR, &data);
-    if (data & (1 << 17)) {
-        printf("Core successfully halted\n");
-    } else {
-        error("Halt failed");
+    ack = core_halt();
+    CHECK_ACK_RT("Halt failed");
+    core_running = 0;
+    printf("Core successfully halted\n");
+    return ack;
+}
+
+/**
+ * @brief Find the breakpoint a halted core is sitting on
+ *
+ * @return Comparator number, or BP_MAX if there is none
+ */
+static uint8_t breakpoint_at_pc() {
+    uint32_t pc, addr;
+    uint8_t i;
+    // No need to read the PC without any breakpoints
+    for (i = 0; i < BP_MAX && !bp_get(i, &addr); ++i);
+    if (i == BP_MAX || core_reg_read(CORE_REGSEL_PC, &pc) != SWD_ACK_OK) {
+        return BP_MAX;
     }
+    for (i = 0; i < BP_MAX; ++i) {
+        if (bp_get(i, &addr) && addr == pc) {
+            return i;
+        }
+    }
+    return BP_MAX;
 }
 
 /**
@@ -92,13 +155,16 @@ uint8_t halt_core() {
  */
 uint8_t continue_core() {
     uint8_t ack;
-    uint32_t data;
-    ack = mem_write(CORE_DHCSR, 0xa05f0000);
-    CHECK_ACK_RT("Failed continuing core");
-    ack = mem_read(CORE_DHCSR, &data);
-    if (data & (1 << 17)) {
-        error("Continue failed");
+    if (breakpoint_at_pc() != BP_MAX) {
+        // Get off the breakpoint first, or the core halts right away
+        ack = core_step();
+        CHECK_ACK_RT("Failed stepping off breakpoint");
     }
+    ack = core_continue();
+    CHECK_ACK_RT("Failed continuing core");
+    // A core that halts again right away is reported by poll_halt()
+    core_running = 1;
+    return ack;
 }
 
 /**
@@ -108,21 +174,11 @@ uint8_t continue_core() {
  */
 uint8_t reset_core() {
     uint8_t ack;
-    uint32_t data;
-
-    // Enable halt on reset
-    ack = mem_write(CORE_DEMCR, 0x00000001);
-    CHECK_ACK_RT("Failed enabling halt on reset");
-
-    // Reset core by writing to NVIC AIRCR
-    ack = mem_write(NVIC_AIRCR, 0x0afa0004);
-    CHECK_ACK_RT("Failed writing to NVIC.AIRCR");
-
-    // Check status
-    ack = mem_read(CORE_DHCSR, &data);
-    CHECK_ACK_RT("Failed reading status after reset");
-
+    ack = core_reset_halt();
+    CHECK_ACK_RT("Failed resetting core");
+    core_running = 0;
     printf("Successfully reset core\n");
+    return ack;
 }
 
 /**
@@ -135,89 +191,218 @@ uint8_t reset_core() {
 uint8_t read_pc() {
     uint8_t ack;
     uint32_t data;
-    ack = mem_write(0xe000edf4, ((0 << 16) | 0x0F));
-    CHECK_ACK_RT("DCRSR write");
-    ack = mem_read(0xe000edf8, &data);
-    CHECK_ACK_RT("DCRDR read");
+    ack = core_reg_read(0x0F, &data);
+    CHECK_ACK_RT("Failed reading PC");
     printf("PC: 0x%.8x\n", data);
     return ack;
 }
 
+typedef enum {
+    STEP_COUNT,
+    STEP_UNTIL,
+    STEP_WHILE,
+} step_mode_t;
+
+// What the step job is stepping for, and every PC it stepped through
+static job_t step_job;
+static step_mode_t step_mode;
+static uint32_t step_lo, step_hi;
+static uint32_t step_trace[STEP_TRACE_LEN];
+static uint32_t step_count;
+
 /**
- * @brief Performs a single step of instruction
+ * @brief Print the PCs the last step job went through, oldest first
  *
- * @return ACK from SWD request
+ * Only the last STEP_TRACE_LEN are kept.
  */
-uint8_t single_step() {
-    uint32_t data; uint8_t ack;
-    ack = mem_write(CORE_DHCSR, 0xa05f0005);
-    CHECK_ACK_RT("Failed single stepping");
-    delay();
-    read_pc();
-    delay();
-    return ack;
+static void print_step_trace() {
+    uint32_t first = step_count > STEP_TRACE_LEN ? step_count - STEP_TRACE_LEN : 0;
+    uint32_t i;
+    if (first) {
+        printf("(%u earlier steps dropped)\n", first);
+    }
+    for (i = first; i < step_count; ++i) {
+        printf("%s0x%.8x", (i - first) % 8 ? " " : "", step_trace[i & (STEP_TRACE_LEN - 1)]);
+        if ((i - first) % 8 == 7 || i + 1 == step_count) {
+            printf("\n");
+        }
+    }
 }
 
 /**
- * @brief Verify written file integrity
- *
- * @param bin_arr Hex dump array of program
- * @param bin_len Length of array
+ * @brief Whether the step job should stop at this PC
+ */
+static uint8_t step_finished(uint32_t pc) {
+    switch (step_mode) {
+    case STEP_COUNT:
+        return step_count == step_job.total;
+    case STEP_UNTIL:
+        return pc == step_lo;
+    case STEP_WHILE:
+        return pc < step_lo || pc >= step_hi;
+    }
+    return 1;
+}
+
+/**
+ * @brief One step of the step job: STEP_BATCH instructions
  *
- * @return ACK from SWD request
+ * Each instruction is a single SWD batch that steps and reads back the PC,
+ * nothing is printed until the job is over.
  */
-uint8_t verify_file(unsigned char* bin_arr, unsigned int bin_len) {
-    uint32_t data; uint8_t ack;
-
-    ack = SWD_AP_write(0b10, 0x20000000);
-    CHECK_ACK_RT("Failed writing target address");
-    delay();
-
-    uint32_t word, index = 0;
-    ack = SWD_AP_read(0b11, &word);
-    ack = SWD_AP_read(0b11, &word); // HACK: Why does reading twice make it work?
-    for (index = 0; index < bin_len; index += 4) {
-        ack = SWD_AP_read(0b11, &word);
-        CHECK_ACK_RT("Failed reading SRAM");
-        if (word != *(uint32_t *)&bin_arr[index]) {
-            error("Verification failed");
-            printf("At index: %d\n", index);
-            printf("0x%.8x != 0x%.8x\n", word, *(uint32_t *)&bin_arr[index]);
-            return 0b100;
+static job_status_t step_step(job_t* job) {
+    uint64_t elapsed;
+    uint32_t pc, i;
+    uint8_t ack;
+
+    for (i = 0; i < STEP_BATCH; ++i) {
+        ack = core_step_pc(&pc);
+        CHECK_ACK_GT("Failed single stepping");
+        step_trace[step_count++ & (STEP_TRACE_LEN - 1)] = pc;
+        job->done = step_count;
+        if (step_finished(pc)) {
+            break;
         }
     }
-    printf("Verification success\n");
+    if (i == STEP_BATCH) {
+        return JOB_RUNNING;
+    }
+
+    elapsed = time_us_64() - job->start_us;
+    if (elapsed == 0) {
+        elapsed = 1;
+    }
+    printf("\r\033[K");
+    print_step_trace();
+    job_printf(job, "%u steps in %u us (%u steps/s), PC: 0x%.8x", step_count, (uint32_t)elapsed,
+               (uint32_t)((uint64_t)step_count * 1000000 / elapsed), pc);
+    return JOB_DONE;
+LOOP:
+    return JOB_FAILED;
 }
 
 /**
- * @brief Write file to RAM, set PC, and reset TARGET
+ * @brief Step instructions on the probe, recording every PC
  *
- * @param bin_arr Hex dump array of program
- * @param bin_len Length of array
+ * Usage: step [count]
+ *        step until <address>
+ *        step while <start> <end>
+ *        step trace
  *
- * @return ACK from SWD request
+ * A plain step steps once and prints the PC. Anything longer runs as a
+ * background job that records the PCs and prints them when it stops.
+ * while keeps stepping as long as the PC is in [start, end). trace prints
+ * the PCs from the last job again, including one that was cancelled.
+ *
+ * @return ACK from SWD request, or 1 for bad arguments
  */
-uint8_t load_file(unsigned char* bin_arr, unsigned int bin_len) {
-    uint32_t data; uint8_t ack;
-    
-    // Enable auto increment
-    ack = SWD_AP_write(0b00, 0x22000012);
-    CHECK_ACK_RT("Error setting auto increment");
-    delay();
+uint8_t single_step(char** args, uint8_t num_args) {
+    step_mode_t mode = STEP_COUNT;
+    uint32_t lo = 0, hi = 0;
+    uint8_t ack;
+    int32_t n = 1;
 
-    // Write Target Address
-    ack = SWD_AP_write(0b10, 0x20000000);
-    CHECK_ACK_RT("Error writing target address");
-    delay();
+    if (num_args == 2 && !strcmp(args[1], "trace")) {
+        print_step_trace();
+        return 0;
+    }
+    if (num_args == 3 && !strcmp(args[1], "until")) {
+        mode = STEP_UNTIL;
+        if (parse_str_to_hex(args[2], &lo)) {
+            error("Address should be 0x followed by 8 hex digits");
+            return 1;
+        }
+        n = 0;
+    } else if (num_args == 4 && !strcmp(args[1], "while")) {
+        mode = STEP_WHILE;
+        if (parse_str_to_hex(args[2], &lo) || parse_str_to_hex(args[3], &hi)) {
+            error("Address should be 0x followed by 8 hex digits");
+            return 1;
+        }
+        n = 0;
+    } else if (num_args == 2) {
+        n = str_to_int(args[1]);
+    } else if (num_args != 1) {
+        n = -1;
+    }
+    if (n < 0 || (n == 0 && mode == STEP_COUNT)) {
+        printf("Incorrect format. Format should be:\n");
+        printf("step [count] | step until <address> | step while <start> <end> | step trace\n");
+        return 1;
+    }
+    // The job reads its stop condition on every step, and owns the core
+    if (step_job.active) {
+        error("Already stepping");
+        return 1;
+    }
 
-    uint32_t word, index = 0;
-    for (; index < bin_len; index += 4) {
-        word = *(uint32_t *)&bin_arr[index];
-        ack = SWD_AP_write(0b11, word);
-        printf("CODE : %x 0x%.8x\n", index, word);
-        CHECK_ACK_RT("Error in writing code");
-        delay();
+    if (n == 1) {
+        ack = core_step();
+        CHECK_ACK_RT("Failed single stepping");
+        core_running = 0;
+        return read_pc();
+    }
+
+    step_job.name = "step";
+    step_job.step = step_step;
+    step_job.done = 0;
+    // Only a count knows how far it has to go
+    step_job.total = n;
+    if (!job_start(&step_job)) {
+        error("Too many jobs running");
+        return 1;
+    }
+    step_mode = mode;
+    step_lo = lo;
+    step_hi = hi;
+    step_count = 0;
+    core_running = 0;
+    return 0;
+}
+
+/**
+ * @brief Say which breakpoint or watchpoint the core stopped on, if any
+ */
+static void print_breakpoint_hit() {
+    uint8_t i = breakpoint_at_pc();
+    uint32_t addr;
+    wp_t hit;
+    if (bp_get(i, &addr)) {
+        printf("Breakpoint %u at 0x%.8x\n", i, addr);
+    } else if (wp_hit(&hit)) {
+        // The PC read above is just past the access
+        printf("Watchpoint on 0x%.8x (%u bytes) hit\n", hit.addr, hit.len);
+    }
+}
+
+/**
+ * @brief Report the core halting on its own, run from the main loop
+ *
+ * Only watches the core after continue, so an idle link sees no traffic.
+ *
+ * @return ACK from SWD request
+ */
+uint8_t poll_halt() {
+    uint32_t dhcsr;
+    uint8_t ack;
+    if (!core_running) {
+        return SWD_ACK_OK;
     }
+    ack = mem_read(CORE_DHCSR, &dhcsr);
+    if (ack != SWD_ACK_OK) {
+        // Link is gone, stop polling until the next continue
+        core_running = 0;
+        return ack;
+    }
+    if (dhcsr & DHCSR_S_HALT) {
+        core_running = 0;
+        printf("\n");
+        read_pc();
+        print_breakpoint_hit();
+        printf("Core halted\n");
+        redraw_line();
+    }
+    return ack;
 }
 
 /**
@@ -229,96 +414,166 @@ uint8_t load_file(unsigned char* bin_arr, unsigned int bin_len) {
  * @return ACK of SWD request
  */
 uint8_t init_file_execution(uint32_t pc, uint32_t msp) {
-    uint32_t data; uint8_t ack;
+    uint8_t ack;
     // Write PC
-    ack = mem_write(CORE_DCRDR, pc);
-    CHECK_ACK_RT("Failed writing PC (DCRDR)");
-    delay();
-    ack = mem_write(CORE_DCRSR, 0x0001000f);
-    CHECK_ACK_RT("Failed writing PC (DCRSR)");
-    delay();
+    ack = core_reg_write(0x0F, pc);
+    CHECK_ACK_RT("Failed writing PC");
 
     // Set MSP
-    ack = mem_write(CORE_DCRDR, msp);
-    CHECK_ACK_RT("Failed writing MSP");
-    delay();
-    ack = mem_write(CORE_DCRSR, 0x0001000d);
+    ack = core_reg_write(0x0D, msp);
     CHECK_ACK_RT("Failed writing MSP");
-    delay();
 
     // Relocate VTOR to SRAM
-    ack = mem_write(0xe000ed08, 0x20000000);
+    ack = mem_write(CORE_VTOR, LOAD_ADDR);
     CHECK_ACK_RT("Failed relocating VTOR");
-    delay();
 
-    return 1;
+    return ack;
 }
 
-uint8_t load_file_and_run(char** args, uint8_t num_args) {
-    unsigned char* bin_arr;
-    unsigned int bin_len;
-    if (!strncmp(args[1], "blink", 5)) {
-        bin_arr = blink_bin;
-        bin_len = blink_bin_len;
-    } else if (!strncmp(args[1], "simple", 5)) {
-        bin_arr = simple_bin;
-        bin_len = simple_bin_len;
-    } else {
-        bin_arr = simple_bin;
-        bin_len = simple_bin_len;
+typedef enum {
+    LOAD_HALT,
+    LOAD_WRITE,
+    LOAD_VERIFY,
+    LOAD_START,
+} load_state_t;
+
+// What the load job is loading, and how far it got
+static job_t load_job;
+static unsigned char* load_bin;
+static unsigned int load_len;
+static uint32_t load_offset;
+static uint64_t load_phase_us;
+
+/**
+ * @brief Next piece of the image for the load job to write or verify
+ */
+static uint32_t load_chunk() {
+    uint32_t chunk = load_len - load_offset;
+    return chunk > LOAD_CHUNK ? LOAD_CHUNK : chunk;
+}
+
+/**
+ * @brief Report how fast the last phase of the load job went
+ */
+static void load_report(char* what) {
+    uint64_t elapsed = time_us_64() - load_phase_us;
+    if (elapsed == 0) {
+        elapsed = 1;
     }
-    halt_core();
-    load_file(bin_arr, bin_len);
-    printf("\n");
-    verify_file(bin_arr, bin_len);
-    reset_core();
-    init_file_execution(0x20000041, 0x20004000);
+    job_printf(&load_job, "%s %u bytes in %u us (%u KB/s)", what, load_len, (uint32_t)elapsed,
+               (uint32_t)((uint64_t)load_len * 1000000 / 1024 / elapsed));
+    load_phase_us = time_us_64();
 }
 
-uint8_t set_mem(uint32_t address, uint32_t value) {
+/**
+ * @brief One step of the load job: halt, write, verify, then set up the core
+ *
+ * Writing and verifying go LOAD_CHUNK bytes per step.
+ */
+static job_status_t load_step(job_t* job) {
+    uint8_t bytes[LOAD_CHUNK];
+    uint32_t chunk, i;
     uint8_t ack;
-    ack = SWD_AP_write(0b10, address);
-    CHECK_ACK_RT("Failed writing target address");
 
-    ack = SWD_AP_write(0b11, value);
-    CHECK_ACK_RT("Failed writing value");
-
-    return 1;
+    switch (job->state) {
+    case LOAD_HALT:
+        ack = core_halt();
+        CHECK_ACK_GT("Halt failed");
+        core_running = 0;
+        load_offset = 0;
+        load_phase_us = time_us_64();
+        job->state = LOAD_WRITE;
+        return JOB_RUNNING;
+    case LOAD_WRITE:
+        chunk = load_chunk();
+        ack = mem_write_bytes(LOAD_ADDR + load_offset, load_bin + load_offset, chunk);
+        CHECK_ACK_GT("Error in writing code");
+        load_offset += chunk;
+        job->done = load_offset;
+        if (load_offset == load_len) {
+            load_report("Loaded");
+            load_offset = 0;
+            job->state = LOAD_VERIFY;
+        }
+        return JOB_RUNNING;
+    case LOAD_VERIFY:
+        chunk = load_chunk();
+        ack = mem_read_bytes(LOAD_ADDR + load_offset, bytes, chunk);
+        CHECK_ACK_GT("Failed reading SRAM");
+        if (memcmp(bytes, load_bin + load_offset, chunk)) {
+            for (i = 0; i < chunk && bytes[i] == load_bin[load_offset + i]; ++i);
+            job_printf(job, "Verification failed at index %u: 0x%.2x != 0x%.2x",
+                       load_offset + i, bytes[i], load_bin[load_offset + i]);
+            return JOB_FAILED;
+        }
+        load_offset += chunk;
+        job->done = load_len + load_offset;
+        if (load_offset == load_len) {
+            load_report("Verified");
+            job->state = LOAD_START;
+        }
+        return JOB_RUNNING;
+    case LOAD_START:
+        ack = core_reset_halt();
+        CHECK_ACK_GT("Failed resetting core");
+        ack = init_file_execution(0x20000041, 0x20004000);
+        return ack == SWD_ACK_OK ? JOB_DONE : JOB_FAILED;
+    }
+LOOP:
+    return JOB_FAILED;
 }
 
-uint8_t interface_set_mem(char** args, uint8_t num_args) {
-    uint32_t addr, val;
-    int err = 0;
-    if (num_args != 3) {
-            printf("Incorrect number of arguments. Format should be:\n");
-            printf("set <address> <value>\n");
-            return 1;
+/**
+ * @brief Load a precompiled program, verify it and get it ready to run
+ *
+ * Usage: load [blink|simple]
+ *
+ * Runs as a background job, see jobs for progress and Ctrl-C to cancel.
+ *
+ * @return 0 if the job started
+ */
+uint8_t load_file_and_run(char** args, uint8_t num_args) {
+    // The running job reads load_bin and load_len on every step
+    if (load_job.active) {
+        error("A load is already running");
+        return 1;
     }
-    err += parse_str_to_hex(args[1], &addr);
-    err += parse_str_to_hex(args[2], &val);
-    if (err) {
-            printf("Incorrect format. Address and val should be in hex format like 0x12341234\n");
-            return 1;
+    if (num_args > 1 && !strncmp(args[1], "blink", 5)) {
+        load_bin = blink_bin;
+        load_len = blink_bin_len;
+    } else {
+        load_bin = simple_bin;
+        load_len = simple_bin_len;
     }
-    set_mem(addr, val);
-    printf("Wrote 0x%.8x to address 0x%.8x\n", val, addr);
+    load_job.name = "load";
+    load_job.step = load_step;
+    load_job.state = LOAD_HALT;
+    load_job.done = 0;
+    // Written once and read back once
+    load_job.total = 2 * load_len;
+    if (!job_start(&load_job)) {
+        error("Too many jobs running");
+        return 1;
+    }
+    return 0;
 }
 
-uint8_t read_mem(uint32_t address, uint32_t* data) {
+uint8_t set_mem(uint32_t address, uint32_t value, uint8_t size) {
     uint8_t ack;
-    ack = SWD_AP_write(0b10, address);
-    CHECK_ACK_RT("Failed writing target address");
-    delay();
-
-    ack = SWD_AP_read(0b11, data);
-    delay();
-    if (ack == 0b010) {
-        ack = SWD_AP_read(0b11, data);
-        CHECK_ACK_RT("Failed reading memory");
+    if (address >= CORE_DHCSR && address <= CORE_DEMCR) {
+        // Could be a register transfer or the core starting to run
+        core_reg_cache_invalidate();
     }
-    ack - SWD_DP_read(0b11, data);
+    ack = mem_write_sized(address, value, size);
+    CHECK_ACK_RT("Failed writing value");
+    return ack;
+}
+
+uint8_t read_mem(uint32_t address, uint32_t* data, uint8_t size) {
+    uint8_t ack;
+    ack = mem_read_sized(address, data, size);
     CHECK_ACK_RT("Failed reading memory");
-    delay();
+    return ack;
 }
 
 void to_uppercase(char* str) {
@@ -342,6 +597,51 @@ int32_t str_to_int(char* str) {
     return ret;
 }
 
+/**
+ * @brief Parse an access size in bits
+ *
+ * @param str "8", "16" or "32"
+ *
+ * @return Access size in bytes, or 0 if invalid
+ */
+static uint8_t parse_access_size(char* str) {
+    int32_t bits = str_to_int(str);
+    if (bits == 8 || bits == 16 || bits == 32) {
+        return bits / 8;
+    }
+    return 0;
+}
+
+uint8_t interface_set_mem(char** args, uint8_t num_args) {
+    uint32_t addr, val;
+    uint8_t size = 4;
+    int err = 0;
+    if (num_args != 3 && num_args != 4) {
+            printf("Incorrect number of arguments. Format should be:\n");
+            printf("set <address> <value> [8|16|32]\n");
+            return 1;
+    }
+    err += parse_str_to_hex(args[1], &addr);
+    err += parse_str_to_hex(args[2], &val);
+    if (err) {
+            printf("Incorrect format. Address and val should be in hex format like 0x12341234\n");
+            return 1;
+    }
+    if (num_args == 4 && !(size = parse_access_size(args[3]))) {
+            printf("Access size should be 8, 16 or 32\n");
+            return 1;
+    }
+    if (addr & (size - 1)) {
+            printf("Address must be aligned to the access size\n");
+            return 1;
+    }
+    if (set_mem(addr, val, size) != SWD_ACK_OK) {
+            return 1;
+    }
+    printf("Wrote 0x%.*x to address 0x%.8x\n", size * 2, val & (uint32_t)((1ull << (size * 8)) - 1), addr);
+    return 0;
+}
+
 /*
  * @brief Parse a string like "$r5" into the REGSEL val for DCRSR
  * 
@@ -424,20 +724,19 @@ uint8_t read_register(char* reg_str, uint32_t* data) {
         return 1;
     }
 
-    ack = set_mem(CORE_DCRSR, regsel);
-    CHECK_ACK_RT("Failed to write regsel");
-    ack = read_mem(CORE_DCRDR, data);
+    ack = core_reg_read(regsel, data);
     CHECK_ACK_RT("Failed to read register");
 
     return 0;
 }
 
 uint8_t interface_read_mem(char** args, uint8_t num_args) {
-    uint32_t addr, val;
+    uint32_t addr, val, count = 1, i;
+    uint8_t size = 4;
     int err = 0;
-    if (num_args != 2) {
+    if (num_args < 2 || num_args > 4) {
         printf("Incorrect number of arguments. Format should be:\n");
-        printf("read <address>\n");
+        printf("read <address> [8|16|32] [count]\n");
         return 1;
     }
     if (args[1][0] == '$') {
@@ -453,9 +752,459 @@ uint8_t interface_read_mem(char** args, uint8_t num_args) {
             printf("Incorrect format. Address should be in hex format like 0x12341234\n");
             return 1;
         }
-        read_mem(addr, &val);
-        printf("0x%.8x: 0x%.8x\n", addr, val);
+        if (num_args >= 3 && !(size = parse_access_size(args[2]))) {
+            printf("Access size should be 8, 16 or 32\n");
+            return 1;
+        }
+        if (num_args == 4 && ((int32_t)(count = str_to_int(args[3])) <= 0 || count > MEM_BLOCK_BATCH * 4 / size)) {
+            printf("Count should be between 1 and %u\n", MEM_BLOCK_BATCH * 4 / size);
+            return 1;
+        }
+        if (addr & (size - 1)) {
+            printf("Address must be aligned to the access size\n");
+            return 1;
+        }
+        if (count == 1) {
+            if (read_mem(addr, &val, size) != SWD_ACK_OK) {
+                return 1;
+            }
+            printf("0x%.8x: 0x%.*x\n", addr, size * 2, val);
+            return 0;
+        }
+        uint8_t bytes[MEM_BLOCK_BATCH * 4];
+        if (mem_read_sized_block(addr, bytes, count, size) != SWD_ACK_OK) {
+            error("Failed reading memory");
+            return 1;
+        }
+        for (i = 0; i < count; ++i) {
+            val = 0;
+            memcpy(&val, &bytes[i * size], size);
+            printf("0x%.8x: 0x%.*x\n", addr + i * size, size * 2, val);
+        }
     }
+    return 0;
 }
 
 // TODO: Refactor all above helping functions into different files
+
+/**
+ * @brief Show or switch the SWD backend
+ *
+ * Usage: backend [pio|bitbang]
+ *
+ * @return 0 for success, 1 for bad arguments
+ */
+uint8_t interface_select_backend(char** args, uint8_t num_args) {
+    if (num_args == 2) {
+        if (!strcmp(args[1], "pio")) {
+            swd_select_backend(SWD_BACKEND_PIO);
+        } else if (!strcmp(args[1], "bitbang")) {
+            swd_select_backend(SWD_BACKEND_BITBANG);
+        } else {
+            printf("Unknown backend. Format should be:\n");
+            printf("backend [pio|bitbang]\n");
+            return 1;
+        }
+        printf("Run init again to reattach\n");
+    }
+    printf("SWD backend: %s\n", swd_get_backend() == SWD_BACKEND_PIO ? "pio" : "bitbang");
+    return 0;
+}
+
+/**
+ * @brief Time back to back IDCODE reads on the current backend
+ *
+ * Usage: bench [count]
+ *
+ * @return ACK of the last SWD request
+ */
+uint8_t interface_bench(char** args, uint8_t num_args) {
+    uint32_t count = 1000, i, data;
+    uint8_t ack = SWD_ACK_OK;
+    if (num_args == 2) {
+        int32_t n = str_to_int(args[1]);
+        if (n <= 0) {
+            printf("Incorrect format. Format should be:\n");
+            printf("bench [count]\n");
+            return 1;
+        }
+        count = n;
+    }
+
+    uint64_t start = time_us_64();
+    for (i = 0; i < count; ++i) {
+        ack = SWD_DP_read(0b00, &data);
+        CHECK_ACK_RT("Failed reading IDCODE");
+    }
+    uint64_t elapsed = time_us_64() - start;
+    if (elapsed == 0) {
+        elapsed = 1;
+    }
+
+    // A read is 46 clocks: header, turnaround, ACK, data, parity, turnaround
+    printf("%u transactions in %u us\n", count, (uint32_t)elapsed);
+    printf("%u ns per transaction, %u kbit/s\n",
+           (uint32_t)(elapsed * 1000 / count),
+           (uint32_t)((uint64_t)count * 46 * 1000 / elapsed));
+    return ack;
+}
+
+/**
+ * @brief Show or set the SWCLK frequency
+ *
+ * Usage: clock [hz]
+ *
+ * @return 0 for success, 1 for bad arguments
+ */
+uint8_t interface_set_clock(char** args, uint8_t num_args) {
+    if (num_args == 2) {
+        int32_t hz = str_to_int(args[1]);
+        if (hz <= 0) {
+            printf("Incorrect format. Format should be:\n");
+            printf("clock [hz]\n");
+            return 1;
+        }
+        printf("Requested %d Hz\n", hz);
+        swd_set_clock(hz);
+    }
+    printf("SWCLK: %u Hz\n", swd_get_clock());
+    return 0;
+}
+
+/**
+ * @brief Print one kind of DHCSR poll latency
+ *
+ * @param what Name of the poll
+ * @param l Latency to print
+ */
+static void print_latency(char* what, const core_latency_t* l) {
+    printf("%-6s polls: %u avg %u us max %u us timeouts %u\n", what, l->count,
+           l->count ? (uint32_t)(l->total_us / l->count) : 0, l->max_us, l->timeouts);
+}
+
+/**
+ * @brief Show or reset SWD traffic counters
+ *
+ * Usage: stats [reset]
+ *
+ * @return 0 for success
+ */
+uint8_t interface_stats(char** args, uint8_t num_args) {
+    if (num_args == 2 && !strcmp(args[1], "reset")) {
+        swd_cache_reset_stats();
+        core_reset_latency();
+        core_reg_cache_reset_stats();
+        swd_reset_error_stats();
+        printf("Counters reset\n");
+        return 0;
+    }
+    const swd_cache_stats_t* cache = swd_cache_get_stats();
+    printf("Skipped SELECT writes: %u\n", cache->select_skipped);
+    printf("Skipped CSW writes:    %u\n", cache->csw_skipped);
+    printf("Skipped TAR writes:    %u\n", cache->tar_skipped);
+    printf("Shadow invalidations:  %u\n", cache->invalidations);
+    const swd_error_stats_t* errors = swd_get_error_stats();
+    printf("Parity errors:         %u\n", errors->parity);
+    printf("WAIT ACKs:             %u\n", errors->wait);
+    printf("FAULT ACKs:            %u\n", errors->fault);
+    printf("No ACKs:               %u\n", errors->no_ack);
+    const core_reg_cache_stats_t* regs = core_reg_cache_get_stats();
+    printf("Register cache hits:   %u\n", regs->hits);
+    printf("Register cache misses: %u\n", regs->misses);
+    print_latency("REGRDY", &core_get_latency()->regrdy);
+    print_latency("Halt", &core_get_latency()->halt);
+    print_latency("Step", &core_get_latency()->step);
+    print_latency("Reset", &core_get_latency()->reset);
+    return 0;
+}
+
+/**
+ * @brief Show or switch SWD overrun detection
+ *
+ * Usage: overrun [on|off]
+ *
+ * @return ACK of SWD request
+ */
+uint8_t interface_overrun(char** args, uint8_t num_args) {
+    uint8_t ack = SWD_ACK_OK;
+    if (num_args == 2) {
+        if (!strcmp(args[1], "on")) {
+            ack = swd_set_overrun_detect(1);
+        } else if (!strcmp(args[1], "off")) {
+            ack = swd_set_overrun_detect(0);
+        } else {
+            printf("Incorrect format. Format should be:\n");
+            printf("overrun [on|off]\n");
+            return 1;
+        }
+        CHECK_ACK_RT("Failed writing CTRL/STAT");
+    }
+    printf("Overrun detection: %s\n", swd_get_overrun_detect() ? "on" : "off");
+    return ack;
+}
+
+/**
+ * @brief Set a hardware breakpoint
+ *
+ * Usage: break <address>
+ *
+ * The FPB is only written when the core next runs.
+ *
+ * @return ACK from SWD request, or 1 for bad arguments
+ */
+uint8_t interface_break(char** args, uint8_t num_args) {
+    uint8_t ack, num, rev;
+    uint32_t addr;
+    if (num_args != 2 || parse_str_to_hex(args[1], &addr)) {
+        printf("Incorrect format. Format should be:\n");
+        printf("break <address>\n");
+        return 1;
+    }
+    ack = bp_get_info(&num, &rev);
+    CHECK_ACK_RT("Failed reading FP_CTRL");
+    ack = bp_set(addr);
+    if (ack == SWD_ACK_FAULT) {
+        if (rev == 0 && addr >= 0x20000000) {
+            error("FPv1 can only break below 0x20000000");
+        } else {
+            printf("\033[31mAll %u comparators are in use\033[0m\n", num);
+        }
+        return ack;
+    }
+    CHECK_ACK_RT("Failed setting breakpoint");
+    printf("Breakpoint at 0x%.8x\n", addr);
+    return ack;
+}
+
+/**
+ * @brief Remove one hardware breakpoint, or all of them
+ *
+ * Usage: delete [address]
+ *
+ * @return ACK from SWD request, or 1 for bad arguments
+ */
+uint8_t interface_delete(char** args, uint8_t num_args) {
+    uint32_t addr;
+    if (num_args == 1) {
+        return bp_clear_all();
+    }
+    if (num_args != 2 || parse_str_to_hex(args[1], &addr)) {
+        printf("Incorrect format. Format should be:\n");
+        printf("delete [address]\n");
+        return 1;
+    }
+    if (bp_clear(addr) != SWD_ACK_OK) {
+        error("No breakpoint at that address");
+        return 1;
+    }
+    return 0;
+}
+
+static const char* wp_type_names[] = { "", "r", "w", "rw" };
+
+/**
+ * @brief Set a data watchpoint
+ *
+ * Usage: watch <address> [len] [r|w|rw] [value]
+ *
+ * Watches len bytes, 4 by default, for writes by default. With a value,
+ * only accesses of that value trigger it, which needs len of 1, 2 or 4.
+ * The DWT is only written when the core next runs.
+ *
+ * @return ACK from SWD request, or 1 for bad arguments
+ */
+uint8_t interface_watch(char** args, uint8_t num_args) {
+    wp_type_t type = WP_WRITE;
+    uint32_t addr, len = 4, value = 0;
+    uint8_t ack, num, v8m, match_value = 0, i;
+    int32_t n;
+
+    if (num_args < 2 || parse_str_to_hex(args[1], &addr)) {
+        goto USAGE;
+    }
+    for (i = 2; i < num_args; ++i) {
+        if (!strcmp(args[i], "r")) {
+            type = WP_READ;
+        } else if (!strcmp(args[i], "w")) {
+            type = WP_WRITE;
+        } else if (!strcmp(args[i], "rw")) {
+            type = WP_ACCESS;
+        } else if (!parse_str_to_hex(args[i], &value)) {
+            match_value = 1;
+        } else if ((n = str_to_int(args[i])) > 0) {
+            len = n;
+        } else {
+            goto USAGE;
+        }
+    }
+
+    ack = wp_get_info(&num, &v8m);
+    CHECK_ACK_RT("Failed reading the DWT");
+    ack = wp_set(addr, len, type, match_value, value);
+    if (ack == SWD_ACK_FAULT) {
+        printf("\033[31mNo comparators left for that on this ARMv%s-M DWT (%u comparators)\033[0m\n",
+               v8m ? "8" : "7", num);
+        return ack;
+    }
+    CHECK_ACK_RT("Failed setting watchpoint");
+    printf("Watchpoint on 0x%.8x, %u bytes, %s\n", addr, len, wp_type_names[type]);
+    return ack;
+USAGE:
+    printf("Incorrect format. Format should be:\n");
+    printf("watch <address> [len] [r|w|rw] [value]\n");
+    return 1;
+}
+
+/**
+ * @brief Remove one data watchpoint, or all of them
+ *
+ * Usage: unwatch [address]
+ *
+ * @return ACK from SWD request, or 1 for bad arguments
+ */
+uint8_t interface_unwatch(char** args, uint8_t num_args) {
+    uint32_t addr;
+    if (num_args == 1) {
+        return wp_clear_all();
+    }
+    if (num_args != 2 || parse_str_to_hex(args[1], &addr)) {
+        printf("Incorrect format. Format should be:\n");
+        printf("unwatch [address]\n");
+        return 1;
+    }
+    if (wp_clear(addr) != SWD_ACK_OK) {
+        error("No watchpoint at that address");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief List the watchpoint table
+ *
+ * @return ACK from SWD request
+ */
+static uint8_t print_watchpoints() {
+    uint8_t ack, num, v8m, i, any = 0;
+    wp_t wp;
+    ack = wp_get_info(&num, &v8m);
+    CHECK_ACK_RT("Failed reading the DWT");
+    printf("ARMv%s-M DWT, %u comparators\n", v8m ? "8" : "7", num);
+    for (i = 0; i < WP_MAX; ++i) {
+        if (wp_get(i, &wp)) {
+            printf("%2u  0x%.8x  %3u bytes  %-2s", i, wp.addr, wp.len, wp_type_names[wp.type]);
+            if (wp.match_value) {
+                printf("  == 0x%.8x", wp.value);
+            }
+            printf("\n");
+            any = 1;
+        }
+    }
+    if (!any) {
+        printf("No watchpoints\n");
+    }
+    return ack;
+}
+
+/**
+ * @brief List the breakpoint table
+ *
+ * @return ACK from SWD request
+ */
+static uint8_t print_breakpoints() {
+    uint8_t ack, num, rev, i, any = 0;
+    uint32_t addr;
+    ack = bp_get_info(&num, &rev);
+    CHECK_ACK_RT("Failed reading FP_CTRL");
+    printf("FPv%u, %u comparators\n", rev + 1, num);
+    for (i = 0; i < num; ++i) {
+        if (bp_get(i, &addr)) {
+            printf("%2u  0x%.8x\n", i, addr);
+            any = 1;
+        }
+    }
+    if (!any) {
+        printf("No breakpoints\n");
+    }
+    return ack;
+}
+
+/**
+ * @brief Print every core register, from one pipelined snapshot
+ *
+ * @return ACK from SWD request
+ */
+static uint8_t print_registers() {
+    static const char* names[16] = {
+        "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7",
+        "r8", "r9", "r10", "r11", "r12", "sp", "lr", "pc",
+    };
+    uint8_t regsels[CORE_REGSEL_S0 + 32];
+    uint32_t n = 0, value, mvfr0, i;
+    uint8_t ack;
+
+    for (i = 0; i <= CORE_REGSEL_PSP; ++i) {
+        regsels[n++] = i;
+    }
+    regsels[n++] = CORE_REGSEL_CONTROL;
+    ack = mem_read(CORE_MVFR0, &mvfr0);
+    CHECK_ACK_RT("Failed reading MVFR0");
+    if (mvfr0) {
+        regsels[n++] = CORE_REGSEL_FPSCR;
+        for (i = 0; i < 32; ++i) {
+            regsels[n++] = CORE_REGSEL_S0 + i;
+        }
+    }
+    ack = core_reg_snapshot(regsels, n);
+    CHECK_ACK_RT("Failed reading registers, is the core halted?");
+
+    // Everything below comes out of the cache
+    for (i = 0; i < 16; ++i) {
+        core_reg_read(i, &value);
+        printf("%-4s 0x%.8x%s", names[i], value, i % 4 == 3 ? "\n" : "  ");
+    }
+    core_reg_read(CORE_REGSEL_XPSR, &value);
+    printf("xpsr 0x%.8x  ", value);
+    core_reg_read(CORE_REGSEL_MSP, &value);
+    printf("msp  0x%.8x  ", value);
+    core_reg_read(CORE_REGSEL_PSP, &value);
+    printf("psp  0x%.8x\n", value);
+    core_reg_read(CORE_REGSEL_CONTROL, &value);
+    printf("control 0x%.2x  faultmask 0x%.2x  basepri 0x%.2x  primask 0x%.2x\n",
+           value >> 24, (value >> 16) & 0xFF, (value >> 8) & 0xFF, value & 0xFF);
+    if (!mvfr0) {
+        return ack;
+    }
+    core_reg_read(CORE_REGSEL_FPSCR, &value);
+    printf("fpscr 0x%.8x\n", value);
+    for (i = 0; i < 32; ++i) {
+        union { uint32_t u; float f; } s;
+        core_reg_read(CORE_REGSEL_S0 + i, &s.u);
+        printf("s%-3u 0x%.8x %-14g%s", i, s.u, s.f, i % 4 == 3 ? "\n" : "");
+    }
+    return ack;
+}
+
+/**
+ * @brief Show information about the TARGET
+ *
+ * Usage: info reg|break|watch
+ *
+ * @return 0 for success, 1 for bad arguments
+ */
+uint8_t interface_info(char** args, uint8_t num_args) {
+    if (num_args == 2 && !strncmp(args[1], "watch", 1)) {
+        print_watchpoints();
+        return 0;
+    }
+    if (num_args == 2 && !strncmp(args[1], "reg", 3)) {
+        print_registers();
+        return 0;
+    }
+    if (num_args == 2 && !strncmp(args[1], "break", 1)) {
+        print_breakpoints();
+        return 0;
+    }
+    error("Usage: info reg|break|watch");
+    return 1;
+}
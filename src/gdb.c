@@ -0,0 +1,717 @@
+/**
+ * @file gdb.c
+ * @author Min Kang
+ * @brief GDB remote serial protocol stub
+ *
+ * Registers go through DCRSR and DCRDR, memory through the MEM-AP block
+ * transfers, and breakpoints through the FPB. Only the Cortex-M core
+ * registers r0-r12, sp, lr, pc and xpsr are described to GDB.
+ *
+ * Bytes are fed in one at a time, so a session can run on the host port
+ * from the main loop, or on the console through the gdb command.
+ */
+#include "gdb.h"
+#include "core.h"
+#include "mem.h"
+#include "breakpoint.h"
+#include "watchpoint.h"
+#include "macros.h"
+#include "utils.h"
+#include "swd_request.h"
+#include "usb_cdc.h"
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <string.h>
+
+#define GDB_NUM_REGS 17
+// DCRSR.REGSEL of xPSR, r0-r15 are simply their number
+#define GDB_REGSEL_XPSR 0x10
+
+static char rx_buf[GDB_PACKET_SIZE + 1];
+static char tx_buf[GDB_PACKET_SIZE + 4];
+static uint8_t mem_buf[GDB_PACKET_SIZE / 2];
+static uint8_t no_ack;
+
+typedef enum {
+    GDB_WAIT_START,
+    GDB_DATA,
+    GDB_ESCAPE,
+    GDB_CSUM_HI,
+    GDB_CSUM_LO,
+} gdb_state_t;
+
+static gdb_state_t state;
+static uint32_t rx_len;
+static uint8_t rx_sum;
+static uint8_t rx_check;
+// Port the session is on
+static uint8_t port;
+// 1 while GDB is attached
+static uint8_t session;
+// 1 while the core runs for a continue, until it halts or is interrupted
+static uint8_t running;
+static uint64_t next_poll_us;
+// Last reply, sent again if GDB asks for it
+static const char* last_reply;
+static uint32_t last_len;
+
+static const char hex_chars[] = "0123456789abcdef";
+
+static const char target_xml[] =
+    "<?xml version=\"1.0\"?>"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+    "<target><architecture>arm</architecture>"
+    "<feature name=\"org.gnu.gdb.arm.m-profile\">"
+    "<reg name=\"r0\" bitsize=\"32\"/><reg name=\"r1\" bitsize=\"32\"/>"
+    "<reg name=\"r2\" bitsize=\"32\"/><reg name=\"r3\" bitsize=\"32\"/>"
+    "<reg name=\"r4\" bitsize=\"32\"/><reg name=\"r5\" bitsize=\"32\"/>"
+    "<reg name=\"r6\" bitsize=\"32\"/><reg name=\"r7\" bitsize=\"32\"/>"
+    "<reg name=\"r8\" bitsize=\"32\"/><reg name=\"r9\" bitsize=\"32\"/>"
+    "<reg name=\"r10\" bitsize=\"32\"/><reg name=\"r11\" bitsize=\"32\"/>"
+    "<reg name=\"r12\" bitsize=\"32\"/>"
+    "<reg name=\"sp\" bitsize=\"32\" type=\"data_ptr\"/>"
+    "<reg name=\"lr\" bitsize=\"32\"/>"
+    "<reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\"/>"
+    "<reg name=\"xpsr\" bitsize=\"32\" regnum=\"16\"/>"
+    "</feature></target>";
+
+// Built once from the TARGET_* layout
+static char memory_map_xml[512];
+
+// ------------------------- HEX ------------------------- //
+
+static int8_t hex_val(char c) {
+    if ('0' <= c && c <= '9') return c - '0';
+    if ('a' <= c && c <= 'f') return c - 'a' + 10;
+    if ('A' <= c && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * @brief Parse a hex number of any length, stopping at the first non hex
+ *
+ * @return Pointer to the first character after the number
+ */
+static const char* parse_hex(const char* str, uint32_t* value) {
+    *value = 0;
+    while (hex_val(*str) >= 0) {
+        *value = (*value << 4) | hex_val(*str++);
+    }
+    return str;
+}
+
+static char* put_hex_bytes(char* out, const uint8_t* data, uint32_t len) {
+    while (len--) {
+        *out++ = hex_chars[*data >> 4];
+        *out++ = hex_chars[*data++ & 0xF];
+    }
+    return out;
+}
+
+/**
+ * @brief Registers go over the wire as little endian bytes
+ */
+static char* put_hex_u32(char* out, uint32_t value) {
+    uint8_t bytes[4] = { value, value >> 8, value >> 16, value >> 24 };
+    return put_hex_bytes(out, bytes, 4);
+}
+
+static uint32_t get_hex_u32(const char* str) {
+    uint32_t value = 0;
+    uint8_t i;
+    for (i = 0; i < 4; ++i) {
+        value |= (uint32_t)((hex_val(str[2 * i]) << 4) | hex_val(str[2 * i + 1])) << (8 * i);
+    }
+    return value;
+}
+
+// ------------------------- PACKETS ------------------------- //
+
+static void send_packet(const char* data, uint32_t len) {
+    char trailer[3] = { '#' };
+    uint8_t sum = 0;
+    uint32_t i;
+    for (i = 0; i < len; ++i) {
+        sum += data[i];
+    }
+    trailer[1] = hex_chars[sum >> 4];
+    trailer[2] = hex_chars[sum & 0xF];
+    usb_cdc_write(port, "$", 1);
+    usb_cdc_write(port, data, len);
+    usb_cdc_write(port, trailer, 3);
+}
+
+/**
+ * @brief Frame and send a reply
+ *
+ * Replies are hex, plain text or XML, none of which need escaping. The
+ * reply is kept until the next one in case GDB NAKs it, so data must stay
+ * valid until then.
+ */
+static void put_packet(const char* data, uint32_t len) {
+    last_reply = data;
+    last_len = len;
+    send_packet(data, len);
+}
+
+static void put_str(const char* str) {
+    put_packet(str, strlen(str));
+}
+
+static void put_error(uint8_t code) {
+    static char err[4] = { 'E' };
+    err[1] = hex_chars[code >> 4];
+    err[2] = hex_chars[code & 0xF];
+    put_str(err);
+}
+
+// ------------------------- COMMANDS ------------------------- //
+
+static uint8_t regsel(uint32_t n) {
+    return n == 16 ? GDB_REGSEL_XPSR : n;
+}
+
+static void cmd_read_regs() {
+    char* out = tx_buf;
+    uint8_t regsels[GDB_NUM_REGS];
+    uint32_t value, i;
+    for (i = 0; i < GDB_NUM_REGS; ++i) {
+        regsels[i] = regsel(i);
+    }
+    // One pipelined batch, the reads below come out of the cache
+    if (core_reg_snapshot(regsels, GDB_NUM_REGS) != SWD_ACK_OK) {
+        put_error(1);
+        return;
+    }
+    for (i = 0; i < GDB_NUM_REGS; ++i) {
+        if (core_reg_read(regsel(i), &value) != SWD_ACK_OK) {
+            put_error(1);
+            return;
+        }
+        out = put_hex_u32(out, value);
+    }
+    put_packet(tx_buf, out - tx_buf);
+}
+
+static void cmd_write_regs(const char* args, uint32_t len) {
+    uint32_t i;
+    if (len < GDB_NUM_REGS * 8) {
+        put_error(1);
+        return;
+    }
+    for (i = 0; i < GDB_NUM_REGS; ++i) {
+        if (core_reg_write(regsel(i), get_hex_u32(&args[i * 8])) != SWD_ACK_OK) {
+            put_error(1);
+            return;
+        }
+    }
+    put_str("OK");
+}
+
+static void cmd_read_reg(const char* args) {
+    uint32_t n, value;
+    parse_hex(args, &n);
+    if (n >= GDB_NUM_REGS) {
+        // Not one of ours, GDB shows it as unavailable
+        put_str("xxxxxxxx");
+        return;
+    }
+    if (core_reg_read(regsel(n), &value) != SWD_ACK_OK) {
+        put_error(1);
+        return;
+    }
+    put_packet(tx_buf, put_hex_u32(tx_buf, value) - tx_buf);
+}
+
+static void cmd_write_reg(const char* args) {
+    uint32_t n;
+    args = parse_hex(args, &n);
+    if (*args != '=' || n >= GDB_NUM_REGS) {
+        put_error(1);
+        return;
+    }
+    if (core_reg_write(regsel(n), get_hex_u32(args + 1)) != SWD_ACK_OK) {
+        put_error(1);
+        return;
+    }
+    put_str("OK");
+}
+
+static void cmd_read_mem(const char* args) {
+    uint32_t addr, len;
+    args = parse_hex(args, &addr);
+    if (*args != ',') {
+        put_error(1);
+        return;
+    }
+    parse_hex(args + 1, &len);
+    if (len > sizeof(mem_buf)) {
+        len = sizeof(mem_buf);
+    }
+    if (mem_read_bytes(addr, mem_buf, len) != SWD_ACK_OK) {
+        put_error(1);
+        return;
+    }
+    put_packet(tx_buf, put_hex_bytes(tx_buf, mem_buf, len) - tx_buf);
+}
+
+/**
+ * @brief M, hex data, and X, binary data
+ */
+static void cmd_write_mem(const char* args, uint32_t packet_len, uint8_t binary) {
+    const char* start = args - 1;
+    uint32_t addr, len, i;
+    args = parse_hex(args, &addr);
+    // Past the end of the packet is whatever a longer one left behind
+    if (*args != ',') {
+        put_error(1);
+        return;
+    }
+    args = parse_hex(args + 1, &len);
+    if (*args++ != ':' || len > sizeof(mem_buf)) {
+        put_error(1);
+        return;
+    }
+    if (binary) {
+        if (len > packet_len - (uint32_t)(args - start)) {
+            put_error(1);
+            return;
+        }
+        memcpy(mem_buf, args, len);
+    } else {
+        if (2 * len > packet_len - (uint32_t)(args - start)) {
+            put_error(1);
+            return;
+        }
+        for (i = 0; i < len; ++i) {
+            mem_buf[i] = (hex_val(args[2 * i]) << 4) | hex_val(args[2 * i + 1]);
+        }
+    }
+    if (len && mem_write_bytes(addr, mem_buf, len) != SWD_ACK_OK) {
+        put_error(1);
+        return;
+    }
+    put_str("OK");
+}
+
+static void cmd_breakpoint(const char* args, uint8_t insert) {
+    // Z2, Z3 and Z4 in the order GDB numbers them
+    static const wp_type_t wp_types[] = { WP_WRITE, WP_READ, WP_ACCESS };
+    uint32_t type, addr, kind;
+    uint8_t ack;
+    args = parse_hex(args, &type);
+    args = parse_hex(args + 1, &addr);
+    parse_hex(args + 1, &kind);
+    if (type > 4) {
+        put_str("");
+        return;
+    }
+    if (type > 1) {
+        // kind is the number of bytes watched
+        ack = insert ? wp_set(addr, kind, wp_types[type - 2], 0, 0) : wp_clear(addr);
+    } else {
+        // Software breakpoints use the FPB as well, flash can't take BKPT
+        ack = insert ? bp_set(addr) : bp_clear(addr);
+    }
+    if (ack != SWD_ACK_OK) {
+        put_error(1);
+        return;
+    }
+    put_str("OK");
+}
+
+/**
+ * @brief Let the core run, gdb_poll() reports when it halts
+ */
+static void resume(uint8_t step, const char* addr_arg) {
+    uint32_t addr;
+    if (*addr_arg) {
+        parse_hex(addr_arg, &addr);
+        if (core_reg_write(15, addr) != SWD_ACK_OK) {
+            put_error(1);
+            return;
+        }
+    }
+    if (step) {
+        put_str(core_step() == SWD_ACK_OK ? "S05" : "E01");
+        return;
+    }
+    if (core_continue() != SWD_ACK_OK) {
+        put_error(1);
+        return;
+    }
+    running = 1;
+    next_poll_us = time_us_64() + GDB_POLL_INTERVAL_US;
+}
+
+/**
+ * @brief Ctrl-C from GDB, stop the core if it is running
+ */
+static void interrupt() {
+    if (!running) {
+        return;
+    }
+    running = 0;
+    put_str(core_halt() == SWD_ACK_OK ? "S02" : "E01");
+}
+
+/**
+ * @brief vCont, only the first action is used as there is one thread
+ */
+static void cmd_vcont(const char* args) {
+    if (*args == '?') {
+        put_str("vCont;c;C;s;S");
+        return;
+    }
+    if (*args++ != ';') {
+        put_str("");
+        return;
+    }
+    switch (*args) {
+    case 'c':
+    case 'C':
+        resume(0, "");
+        break;
+    case 's':
+    case 'S':
+        resume(1, "");
+        break;
+    default:
+        put_error(1);
+        break;
+    }
+}
+
+/**
+ * @brief qXfer:<object>:read:<annex>:<offset>,<length>
+ */
+static void cmd_xfer(const char* doc, const char* args) {
+    uint32_t offset, len, doc_len = strlen(doc);
+    args = parse_hex(args, &offset);
+    parse_hex(args + 1, &len);
+    if (offset >= doc_len) {
+        put_str("l");
+        return;
+    }
+    if (len > GDB_PACKET_SIZE - 1) {
+        len = GDB_PACKET_SIZE - 1;
+    }
+    if (len > doc_len - offset) {
+        len = doc_len - offset;
+    }
+    tx_buf[0] = offset + len < doc_len ? 'm' : 'l';
+    memcpy(&tx_buf[1], doc + offset, len);
+    put_packet(tx_buf, len + 1);
+}
+
+static void cmd_query(const char* packet) {
+    if (!strncmp(packet, "qSupported", 10)) {
+        snprintf(tx_buf, sizeof(tx_buf),
+                 "PacketSize=%x;qXfer:memory-map:read+;qXfer:features:read+;QStartNoAckMode+;vContSupported+",
+                 GDB_PACKET_SIZE);
+        put_str(tx_buf);
+    } else if (!strncmp(packet, "qXfer:features:read:target.xml:", 31)) {
+        cmd_xfer(target_xml, packet + 31);
+    } else if (!strncmp(packet, "qXfer:memory-map:read::", 23)) {
+        cmd_xfer(memory_map_xml, packet + 23);
+    } else if (!strcmp(packet, "qAttached")) {
+        put_str("1");
+    } else if (!strcmp(packet, "qC")) {
+        put_str("QC1");
+    } else if (!strcmp(packet, "qfThreadInfo")) {
+        put_str("m1");
+    } else if (!strcmp(packet, "qsThreadInfo")) {
+        put_str("l");
+    } else {
+        put_str("");
+    }
+}
+
+/**
+ * @brief Answer a complete packet sitting in rx_buf
+ */
+static void handle_packet(uint32_t len) {
+    switch (rx_buf[0]) {
+    case '?':
+        put_str("S05");
+        break;
+    case 'g':
+        cmd_read_regs();
+        break;
+    case 'G':
+        cmd_write_regs(rx_buf + 1, len - 1);
+        break;
+    case 'p':
+        cmd_read_reg(rx_buf + 1);
+        break;
+    case 'P':
+        cmd_write_reg(rx_buf + 1);
+        break;
+    case 'm':
+        cmd_read_mem(rx_buf + 1);
+        break;
+    case 'M':
+        cmd_write_mem(rx_buf + 1, len, 0);
+        break;
+    case 'X':
+        cmd_write_mem(rx_buf + 1, len, 1);
+        break;
+    case 'Z':
+        cmd_breakpoint(rx_buf + 1, 1);
+        break;
+    case 'z':
+        cmd_breakpoint(rx_buf + 1, 0);
+        break;
+    case 'c':
+        resume(0, rx_buf + 1);
+        break;
+    case 's':
+        resume(1, rx_buf + 1);
+        break;
+    case 'H':
+    case 'T':
+        put_str("OK");
+        break;
+    case 'q':
+        cmd_query(rx_buf);
+        break;
+    case 'Q':
+        if (!strcmp(rx_buf, "QStartNoAckMode")) {
+            put_str("OK");
+            no_ack = 1;
+        } else {
+            put_str("");
+        }
+        break;
+    case 'v':
+        if (!strncmp(rx_buf, "vCont", 5)) {
+            cmd_vcont(rx_buf + 5);
+        } else {
+            put_str("");
+        }
+        break;
+    case 'D':
+        // Leave the core running without our breakpoints
+        bp_clear_all();
+        wp_clear_all();
+        core_continue();
+        put_str("OK");
+        session = 0;
+        running = 0;
+        break;
+    case 'k':
+        bp_clear_all();
+        wp_clear_all();
+        session = 0;
+        running = 0;
+        break;
+    default:
+        put_str("");
+        break;
+    }
+}
+
+/**
+ * @brief Append a ram region for the gap from start up to end
+ *
+ * An end of 0 is the top of the 4 GB address space.
+ *
+ * @return Characters appended
+ */
+static uint32_t map_gap(char* out, uint32_t size, uint32_t start, uint32_t end) {
+    if (start == end) {
+        return 0;
+    }
+    return snprintf(out, size, "<memory type=\"ram\" start=\"0x%x\" length=\"0x%x\"/>",
+                    start, end - start);
+}
+
+/**
+ * @brief Build the memory map from the TARGET_* layout
+ *
+ * GDB refuses to touch addresses outside the map, so everything between
+ * the flash and RAM, peripherals and the system space included, is mapped
+ * as ram too. Accesses there go to the TARGET, which FAULTs if nothing is
+ * behind them.
+ */
+static void build_memory_map() {
+    char* out = memory_map_xml;
+    uint32_t size = sizeof(memory_map_xml);
+    uint32_t len;
+
+    len = snprintf(out, size, "<memory-map>");
+    len += map_gap(out + len, size - len, 0, TARGET_FLASH_BASE);
+    len += snprintf(out + len, size - len,
+                    "<memory type=\"flash\" start=\"0x%x\" length=\"0x%x\">"
+                    "<property name=\"blocksize\">0x%x</property></memory>",
+                    TARGET_FLASH_BASE, TARGET_FLASH_SIZE, TARGET_FLASH_BLOCK);
+    len += map_gap(out + len, size - len, TARGET_FLASH_BASE + TARGET_FLASH_SIZE,
+                   TARGET_RAM_BASE);
+    len += snprintf(out + len, size - len,
+                    "<memory type=\"ram\" start=\"0x%x\" length=\"0x%x\"/>",
+                    TARGET_RAM_BASE, TARGET_RAM_SIZE);
+    len += map_gap(out + len, size - len, TARGET_RAM_BASE + TARGET_RAM_SIZE, 0);
+    snprintf(out + len, size - len, "</memory-map>");
+}
+
+/**
+ * @brief Start a GDB session on a port
+ *
+ * Halts the core and sets up the FPB. The session is open even if that
+ * fails, GDB then sees errors for whatever it asks.
+ *
+ * @param p One of the USB_CDC_* ports
+ *
+ * @return ACK of halting the core
+ */
+uint8_t gdb_attach(uint8_t p) {
+    uint8_t ack;
+    build_memory_map();
+    port = p;
+    session = 1;
+    running = 0;
+    no_ack = 0;
+    last_reply = NULL;
+    state = GDB_WAIT_START;
+    ack = core_halt();
+    if (ack == SWD_ACK_OK) {
+        ack = bp_init();
+    }
+    return ack;
+}
+
+/**
+ * @brief Whether a GDB session is open
+ *
+ * @return 1 until GDB detaches or kills the session
+ */
+uint8_t gdb_active() {
+    return session;
+}
+
+/**
+ * @brief Feed one byte from GDB to the packet parser
+ *
+ * A complete packet is answered before this returns, except a continue,
+ * whose answer comes from gdb_poll() once the core halts.
+ *
+ * @param c Byte received on the session's port
+ */
+void gdb_feed(uint8_t c) {
+    switch (state) {
+    case GDB_WAIT_START:
+        if (c == '$') {
+            rx_len = 0;
+            rx_sum = 0;
+            state = GDB_DATA;
+        } else if (c == 0x03) {
+            interrupt();
+        } else if (c == '-' && last_reply) {
+            send_packet(last_reply, last_len);
+        }
+        break;
+    case GDB_DATA:
+        if (c == '#') {
+            state = GDB_CSUM_HI;
+            break;
+        }
+        rx_sum += c;
+        if (c == '}') {
+            state = GDB_ESCAPE;
+            break;
+        }
+        if (rx_len < GDB_PACKET_SIZE) {
+            rx_buf[rx_len++] = c;
+        }
+        break;
+    case GDB_ESCAPE:
+        rx_sum += c;
+        if (rx_len < GDB_PACKET_SIZE) {
+            rx_buf[rx_len++] = c ^ 0x20;
+        }
+        state = GDB_DATA;
+        break;
+    case GDB_CSUM_HI:
+        rx_check = hex_val(c) << 4;
+        state = GDB_CSUM_LO;
+        break;
+    case GDB_CSUM_LO:
+        rx_check |= hex_val(c);
+        state = GDB_WAIT_START;
+        if (!no_ack) {
+            if (rx_check != rx_sum) {
+                usb_cdc_write(port, "-", 1);
+                break;
+            }
+            usb_cdc_write(port, "+", 1);
+        }
+        rx_buf[rx_len] = '\0';
+        handle_packet(rx_len);
+        break;
+    }
+}
+
+/**
+ * @brief Check whether a running core has halted, and tell GDB if so
+ *
+ * Only reads DHCSR every GDB_POLL_INTERVAL_US, so it can be called as
+ * often as convenient.
+ *
+ * @return 0
+ */
+uint8_t gdb_poll() {
+    uint32_t dhcsr;
+    wp_t hit;
+    uint64_t now = time_us_64();
+    if (!session || !running || (int64_t)(now - next_poll_us) < 0) {
+        return 0;
+    }
+    next_poll_us = now + GDB_POLL_INTERVAL_US;
+    if (mem_read(CORE_DHCSR, &dhcsr) != SWD_ACK_OK) {
+        running = 0;
+        put_error(1);
+    } else if (dhcsr & DHCSR_S_HALT) {
+        running = 0;
+        if (wp_hit(&hit)) {
+            snprintf(tx_buf, sizeof(tx_buf), "T05%swatch:%x;",
+                     hit.type == WP_READ ? "r" : hit.type == WP_ACCESS ? "a" : "", hit.addr);
+            put_str(tx_buf);
+        } else {
+            put_str("S05");
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Serve GDB on the console until it detaches or kills the session
+ *
+ * Halts the core and speaks RSP on the console. Connect with
+ * `target remote /dev/ttyACM0` after running the gdb command. GDB can
+ * also just connect to the host port, without this command.
+ *
+ * @return 0
+ */
+uint8_t gdb_server_run() {
+    int c;
+    if (session) {
+        error("GDB is already attached on another port");
+        return 1;
+    }
+    if (gdb_attach(USB_CDC_CONSOLE) != SWD_ACK_OK) {
+        session = 0;
+        error("Can't halt the core, run init first");
+        return 1;
+    }
+    printf("GDB server running, connect with: target remote <this port>\n");
+
+    while (session) {
+        c = getchar_timeout_us(GDB_POLL_INTERVAL_US);
+        if (c != PICO_ERROR_TIMEOUT) {
+            gdb_feed(c);
+        }
+        gdb_poll();
+    }
+    printf("GDB session ended\n");
+    return 0;
+}
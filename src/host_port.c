@@ -0,0 +1,50 @@
+/**
+ * @file host_port.c
+ * @author Min Kang
+ * @brief Host CDC port: binary protocol or GDB, whichever shows up
+ *
+ * Tools use this port while a person uses the console, so both can drive
+ * the probe at the same time.
+ */
+#include "host_port.h"
+#include "usb_cdc.h"
+#include "proto.h"
+#include "gdb.h"
+#include "pico/time.h"
+
+static uint64_t last_byte_us;
+
+/**
+ * @brief Serve whatever has arrived on the host port, run from the main loop
+ *
+ * Frames starting with PROTO_SOF go to the binary protocol, and a '$'
+ * between frames starts a GDB session, which then has the port until GDB
+ * detaches.
+ *
+ * @return 0
+ */
+uint8_t host_port_task() {
+    int c;
+    uint64_t now = time_us_64();
+
+    if (!proto_idle() && now - last_byte_us > PROTO_BYTE_TIMEOUT_US) {
+        // The rest of the frame is never coming
+        proto_reset();
+    }
+    while ((c = usb_cdc_getc(USB_CDC_HOST)) >= 0) {
+        last_byte_us = now;
+        if (gdb_active()) {
+            gdb_feed(c);
+            continue;
+        }
+        if (c == '$' && proto_idle()) {
+            gdb_attach(USB_CDC_HOST);
+            gdb_feed(c);
+            continue;
+        }
+        proto_set_port(USB_CDC_HOST);
+        proto_feed(c);
+    }
+    gdb_poll();
+    return 0;
+}
@@ -0,0 +1,178 @@
+/**
+ * @file itm_decode.c
+ * @author Min Kang
+ * @brief ITM and DWT trace packet decoder
+ *
+ * The packet formats are the ones in the ARMv7-M and ARMv8-M architecture
+ * manuals, appendix "Debug ITM and DWT Packet Protocol". Every packet is a
+ * header byte, then either a fixed size payload (source packets) or bytes
+ * with a continuation bit (timestamps and extensions). A sync is at least
+ * 47 zero bits followed by a one, i.e. five zero bytes and 0x80.
+ *
+ * Plain C with no hardware dependencies.
+ */
+#include "itm_decode.h"
+
+#define ITM_HEADER_OVERFLOW 0x70
+#define ITM_HEADER_GTS1 0x94
+#define ITM_HEADER_GTS2 0xB4
+// Bytes of zeros a sync starts with
+#define ITM_SYNC_ZEROS 5
+#define ITM_CONTINUE 0x80
+
+// Hardware source IDs
+#define HW_EVENT_COUNTER 0
+#define HW_EXCEPTION 1
+#define HW_PC_SAMPLE 2
+#define HW_DATA_TRACE_FIRST 8
+#define HW_DATA_TRACE_LAST 23
+
+/**
+ * @brief Start decoding from scratch
+ *
+ * @param d Decoder state
+ */
+void itm_decoder_init(itm_decoder_t* d) {
+    d->state = ITM_STATE_HEADER;
+    d->remaining = 0;
+    d->shift = 0;
+    d->zeros = 0;
+}
+
+/**
+ * @brief Work out what a source packet header is from its hardware ID
+ */
+static itm_packet_type_t hardware_type(uint8_t id) {
+    if (id == HW_EVENT_COUNTER) {
+        return ITM_PKT_EVENT_COUNTER;
+    }
+    if (id == HW_EXCEPTION) {
+        return ITM_PKT_EXCEPTION;
+    }
+    if (id == HW_PC_SAMPLE) {
+        return ITM_PKT_PC_SAMPLE;
+    }
+    if (id >= HW_DATA_TRACE_FIRST && id <= HW_DATA_TRACE_LAST) {
+        return ITM_PKT_DATA_TRACE;
+    }
+    return ITM_PKT_HARDWARE;
+}
+
+/**
+ * @brief Decode a header byte
+ *
+ * @return 1 if the header is a whole packet on its own
+ */
+static uint8_t decode_header(itm_decoder_t* d, uint8_t byte) {
+    itm_packet_t* p = &d->packet;
+    p->port = 0;
+    p->size = 0;
+    p->value = 0;
+    d->shift = 0;
+
+    if (byte == 0) {
+        d->state = ITM_STATE_SYNC;
+        d->zeros = 1;
+        return 0;
+    }
+    if (byte == ITM_HEADER_OVERFLOW) {
+        p->type = ITM_PKT_OVERFLOW;
+        return 1;
+    }
+    if (byte & 0x03) {
+        // Source packet, SS is the payload size
+        static const uint8_t sizes[4] = { 0, 1, 2, 4 };
+        p->port = byte >> 3;
+        p->type = byte & 0x04 ? hardware_type(p->port) : ITM_PKT_STIMULUS;
+        d->remaining = sizes[byte & 0x03];
+        d->state = ITM_STATE_PAYLOAD;
+        return 0;
+    }
+    if (byte == ITM_HEADER_GTS1 || byte == ITM_HEADER_GTS2) {
+        p->type = ITM_PKT_GLOBAL_TS;
+        d->state = ITM_STATE_CONTINUATION;
+        return 0;
+    }
+    if ((byte & 0x0F) == 0 && !(byte & ITM_CONTINUE)) {
+        // Short local timestamp, the header alone
+        p->type = ITM_PKT_TIMESTAMP;
+        p->value = (byte >> 4) & 0x07;
+        return 1;
+    }
+    if ((byte & 0xCF) == 0xC0) {
+        // Long local timestamp, TC in the header says how it relates to the data
+        p->type = ITM_PKT_TIMESTAMP;
+        d->state = ITM_STATE_CONTINUATION;
+        return 0;
+    }
+    if ((byte & 0x0B) == 0x08) {
+        // Extension, three bits of it live in the header
+        p->type = ITM_PKT_EXTENSION;
+        p->value = (byte >> 4) & 0x07;
+        d->shift = 3;
+        if (!(byte & ITM_CONTINUE)) {
+            return 1;
+        }
+        d->state = ITM_STATE_CONTINUATION;
+        return 0;
+    }
+    // Reserved, skip it and hope the next byte is a header
+    return 0;
+}
+
+/**
+ * @brief Feed one byte of trace to the decoder
+ *
+ * @param d Decoder state
+ * @param byte Next byte of trace
+ * @param out Where a finished packet is stored
+ *
+ * @return 1 if the byte finished a packet
+ */
+uint8_t itm_decode_byte(itm_decoder_t* d, uint8_t byte, itm_packet_t* out) {
+    itm_packet_t* p = &d->packet;
+
+    switch (d->state) {
+    case ITM_STATE_HEADER:
+        if (!decode_header(d, byte)) {
+            return 0;
+        }
+        break;
+    case ITM_STATE_PAYLOAD:
+        p->value |= (uint32_t)byte << (8 * p->size);
+        p->size++;
+        if (--d->remaining) {
+            return 0;
+        }
+        d->state = ITM_STATE_HEADER;
+        break;
+    case ITM_STATE_CONTINUATION:
+        // Seven bits a byte, anything past 32 bits is dropped
+        if (d->shift < 32) {
+            p->value |= (uint32_t)(byte & 0x7F) << d->shift;
+        }
+        d->shift += 7;
+        p->size++;
+        if (byte & ITM_CONTINUE) {
+            return 0;
+        }
+        d->state = ITM_STATE_HEADER;
+        break;
+    case ITM_STATE_SYNC:
+        if (byte == 0) {
+            if (d->zeros < ITM_SYNC_ZEROS) {
+                d->zeros++;
+            }
+            return 0;
+        }
+        d->state = ITM_STATE_HEADER;
+        if (byte == ITM_CONTINUE && d->zeros >= ITM_SYNC_ZEROS) {
+            p->type = ITM_PKT_SYNC;
+            break;
+        }
+        // Not a sync after all, the zeros were lost and this is a header
+        return itm_decode_byte(d, byte, out);
+    }
+    *out = *p;
+    return 1;
+}
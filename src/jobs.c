@@ -0,0 +1,144 @@
+/**
+ * @file jobs.c
+ * @author Min Kang
+ * @brief Cooperative scheduler for long running operations
+ *
+ * Jobs take turns, one step each per pass of the main loop, so a short
+ * command typed in the middle of a load only waits for the step that is
+ * running. Steps must leave the SWD link idle when they return.
+ */
+#include "jobs.h"
+#include "utils.h"
+#include "pico/time.h"
+#include <stdio.h>
+#include <stdarg.h>
+
+static job_t* jobs[JOBS_MAX];
+
+static uint32_t percent(job_t* job) {
+    return job->total ? (uint32_t)((uint64_t)job->done * 100 / job->total) : 0;
+}
+
+/**
+ * @brief Take a job off the list
+ */
+static void job_remove(uint8_t i) {
+    jobs[i]->active = 0;
+    jobs[i] = NULL;
+}
+
+/**
+ * @brief Start running a job in the background
+ *
+ * The job's state, done and total are left as the caller set them.
+ *
+ * @param job Job to start, must stay valid until it finishes
+ *
+ * @return 1 if started, 0 if it is already running or there is no room
+ */
+uint8_t job_start(job_t* job) {
+    uint8_t i;
+    if (job->active) {
+        return 0;
+    }
+    for (i = 0; i < JOBS_MAX; ++i) {
+        if (!jobs[i]) {
+            job->active = 1;
+            job->start_us = time_us_64();
+            job->report_us = job->start_us + JOB_PROGRESS_INTERVAL_US;
+            jobs[i] = job;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Run one step of every job, run from the main loop
+ *
+ * @return Number of jobs still running
+ */
+uint8_t job_run() {
+    uint8_t i, running = 0;
+    job_status_t status;
+    uint64_t now;
+
+    for (i = 0; i < JOBS_MAX; ++i) {
+        job_t* job = jobs[i];
+        if (!job) {
+            continue;
+        }
+        status = job->step(job);
+        now = time_us_64();
+        if (status == JOB_RUNNING) {
+            running++;
+            if (job->total && (int64_t)(now - job->report_us) >= 0) {
+                job->report_us = now + JOB_PROGRESS_INTERVAL_US;
+                job_printf(job, "%u%%", percent(job));
+            }
+            continue;
+        }
+        if (status == JOB_DONE) {
+            job_printf(job, "done in %u ms", (uint32_t)((now - job->start_us) / 1000));
+        } else {
+            job_printf(job, "\033[31mfailed\033[0m");
+        }
+        job_remove(i);
+    }
+    return running;
+}
+
+/**
+ * @brief Stop every running job where it is
+ *
+ * @return Number of jobs cancelled
+ */
+uint8_t job_cancel_all() {
+    uint8_t i, cancelled = 0;
+    for (i = 0; i < JOBS_MAX; ++i) {
+        if (jobs[i]) {
+            job_printf(jobs[i], "cancelled at %u%%", percent(jobs[i]));
+            job_remove(i);
+            cancelled++;
+        }
+    }
+    return cancelled;
+}
+
+/**
+ * @brief Print a message from a job without mangling the line being typed
+ *
+ * @param job Job the message is from
+ * @param fmt printf() format
+ */
+void job_printf(job_t* job, const char* fmt, ...) {
+    va_list args;
+    // Wipe the prompt, print, and put the prompt back under the message
+    printf("\r\033[K[%s] ", job->name);
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    printf("\n");
+    redraw_line();
+}
+
+/**
+ * @brief List the running jobs and how far they got
+ *
+ * @return 0
+ */
+uint8_t show_jobs() {
+    uint8_t i, any = 0;
+    uint64_t now = time_us_64();
+    for (i = 0; i < JOBS_MAX; ++i) {
+        if (jobs[i]) {
+            printf("%-8s %3u%%  %u ms\n", jobs[i]->name, percent(jobs[i]),
+                   (uint32_t)((now - jobs[i]->start_us) / 1000));
+            any = 1;
+        }
+    }
+    if (!any) {
+        printf("No jobs running\n");
+    }
+    return 0;
+}
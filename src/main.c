@@ -18,6 +18,16 @@
 #include "swd_init.h"
 #include "mem.h"
 #include "debug_interface.h"
+#include "proto.h"
+#include "gdb.h"
+#include "console.h"
+#include "swd_engine.h"
+#include "jobs.h"
+#include "usb_cdc.h"
+#include "host_port.h"
+#include "profile.h"
+#include "swo.h"
+#include "rtt.h"
 
 typedef struct {
     char* cmd;
@@ -31,21 +41,79 @@ typedef struct {
 
 Command commands[] = {
     { "help",     .has_args = 0, .single_char = 1, .func_ptr.no_arg_func = show_help },
-    { "init",     .has_args = 0, .single_char = 1, .func_ptr.no_arg_func = debug_initialize_swd },
+    { "init",     .has_args = 1, .single_char = 1, .func_ptr.arg_func = debug_initialize_swd },
     { "status",   .has_args = 0, .single_char = 0, .func_ptr.no_arg_func = show_debug_status },
     { "halt",     .has_args = 0, .single_char = 0, .func_ptr.no_arg_func = halt_core },
     { "continue", .has_args = 0, .single_char = 1, .func_ptr.no_arg_func = continue_core },
     { "reset",    .has_args = 0, .single_char = 0, .func_ptr.no_arg_func = reset_core },
-    { "step",     .has_args = 0, .single_char = 1, .func_ptr.no_arg_func = single_step },
+    { "step",     .has_args = 1, .single_char = 1, .func_ptr.arg_func = single_step },
     { "pc",       .has_args = 0, .single_char = 0, .func_ptr.no_arg_func = read_pc },
 
     { "load",     .has_args = 1, .single_char = 0, .func_ptr.arg_func = load_file_and_run },
     { "set",      .has_args = 1, .single_char = 0, .func_ptr.arg_func = interface_set_mem },
     { "read",     .has_args = 1, .single_char = 0, .func_ptr.arg_func = interface_read_mem },
     { "x",        .has_args = 1, .single_char = 0, .func_ptr.arg_func = interface_read_mem },
-    // TODO: Add info command, info reg should print all register values
+    { "backend",  .has_args = 1, .single_char = 0, .func_ptr.arg_func = interface_select_backend },
+    { "bench",    .has_args = 1, .single_char = 0, .func_ptr.arg_func = interface_bench },
+    { "clock",    .has_args = 1, .single_char = 0, .func_ptr.arg_func = interface_set_clock },
+    { "stats",    .has_args = 1, .single_char = 0, .func_ptr.arg_func = interface_stats },
+    { "overrun",  .has_args = 1, .single_char = 0, .func_ptr.arg_func = interface_overrun },
+    { "proto",    .has_args = 0, .single_char = 0, .func_ptr.no_arg_func = proto_run },
+    { "gdb",      .has_args = 0, .single_char = 0, .func_ptr.no_arg_func = gdb_server_run },
+    { "jobs",     .has_args = 0, .single_char = 0, .func_ptr.no_arg_func = show_jobs },
+    { "break",    .has_args = 1, .single_char = 0, .func_ptr.arg_func = interface_break },
+    { "delete",   .has_args = 1, .single_char = 0, .func_ptr.arg_func = interface_delete },
+    { "watch",    .has_args = 1, .single_char = 0, .func_ptr.arg_func = interface_watch },
+    { "unwatch",  .has_args = 1, .single_char = 0, .func_ptr.arg_func = interface_unwatch },
+    { "profile",  .has_args = 1, .single_char = 0, .func_ptr.arg_func = profile_run },
+    { "swo",      .has_args = 1, .single_char = 0, .func_ptr.arg_func = swo_run },
+    { "rtt",      .has_args = 1, .single_char = 0, .func_ptr.arg_func = rtt_run },
+    { "info",     .has_args = 1, .single_char = 0, .func_ptr.arg_func = interface_info },
 };
 
+typedef struct {
+    uint8_t (*func)();
+    uint32_t period_us;
+    uint8_t bulk;
+    uint64_t next_us;
+} Task;
+
+// Background work run by the main loop between keystrokes. Bulk tasks
+// hand the SWD link over one batch at a time and wait for the rest.
+Task tasks[] = {
+    { host_port_task, .period_us = 0,                     .bulk = 0 },
+    { poll_halt,      .period_us = HALT_POLL_INTERVAL_US, .bulk = 0 },
+    { swo_task,       .period_us = SWO_POLL_INTERVAL_US,  .bulk = 0 },
+    { job_run,        .period_us = 0,                     .bulk = 1 },
+    { rtt_task,       .period_us = 0,                     .bulk = 1 },
+};
+
+static uint64_t bulk_us;
+
+/**
+ * @brief Whether a client is waiting for the SWD link
+ */
+uint8_t interactive_pending(void) {
+    return console_available() || usb_cdc_available(USB_CDC_HOST);
+}
+
+void run_tasks(void) {
+    uint64_t now = time_us_64();
+    int task_size = sizeof(tasks) / sizeof(Task);
+    for (int i = 0; i < task_size; ++i) {
+        if ((int64_t)(now - tasks[i].next_us) < 0)
+            continue;
+        if (tasks[i].bulk) {
+            // Clients go first, but bulk work is never held off for long
+            if (interactive_pending() && now - bulk_us < BULK_MAX_DEFER_US)
+                continue;
+            bulk_us = now;
+        }
+        tasks[i].next_us = now + tasks[i].period_us;
+        tasks[i].func();
+    }
+}
+
 void parse_cmd(char** args, uint8_t num_args) {
     if (num_args == 0) {
         return;
@@ -68,7 +136,9 @@ void parse_cmd(char** args, uint8_t num_args) {
 
 void init(void) {
     stdio_init_all();
+    console_init();
     setup();
+    swd_engine_start();
 }
 
 // *********************************** //
@@ -93,7 +163,15 @@ int main(void) {
 
 
     while (1) {
-        get_line(buf, BUF_LEN);
+        if (!get_line(buf, BUF_LEN)) {
+            run_tasks();
+            console_flush();
+            continue;
+        }
+        if (buf[0] == PROTO_ESCAPE) {
+            proto_run();
+            continue;
+        }
         tokenize(buf, BUF_LEN, tokens, TOKENS_LEN, &num_tokens);
         parse_cmd(tokens, num_tokens);
     }
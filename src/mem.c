@@ -5,9 +5,12 @@
  */
 #include "mem.h"
 #include "data_transfer.h"
+#include "swd_batch.h"
+#include "swd_engine.h"
 #include "utils.h"
 #include "macros.h"
 #include <stdio.h>
+#include <string.h>
 
 /**
  * @brief Read from address of TARGET
@@ -19,32 +22,22 @@
  */
 uint8_t mem_read(uint32_t addr, uint32_t* data) {
     uint8_t ack;
-    // ------ Write to CSW of MEM-AP ----- //
-    // Enable auto increment
-	ack = SWD_AP_write(0b00, 0x22000012);
-	CHECK_ACK_RT("Failed reading core while writing to CSW");
-    delay();
-
-    // Write to TAR to set address to read from
-	ack = SWD_AP_write(0b10, addr);
-	CHECK_ACK_RT("Failed setting target address while reading core");
-    delay();
-
-    // Read from DRW and handle WAIT ACK
-    if ((ack = SWD_AP_read(0b11, data)) == 0b010) {
-		// First read returns nothing of use
-        ack = SWD_DP_read(0b11, data);
-		CHECK_ACK_RT("Bad ACK while reading core");
-        ack = SWD_AP_read(0b11, data);
-		CHECK_ACK_RT("Bad ACK while reading core");
-        if ((ack = SWD_DP_read(0b11, data)) != 1) {
-            error("Bad ACK in SWD_core_single_read while reading from RDBUFF");
-            return ack;
-        }
-    } else {
-        error("Bad ACK while reading from DRW in SWD_core_single_read");
-        return ack;
+    swd_op_t ops[] = {
+        // 32-bit, no auto increment. Dropped if CSW already holds this.
+        { .req = AP_WRITE(AP_CSW), .data = CSW_WORD },
+        // Set address to read from
+        { .req = AP_WRITE(AP_TAR), .data = addr },
+        // Posted read, the batch collects it from RDBUFF
+        { .req = AP_READ(AP_DRW) },
+    };
+
+    ack = swd_transfer_batch(ops, 3);
+    if (ack == SWD_ERR_PARITY) {
+        // The data got corrupted on the way back, read it again
+        ack = swd_transfer_batch(ops, 3);
     }
+    CHECK_ACK_RT("Failed reading memory");
+    *data = ops[2].data;
 
     return ack;
 }
@@ -60,41 +53,20 @@ uint8_t mem_read(uint32_t addr, uint32_t* data) {
  */
 uint8_t mem_read_db(uint32_t addr, uint32_t* data, char* reg_name) {
     uint8_t ack;
-    // ------ Write to CSW of MEM-AP ----- //
-    // Enable auto increment
-    if ((ack = SWD_AP_write(0b00, 0x22000012)) != 1) {
-        error("Error in CSW write");
-        return ack;
-    }
-    delay();
+    swd_op_t ops[] = {
+        { .req = AP_WRITE(AP_CSW), .data = CSW_WORD },
+        { .req = AP_WRITE(AP_TAR), .data = addr },
+        { .req = AP_READ(AP_DRW) },
+    };
 
-    // Write to TAR to set address to read from
-    if ((ack = SWD_AP_write(0b10, addr)) != 1) {
-        error("Bad ACK in SWD core single read");
-        return ack;
-    }
-    printf("%s ADDR: 0x%.8x ACK: \033[33m%d\033[0m\n", reg_name, addr, ack);
-    delay();
-
-    // Read from DRW and handle WAIT ACK
-    if ((ack = SWD_AP_read(0b11, data)) == 0b010) {
-        ack = SWD_DP_read(0b11, data);
-        if (ack != 1) {
-            error("Error");
-            return ack;
-        }
-        // HACK Handle corrupted read on first AP-read of TARGET
-        //printf("Handling corrupted read\n");
-        ack = SWD_AP_read(0b11, data);
-        //return ack;
-        if ((ack = SWD_DP_read(0b11, data)) != 1) {
-            error("Bad ACK in SWD_core_single_read while reading from RDBUFF");
-            return ack;
-        }
-    } else {
-        error("Bad ACK while reading from DRW in SWD_core_single_read");
+    ack = swd_transfer_batch(ops, 3);
+    printf("%s CSW ACK: \033[33m%d\033[0m\n", reg_name, ops[0].ack);
+    printf("%s ADDR: 0x%.8x ACK: \033[33m%d\033[0m\n", reg_name, addr, ops[1].ack);
+    if (ack != SWD_ACK_OK) {
+        error_ack("Bad ACK while reading memory", ack);
         return ack;
     }
+    *data = ops[2].data;
     printf("%s VALUE: 0x%.8x ACK: \033[33m%d\033[0m\n", reg_name, *data, ack);
 
     return ack;
@@ -110,15 +82,15 @@ uint8_t mem_read_db(uint32_t addr, uint32_t* data, char* reg_name) {
  */
 uint8_t mem_write(uint32_t addr, uint32_t data) {
     uint8_t ack;
-    if ((ack = SWD_AP_write(0b10, addr)) != 1) {
-        error ("Bad ACK in SWD_core_single_write");
-        return ack;
-    }
-    if ((ack = SWD_AP_write(0b11, data)) != 1) {
+    swd_op_t ops[] = {
+        { .req = AP_WRITE(AP_CSW), .data = CSW_WORD },
+        { .req = AP_WRITE(AP_TAR), .data = addr },
+        { .req = AP_WRITE(AP_DRW), .data = data },
+    };
+    if ((ack = swd_transfer_batch(ops, 3)) != 1) {
         error ("Bad ACK in SWD_core_single_write");
         return ack;
     }
-    delay();
     return ack;
 }
 
@@ -133,16 +105,432 @@ uint8_t mem_write(uint32_t addr, uint32_t data) {
  */
 uint8_t mem_write_db(uint32_t addr, uint32_t data, char* reg_name) {
     uint8_t ack;
-    if ((ack = SWD_AP_write(0b10, addr)) != 1) {
+    if ((ack = SWD_AP_write(AP_CSW, CSW_WORD)) != 1) {
+        error ("Bad ACK in SWD_core_single_write");
+        return ack;
+    }
+    if ((ack = SWD_AP_write(AP_TAR, addr)) != 1) {
         error ("Bad ACK in SWD_core_single_write");
         return ack;
     }
     printf("%s ADDR: 0x%.8x ACK: \033[33m%d\033[0m\n", reg_name, addr, ack);
-    if ((ack = SWD_AP_write(0b11, data)) != 1) {
+    if ((ack = SWD_AP_write(AP_DRW, data)) != 1) {
         error ("Bad ACK in SWD_core_single_write");
         return ack;
     }
     printf("%s ADDR: 0x%.8x ACK: \033[33m%d\033[0m\n", reg_name, data, ack);
-    delay();
     return ack;
 }
+
+static swd_op_t block_ops[2][MEM_BLOCK_BATCH + 2];
+static mem_caps_t caps = { .probed = 0, .sub_word = 1, .packed = 0 };
+
+/**
+ * @brief CSW.Size field for an access size in bytes
+ */
+static inline uint32_t csw_size(uint8_t size) {
+    return size == 1 ? CSW_SIZE_BYTE : size == 2 ? CSW_SIZE_HALF : CSW_SIZE_WORD;
+}
+
+/**
+ * @brief Mask covering an access size in bytes
+ */
+static inline uint32_t size_mask(uint8_t size) {
+    return size == 4 ? 0xFFFFFFFF : (1u << (size * 8)) - 1;
+}
+
+/**
+ * @brief Find out which access sizes and increment modes the MEM-AP has
+ *
+ * Writes CSW asking for byte size and packed increment and reads it back.
+ * A MEM-AP that lacks either leaves the field at something else.
+ *
+ * @return ACK of request
+ */
+uint8_t mem_probe_caps() {
+    uint8_t ack;
+    swd_op_t ops[] = {
+        { .req = AP_WRITE(AP_CSW), .data = CSW_BASE | CSW_ADDRINC_PACKED | CSW_SIZE_BYTE },
+        { .req = AP_READ(AP_CSW) },
+        // Leave CSW how the shadow cache expects it
+        { .req = AP_WRITE(AP_CSW), .data = CSW_WORD_INC },
+    };
+    ack = swd_transfer_batch(ops, 3);
+    CHECK_ACK_RT("Failed probing CSW");
+    caps.sub_word = (ops[1].data & CSW_SIZE_MASK) == CSW_SIZE_BYTE;
+    caps.packed = (ops[1].data & CSW_ADDRINC_MASK) == CSW_ADDRINC_PACKED;
+    caps.probed = 1;
+    return ack;
+}
+
+/**
+ * @brief Get what the MEM-AP was found to support
+ *
+ * Until mem_probe_caps() runs, byte and halfword accesses are assumed to
+ * work and packed transfers are not.
+ *
+ * @return Pointer to the capabilities
+ */
+const mem_caps_t* mem_get_caps() {
+    return &caps;
+}
+
+/**
+ * @brief Read a byte, halfword or word from TARGET
+ *
+ * The value is taken off the byte lanes the address selects.
+ *
+ * @param addr Address to read from, aligned to size
+ * @param data Where the value is stored, zero extended
+ * @param size Access size in bytes, 1, 2 or 4
+ *
+ * @return ACK of request
+ */
+uint8_t mem_read_sized(uint32_t addr, uint32_t* data, uint8_t size) {
+    uint8_t ack;
+    swd_op_t ops[] = {
+        { .req = AP_WRITE(AP_CSW), .data = CSW_BASE | csw_size(size) },
+        { .req = AP_WRITE(AP_TAR), .data = addr },
+        { .req = AP_READ(AP_DRW) },
+    };
+
+    ack = swd_transfer_batch(ops, 3);
+    if (ack == SWD_ERR_PARITY) {
+        ack = swd_transfer_batch(ops, 3);
+    }
+    CHECK_ACK_RT("Failed reading memory");
+    *data = (ops[2].data >> ((addr & 3) * 8)) & size_mask(size);
+    return ack;
+}
+
+/**
+ * @brief Write a byte, halfword or word to TARGET
+ *
+ * The value is put on the byte lanes the address selects, only those bytes
+ * are written.
+ *
+ * @param addr Address to write to, aligned to size
+ * @param data Value to write
+ * @param size Access size in bytes, 1, 2 or 4
+ *
+ * @return ACK of request
+ */
+uint8_t mem_write_sized(uint32_t addr, uint32_t data, uint8_t size) {
+    uint8_t ack;
+    swd_op_t ops[] = {
+        { .req = AP_WRITE(AP_CSW), .data = CSW_BASE | csw_size(size) },
+        { .req = AP_WRITE(AP_TAR), .data = addr },
+        { .req = AP_WRITE(AP_DRW), .data = (data & size_mask(size)) << ((addr & 3) * 8) },
+    };
+
+    ack = swd_transfer_batch(ops, 3);
+    CHECK_ACK_RT("Failed writing memory");
+    return ack;
+}
+
+/**
+ * @brief One batch of a block transfer, run by the SWD engine
+ */
+typedef struct {
+    swd_job_t job;
+    uint32_t addr;     // Address of the first DRW access
+    uint8_t* buf;      // Bytes the accesses move
+    uint32_t accesses; // DRW accesses, after the CSW and TAR writes
+} block_batch_t;
+
+/**
+ * @brief Fill in the next batch of a block transfer
+ *
+ * A batch never crosses a 1 KB boundary, so TAR auto increment holds.
+ */
+static void block_build(block_batch_t* b, uint32_t addr, uint8_t* buf, uint32_t len, uint8_t step, uint32_t csw, uint8_t rnw) {
+    swd_op_t* ops = b->job.ops;
+    uint32_t accesses = (TAR_AUTOINC_BLOCK - (addr & (TAR_AUTOINC_BLOCK - 1))) / step;
+    uint32_t num_ops = 0, i, word;
+    if (accesses > len / step) {
+        accesses = len / step;
+    }
+    if (accesses > MEM_BLOCK_BATCH) {
+        accesses = MEM_BLOCK_BATCH;
+    }
+
+    // Dropped by the shadow cache unless a 1 KB boundary or an error
+    // means TAR really has to be written
+    ops[num_ops].req = AP_WRITE(AP_CSW);
+    ops[num_ops++].data = csw;
+    ops[num_ops].req = AP_WRITE(AP_TAR);
+    ops[num_ops++].data = addr;
+    for (i = 0; i < accesses; ++i) {
+        word = 0;
+        if (!rnw) {
+            // A lone element rides on the byte lanes its address selects
+            memcpy(&word, &buf[i * step], step);
+            word <<= ((addr + i * step) & 3) * 8;
+        }
+        ops[num_ops].req = rnw ? AP_READ(AP_DRW) : AP_WRITE(AP_DRW);
+        ops[num_ops++].data = word;
+    }
+
+    b->job.num_ops = num_ops;
+    b->job.raw = 0;
+    b->addr = addr;
+    b->buf = buf;
+    b->accesses = accesses;
+}
+
+/**
+ * @brief Wait for a batch of a block transfer and unpack what it read
+ */
+static uint8_t block_finish(block_batch_t* b, uint8_t step, uint8_t rnw) {
+    uint32_t i, word;
+    uint8_t ack = swd_engine_wait(&b->job);
+    if (ack == SWD_ACK_WAIT || ack == SWD_ERR_PARITY) {
+        // Errors are cleared by now and the batch starts by setting TAR,
+        // so it can simply run again. The batch queued behind it covers
+        // other addresses, so it doesn't matter that it ran first.
+        swd_engine_submit(&b->job);
+        ack = swd_engine_wait(&b->job);
+    }
+    if (ack != SWD_ACK_OK || !rnw) {
+        return ack;
+    }
+    for (i = 0; i < b->accesses; ++i) {
+        word = b->job.ops[2 + i].data >> (((b->addr + i * step) & 3) * 8);
+        memcpy(&b->buf[i * step], &word, step);
+    }
+    return ack;
+}
+
+/**
+ * @brief Stream accesses through DRW, one batch at a time
+ *
+ * Every DRW access moves step bytes of buf: one element, or a whole word
+ * of them when packed.
+ *
+ * Two batches are kept going, so the next one is packed, or the last one
+ * unpacked, while the SWD engine is busy with the other.
+ *
+ * @param addr Address to start at, aligned to size, word aligned if packed
+ * @param buf Bytes to write, or where bytes are read into
+ * @param len Number of bytes, a multiple of size, of 4 if packed
+ * @param size Access size in bytes, 1, 2 or 4
+ * @param packed 1 to pack several elements into each access
+ * @param rnw 1 to read, 0 to write
+ *
+ * @return ACK of request
+ */
+static uint8_t mem_block(uint32_t addr, uint8_t* buf, uint32_t len, uint8_t size, uint8_t packed, uint8_t rnw) {
+    static block_batch_t batches[2] = {
+        { .job.ops = block_ops[0] },
+        { .job.ops = block_ops[1] },
+    };
+    uint8_t step = packed ? 4 : size;
+    uint32_t csw = CSW_BASE | csw_size(size) | (packed ? CSW_ADDRINC_PACKED : CSW_ADDRINC_SINGLE);
+    uint32_t next = 0, oldest = 0, in_flight = 0, moved;
+    uint8_t ack = SWD_ACK_OK;
+
+    while (len || in_flight) {
+        if (len && in_flight < 2) {
+            block_batch_t* b = &batches[next];
+            next ^= 1;
+            block_build(b, addr, buf, len, step, csw, rnw);
+            swd_engine_submit(&b->job);
+            in_flight++;
+
+            moved = b->accesses * step;
+            addr += moved;
+            buf += moved;
+            len -= moved;
+            continue;
+        }
+
+        ack = block_finish(&batches[oldest], step, rnw);
+        oldest ^= 1;
+        in_flight--;
+        if (ack != SWD_ACK_OK) {
+            // Nothing may be left running on the link
+            if (in_flight) {
+                swd_engine_wait(&batches[oldest].job);
+            }
+            return ack;
+        }
+    }
+    return ack;
+}
+
+/**
+ * @brief Read consecutive words from TARGET
+ *
+ * Streams through DRW with TAR auto increment and posted reads. TAR is only
+ * rewritten when the transfer crosses a 1 KB auto increment boundary.
+ *
+ * @param addr Word aligned address to start reading from
+ * @param buf Where the words are read into
+ * @param n Number of words
+ *
+ * @return ACK of request
+ */
+uint8_t mem_read_block(uint32_t addr, uint32_t* buf, uint32_t n) {
+    return mem_block(addr, (uint8_t*)buf, n * 4, 4, 0, 1);
+}
+
+/**
+ * @brief Write consecutive words to TARGET
+ *
+ * Streams through DRW with TAR auto increment. TAR is only rewritten when
+ * the transfer crosses a 1 KB auto increment boundary.
+ *
+ * @param addr Word aligned address to start writing to
+ * @param buf Words to write
+ * @param n Number of words
+ *
+ * @return ACK of request
+ */
+uint8_t mem_write_block(uint32_t addr, const uint32_t* buf, uint32_t n) {
+    return mem_block(addr, (uint8_t*)buf, n * 4, 4, 0, 0);
+}
+
+/**
+ * @brief Access less than a word on a MEM-AP without byte or halfword sizes
+ *
+ * The only way left is to go through the whole word.
+ */
+static uint8_t mem_partial_word(uint32_t addr, uint8_t* buf, uint8_t len, uint8_t rnw) {
+    uint32_t word;
+    uint8_t ack = mem_read(addr & ~3, &word);
+    if (ack != SWD_ACK_OK) {
+        return ack;
+    }
+    if (rnw) {
+        memcpy(buf, (uint8_t*)&word + (addr & 3), len);
+        return ack;
+    }
+    memcpy((uint8_t*)&word + (addr & 3), buf, len);
+    return mem_write(addr & ~3, word);
+}
+
+/**
+ * @brief Move bytes at any alignment, in as few accesses as possible
+ */
+static uint8_t mem_bytes(uint32_t addr, uint8_t* buf, uint32_t len, uint8_t rnw) {
+    uint8_t ack = SWD_ACK_OK;
+    uint32_t words;
+
+    while (len) {
+        if ((addr & 3) == 0 && len >= 4) {
+            words = len & ~3;
+            ack = mem_block(addr, buf, words, 4, 0, rnw);
+        } else if (!caps.sub_word) {
+            words = 4 - (addr & 3);
+            if (words > len) {
+                words = len;
+            }
+            ack = mem_partial_word(addr, buf, words, rnw);
+        } else {
+            // Halfword if aligned and there's enough left, otherwise a byte.
+            // TAR carries on from the last access so only CSW changes.
+            words = ((addr & 1) == 0 && len >= 2) ? 2 : 1;
+            ack = mem_block(addr, buf, words, words, 0, rnw);
+        }
+        if (ack != SWD_ACK_OK) {
+            return ack;
+        }
+        addr += words;
+        buf += words;
+        len -= words;
+    }
+    return ack;
+}
+
+/**
+ * @brief Read bytes from TARGET at any alignment
+ *
+ * Unaligned heads and tails use byte and halfword accesses, and never touch
+ * memory outside the range. Whole words in between are streamed.
+ *
+ * @param addr Address to start reading from
+ * @param buf Where the bytes are read into
+ * @param len Number of bytes
+ *
+ * @return ACK of request
+ */
+uint8_t mem_read_bytes(uint32_t addr, uint8_t* buf, uint32_t len) {
+    return mem_bytes(addr, buf, len, 1);
+}
+
+/**
+ * @brief Write bytes to TARGET at any alignment
+ *
+ * Unaligned heads and tails use byte and halfword accesses, so nothing
+ * outside the range is written. Whole words in between are streamed.
+ *
+ * @param addr Address to start writing to
+ * @param buf Bytes to write
+ * @param len Number of bytes
+ *
+ * @return ACK of request
+ */
+uint8_t mem_write_bytes(uint32_t addr, const uint8_t* buf, uint32_t len) {
+    return mem_bytes(addr, (uint8_t*)buf, len, 0);
+}
+
+/**
+ * @brief Move elements that must each be accessed at their own size
+ */
+static uint8_t mem_sized_block(uint32_t addr, uint8_t* buf, uint32_t n, uint8_t size, uint8_t rnw) {
+    uint32_t len = n * size, head, body;
+    uint8_t ack;
+
+    if (size == 4 || !caps.packed) {
+        return mem_block(addr, buf, len, size, 0, rnw);
+    }
+
+    // Single accesses up to a word boundary, then a word of elements per
+    // access, then whatever is left over
+    head = (4 - (addr & 3)) & 3;
+    if (head > len) {
+        head = len;
+    }
+    body = (len - head) & ~3;
+    if (head && (ack = mem_block(addr, buf, head, size, 0, rnw)) != SWD_ACK_OK) {
+        return ack;
+    }
+    if (body && (ack = mem_block(addr + head, buf + head, body, size, 1, rnw)) != SWD_ACK_OK) {
+        return ack;
+    }
+    return mem_block(addr + head + body, buf + head + body, len - head - body, size, 0, rnw);
+}
+
+/**
+ * @brief Read consecutive bytes, halfwords or words, each at its own size
+ *
+ * For registers that care about access size. Packed transfers are used
+ * when the MEM-AP has them, so a word of elements costs one access.
+ *
+ * @param addr Address to start reading from, aligned to size
+ * @param buf Where the elements are read into
+ * @param n Number of elements
+ * @param size Access size in bytes, 1, 2 or 4
+ *
+ * @return ACK of request
+ */
+uint8_t mem_read_sized_block(uint32_t addr, void* buf, uint32_t n, uint8_t size) {
+    return mem_sized_block(addr, buf, n, size, 1);
+}
+
+/**
+ * @brief Write consecutive bytes, halfwords or words, each at its own size
+ *
+ * For registers that care about access size. Packed transfers are used
+ * when the MEM-AP has them, so a word of elements costs one access.
+ *
+ * @param addr Address to start writing to, aligned to size
+ * @param buf Elements to write
+ * @param n Number of elements
+ * @param size Access size in bytes, 1, 2 or 4
+ *
+ * @return ACK of request
+ */
+uint8_t mem_write_sized_block(uint32_t addr, const void* buf, uint32_t n, uint8_t size) {
+    return mem_sized_block(addr, (uint8_t*)buf, n, size, 0);
+}
@@ -0,0 +1,278 @@
+/**
+ * @file profile.c
+ * @author Min Kang
+ * @brief PC sampling profiler
+ *
+ * DWT_PCSR hands out the PC of the running core without stopping it, so
+ * every sample is a single mem_read(). Cores without one are halted for
+ * each sample instead, which costs the TARGET a few microseconds a time.
+ *
+ * Samples are counted in a fixed size open addressed hash table keyed by
+ * address bucket. Once it is three quarters full, samples in buckets it
+ * doesn't have yet are only counted as dropped.
+ */
+#include "profile.h"
+#include "jobs.h"
+#include "core.h"
+#include "mem.h"
+#include "proto.h"
+#include "usb_cdc.h"
+#include "macros.h"
+#include "utils.h"
+#include "debug_interface.h"
+#include "swd_request.h"
+#include "pico/time.h"
+#include <stdio.h>
+#include <string.h>
+
+// PCSR reads as this while the core is halted or can't be sampled
+#define PCSR_NONE 0xFFFFFFFF
+
+typedef struct {
+    uint32_t bucket; // Address >> shift
+    uint32_t count;  // 0 for an empty entry
+} profile_entry_t;
+
+static profile_entry_t hist[PROFILE_BUCKETS];
+static uint32_t used;
+static uint32_t samples;
+static uint32_t dropped;
+static uint32_t halted;
+static uint8_t shift;
+static uint8_t use_pcsr;
+static uint32_t period_us;
+static uint64_t next_us;
+static uint64_t end_us;
+static job_t profile_job;
+
+static inline void put_u32(uint8_t* p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+/**
+ * @brief Count a sample in its bucket
+ */
+static void hist_add(uint32_t pc) {
+    uint32_t bucket = pc >> shift;
+    // Fibonacci hashing, neighbouring buckets spread out over the table
+    uint32_t i = (bucket * 2654435761u) & (PROFILE_BUCKETS - 1);
+    samples++;
+    while (hist[i].count) {
+        if (hist[i].bucket == bucket) {
+            hist[i].count++;
+            return;
+        }
+        i = (i + 1) & (PROFILE_BUCKETS - 1);
+    }
+    if (used >= PROFILE_BUCKETS * 3 / 4) {
+        dropped++;
+        return;
+    }
+    hist[i].bucket = bucket;
+    hist[i].count = 1;
+    used++;
+}
+
+/**
+ * @brief Take one PC sample
+ *
+ * @return ACK from SWD request
+ */
+static uint8_t take_sample() {
+    uint32_t pc, dhcsr;
+    uint8_t ack;
+
+    if (use_pcsr) {
+        if ((ack = mem_read(DWT_PCSR, &pc)) != SWD_ACK_OK) {
+            return ack;
+        }
+    } else {
+        // Leave a core that stopped on its own alone
+        if ((ack = mem_read(CORE_DHCSR, &dhcsr)) != SWD_ACK_OK) {
+            return ack;
+        }
+        pc = PCSR_NONE;
+        if (!(dhcsr & DHCSR_S_HALT)) {
+            if ((ack = core_halt()) != SWD_ACK_OK) {
+                return ack;
+            }
+            if ((ack = core_reg_read(CORE_REGSEL_PC, &pc)) != SWD_ACK_OK) {
+                return ack;
+            }
+            if ((ack = core_continue()) != SWD_ACK_OK) {
+                return ack;
+            }
+        }
+    }
+    if (pc == PCSR_NONE) {
+        halted++;
+    } else {
+        hist_add(pc & ~1u);
+    }
+    return SWD_ACK_OK;
+}
+
+/**
+ * @brief Print the hottest buckets
+ */
+static void print_top(uint64_t elapsed) {
+    uint32_t counted = samples - dropped;
+    uint32_t best, i, n;
+    uint8_t printed[PROFILE_BUCKETS / 8];
+
+    printf("%u samples in %u ms (%u Hz), %u buckets, %u dropped, %u while halted\n",
+           samples + halted, (uint32_t)(elapsed / 1000),
+           (uint32_t)((uint64_t)(samples + halted) * 1000000 / elapsed), used, dropped, halted);
+    memset(printed, 0, sizeof(printed));
+    for (n = 0; n < PROFILE_TOP && n < used; ++n) {
+        best = PROFILE_BUCKETS;
+        for (i = 0; i < PROFILE_BUCKETS; ++i) {
+            if (hist[i].count && !(printed[i / 8] & (1 << (i % 8))) &&
+                (best == PROFILE_BUCKETS || hist[i].count > hist[best].count)) {
+                best = i;
+            }
+        }
+        printed[best / 8] |= 1 << (best % 8);
+        printf("0x%.8x-0x%.8x %8u %3u%%\n", hist[best].bucket << shift,
+               ((hist[best].bucket + 1) << shift) - 1, hist[best].count,
+               (uint32_t)((uint64_t)hist[best].count * 100 / counted));
+    }
+}
+
+/**
+ * @brief Send n histogram entries already in the payload as one PROFILE event
+ */
+static void send_piece(uint8_t* payload, uint32_t first, uint32_t n) {
+    payload[0] = first;
+    payload[1] = first >> 8;
+    payload[2] = used;
+    payload[3] = used >> 8;
+    payload[4] = shift;
+    put_u32(&payload[5], samples);
+    proto_send_event(USB_CDC_STREAM, PROTO_EVT_PROFILE, payload, 9 + 8 * n);
+}
+
+/**
+ * @brief Send the histogram on the stream port as PROFILE events
+ */
+static void send_histogram() {
+    static uint8_t payload[PROTO_MAX_PAYLOAD];
+    const uint32_t per_frame = (PROTO_MAX_PAYLOAD - 9) / 8;
+    uint32_t first = 0, n = 0, i;
+
+    for (i = 0; i < PROFILE_BUCKETS; ++i) {
+        if (!hist[i].count) {
+            continue;
+        }
+        put_u32(&payload[9 + 8 * n], hist[i].bucket);
+        put_u32(&payload[13 + 8 * n], hist[i].count);
+        if (++n == per_frame) {
+            send_piece(payload, first, n);
+            first += n;
+            n = 0;
+        }
+    }
+    if (n || used == 0) {
+        // The rest, or a single empty piece so the host sees the end
+        send_piece(payload, first, n);
+    }
+}
+
+/**
+ * @brief One step of the profile job: every sample that is due
+ *
+ * A link too slow for the rate asked for drops the samples it can't make.
+ */
+static job_status_t profile_step(job_t* job) {
+    uint64_t now = time_us_64();
+    uint32_t n = 0;
+    uint8_t ack;
+
+    while ((int64_t)(now - next_us) >= 0 && n++ < PROFILE_BATCH) {
+        ack = take_sample();
+        CHECK_ACK_GT("Failed sampling PC");
+        next_us += period_us;
+    }
+    if ((int64_t)(now - next_us) >= 0) {
+        next_us = now + period_us;
+    }
+    job->done = (uint32_t)((now - job->start_us) / 1000);
+    if ((int64_t)(now - end_us) < 0) {
+        return JOB_RUNNING;
+    }
+
+    printf("\r\033[K");
+    print_top(now - job->start_us);
+    send_histogram();
+    return JOB_DONE;
+LOOP:
+    return JOB_FAILED;
+}
+
+/**
+ * @brief Profile the running core by sampling its PC
+ *
+ * Usage: profile <ms> [hz] [bucket]
+ *
+ * Samples DWT_PCSR, or halts the core for each sample where there is no
+ * PCSR, into a histogram of bucket byte ranges. Runs as a background job.
+ * At the end the hottest buckets are printed, and the whole histogram is
+ * sent on the stream port as PROTO_EVT_PROFILE frames, see proto.h.
+ *
+ * @return 0 if the job started, 1 for bad arguments
+ */
+uint8_t profile_run(char** args, uint8_t num_args) {
+    int32_t ms = num_args > 1 ? str_to_int(args[1]) : -1;
+    int32_t hz = num_args > 2 ? str_to_int(args[2]) : PROFILE_DEFAULT_HZ;
+    int32_t bucket = num_args > 3 ? str_to_int(args[3]) : PROFILE_DEFAULT_BUCKET;
+    uint32_t dhcsr, demcr, pc;
+    uint8_t ack;
+
+    if (num_args < 2 || num_args > 4 || ms <= 0 || hz <= 0 || hz > 1000000 ||
+        bucket < 2 || (bucket & (bucket - 1))) {
+        printf("Incorrect format. Format should be:\n");
+        printf("profile <ms> [hz] [bucket], bucket is a power of two\n");
+        return 1;
+    }
+    if (profile_job.active) {
+        error("Already profiling");
+        return 1;
+    }
+    ack = mem_read(CORE_DHCSR, &dhcsr);
+    CHECK_ACK_RT("Failed reading DHCSR");
+    if (dhcsr & DHCSR_S_HALT) {
+        error("Core is halted, continue it first");
+        return 1;
+    }
+
+    // PCSR needs the DWT powered, and reads as zero where there is none
+    ack = mem_read(CORE_DEMCR, &demcr);
+    CHECK_ACK_RT("Failed reading DEMCR");
+    ack = mem_write(CORE_DEMCR, demcr | DEMCR_TRCENA);
+    CHECK_ACK_RT("Failed writing DEMCR");
+    ack = mem_read(DWT_PCSR, &pc);
+    CHECK_ACK_RT("Failed reading DWT_PCSR");
+    use_pcsr = pc != 0;
+    if (!use_pcsr) {
+        printf("No DWT_PCSR, halting the core for every sample\n");
+    }
+
+    memset(hist, 0, sizeof(hist));
+    used = samples = dropped = halted = 0;
+    for (shift = 0; (1 << shift) < bucket; ++shift);
+    period_us = 1000000 / hz;
+    profile_job.name = "profile";
+    profile_job.step = profile_step;
+    profile_job.done = 0;
+    profile_job.total = ms;
+    if (!job_start(&profile_job)) {
+        error("Too many jobs running");
+        return 1;
+    }
+    next_us = profile_job.start_us;
+    end_us = profile_job.start_us + (uint64_t)ms * 1000;
+    return 0;
+}
@@ -0,0 +1,389 @@
+/**
+ * @file proto.c
+ * @author Min Kang
+ * @brief Framed binary host protocol
+ *
+ * Frames are parsed a byte at a time so the parser doesn't care where the
+ * bytes come from. Responses are built in place and sent in one go.
+ */
+#include "proto.h"
+#include "data_transfer.h"
+#include "swd_batch.h"
+#include "swd_init.h"
+#include "mem.h"
+#include "dap.h"
+#include "core.h"
+#include "usb_cdc.h"
+#include "macros.h"
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef enum {
+    PROTO_WAIT_SOF,
+    PROTO_LEN_LO,
+    PROTO_LEN_HI,
+    PROTO_CMD,
+    PROTO_PAYLOAD,
+    PROTO_CRC_LO,
+    PROTO_CRC_HI,
+} proto_state_t;
+
+static proto_state_t state = PROTO_WAIT_SOF;
+static uint16_t rx_len;
+static uint16_t rx_pos;
+static uint16_t rx_crc;
+// LEN, CMD and PAYLOAD as received, which is also what the CRC covers
+static uint8_t rx_frame[3 + PROTO_MAX_PAYLOAD];
+// SOF, LEN, CMD, PAYLOAD and CRC of the response
+static uint8_t tx_frame[1 + 3 + PROTO_MAX_PAYLOAD + 2];
+static uint8_t event_frame[1 + 3 + PROTO_MAX_PAYLOAD + 2];
+static swd_op_t ops[PROTO_MAX_OPS];
+// Where responses go, the port the frames come in on
+static uint8_t out_port = USB_CDC_CONSOLE;
+
+static inline uint32_t get_u32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint16_t get_u16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline void put_u32(uint8_t* p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+/**
+ * @brief CRC-16/CCITT-FALSE
+ *
+ * @param data Bytes to checksum
+ * @param len Number of bytes
+ *
+ * @return CRC of the bytes
+ */
+uint16_t proto_crc16(const uint8_t* data, uint32_t len) {
+    uint16_t crc = 0xFFFF;
+    uint8_t i;
+    while (len--) {
+        crc ^= (uint16_t)*data++ << 8;
+        for (i = 0; i < 8; ++i) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+/**
+ * @brief Frame and send a response
+ *
+ * The payload must already be in place after the header in tx_frame.
+ */
+static void send_response(uint8_t cmd, uint16_t len) {
+    tx_frame[0] = PROTO_SOF;
+    tx_frame[1] = len;
+    tx_frame[2] = len >> 8;
+    tx_frame[3] = cmd | PROTO_RESPONSE;
+    uint16_t crc = proto_crc16(&tx_frame[1], 3 + len);
+    tx_frame[4 + len] = crc;
+    tx_frame[5 + len] = crc >> 8;
+    usb_cdc_write(out_port, tx_frame, 6 + len);
+}
+
+/**
+ * @brief Run the accesses of a TRANSFER request
+ *
+ * @return Length of the response payload
+ */
+static uint16_t cmd_transfer(const uint8_t* req, uint16_t len, uint8_t* resp) {
+    uint32_t num_ops = 0, i, pos = 0, out = 1;
+    uint8_t ack;
+
+    while (pos < len) {
+        if (num_ops == PROTO_MAX_OPS) {
+            resp[0] = PROTO_ERR_LEN;
+            return 1;
+        }
+        ops[num_ops].req = req[pos++] & 0xF;
+        ops[num_ops].data = 0;
+        if (!(ops[num_ops].req & SWD_REQ_RnW)) {
+            if (pos + 4 > len) {
+                resp[0] = PROTO_ERR_LEN;
+                return 1;
+            }
+            ops[num_ops].data = get_u32(&req[pos]);
+            pos += 4;
+        }
+        num_ops++;
+    }
+
+    ack = swd_transfer_batch(ops, num_ops);
+    resp[0] = ack == SWD_ACK_OK ? PROTO_OK : PROTO_ERR_SWD | ack;
+    // At most 5 bytes per op, always fits
+    for (i = 0; i < num_ops; ++i) {
+        resp[out++] = ops[i].ack;
+        if (ops[i].req & SWD_REQ_RnW) {
+            put_u32(&resp[out], ops[i].data);
+            out += 4;
+        }
+    }
+    return out;
+}
+
+/**
+ * @brief Read every range of a READ request
+ *
+ * @return Length of the response payload
+ */
+static uint16_t cmd_read(const uint8_t* req, uint16_t len, uint8_t* resp) {
+    uint32_t pos, out = 1;
+    uint8_t ack;
+
+    if (len % 6) {
+        resp[0] = PROTO_ERR_LEN;
+        return 1;
+    }
+    for (pos = 0; pos < len; pos += 6) {
+        uint16_t n = get_u16(&req[pos + 4]);
+        if (out + n > PROTO_MAX_PAYLOAD) {
+            resp[0] = PROTO_ERR_LEN;
+            return 1;
+        }
+        if ((ack = mem_read_bytes(get_u32(&req[pos]), &resp[out], n)) != SWD_ACK_OK) {
+            resp[0] = PROTO_ERR_SWD | ack;
+            return 1;
+        }
+        out += n;
+    }
+    resp[0] = PROTO_OK;
+    return out;
+}
+
+/**
+ * @brief Write every range of a WRITE request
+ *
+ * @return Length of the response payload
+ */
+static uint16_t cmd_write(const uint8_t* req, uint16_t len, uint8_t* resp) {
+    uint32_t pos = 0;
+    uint8_t ack;
+
+    while (pos < len) {
+        if (pos + 6 > len || pos + 6 + get_u16(&req[pos + 4]) > len) {
+            resp[0] = PROTO_ERR_LEN;
+            return 1;
+        }
+        uint16_t n = get_u16(&req[pos + 4]);
+        if ((ack = mem_write_bytes(get_u32(&req[pos]), &req[pos + 6], n)) != SWD_ACK_OK) {
+            resp[0] = PROTO_ERR_SWD | ack;
+            return 1;
+        }
+        pos += 6 + n;
+    }
+    resp[0] = PROTO_OK;
+    return 1;
+}
+
+/**
+ * @brief Attach to the TARGET, at a given clock or a negotiated one
+ *
+ * @return Length of the response payload
+ */
+static uint16_t cmd_init(const uint8_t* req, uint16_t len, uint8_t* resp) {
+    uint8_t ack;
+    if (len != 0 && len != 4) {
+        resp[0] = PROTO_ERR_LEN;
+        return 1;
+    }
+    if (len == 0 || get_u32(req) == 0) {
+        ack = negotiate_swd_clock() ? SWD_ACK_OK : SWD_ACK_FAULT;
+    } else {
+        swd_set_clock(get_u32(req));
+        initialize_swd();
+        ack = setup_dp_and_mem_ap();
+    }
+    resp[0] = ack == SWD_ACK_OK ? PROTO_OK : PROTO_ERR_SWD | ack;
+    put_u32(&resp[1], swd_get_clock());
+    return 5;
+}
+
+/**
+ * @brief Run a complete, checked frame and answer it
+ *
+ * @return 1 if the host asked to leave binary mode
+ */
+static uint8_t dispatch(uint8_t cmd, const uint8_t* req, uint16_t len) {
+    uint8_t* resp = &tx_frame[4];
+    uint16_t resp_len = 1;
+
+    resp[0] = PROTO_OK;
+    if (cmd == PROTO_CMD_TRANSFER || cmd == PROTO_CMD_WRITE || cmd == PROTO_CMD_DAP) {
+        // Raw accesses can halt, run or write the core behind core.c's back
+        core_reg_cache_invalidate();
+    }
+    switch (cmd) {
+    case PROTO_CMD_PING:
+        if (len + 2 > PROTO_MAX_PAYLOAD) {
+            resp[0] = PROTO_ERR_LEN;
+            break;
+        }
+        resp[1] = PROTO_VERSION;
+        memcpy(&resp[2], req, len);
+        resp_len = 2 + len;
+        break;
+    case PROTO_CMD_INIT:
+        resp_len = cmd_init(req, len, resp);
+        break;
+    case PROTO_CMD_CLOCK:
+        if (len != 4) {
+            resp[0] = PROTO_ERR_LEN;
+            break;
+        }
+        put_u32(&resp[1], swd_set_clock(get_u32(req)));
+        resp_len = 5;
+        break;
+    case PROTO_CMD_TRANSFER:
+        resp_len = cmd_transfer(req, len, resp);
+        break;
+    case PROTO_CMD_READ:
+        resp_len = cmd_read(req, len, resp);
+        break;
+    case PROTO_CMD_WRITE:
+        resp_len = cmd_write(req, len, resp);
+        break;
+    case PROTO_CMD_DAP:
+        resp_len = 1 + dap_process(req, len, &resp[1]);
+        break;
+    case PROTO_CMD_EXIT:
+        send_response(cmd, resp_len);
+        return 1;
+    default:
+        resp[0] = PROTO_ERR_CMD;
+        break;
+    }
+    send_response(cmd, resp_len);
+    return 0;
+}
+
+/**
+ * @brief Drop any partly received frame
+ */
+void proto_reset() {
+    state = PROTO_WAIT_SOF;
+}
+
+/**
+ * @brief Choose the port responses are sent on
+ *
+ * @param port One of the USB_CDC_* ports
+ */
+void proto_set_port(uint8_t port) {
+    out_port = port;
+}
+
+/**
+ * @brief Frame and send an event
+ *
+ * @param port One of the USB_CDC_* ports
+ * @param cmd One of the PROTO_EVT_* commands
+ * @param payload Bytes of the event
+ * @param len Number of bytes, at most PROTO_MAX_PAYLOAD
+ */
+void proto_send_event(uint8_t port, uint8_t cmd, const uint8_t* payload, uint16_t len) {
+    event_frame[0] = PROTO_SOF;
+    event_frame[1] = len;
+    event_frame[2] = len >> 8;
+    event_frame[3] = cmd;
+    memcpy(&event_frame[4], payload, len);
+    uint16_t crc = proto_crc16(&event_frame[1], 3 + len);
+    event_frame[4 + len] = crc;
+    event_frame[5 + len] = crc >> 8;
+    usb_cdc_write(port, event_frame, 6 + len);
+}
+
+/**
+ * @brief Whether the parser is between frames
+ *
+ * @return 1 if no frame is partly received
+ */
+uint8_t proto_idle() {
+    return state == PROTO_WAIT_SOF;
+}
+
+/**
+ * @brief Feed one received byte to the frame parser
+ *
+ * A complete frame is checked, run, and answered before this returns.
+ *
+ * @param byte Byte received from the host
+ *
+ * @return 1 once the host has asked to leave binary mode, 0 otherwise
+ */
+uint8_t proto_feed(uint8_t byte) {
+    switch (state) {
+    case PROTO_WAIT_SOF:
+        if (byte == PROTO_SOF) {
+            state = PROTO_LEN_LO;
+        }
+        break;
+    case PROTO_LEN_LO:
+        rx_frame[0] = byte;
+        state = PROTO_LEN_HI;
+        break;
+    case PROTO_LEN_HI:
+        rx_frame[1] = byte;
+        rx_len = get_u16(rx_frame);
+        // Not a frame we could hold, hunt for the next SOF
+        state = rx_len > PROTO_MAX_PAYLOAD ? PROTO_WAIT_SOF : PROTO_CMD;
+        break;
+    case PROTO_CMD:
+        rx_frame[2] = byte;
+        rx_pos = 0;
+        state = rx_len ? PROTO_PAYLOAD : PROTO_CRC_LO;
+        break;
+    case PROTO_PAYLOAD:
+        rx_frame[3 + rx_pos++] = byte;
+        if (rx_pos == rx_len) {
+            state = PROTO_CRC_LO;
+        }
+        break;
+    case PROTO_CRC_LO:
+        rx_crc = byte;
+        state = PROTO_CRC_HI;
+        break;
+    case PROTO_CRC_HI:
+        rx_crc |= byte << 8;
+        state = PROTO_WAIT_SOF;
+        if (rx_crc != proto_crc16(rx_frame, 3 + rx_len)) {
+            tx_frame[4] = PROTO_ERR_CRC;
+            send_response(rx_frame[2], 1);
+            break;
+        }
+        return dispatch(rx_frame[2], &rx_frame[3], rx_len);
+    }
+    return 0;
+}
+
+/**
+ * @brief Run binary mode on the console until the host sends PROTO_CMD_EXIT
+ *
+ * @return 0
+ */
+uint8_t proto_run() {
+    int c;
+    proto_set_port(USB_CDC_CONSOLE);
+    proto_reset();
+    while (1) {
+        c = getchar_timeout_us(PROTO_BYTE_TIMEOUT_US);
+        if (c == PICO_ERROR_TIMEOUT) {
+            proto_reset();
+            continue;
+        }
+        if (proto_feed(c)) {
+            return 0;
+        }
+    }
+}
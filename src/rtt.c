@@ -0,0 +1,371 @@
+/**
+ * @file rtt.c
+ * @author Min Kang
+ * @brief RTT host side: TARGET logging through RAM ring buffers
+ *
+ * The TARGET keeps a control block in RAM, starting with RTT_ID, followed
+ * by the descriptors of its up (TARGET to host) and down (host to TARGET)
+ * rings. Each descriptor is name, buffer, size, WrOff, RdOff and flags.
+ * The writer of a ring only moves WrOff and the reader only moves RdOff,
+ * so both sides can work on it at once and the TARGET never stops.
+ *
+ * The probe owns RdOff of the up ring and WrOff of the down ring, so it
+ * keeps them here and only ever reads the other side's offset. An idle
+ * poll is a single word read. Polling backs off while the TARGET is quiet
+ * and goes back to full speed as soon as there is data.
+ */
+#include "rtt.h"
+#include "jobs.h"
+#include "mem.h"
+#include "macros.h"
+#include "utils.h"
+#include "usb_cdc.h"
+#include "swd_request.h"
+#include "debug_interface.h"
+#include "pico/time.h"
+#include <stdio.h>
+#include <string.h>
+
+// Control block layout
+#define CB_NUM_UP   16
+#define CB_NUM_DOWN 20
+#define CB_RINGS    24
+// Ring descriptor layout
+#define RING_DESC_SIZE 24
+#define RING_BUFFER    4
+#define RING_SIZE      8
+#define RING_WROFF     12
+#define RING_RDOFF     16
+
+typedef struct {
+    uint32_t desc;   // Address of the descriptor
+    uint32_t buffer;
+    uint32_t size;
+    uint32_t off;    // The probe's own offset: RdOff going up, WrOff going down
+} rtt_ring_t;
+
+static job_t find_job;
+static uint32_t scan_start;
+static uint32_t scan_addr;
+static uint32_t scan_end;
+static uint8_t scan_stop;
+
+static uint32_t cb_addr;
+static uint8_t attached;
+static uint8_t channel;
+static rtt_ring_t up;
+static rtt_ring_t down;
+static uint8_t has_down;
+static uint32_t poll_us = RTT_POLL_MIN_US;
+static uint64_t next_poll_us;
+static rtt_stats_t stats;
+
+/**
+ * @brief Read a ring descriptor
+ */
+static uint8_t read_ring(uint32_t desc, rtt_ring_t* ring, uint8_t up_ring) {
+    uint32_t words[RING_DESC_SIZE / 4];
+    uint8_t ack;
+    if ((ack = mem_read_block(desc, words, RING_DESC_SIZE / 4)) != SWD_ACK_OK) {
+        return ack;
+    }
+    ring->desc = desc;
+    ring->buffer = words[RING_BUFFER / 4];
+    ring->size = words[RING_SIZE / 4];
+    // Carry on where the last reader or writer left off
+    ring->off = words[(up_ring ? RING_RDOFF : RING_WROFF) / 4];
+    if (ring->size == 0 || ring->off >= ring->size) {
+        return SWD_ACK_FAULT;
+    }
+    return SWD_ACK_OK;
+}
+
+/**
+ * @brief Check a candidate control block, and attach to it if it holds up
+ *
+ * @return ACK of request, or SWD_ACK_FAULT if it isn't a control block
+ */
+static uint8_t attach(uint32_t addr) {
+    uint32_t counts[2];
+    uint8_t ack;
+    if ((ack = mem_read_block(addr + CB_NUM_UP, counts, 2)) != SWD_ACK_OK) {
+        return ack;
+    }
+    if (counts[0] > RTT_MAX_RINGS || counts[1] > RTT_MAX_RINGS || channel >= counts[0]) {
+        return SWD_ACK_FAULT;
+    }
+    ack = read_ring(addr + CB_RINGS + channel * RING_DESC_SIZE, &up, 1);
+    if (ack != SWD_ACK_OK) {
+        return ack;
+    }
+    has_down = channel < counts[1] &&
+               read_ring(addr + CB_RINGS + (counts[0] + channel) * RING_DESC_SIZE, &down, 0) == SWD_ACK_OK;
+    cb_addr = addr;
+    attached = 1;
+    poll_us = RTT_POLL_MIN_US;
+    next_poll_us = time_us_64();
+    return SWD_ACK_OK;
+}
+
+/**
+ * @brief One step of the find job: look for RTT_ID in RTT_SCAN_CHUNK bytes
+ *
+ * Chunks overlap by less than a whole ID, so one straddling two chunks is
+ * still seen.
+ */
+static job_status_t find_step(job_t* job) {
+    uint32_t words[RTT_SCAN_CHUNK / 4];
+    uint32_t n = (scan_end - scan_addr) / 4, i;
+    uint8_t ack;
+
+    if (scan_stop) {
+        return JOB_FAILED;
+    }
+    if (n < RTT_ID_LEN / 4) {
+        job_printf(job, "No control block between 0x%.8x and 0x%.8x", scan_start, scan_end);
+        return JOB_FAILED;
+    }
+    if (n > RTT_SCAN_CHUNK / 4) {
+        n = RTT_SCAN_CHUNK / 4;
+    }
+    ack = mem_read_block(scan_addr, words, n);
+    CHECK_ACK_GT("Failed reading TARGET RAM");
+    for (i = 0; i + RTT_ID_LEN / 4 <= n; ++i) {
+        // The NUL after the ID included
+        if (memcmp(&words[i], RTT_ID, sizeof(RTT_ID)) || attach(scan_addr + 4 * i) != SWD_ACK_OK) {
+            continue;
+        }
+        job_printf(job, "Control block at 0x%.8x, up %u bytes, down %u bytes", cb_addr, up.size,
+                   has_down ? down.size : 0);
+        return JOB_DONE;
+    }
+    scan_addr += 4 * (n - (RTT_ID_LEN / 4 - 1));
+    job->done = scan_addr - scan_start;
+    return JOB_RUNNING;
+LOOP:
+    return JOB_FAILED;
+}
+
+/**
+ * @brief Move whatever is new in the up ring to the stream port
+ *
+ * @param moved Where the number of bytes moved is stored
+ * @param more Where 1 is stored if there is data left for the next poll
+ *
+ * @return ACK of request, or SWD_ACK_FAULT if the ring looks corrupt
+ */
+static uint8_t drain_up(uint32_t* moved, uint8_t* more) {
+    uint8_t buf[RTT_CHUNK];
+    uint32_t wr, len;
+    uint8_t ack, pieces;
+
+    *moved = 0;
+    *more = 0;
+    if ((ack = mem_read(up.desc + RING_WROFF, &wr)) != SWD_ACK_OK) {
+        return ack;
+    }
+    stats.polls++;
+    if (wr >= up.size) {
+        return SWD_ACK_FAULT;
+    }
+    // At most the run up to the end of the buffer and the run after the wrap
+    for (pieces = 0; up.off != wr && pieces < 2; ++pieces) {
+        len = (wr > up.off ? wr : up.size) - up.off;
+        if (len > RTT_CHUNK) {
+            len = RTT_CHUNK;
+        }
+        if ((ack = mem_read_bytes(up.buffer + up.off, buf, len)) != SWD_ACK_OK) {
+            return ack;
+        }
+        usb_cdc_write(USB_CDC_STREAM, buf, len);
+        up.off += len;
+        if (up.off == up.size) {
+            up.off = 0;
+        }
+        *moved += len;
+    }
+    if (*moved == 0) {
+        return SWD_ACK_OK;
+    }
+    *more = up.off != wr;
+    stats.bytes_up += *moved;
+    // Hands the space back to the TARGET
+    return mem_write(up.desc + RING_RDOFF, up.off);
+}
+
+/**
+ * @brief Copy stream port input into the down ring, as much as fits
+ *
+ * @param moved Where the number of bytes moved is stored
+ *
+ * @return ACK of request
+ */
+static uint8_t feed_down(uint32_t* moved) {
+    uint8_t buf[RTT_CHUNK];
+    uint32_t rd, space, len, i;
+    uint8_t ack;
+
+    *moved = 0;
+    if (!has_down || !usb_cdc_available(USB_CDC_STREAM)) {
+        return SWD_ACK_OK;
+    }
+    if ((ack = mem_read(down.desc + RING_RDOFF, &rd)) != SWD_ACK_OK) {
+        return ack;
+    }
+    if (rd >= down.size) {
+        return SWD_ACK_FAULT;
+    }
+    // One byte always stays free, so a full ring isn't mistaken for empty
+    space = (rd + down.size - down.off - 1) % down.size;
+    len = down.size - down.off;
+    if (len > space) {
+        len = space;
+    }
+    if (len > usb_cdc_available(USB_CDC_STREAM)) {
+        len = usb_cdc_available(USB_CDC_STREAM);
+    }
+    if (len > RTT_CHUNK) {
+        len = RTT_CHUNK;
+    }
+    if (len == 0) {
+        return SWD_ACK_OK;
+    }
+    for (i = 0; i < len; ++i) {
+        buf[i] = usb_cdc_getc(USB_CDC_STREAM);
+    }
+    if ((ack = mem_write_bytes(down.buffer + down.off, buf, len)) != SWD_ACK_OK) {
+        return ack;
+    }
+    down.off = (down.off + len) % down.size;
+    *moved = len;
+    stats.bytes_down += len;
+    return mem_write(down.desc + RING_WROFF, down.off);
+}
+
+/**
+ * @brief Poll the up channel and feed the down channel, run from the main loop
+ *
+ * Only does anything once the control block is found, and only when the
+ * poll interval is up.
+ *
+ * @return 0
+ */
+uint8_t rtt_task() {
+    uint64_t now = time_us_64();
+    uint32_t moved_up, moved_down;
+    uint8_t ack, more;
+
+    if (!attached || (int64_t)(now - next_poll_us) < 0) {
+        return 0;
+    }
+    ack = drain_up(&moved_up, &more);
+    if (ack == SWD_ACK_OK) {
+        ack = feed_down(&moved_down);
+    }
+    if (ack != SWD_ACK_OK) {
+        // Most likely the TARGET was reset or reflashed
+        attached = 0;
+        printf("\r\033[K");
+        error_ack("RTT stopped, the control block went away", ack);
+        redraw_line();
+        return 0;
+    }
+    if (moved_up || moved_down) {
+        poll_us = RTT_POLL_MIN_US;
+    } else {
+        stats.idle_polls++;
+        poll_us = poll_us * 2 > RTT_POLL_MAX_US ? RTT_POLL_MAX_US : poll_us * 2;
+    }
+    // A ring with data left goes again on the next pass of the main loop
+    next_poll_us = more ? now : now + poll_us;
+    return 0;
+}
+
+/**
+ * @brief Get the RTT counters
+ *
+ * @return Pointer to the counters
+ */
+const rtt_stats_t* rtt_get_stats() {
+    return &stats;
+}
+
+/**
+ * @brief Print where RTT is and the counters
+ */
+static void print_rtt_stats() {
+    if (attached) {
+        printf("RTT:        channel %u, control block at 0x%.8x\n", channel, cb_addr);
+        printf("Up ring:    %u bytes at 0x%.8x\n", up.size, up.buffer);
+        if (has_down) {
+            printf("Down ring:  %u bytes at 0x%.8x\n", down.size, down.buffer);
+        }
+    } else {
+        printf("RTT:        %s\n", find_job.active ? "searching" : "stopped");
+    }
+    printf("Bytes up:   %u\n", stats.bytes_up);
+    printf("Bytes down: %u\n", stats.bytes_down);
+    printf("Polls:      %u (%u idle)\n", stats.polls, stats.idle_polls);
+    printf("Interval:   %u us\n", poll_us);
+}
+
+/**
+ * @brief Log the TARGET's RTT channel to the stream port
+ *
+ * Usage: rtt start [address] [size] [channel]
+ *        rtt stop
+ *        rtt
+ *
+ * start looks for the control block in size bytes from address, the
+ * TARGET's RAM by default, then moves up channel bytes to the stream port
+ * and stream port input to the down channel of the same number. Without
+ * arguments, shows the counters.
+ *
+ * @return 0 for success, 1 for bad arguments
+ */
+uint8_t rtt_run(char** args, uint8_t num_args) {
+    uint32_t addr = TARGET_RAM_BASE, size = TARGET_RAM_SIZE;
+    int32_t n = 0;
+
+    if (num_args == 1) {
+        print_rtt_stats();
+        return 0;
+    }
+    if (num_args == 2 && !strcmp(args[1], "stop")) {
+        attached = 0;
+        scan_stop = 1;
+        return 0;
+    }
+    if (num_args > 5 || strcmp(args[1], "start") ||
+        (num_args > 2 && parse_str_to_hex(args[2], &addr)) ||
+        (num_args > 3 && (size = str_to_int(args[3])) == (uint32_t)-1) ||
+        (num_args > 4 && ((n = str_to_int(args[4])) < 0 || n >= RTT_MAX_RINGS))) {
+        printf("Incorrect format. Format should be:\n");
+        printf("rtt start [address] [size] [channel] | rtt stop | rtt\n");
+        return 1;
+    }
+    if (find_job.active) {
+        error("Already looking for the control block");
+        return 1;
+    }
+    if (num_args == 3) {
+        // Just the address, only look there
+        size = RTT_ID_LEN;
+    }
+
+    attached = 0;
+    channel = n;
+    memset(&stats, 0, sizeof(stats));
+    scan_start = scan_addr = addr & ~3u;
+    scan_end = addr + size;
+    scan_stop = 0;
+    find_job.name = "rtt";
+    find_job.step = find_step;
+    find_job.done = 0;
+    find_job.total = scan_end - scan_start;
+    if (!job_start(&find_job)) {
+        error("Too many jobs running");
+        return 1;
+    }
+    return 0;
+}
@@ -5,6 +5,7 @@
  */
 #include "setup.h"
 #include "macros.h"
+#include "data_transfer.h"
 #include "pico/stdlib.h"
 
 /**
@@ -44,6 +45,7 @@ void led_setup() {
  */
 void setup() {
     pin_setup();
+    swd_select_backend(SWD_DEFAULT_BACKEND);
     button_setup();
     led_setup();
 }
@@ -0,0 +1,217 @@
+/**
+ * @file swd_batch.c
+ * @author Min Kang
+ * @brief Batched SWD transfers with posted AP reads
+ */
+#include "swd_batch.h"
+#include "data_transfer.h"
+#include "swd_cache.h"
+#include "swd_pio.h"
+#include "swd_engine.h"
+#include "macros.h"
+#include <stddef.h>
+
+// Transactions handed to the PIO stream at a time
+#define STREAM_MAX 64
+
+static uint8_t stream_reqs[STREAM_MAX];
+static uint32_t stream_data[STREAM_MAX];
+static uint8_t stream_acks[STREAM_MAX];
+// Op each streamed transaction reports its ACK to
+static swd_op_t* stream_owner[STREAM_MAX];
+// Op each streamed transaction's read data belongs to, if any
+static swd_op_t* stream_dest[STREAM_MAX];
+
+/**
+ * @brief Add a transaction to the stream
+ */
+static inline void stream_add(uint32_t* n, uint8_t req, uint32_t data, swd_op_t* owner, swd_op_t* dest) {
+    stream_reqs[*n] = req;
+    stream_data[*n] = data;
+    stream_owner[*n] = owner;
+    stream_dest[*n] = dest;
+    (*n)++;
+    // Assume success so later writes in the batch see the right shadows
+    swd_cache_update(req, data, SWD_ACK_OK);
+}
+
+/**
+ * @brief Run the queued transactions and hand results back to their ops
+ *
+ * A parity error doesn't stop the stream, the ops it hit are marked and the
+ * rest are still handed back.
+ *
+ * @return SWD_ACK_OK, or the first bad ACK
+ */
+static uint8_t stream_flush(uint32_t n, swd_op_t* ops, uint32_t num_ops) {
+    uint8_t ack = SWD_ACK_OK;
+    uint32_t i;
+    swd_pio_transfer_stream(stream_reqs, stream_data, stream_acks, n);
+
+    for (i = 0; i < n; ++i) {
+        stream_owner[i]->ack = stream_acks[i];
+        swd_count_error(stream_acks[i]);
+        if (stream_acks[i] == SWD_ERR_PARITY) {
+            // Only the HOST saw it, the TARGET carried on with the stream
+            if (stream_dest[i]) {
+                stream_dest[i]->ack = SWD_ERR_PARITY;
+            }
+            if (ack == SWD_ACK_OK) {
+                ack = SWD_ERR_PARITY;
+            }
+            continue;
+        }
+        if (stream_acks[i] != SWD_ACK_OK) {
+            // The TARGET has ignored everything since, forget it ever ran
+            swd_op_t* op;
+            for (op = stream_owner[i] + 1; op < ops + num_ops; ++op) {
+                op->ack = 0;
+            }
+            if (stream_dest[i]) {
+                // Posted data that was riding on this transaction is lost too
+                stream_dest[i]->ack = stream_acks[i];
+            }
+            swd_clear_errors();
+            return stream_acks[i];
+        }
+        if (stream_dest[i]) {
+            stream_dest[i]->data = stream_data[i];
+        }
+    }
+    return ack;
+}
+
+/**
+ * @brief Run a batch with overrun detection on, without waiting for ACKs
+ *
+ * The same posted read bookkeeping as the normal path, but the whole
+ * sequence is laid out up front and streamed through PIO.
+ */
+static uint8_t batch_streamed(swd_op_t* ops, uint32_t num_ops) {
+    swd_op_t* posted = NULL;
+    uint32_t i, n = 0;
+    uint8_t ack;
+
+    for (i = 0; i < num_ops; ++i) {
+        swd_op_t* op = &ops[i];
+        uint8_t is_ap_read = (op->req & (SWD_REQ_APnDP | SWD_REQ_RnW)) == (SWD_REQ_APnDP | SWD_REQ_RnW);
+
+        // Leave room for an RDBUFF read as well
+        if (n >= STREAM_MAX - 1) {
+            if ((ack = stream_flush(n, ops, num_ops)) != SWD_ACK_OK) {
+                if (posted) {
+                    // Its data would have come in the next flush
+                    posted->ack = ack;
+                }
+                return ack;
+            }
+            n = 0;
+        }
+
+        if (is_ap_read) {
+            stream_add(&n, op->req, 0, op, posted);
+            posted = op;
+            continue;
+        }
+        if (posted) {
+            stream_add(&n, DP_READ(DP_RDBUFF), 0, posted, posted);
+            posted = NULL;
+        }
+        if (!(op->req & SWD_REQ_RnW) && swd_cache_write_redundant(op->req, op->data)) {
+            op->ack = SWD_ACK_OK;
+            continue;
+        }
+        stream_add(&n, op->req, op->data, op, (op->req & SWD_REQ_RnW) ? op : NULL);
+    }
+    if (posted) {
+        stream_add(&n, DP_READ(DP_RDBUFF), 0, posted, posted);
+    }
+    return n ? stream_flush(n, ops, num_ops) : SWD_ACK_OK;
+}
+
+/**
+ * @brief Run a list of DP and AP accesses back to back
+ *
+ * AP reads are posted: each one returns the result of the AP read before
+ * it, so a run of AP reads costs one transaction per read plus a single
+ * RDBUFF read where the run ends. Results always land in the op that asked
+ * for them.
+ *
+ * With overrun detection on and the PIO backend, the whole batch is
+ * streamed without waiting for each ACK. Otherwise every access goes
+ * through swd_transfer() and gets its WAIT retries there.
+ *
+ * The batch stops at the first access that doesn't ACK OK. That op holds
+ * the bad ACK, and ops after it are left with an ACK of 0.
+ *
+ * Once the SWD engine is running, calls from core0 are run on core1.
+ *
+ * @param ops Accesses to run, read data is stored back into them
+ * @param num_ops Number of accesses
+ *
+ * @return SWD_ACK_OK if every access succeeded, otherwise the failing ACK
+ */
+uint8_t swd_transfer_batch(swd_op_t* ops, uint32_t num_ops) {
+    // Op whose AP read is still in flight, waiting for its data
+    swd_op_t* posted = NULL;
+    uint32_t i, data;
+    uint8_t ack = SWD_ACK_OK;
+
+    if (swd_engine_forward()) {
+        return swd_engine_run(ops, num_ops, 0);
+    }
+
+    for (i = 0; i < num_ops; ++i) {
+        ops[i].ack = 0;
+    }
+
+    if (swd_get_overrun_detect() && swd_get_backend() == SWD_BACKEND_PIO) {
+        return batch_streamed(ops, num_ops);
+    }
+
+    for (i = 0; i < num_ops; ++i) {
+        swd_op_t* op = &ops[i];
+        uint8_t is_ap_read = (op->req & (SWD_REQ_APnDP | SWD_REQ_RnW)) == (SWD_REQ_APnDP | SWD_REQ_RnW);
+
+        if (is_ap_read) {
+            // This read hands back the data of the previous one
+            ack = swd_transfer(op->req, &data);
+            op->ack = ack;
+            if (ack != SWD_ACK_OK) {
+                break;
+            }
+            if (posted) {
+                posted->data = data;
+            }
+            posted = op;
+            continue;
+        }
+
+        if (posted) {
+            // Anything else would lose the posted data, so collect it first
+            ack = swd_transfer(DP_READ(DP_RDBUFF), &posted->data);
+            if (ack != SWD_ACK_OK) {
+                posted->ack = ack;
+                posted = NULL;
+                break;
+            }
+            posted = NULL;
+        }
+
+        ack = swd_transfer(op->req, &op->data);
+        op->ack = ack;
+        if (ack != SWD_ACK_OK) {
+            break;
+        }
+    }
+
+    if (posted) {
+        if (ack == SWD_ACK_OK) {
+            ack = swd_transfer(DP_READ(DP_RDBUFF), &posted->data);
+        }
+        // The data never made it out if the batch failed after the read
+        posted->ack = ack;
+    }
+
+    return ack;
+}
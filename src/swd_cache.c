@@ -0,0 +1,181 @@
+/**
+ * @file swd_cache.c
+ * @author Min Kang
+ * @brief Shadow copies of DP SELECT, MEM-AP CSW and TAR
+ *
+ * Most memory accesses rewrite CSW and TAR even when they already hold the
+ * right value. Keeping a copy of what was last written, and predicting
+ * where auto increment leaves TAR, lets those writes be dropped.
+ */
+#include "swd_cache.h"
+#include "swd_request.h"
+#include "macros.h"
+#include <string.h>
+
+// SELECT fields
+#define SELECT_APSEL_MASK     0xFF000000
+#define SELECT_APBANKSEL_MASK 0x000000F0
+
+static struct {
+    uint8_t select_valid;
+    uint8_t csw_valid;
+    uint8_t tar_valid;
+    uint32_t select;
+    uint32_t csw;
+    uint32_t tar;
+} shadow;
+
+static swd_cache_stats_t stats;
+
+/**
+ * @brief Whether AP A values currently map onto CSW, TAR and DRW
+ */
+static inline uint8_t ap_bank0_selected() {
+    return shadow.select_valid && (shadow.select & SELECT_APBANKSEL_MASK) == 0;
+}
+
+/**
+ * @brief Check whether a write would leave the TARGET unchanged
+ *
+ * @param req Request built with SWD_REQ()
+ * @param data Data about to be written
+ *
+ * @return 1 if the write can be dropped
+ */
+uint8_t swd_cache_write_redundant(uint8_t req, uint32_t data) {
+    if (req == DP_WRITE(DP_SELECT)) {
+        if (shadow.select_valid && shadow.select == data) {
+            stats.select_skipped++;
+            return 1;
+        }
+    } else if (req == AP_WRITE(AP_CSW)) {
+        if (ap_bank0_selected() && shadow.csw_valid && shadow.csw == data) {
+            stats.csw_skipped++;
+            return 1;
+        }
+    } else if (req == AP_WRITE(AP_TAR)) {
+        if (ap_bank0_selected() && shadow.tar_valid && shadow.tar == data) {
+            stats.tar_skipped++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Move the predicted TAR past a DRW access
+ */
+static void predict_tar_increment() {
+    uint32_t inc;
+    if (!shadow.tar_valid) {
+        return;
+    }
+    if (!shadow.csw_valid) {
+        shadow.tar_valid = 0;
+        return;
+    }
+    switch (shadow.csw & CSW_ADDRINC_MASK) {
+        case CSW_ADDRINC_SINGLE:
+            inc = 1u << (shadow.csw & CSW_SIZE_MASK);
+            break;
+        case CSW_ADDRINC_PACKED:
+            inc = 4;
+            break;
+        case 0:
+            return;
+        default:
+            shadow.tar_valid = 0;
+            return;
+    }
+    // Wrapping past a 1 KB block is implementation defined
+    if (((shadow.tar + inc) ^ shadow.tar) & ~(TAR_AUTOINC_BLOCK - 1)) {
+        shadow.tar_valid = 0;
+        return;
+    }
+    shadow.tar += inc;
+}
+
+/**
+ * @brief Update the shadows after a transaction went out on the wire
+ *
+ * Tracks SELECT, CSW and TAR writes and predicts TAR auto increment on DRW
+ * accesses. Everything is forgotten on FAULT or a protocol error.
+ *
+ * @param req Request built with SWD_REQ()
+ * @param data Data written or read
+ * @param ack ACK of the transaction
+ */
+void swd_cache_update(uint8_t req, uint32_t data, uint8_t ack) {
+    if (ack == SWD_ACK_WAIT) {
+        // Nothing happened, the request gets retried
+        return;
+    }
+    if (ack != SWD_ACK_OK) {
+        swd_cache_invalidate();
+        return;
+    }
+
+    if (!(req & SWD_REQ_APnDP)) {
+        if (req == DP_WRITE(DP_SELECT)) {
+            if (!shadow.select_valid ||
+                ((shadow.select ^ data) & (SELECT_APSEL_MASK | SELECT_APBANKSEL_MASK))) {
+                // A different AP or bank, CSW and TAR are someone else's now
+                shadow.csw_valid = 0;
+                shadow.tar_valid = 0;
+            }
+            shadow.select = data;
+            shadow.select_valid = 1;
+        } else if (req == DP_WRITE(DP_ABORT)) {
+            // An aborted AP transaction may or may not have moved TAR
+            shadow.tar_valid = 0;
+        }
+        return;
+    }
+
+    if (!ap_bank0_selected()) {
+        return;
+    }
+    switch (req) {
+        case AP_WRITE(AP_CSW):
+            shadow.csw = data;
+            shadow.csw_valid = 1;
+            break;
+        case AP_WRITE(AP_TAR):
+            shadow.tar = data;
+            shadow.tar_valid = 1;
+            break;
+        case AP_WRITE(AP_DRW):
+        case AP_READ(AP_DRW):
+            predict_tar_increment();
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Forget every shadow
+ *
+ * Must be called whenever the DP or AP state can't be trusted, like after
+ * a line reset.
+ */
+void swd_cache_invalidate() {
+    memset(&shadow, 0, sizeof(shadow));
+    stats.invalidations++;
+}
+
+/**
+ * @brief Get the skipped write counters
+ *
+ * @return Pointer to the counters
+ */
+const swd_cache_stats_t* swd_cache_get_stats() {
+    return &stats;
+}
+
+/**
+ * @brief Zero the skipped write counters
+ */
+void swd_cache_reset_stats() {
+    memset(&stats, 0, sizeof(stats));
+}
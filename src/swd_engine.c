@@ -0,0 +1,151 @@
+/**
+ * @file swd_engine.c
+ * @author Min Kang
+ * @brief SWD engine on core1
+ *
+ * Core0 keeps USB, the console and everything that prints. Every SWD
+ * transfer it asks for is pushed onto a command queue and run by core1,
+ * which pushes the job back onto a result queue when it is done. USB
+ * interrupts and printf() never land in the middle of a transfer, and core0
+ * can get the next batch ready while core1 is still clocking the last one.
+ *
+ * The link belongs to core1 while any job is queued. Line level helpers
+ * such as pulse_clock() still run on whichever core calls them, which is
+ * fine as long as no job is in flight.
+ */
+#include "swd_engine.h"
+#include "data_transfer.h"
+#include "spsc.h"
+#include "pico/multicore.h"
+#include "pico/platform.h"
+#include "hardware/sync.h"
+
+static spsc_queue_t cmd_queue;
+static spsc_queue_t result_queue;
+static volatile uint8_t running;
+
+static void run_job(swd_job_t* job) {
+    uint32_t i;
+    if (!job->raw) {
+        job->ack = swd_transfer_batch(job->ops, job->num_ops);
+        return;
+    }
+    job->ack = SWD_ACK_OK;
+    for (i = 0; i < job->num_ops; ++i) {
+        job->ops[i].ack = 0;
+    }
+    for (i = 0; i < job->num_ops && job->ack == SWD_ACK_OK; ++i) {
+        job->ack = swd_transfer(job->ops[i].req, &job->ops[i].data);
+        job->ops[i].ack = job->ack;
+    }
+}
+
+/**
+ * @brief Core1 main loop, runs jobs until the end of time
+ */
+static void engine_main() {
+    swd_job_t* job;
+    while (1) {
+        if (!(job = spsc_pop(&cmd_queue))) {
+            __wfe();
+            continue;
+        }
+        run_job(job);
+        while (!spsc_push(&result_queue, job)) {
+            __wfe();
+        }
+        __sev();
+    }
+}
+
+/**
+ * @brief Mark every job core1 has handed back as done
+ */
+static void collect_results() {
+    swd_job_t* job;
+    while ((job = spsc_pop(&result_queue))) {
+        job->done = 1;
+        // Core1 may be waiting for room in the result queue
+        __sev();
+    }
+}
+
+/**
+ * @brief Start running SWD transfers on core1
+ *
+ * From here on swd_transfer() and swd_transfer_batch() called on core0 are
+ * handed over to core1 and wait for it.
+ */
+void swd_engine_start() {
+    if (running) {
+        return;
+    }
+    spsc_init(&cmd_queue);
+    spsc_init(&result_queue);
+    multicore_launch_core1(engine_main);
+    running = 1;
+}
+
+/**
+ * @brief Whether an SWD call on this core should go to core1
+ *
+ * @return 1 on core0 once the engine is running
+ */
+uint8_t swd_engine_forward() {
+    return running && get_core_num() == 0;
+}
+
+/**
+ * @brief Queue a job for core1 without waiting for it
+ *
+ * Jobs run in the order they are submitted. Without the engine the job runs
+ * before this returns. Nothing else may touch the SWD link until every
+ * submitted job is done.
+ *
+ * @param job Job to run, must stay valid until it is done
+ */
+void swd_engine_submit(swd_job_t* job) {
+    job->done = 0;
+    if (!swd_engine_forward()) {
+        run_job(job);
+        job->done = 1;
+        return;
+    }
+    while (!spsc_push(&cmd_queue, job)) {
+        collect_results();
+        __wfe();
+    }
+    __sev();
+}
+
+/**
+ * @brief Wait for a submitted job to come back
+ *
+ * @param job Job to wait for
+ *
+ * @return ACK of the job
+ */
+uint8_t swd_engine_wait(swd_job_t* job) {
+    while (1) {
+        collect_results();
+        if (job->done) {
+            return job->ack;
+        }
+        __wfe();
+    }
+}
+
+/**
+ * @brief Run a batch on core1 and wait for it
+ *
+ * @param ops Accesses to run, see swd_transfer_batch()
+ * @param num_ops Number of accesses
+ * @param raw 1 to run every op through swd_transfer() as is
+ *
+ * @return ACK of the batch
+ */
+uint8_t swd_engine_run(swd_op_t* ops, uint32_t num_ops, uint8_t raw) {
+    swd_job_t job = { .ops = ops, .num_ops = num_ops, .raw = raw };
+    swd_engine_submit(&job);
+    return swd_engine_wait(&job);
+}
@@ -7,14 +7,18 @@
 #include "macros.h"
 #include "data_transfer.h"
 #include "utils.h"
+#include "swd_cache.h"
+#include "mem.h"
 #include "hardware/gpio.h"
+#include "pico/time.h"
 #include <stdio.h>
 
 /**
- * @brief Sends 50 clock pulses to reset DP
+ * @brief Sends 50 clock pulses with SWDIO high to reset DP
  */
 void reset_dp() {
-    pulse_clock(50);
+    send_data_lsb(0xFFFFFFFF, 32);
+    send_data_lsb(0x0003FFFF, 18);
 }
 
 /**
@@ -34,8 +38,8 @@ void jtag_to_swd_bit_seq() {
  * Sends 12 clock signals with SWDIO low
  */
 void line_reset() {
-    gpio_put(SWDIO, 0);
-    pulse_clock(12);
+    send_data_lsb(0, 12);
+    swd_cache_invalidate();
 }
 
 /**
@@ -45,21 +49,42 @@ void line_reset() {
  * resets the line.
  */
 void initialize_swd() {
+    // Nothing the DP or AP held before the reset can be trusted
+    swd_cache_invalidate();
+
     // Reset current DP (currently JTAG-DP)
     reset_dp();
-    delay();
 
     // Send special JTAG-to-SWD select sequence
     jtag_to_swd_bit_seq();
-    delay();
 
     // Reset DP again (which is now SWD-DP)
     reset_dp();
-    delay();
 
     // Reset the line by sending 12 clocks with SWDIO low
     line_reset();
-    delay();
+}
+
+/**
+ * @brief Poll CTRL/STAT until both power up requests are acknowledged
+ *
+ * @param data Where the last CTRL/STAT value read is stored
+ *
+ * @return ACK of request, or SWD_ERR_TIMEOUT
+ */
+static uint8_t wait_for_powerup(uint32_t* data) {
+    const uint32_t acks = CTRL_STAT_CDBGPWRUPACK | CTRL_STAT_CSYSPWRUPACK;
+    uint64_t start = time_us_64();
+    uint8_t ack;
+    do {
+        if ((ack = SWD_DP_read(DP_CTRL_STAT, data)) != SWD_ACK_OK) {
+            return ack;
+        }
+        if ((*data & acks) == acks) {
+            return ack;
+        }
+    } while (time_us_64() - start < POWERUP_TIMEOUT_US);
+    return SWD_ERR_TIMEOUT;
 }
 
 /**
@@ -75,20 +100,18 @@ uint8_t setup_dp_and_mem_ap() {
     ack = SWD_DP_read(0b00, &data);
     CHECK_ACK_RT("Failed to read IDCODE.");
     printf("IDCODE: 0x%x ACK: %d\r\n", data, ack);
-    delay();
 
     // ------ CTRL/STAT Write ----- //
     // Set CSYSPWRUPREQ and CDBGPWRUPREQ to bring rest of system online
     ack = SWD_DP_write(0b10, 0x50000000);
     CHECK_ACK_RT("Failed to write to CTRL/STAT");
     printf("CTRL/STAT Write: 0x5000.0000 ACK: %d\n", ack);
-    delay();
 
     // ----- CTRL/STAT Read ----- //
-    ack = SWD_DP_read(0b10, &data);
-    CHECK_ACK_RT("Error in CTRL/STAT read");
+    // Wait for CDBGPWRUPACK and CSYSPWRUPACK instead of hoping it's been long enough
+    ack = wait_for_powerup(&data);
+    CHECK_ACK_RT("Debug power up not acknowledged");
     printf("CTRL/STAT Read: 0x%x ACK: %d\n", data, ack);
-    delay();
 
     // ------ SELECT Write ----- //
     // Set APSEL to 0x00
@@ -98,7 +121,6 @@ uint8_t setup_dp_and_mem_ap() {
 	ack = SWD_DP_write(0b01, 0x00000000);
 	CHECK_ACK_RT("Error in SELECT write");
     printf("SELECT Write: 0x0000.0000 ACK: %d\n", ack);
-    delay();
 
     // ------ Write to CSW of MEM-AP ----- //
     // To enable privledged master access over AHB-AP
@@ -108,6 +130,134 @@ uint8_t setup_dp_and_mem_ap() {
     ack = SWD_AP_write(0b00, 0x22000012);
 	CHECK_ACK_RT("Error in CSW write");
     printf("CSW Write: 0x22000012 ACK: %d\n", ack);
-    delay();
+
+    // ------ Probe access sizes ----- //
+    ack = mem_probe_caps();
+    CHECK_ACK_RT("Error probing MEM-AP");
+    printf("MEM-AP byte/halfword: %s, packed: %s\n",
+           mem_get_caps()->sub_word ? "yes" : "no", mem_get_caps()->packed ? "yes" : "no");
+
+    return ack;
+}
+
+// Frequencies tried by negotiate_swd_clock(), slowest first
+static const uint32_t negotiate_steps_hz[] = {
+    250000, 500000, 1000000, 2000000, 4000000, 6000000, 8000000,
+    12000000, 16000000, 20000000, 25000000, 30000000, 37500000,
+};
+
+/**
+ * @brief Write a word to TARGET RAM and read it back
+ *
+ * @return 1 if the word read back matches
+ */
+static uint8_t negotiate_ram_word(uint32_t addr, uint32_t pattern) {
+    uint32_t data;
+    if (swd_transfer(AP_WRITE(AP_TAR), &addr) != SWD_ACK_OK) return 0;
+    if (swd_transfer(AP_WRITE(AP_DRW), &pattern) != SWD_ACK_OK) return 0;
+    if (swd_transfer(AP_WRITE(AP_TAR), &addr) != SWD_ACK_OK) return 0;
+    // AP reads are posted, the value comes back through RDBUFF
+    if (swd_transfer(AP_READ(AP_DRW), &data) != SWD_ACK_OK) return 0;
+    if (swd_transfer(DP_READ(DP_RDBUFF), &data) != SWD_ACK_OK) return 0;
+    return data == pattern;
+}
+
+/**
+ * @brief Check that the link works at the current SWCLK frequency
+ *
+ * Runs IDCODE reads, CTRL/STAT round trips and a RAM write and readback
+ * pattern. The RAM word is restored afterwards. Any parity error, even one
+ * that was retried away, fails the check.
+ *
+ * @param idcode IDCODE read at a known good frequency
+ *
+ * @return 1 if every check passed
+ */
+static uint8_t negotiate_check_link(uint32_t idcode) {
+    static const uint32_t patterns[] = {
+        0x00000000, 0xFFFFFFFF, 0xAAAAAAAA, 0x55555555, 0x01234567, 0xFEDCBA98,
+    };
+    uint32_t data, saved, addr = SWD_NEGOTIATE_RAM_ADDR;
+    uint32_t parity_errors = swd_get_error_stats()->parity;
+    uint8_t round, i;
+
+    for (round = 0; round < SWD_NEGOTIATE_ROUNDS; ++round) {
+        if (SWD_DP_read(0b00, &data) != SWD_ACK_OK || data != idcode) {
+            return 0;
+        }
+        if (SWD_DP_write(0b10, 0x50000000) != SWD_ACK_OK) {
+            return 0;
+        }
+        if (SWD_DP_read(0b10, &data) != SWD_ACK_OK || (data & 0xF0000000) != 0xF0000000) {
+            return 0;
+        }
+    }
+
+    // Save the RAM word, walk the patterns over it and put it back
+    if (swd_transfer(AP_WRITE(AP_TAR), &addr) != SWD_ACK_OK ||
+        swd_transfer(AP_READ(AP_DRW), &saved) != SWD_ACK_OK ||
+        swd_transfer(DP_READ(DP_RDBUFF), &saved) != SWD_ACK_OK) {
+        return 0;
+    }
+    for (i = 0; i < sizeof(patterns) / sizeof(patterns[0]); ++i) {
+        if (!negotiate_ram_word(addr, patterns[i])) {
+            return 0;
+        }
+    }
+    if (!negotiate_ram_word(addr, saved)) {
+        return 0;
+    }
+    // Retried reads still mean the link is marginal at this speed
+    return swd_get_error_stats()->parity == parity_errors;
+}
+
+/**
+ * @brief Find the fastest SWCLK frequency the link survives
+ *
+ * Attaches at SWD_NEGOTIATE_START_HZ, then steps the clock up until
+ * negotiate_check_link() fails. The clock is left at
+ * SWD_NEGOTIATE_MARGIN_PCT percent of the fastest frequency that passed,
+ * and the link is reinitialized there.
+ *
+ * @return Frequency settled on in Hz, or 0 if the TARGET can't be reached
+ */
+uint32_t negotiate_swd_clock() {
+    uint32_t idcode, best_hz, i;
+
+    best_hz = swd_set_clock(SWD_NEGOTIATE_START_HZ);
+    initialize_swd();
+    if (setup_dp_and_mem_ap() != SWD_ACK_OK) {
+        return 0;
+    }
+    if (SWD_DP_read(0b00, &idcode) != SWD_ACK_OK) {
+        return 0;
+    }
+
+    for (i = 0; i < sizeof(negotiate_steps_hz) / sizeof(negotiate_steps_hz[0]); ++i) {
+        uint32_t hz = swd_set_clock(negotiate_steps_hz[i]);
+        if (hz <= best_hz) {
+            // The backend has topped out
+            break;
+        }
+        if (!negotiate_check_link(idcode)) {
+            printf("SWCLK %u Hz: failed\n", hz);
+            break;
+        }
+        printf("SWCLK %u Hz: ok\n", hz);
+        best_hz = hz;
+    }
+
+    uint32_t settled_hz = swd_set_clock((uint64_t)best_hz * SWD_NEGOTIATE_MARGIN_PCT / 100);
+    printf("Fastest passing SWCLK: %u Hz, settled on %u Hz\n", best_hz, settled_hz);
+
+    // A failed step can leave the DP confused or with sticky errors set.
+    // IDCODE has to be read after the line reset before ABORT can be written.
+    initialize_swd();
+    SWD_DP_read(0b00, &idcode);
+    SWD_DP_write(0b00, 0x0000001E);
+    if (setup_dp_and_mem_ap() != SWD_ACK_OK) {
+        return 0;
+    }
+    return settled_hz;
 }
 
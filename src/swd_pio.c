@@ -0,0 +1,211 @@
+/**
+ * @file swd_pio.c
+ * @author Min Kang
+ * @brief SWD backend that shifts whole phases through a PIO state machine
+ */
+#include "swd_pio.h"
+#include "swd_request.h"
+#include "macros.h"
+#include "hardware/pio.h"
+#include "hardware/gpio.h"
+#include "hardware/clocks.h"
+
+#include "swd.pio.h"
+
+#define SWD_PIO pio0
+
+static int swd_sm = -1;
+static uint swd_offset;
+static uint32_t swd_div = 256;
+
+/**
+ * @brief Build a command word for the state machine
+ *
+ * @param len Number of bits in the phase
+ * @param host_drives 1 if HOST drives SWDIO for the phase
+ * @param routine Offset of write_cmd or read_cmd within the program
+ *
+ * @return Command word
+ */
+static inline uint32_t swd_pio_cmd(uint8_t len, uint8_t host_drives, uint routine) {
+    return swd_pio_cmd_word(len, host_drives, swd_offset + routine);
+}
+
+/**
+ * @brief Set the SWCLK frequency through the state machine clock divider
+ *
+ * The divider has 8 fractional bits, so the result is the closest frequency
+ * clk_sys / (4 * divider) can produce.
+ *
+ * @param freq_hz Requested SWCLK frequency in Hz
+ *
+ * @return Frequency actually achieved in Hz
+ */
+uint32_t swd_pio_set_freq(uint32_t freq_hz) {
+    uint64_t sys_hz = clock_get_hz(clk_sys);
+    // Divider in 1/256ths, rounded to nearest
+    uint64_t div = (sys_hz * 256 + 2 * freq_hz) / (4ull * freq_hz);
+    if (div < 256) {
+        div = 256;
+    } else if (div > 0xFFFFFF) {
+        div = 0xFFFFFF;
+    }
+    if (swd_sm >= 0) {
+        pio_sm_set_clkdiv_int_frac(SWD_PIO, swd_sm, div >> 8, div & 0xFF);
+    }
+    swd_div = div;
+    return (uint32_t)(sys_hz * 256 / (4 * div));
+}
+
+/**
+ * @brief Load the SWD program and hand SWCLK and SWDIO over to PIO
+ *
+ * @param freq_hz SWCLK frequency in Hz
+ *
+ * @return Frequency actually achieved in Hz
+ */
+uint32_t swd_pio_init(uint32_t freq_hz) {
+    if (swd_sm >= 0) {
+        return swd_pio_set_freq(freq_hz);
+    }
+    uint32_t achieved = swd_pio_set_freq(freq_hz);
+    swd_offset = pio_add_program(SWD_PIO, &swd_program);
+    swd_sm = pio_claim_unused_sm(SWD_PIO, true);
+
+    pio_sm_config c = swd_program_get_default_config(swd_offset);
+    sm_config_set_out_pins(&c, SWDIO, 1);
+    sm_config_set_set_pins(&c, SWDIO, 1);
+    sm_config_set_in_pins(&c, SWDIO);
+    sm_config_set_sideset_pins(&c, SWCLK);
+    // LSB first in both directions, FIFOs are fed by hand
+    sm_config_set_out_shift(&c, true, false, 32);
+    sm_config_set_in_shift(&c, true, false, 32);
+    // 4 PIO cycles per SWCLK period
+    sm_config_set_clkdiv_int_frac(&c, swd_div >> 8, swd_div & 0xFF);
+
+    // SWDIO idles high through the pull up whenever it's released
+    gpio_pull_up(SWDIO);
+    pio_sm_set_pins_with_mask(SWD_PIO, swd_sm, (1u << SWDIO), (1u << SWCLK) | (1u << SWDIO));
+    pio_sm_set_consecutive_pindirs(SWD_PIO, swd_sm, SWCLK, 1, true);
+    pio_sm_set_consecutive_pindirs(SWD_PIO, swd_sm, SWDIO, 1, true);
+    pio_gpio_init(SWD_PIO, SWCLK);
+    pio_gpio_init(SWD_PIO, SWDIO);
+
+    pio_sm_init(SWD_PIO, swd_sm, swd_offset + swd_offset_get_next_cmd, &c);
+    pio_sm_set_enabled(SWD_PIO, swd_sm, true);
+    return achieved;
+}
+
+/**
+ * @brief Stop the state machine and give SWCLK and SWDIO back to SIO
+ */
+void swd_pio_deinit() {
+    if (swd_sm < 0) {
+        return;
+    }
+    pio_sm_set_enabled(SWD_PIO, swd_sm, false);
+    pio_sm_unclaim(SWD_PIO, swd_sm);
+    pio_remove_program(SWD_PIO, &swd_program, swd_offset);
+    swd_sm = -1;
+
+    gpio_set_function(SWCLK, GPIO_FUNC_SIO);
+    gpio_set_function(SWDIO, GPIO_FUNC_SIO);
+}
+
+/**
+ * @brief Shift bits out on SWDIO, LSB first
+ *
+ * @param data Data to be sent
+ * @param len Length of data in bits, 1 to 32
+ */
+void swd_pio_write_bits(uint32_t data, uint8_t len) {
+    pio_sm_put_blocking(SWD_PIO, swd_sm, swd_pio_cmd(len, 1, swd_offset_write_cmd));
+    pio_sm_put_blocking(SWD_PIO, swd_sm, data);
+}
+
+/**
+ * @brief Shift bits in from SWDIO, LSB first
+ *
+ * SWDIO is released for the whole phase, so a read of 1 bit doubles as a
+ * turnaround cycle.
+ *
+ * @param len Length of read, 1 to 32
+ *
+ * @return Data read
+ */
+uint32_t swd_pio_read_bits(uint8_t len) {
+    pio_sm_put_blocking(SWD_PIO, swd_sm, swd_pio_cmd(len, 0, swd_offset_read_cmd));
+    // Bits are pushed in from the top of the ISR
+    return pio_sm_get_blocking(SWD_PIO, swd_sm) >> (32 - len);
+}
+
+/**
+ * @brief Run transactions without waiting for each ACK
+ *
+ * Only valid with CTRL/STAT.ORUNDETECT on. Every transaction then has the
+ * same shape whatever the ACK, so the whole list is fed to the state
+ * machine while ACKs and data are collected from the RX FIFO behind it.
+ * A read whose data fails its parity check gets SWD_ERR_PARITY as its ACK.
+ *
+ * @param reqs Requests built with SWD_REQ()
+ * @param data Data to write, or where read data is stored
+ * @param acks Where the ACK of every transaction is stored
+ * @param n Number of transactions
+ */
+void swd_pio_transfer_stream(const uint8_t* reqs, uint32_t* data, uint8_t* acks, uint32_t n) {
+    uint32_t words[7];
+    uint8_t num_words = 0, next_word = 0, rx_phase = 0;
+    uint32_t tx_op = 0, rx_op = 0;
+
+    while (rx_op < n) {
+        if (next_word == num_words && tx_op < n) {
+            // Lay out every phase of the next transaction
+            uint8_t req = reqs[tx_op];
+            num_words = next_word = 0;
+            words[num_words++] = swd_pio_cmd(8, 1, swd_offset_write_cmd);
+            words[num_words++] = swd_req_headers[req & 0xF];
+            // Turnaround and ACK
+            words[num_words++] = swd_pio_cmd(4, 0, swd_offset_read_cmd);
+            if (req & SWD_REQ_RnW) {
+                words[num_words++] = swd_pio_cmd(32, 0, swd_offset_read_cmd);
+                // Parity and turnaround
+                words[num_words++] = swd_pio_cmd(2, 0, swd_offset_read_cmd);
+            } else {
+                words[num_words++] = swd_pio_cmd(1, 0, swd_offset_read_cmd);
+                words[num_words++] = swd_pio_cmd(32, 1, swd_offset_write_cmd);
+                words[num_words++] = data[tx_op];
+                words[num_words++] = swd_pio_cmd(1, 1, swd_offset_write_cmd);
+                words[num_words++] = __builtin_parity(data[tx_op]);
+            }
+            tx_op++;
+        }
+
+        if (next_word < num_words && !pio_sm_is_tx_fifo_full(SWD_PIO, swd_sm)) {
+            pio_sm_put(SWD_PIO, swd_sm, words[next_word++]);
+            continue;
+        }
+
+        if (pio_sm_is_rx_fifo_empty(SWD_PIO, swd_sm)) {
+            continue;
+        }
+        uint32_t rx = pio_sm_get(SWD_PIO, swd_sm);
+        if (rx_phase == 0) {
+            // Turnaround is the lowest of the 4 bits
+            acks[rx_op] = (rx >> 29) & 0b111;
+            rx_phase = 1;
+        } else if (rx_phase == 1 && (reqs[rx_op] & SWD_REQ_RnW)) {
+            if (acks[rx_op] == SWD_ACK_OK) {
+                data[rx_op] = rx;
+            }
+            rx_phase = 2;
+        } else {
+            // Parity of a read, or the turnaround of a write
+            if ((reqs[rx_op] & SWD_REQ_RnW) && acks[rx_op] == SWD_ACK_OK &&
+                ((rx >> 30) & 1) != __builtin_parity(data[rx_op])) {
+                acks[rx_op] = SWD_ERR_PARITY;
+            }
+            rx_phase = 0;
+            rx_op++;
+        }
+    }
+}
@@ -0,0 +1,17 @@
+/**
+ * @file swd_request.c
+ * @author Min Kang
+ * @brief SWD request headers
+ */
+#include "swd_request.h"
+
+/**
+ * @brief Every possible request header, indexed by SWD_REQ()
+ */
+const uint8_t swd_req_headers[16] = {
+    // Indexed by APnDP | RnW << 1 | A << 2, so A is the slowest moving
+    SWD_HEADER(0, 0, 0b00), SWD_HEADER(1, 0, 0b00), SWD_HEADER(0, 1, 0b00), SWD_HEADER(1, 1, 0b00),
+    SWD_HEADER(0, 0, 0b01), SWD_HEADER(1, 0, 0b01), SWD_HEADER(0, 1, 0b01), SWD_HEADER(1, 1, 0b01),
+    SWD_HEADER(0, 0, 0b10), SWD_HEADER(1, 0, 0b10), SWD_HEADER(0, 1, 0b10), SWD_HEADER(1, 1, 0b10),
+    SWD_HEADER(0, 0, 0b11), SWD_HEADER(1, 0, 0b11), SWD_HEADER(0, 1, 0b11), SWD_HEADER(1, 1, 0b11),
+};
@@ -0,0 +1,327 @@
+/**
+ * @file swo.c
+ * @author Min Kang
+ * @brief SWO trace capture
+ *
+ * A PIO state machine receives the TARGET's SWO as a UART, and a DMA
+ * channel copies every byte into a ring without the CPU. The main loop
+ * empties the ring every SWO_POLL_INTERVAL_US, decoding ITM packets or
+ * passing the bytes on, so trace costs the probe nothing while it is
+ * running and the TARGET only the few cycles of an ITM stimulus write.
+ */
+#include "swo.h"
+#include "mem.h"
+#include "macros.h"
+#include "utils.h"
+#include "usb_cdc.h"
+#include "swd_request.h"
+#include "debug_interface.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/clocks.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "swo.pio.h"
+
+#define SWO_PIO pio1
+// Bytes the DMA channel is armed for, the count register is 28 bits on RP2350
+#define SWO_DMA_COUNT 0x0FFFFFFF
+
+static int swo_sm = -1;
+static uint swo_offset;
+static int swo_dma = -1;
+static dma_channel_config swo_dma_config;
+static uint8_t ring[SWO_RING_SIZE] __attribute__((aligned(SWO_RING_SIZE)));
+// Bytes taken out of the ring since the DMA channel was armed
+static uint32_t ring_read;
+static uint8_t swo_raw;
+static itm_decoder_t decoder;
+static swo_stats_t stats;
+
+/**
+ * @brief Set up the TARGET's TPIU, ITM and DWT to send trace over SWO
+ *
+ * UART (NRZ) encoding with the formatter off, every stimulus port enabled.
+ *
+ * @param baud SWO bit rate
+ * @param trace_hz Frequency of the TARGET's trace clock, usually its core clock
+ * @param pc_sampling 1 to also send periodic PC samples
+ *
+ * @return ACK of request
+ */
+uint8_t swo_target_setup(uint32_t baud, uint32_t trace_hz, uint8_t pc_sampling) {
+    uint32_t demcr, ctrl;
+    uint8_t ack;
+
+    if ((ack = mem_read(CORE_DEMCR, &demcr)) != SWD_ACK_OK) {
+        return ack;
+    }
+    if ((ack = mem_write(CORE_DEMCR, demcr | DEMCR_TRCENA)) != SWD_ACK_OK) {
+        return ack;
+    }
+    // One bit wide port, NRZ, SWOSCALER divides the trace clock down to baud
+    if ((ack = mem_write(TPIU_CSPSR, 1)) != SWD_ACK_OK) {
+        return ack;
+    }
+    if ((ack = mem_write(TPIU_ACPR, trace_hz / baud - 1)) != SWD_ACK_OK) {
+        return ack;
+    }
+    if ((ack = mem_write(TPIU_SPPR, TPIU_SPPR_NRZ)) != SWD_ACK_OK) {
+        return ack;
+    }
+    if ((ack = mem_write(TPIU_FFCR, TPIU_FFCR_TRIGIN)) != SWD_ACK_OK) {
+        return ack;
+    }
+
+    if ((ack = mem_write(ITM_LAR, ITM_LAR_KEY)) != SWD_ACK_OK) {
+        return ack;
+    }
+    if ((ack = mem_write(ITM_TCR, ITM_TCR_ITMENA | ITM_TCR_SYNCENA | ITM_TCR_TXENA |
+                                  ITM_TCR_TRACEBUSID(1))) != SWD_ACK_OK) {
+        return ack;
+    }
+    // A set PRIVMASK bit would lock its 8 ports to privileged code
+    if ((ack = mem_write(ITM_TPR, 0)) != SWD_ACK_OK) {
+        return ack;
+    }
+    // Every stimulus port
+    if ((ack = mem_write(ITM_TER0, 0xFFFFFFFF)) != SWD_ACK_OK) {
+        return ack;
+    }
+
+    if ((ack = mem_read(DWT_CTRL, &ctrl)) != SWD_ACK_OK) {
+        return ack;
+    }
+    ctrl &= ~(DWT_CTRL_PCSAMPLENA | DWT_CTRL_POSTPRESET | DWT_CTRL_CYCTAP);
+    if (pc_sampling) {
+        // A sample every 16 * 1024 cycles
+        ctrl |= DWT_CTRL_CYCCNTENA | DWT_CTRL_PCSAMPLENA | DWT_CTRL_POSTPRESET | DWT_CTRL_CYCTAP;
+    }
+    return mem_write(DWT_CTRL, ctrl);
+}
+
+/**
+ * @brief Point the DMA channel at the start of the ring again
+ */
+static void dma_arm() {
+    dma_channel_configure(swo_dma, &swo_dma_config, ring,
+                          // The byte is in the top of the FIFO word
+                          (const volatile uint8_t*)pio_sm_get_rx_fifo_addr(SWO_PIO, swo_sm) + 3,
+                          SWO_DMA_COUNT, true);
+    ring_read = 0;
+}
+
+/**
+ * @brief Start receiving SWO on SWO_PIN
+ *
+ * @param baud SWO bit rate
+ */
+void swo_capture_start(uint32_t baud) {
+    if (swo_sm >= 0) {
+        swo_capture_stop();
+    }
+    swo_offset = pio_add_program(SWO_PIO, &swo_uart_program);
+    swo_sm = pio_claim_unused_sm(SWO_PIO, true);
+
+    pio_sm_config c = swo_uart_program_get_default_config(swo_offset);
+    sm_config_set_in_pins(&c, SWO_PIN);
+    sm_config_set_jmp_pin(&c, SWO_PIN);
+    sm_config_set_in_shift(&c, true, false, 32);
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
+    // 8 PIO cycles per bit
+    sm_config_set_clkdiv(&c, (float)clock_get_hz(clk_sys) / (8.0f * baud));
+
+    // SWO idles high, and stays there when nothing is connected
+    gpio_pull_up(SWO_PIN);
+    pio_sm_set_consecutive_pindirs(SWO_PIO, swo_sm, SWO_PIN, 1, false);
+    pio_gpio_init(SWO_PIO, SWO_PIN);
+
+    swo_dma = dma_claim_unused_channel(true);
+    swo_dma_config = dma_channel_get_default_config(swo_dma);
+    channel_config_set_transfer_data_size(&swo_dma_config, DMA_SIZE_8);
+    channel_config_set_read_increment(&swo_dma_config, false);
+    channel_config_set_write_increment(&swo_dma_config, true);
+    channel_config_set_ring(&swo_dma_config, true, SWO_RING_BITS);
+    channel_config_set_dreq(&swo_dma_config, pio_get_dreq(SWO_PIO, swo_sm, false));
+
+    itm_decoder_init(&decoder);
+    memset(&stats, 0, sizeof(stats));
+    pio_sm_init(SWO_PIO, swo_sm, swo_offset + swo_uart_offset_start, &c);
+    dma_arm();
+    pio_sm_set_enabled(SWO_PIO, swo_sm, true);
+}
+
+/**
+ * @brief Stop receiving SWO and free the state machine and DMA channel
+ */
+void swo_capture_stop() {
+    if (swo_sm < 0) {
+        return;
+    }
+    pio_sm_set_enabled(SWO_PIO, swo_sm, false);
+    dma_channel_abort(swo_dma);
+    dma_channel_unclaim(swo_dma);
+    pio_sm_unclaim(SWO_PIO, swo_sm);
+    pio_remove_program(SWO_PIO, &swo_uart_program, swo_offset);
+    swo_sm = -1;
+    swo_dma = -1;
+    gpio_set_function(SWO_PIN, GPIO_FUNC_SIO);
+}
+
+/**
+ * @brief Choose whether trace is decoded on the probe or passed on raw
+ *
+ * Decoded, only stimulus port data reaches the stream port. Raw, every
+ * byte does, for a decoder on the host.
+ *
+ * @param raw 1 to pass bytes through as they are
+ */
+void swo_set_raw(uint8_t raw) {
+    swo_raw = raw;
+    itm_decoder_init(&decoder);
+}
+
+/**
+ * @brief Decode or pass on a run of bytes from the ring
+ */
+static void swo_handle(const uint8_t* bytes, uint32_t len) {
+    itm_packet_t packet;
+    uint32_t i;
+
+    stats.bytes += len;
+    if (swo_raw) {
+        usb_cdc_write(USB_CDC_STREAM, bytes, len);
+        return;
+    }
+    for (i = 0; i < len; ++i) {
+        if (!itm_decode_byte(&decoder, bytes[i], &packet)) {
+            continue;
+        }
+        stats.packets[packet.type]++;
+        if (packet.type == ITM_PKT_STIMULUS) {
+            // Little endian, the way the TARGET wrote it
+            usb_cdc_write(USB_CDC_STREAM, &packet.value, packet.size);
+        }
+    }
+}
+
+/**
+ * @brief Move received trace to the stream port, run from the main loop
+ *
+ * @return 0
+ */
+uint8_t swo_task() {
+    uint32_t written, start, len, budget = SWO_TASK_MAX;
+    uint8_t rearm;
+
+    if (swo_sm < 0) {
+        return 0;
+    }
+    rearm = !dma_channel_is_busy(swo_dma);
+    written = SWO_DMA_COUNT - (dma_hw->ch[swo_dma].transfer_count & SWO_DMA_COUNT);
+    if (written - ring_read > SWO_RING_SIZE) {
+        // Lapped, what is left in the ring is the newest SWO_RING_SIZE bytes
+        stats.overruns++;
+        ring_read = written - SWO_RING_SIZE;
+        itm_decoder_init(&decoder);
+    }
+    while (ring_read != written && budget) {
+        start = ring_read & (SWO_RING_SIZE - 1);
+        len = written - ring_read;
+        // Up to where the ring wraps
+        if (len > SWO_RING_SIZE - start) {
+            len = SWO_RING_SIZE - start;
+        }
+        if (len > budget) {
+            len = budget;
+        }
+        swo_handle(&ring[start], len);
+        ring_read += len;
+        budget -= len;
+    }
+    if (rearm && ring_read == written) {
+        dma_arm();
+    }
+    return 0;
+}
+
+/**
+ * @brief Get the capture counters
+ *
+ * @return Pointer to the counters
+ */
+const swo_stats_t* swo_get_stats() {
+    return &stats;
+}
+
+/**
+ * @brief Print the capture counters
+ */
+static void print_swo_stats() {
+    printf("SWO:        %s, %s\n", swo_sm >= 0 ? "capturing" : "stopped", swo_raw ? "raw" : "decoded");
+    printf("Bytes:      %u\n", stats.bytes);
+    printf("Overruns:   %u\n", stats.overruns);
+    printf("Syncs:      %u\n", stats.packets[ITM_PKT_SYNC]);
+    printf("Overflows:  %u\n", stats.packets[ITM_PKT_OVERFLOW]);
+    printf("Stimulus:   %u\n", stats.packets[ITM_PKT_STIMULUS]);
+    printf("Counters:   %u\n", stats.packets[ITM_PKT_EVENT_COUNTER]);
+    printf("Exceptions: %u\n", stats.packets[ITM_PKT_EXCEPTION]);
+    printf("PC samples: %u\n", stats.packets[ITM_PKT_PC_SAMPLE]);
+    printf("Data trace: %u\n", stats.packets[ITM_PKT_DATA_TRACE]);
+    printf("Timestamps: %u\n", stats.packets[ITM_PKT_TIMESTAMP] + stats.packets[ITM_PKT_GLOBAL_TS]);
+}
+
+/**
+ * @brief Capture SWO trace from the TARGET
+ *
+ * Usage: swo start <trace hz> [baud] [pc]
+ *        swo stop|raw|decode
+ *        swo
+ *
+ * start sets up the TARGET and starts receiving, pc adds periodic PC
+ * samples. Trace goes to the stream port. Without arguments, shows the
+ * capture counters.
+ *
+ * @return ACK from SWD request, or 1 for bad arguments
+ */
+uint8_t swo_run(char** args, uint8_t num_args) {
+    int32_t trace_hz, baud = SWO_DEFAULT_BAUD;
+    uint8_t ack, pc = 0;
+
+    if (num_args == 1) {
+        print_swo_stats();
+        return 0;
+    }
+    if (num_args == 2 && !strcmp(args[1], "stop")) {
+        swo_capture_stop();
+        return 0;
+    }
+    if (num_args == 2 && (!strcmp(args[1], "raw") || !strcmp(args[1], "decode"))) {
+        swo_set_raw(args[1][0] == 'r');
+        return 0;
+    }
+    if (num_args >= 3 && num_args <= 5 && !strcmp(args[1], "start")) {
+        trace_hz = str_to_int(args[2]);
+        if (num_args > 3 && !strcmp(args[num_args - 1], "pc")) {
+            pc = 1;
+            num_args--;
+        }
+        if (num_args == 4) {
+            baud = str_to_int(args[3]);
+        }
+        if (num_args <= 4 && trace_hz > 0 && baud > 0 && baud <= trace_hz) {
+            // The TARGET can only divide its trace clock by a whole number
+            baud = trace_hz / (trace_hz / baud);
+            ack = swo_target_setup(baud, trace_hz, pc);
+            CHECK_ACK_RT("Failed setting up trace");
+            swo_capture_start(baud);
+            printf("Capturing SWO at %u baud on GPIO %u\n", baud, SWO_PIN);
+            return ack;
+        }
+    }
+    printf("Incorrect format. Format should be:\n");
+    printf("swo start <trace hz> [baud] [pc] | swo stop | swo raw | swo decode | swo\n");
+    return 1;
+}
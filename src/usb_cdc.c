@@ -0,0 +1,167 @@
+/**
+ * @file usb_cdc.c
+ * @author Min Kang
+ * @brief USB CDC ports
+ *
+ * TinyUSB only ever runs in a repeating timer interrupt, which moves bytes
+ * between the CDC FIFOs and a pair of rings per port. The rest of the code
+ * only touches the rings, each of which has one writer on each side, so
+ * no locks are needed and a busy main loop never holds up USB.
+ */
+#include "usb_cdc.h"
+#include "pico/time.h"
+#include "tusb.h"
+#include <stddef.h>
+
+typedef struct {
+    volatile uint8_t rx[USB_CDC_RX_SIZE];
+    volatile uint32_t rx_head; // Written by the interrupt
+    volatile uint32_t rx_tail; // Written by the main loop
+    volatile uint8_t tx[USB_CDC_TX_SIZE];
+    volatile uint32_t tx_head; // Written by the main loop
+    volatile uint32_t tx_tail; // Written by the interrupt
+    volatile uint8_t connected;
+} port_t;
+
+static port_t ports[USB_CDC_PORTS];
+static repeating_timer_t usb_timer;
+
+/**
+ * @brief Move received bytes into the ring, as many as fit
+ *
+ * The rest stays in the CDC, which then holds off the host.
+ */
+static void port_receive(uint8_t itf, port_t* p) {
+    uint8_t buf[CFG_TUD_CDC_EP_BUFSIZE];
+    uint32_t head = p->rx_head;
+    uint32_t space, n, i;
+    while ((space = USB_CDC_RX_SIZE - (head - p->rx_tail)) && tud_cdc_n_available(itf)) {
+        n = tud_cdc_n_read(itf, buf, space < sizeof(buf) ? space : sizeof(buf));
+        for (i = 0; i < n; ++i) {
+            p->rx[head++ & (USB_CDC_RX_SIZE - 1)] = buf[i];
+        }
+        p->rx_head = head;
+    }
+}
+
+/**
+ * @brief Hand queued bytes to the CDC, as many as it takes
+ */
+static void port_send(uint8_t itf, port_t* p) {
+    uint8_t buf[CFG_TUD_CDC_EP_BUFSIZE];
+    uint32_t tail = p->tx_tail;
+    uint32_t n, i;
+    if (tail == p->tx_head) {
+        return;
+    }
+    while ((n = p->tx_head - tail)) {
+        if (n > sizeof(buf)) {
+            n = sizeof(buf);
+        }
+        if (n > tud_cdc_n_write_available(itf)) {
+            n = tud_cdc_n_write_available(itf);
+        }
+        if (n == 0) {
+            break;
+        }
+        for (i = 0; i < n; ++i) {
+            buf[i] = p->tx[tail++ & (USB_CDC_TX_SIZE - 1)];
+        }
+        tud_cdc_n_write(itf, buf, n);
+    }
+    p->tx_tail = tail;
+    tud_cdc_n_write_flush(itf);
+}
+
+static bool usb_task(repeating_timer_t* rt) {
+    uint8_t itf;
+    tud_task();
+    for (itf = 0; itf < USB_CDC_PORTS; ++itf) {
+        port_t* p = &ports[itf];
+        p->connected = tud_cdc_n_connected(itf);
+        port_receive(itf, p);
+        if (p->connected) {
+            port_send(itf, p);
+        } else {
+            // Nobody to send it to
+            p->tx_tail = p->tx_head;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Bring up TinyUSB and start servicing it in the background
+ */
+void usb_cdc_init() {
+    tusb_init();
+    add_repeating_timer_us(-USB_TASK_INTERVAL_US, usb_task, NULL, &usb_timer);
+}
+
+/**
+ * @brief Get a received byte without waiting
+ *
+ * @param port USB_CDC_CONSOLE, USB_CDC_HOST or USB_CDC_STREAM
+ *
+ * @return Byte received, or -1 if there is none
+ */
+int usb_cdc_getc(uint8_t port) {
+    port_t* p = &ports[port];
+    uint8_t c;
+    if (p->rx_head == p->rx_tail) {
+        return -1;
+    }
+    c = p->rx[p->rx_tail & (USB_CDC_RX_SIZE - 1)];
+    p->rx_tail++;
+    return c;
+}
+
+/**
+ * @brief Number of received bytes waiting to be read
+ *
+ * @param port USB_CDC_CONSOLE, USB_CDC_HOST or USB_CDC_STREAM
+ *
+ * @return Bytes waiting
+ */
+uint32_t usb_cdc_available(uint8_t port) {
+    return ports[port].rx_head - ports[port].rx_tail;
+}
+
+/**
+ * @brief Queue bytes to send
+ *
+ * Waits for room while the host has the port open. With nobody listening
+ * the bytes are dropped, so output never hangs the probe.
+ *
+ * @param port USB_CDC_CONSOLE, USB_CDC_HOST or USB_CDC_STREAM
+ * @param buf Bytes to send
+ * @param len Number of bytes
+ */
+void usb_cdc_write(uint8_t port, const void* buf, uint32_t len) {
+    port_t* p = &ports[port];
+    const uint8_t* bytes = buf;
+    uint32_t head = p->tx_head;
+    while (len) {
+        if (!p->connected) {
+            return;
+        }
+        if (head - p->tx_tail == USB_CDC_TX_SIZE) {
+            // Full, the timer interrupt makes room
+            continue;
+        }
+        p->tx[head++ & (USB_CDC_TX_SIZE - 1)] = *bytes++;
+        p->tx_head = head;
+        len--;
+    }
+}
+
+/**
+ * @brief Whether the host has the port open
+ *
+ * @param port USB_CDC_CONSOLE, USB_CDC_HOST or USB_CDC_STREAM
+ *
+ * @return 1 if DTR is set
+ */
+uint8_t usb_cdc_connected(uint8_t port) {
+    return ports[port].connected;
+}
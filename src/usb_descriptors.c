@@ -0,0 +1,104 @@
+/**
+ * @file usb_descriptors.c
+ * @author Min Kang
+ * @brief USB descriptors: one CDC interface pair per port in usb_cdc.h
+ */
+#include "tusb.h"
+#include "usb_cdc.h"
+#include "pico/unique_id.h"
+#include <string.h>
+
+// TinyUSB's VID for development boards
+#define USB_VID 0xCAFE
+#define USB_PID 0x4013
+#define USB_BCD 0x0200
+
+enum {
+    STR_LANGID,
+    STR_MANUFACTURER,
+    STR_PRODUCT,
+    STR_SERIAL,
+    STR_CONSOLE,
+    STR_HOST,
+    STR_STREAM,
+};
+
+static const tusb_desc_device_t device_descriptor = {
+    .bLength = sizeof(tusb_desc_device_t),
+    .bDescriptorType = TUSB_DESC_DEVICE,
+    .bcdUSB = USB_BCD,
+    // Interface association, every CDC is a pair of interfaces
+    .bDeviceClass = TUSB_CLASS_MISC,
+    .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+    .bDeviceProtocol = MISC_PROTOCOL_IAD,
+    .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+    .idVendor = USB_VID,
+    .idProduct = USB_PID,
+    .bcdDevice = 0x0100,
+    .iManufacturer = STR_MANUFACTURER,
+    .iProduct = STR_PRODUCT,
+    .iSerialNumber = STR_SERIAL,
+    .bNumConfigurations = 1,
+};
+
+#define CONFIG_LEN (TUD_CONFIG_DESC_LEN + USB_CDC_PORTS * TUD_CDC_DESC_LEN)
+
+// Port n has interfaces 2n and 2n+1, notification endpoint 0x81 + 2n, and
+// data endpoints 0x02 + 2n and 0x82 + 2n
+#define CDC_PORT_DESCRIPTOR(n, str) \
+    TUD_CDC_DESCRIPTOR(2 * (n), str, 0x81 + 2 * (n), 8, 0x02 + 2 * (n), 0x82 + 2 * (n), CFG_TUD_CDC_EP_BUFSIZE)
+
+static const uint8_t config_descriptor[] = {
+    TUD_CONFIG_DESCRIPTOR(1, 2 * USB_CDC_PORTS, 0, CONFIG_LEN, 0, 100),
+    CDC_PORT_DESCRIPTOR(USB_CDC_CONSOLE, STR_CONSOLE),
+    CDC_PORT_DESCRIPTOR(USB_CDC_HOST, STR_HOST),
+    CDC_PORT_DESCRIPTOR(USB_CDC_STREAM, STR_STREAM),
+};
+
+static const char* const strings[] = {
+    [STR_MANUFACTURER] = "Min Kang",
+    [STR_PRODUCT] = "Pico SWD Debugger",
+    [STR_CONSOLE] = "Pico SWD Debugger Console",
+    [STR_HOST] = "Pico SWD Debugger Host",
+    [STR_STREAM] = "Pico SWD Debugger Stream",
+};
+
+const uint8_t* tud_descriptor_device_cb(void) {
+    return (const uint8_t*)&device_descriptor;
+}
+
+const uint8_t* tud_descriptor_configuration_cb(uint8_t index) {
+    return config_descriptor;
+}
+
+const uint16_t* tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
+    static uint16_t desc[32];
+    char serial[2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
+    const char* str;
+    uint8_t len, i;
+
+    if (index == STR_LANGID) {
+        // English
+        desc[1] = 0x0409;
+        len = 1;
+    } else {
+        if (index == STR_SERIAL) {
+            pico_get_unique_board_id_string(serial, sizeof(serial));
+            str = serial;
+        } else if (index < TU_ARRAY_SIZE(strings) && strings[index]) {
+            str = strings[index];
+        } else {
+            return NULL;
+        }
+        len = strlen(str);
+        if (len > TU_ARRAY_SIZE(desc) - 1) {
+            len = TU_ARRAY_SIZE(desc) - 1;
+        }
+        for (i = 0; i < len; ++i) {
+            desc[1 + i] = str[i];
+        }
+    }
+    // Length in bytes, including this header
+    desc[0] = (TUSB_DESC_STRING << 8) | (2 * len + 2);
+    return desc;
+}
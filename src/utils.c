@@ -5,9 +5,13 @@
  */
 #include "utils.h"
 #include "macros.h"
+#include "proto.h"
+#include "console.h"
+#include "jobs.h"
 
 #include "hardware/gpio.h"
 #include "pico/time.h"
+#include "pico/stdlib.h"
 #include <stdio.h>
 
 /**
@@ -53,39 +57,91 @@ void wait_for_button() {
  * @return Key that was pressed
  */
 char get_keypress() {
-    char c;
+    int c;
     gpio_put(PICO_DEFAULT_LED_PIN, 1);
-    scanf("%c", &c);
+    console_flush();
+    while ((c = console_getc()) < 0) {
+        tight_loop_contents();
+    }
     gpio_put(PICO_DEFAULT_LED_PIN, 0);
     return c;
 }
 
+// Line being edited by get_line(), kept between calls
+static char* line_buf;
+static int8_t line_len;
+static uint8_t line_prompted;
+
 /**
  * @brief Get a line of text from user
  * 
- * Receive text from user until new line is received
- * Can also handle backspaces
+ * Takes whatever has been received so far without waiting, so it is called
+ * again and again until a new line is received. The same buffer must be
+ * passed every time. Can also handle backspaces
+ *
+ * PROTO_ESCAPE at the start of a line is returned on its own without being
+ * echoed, so the caller can switch to binary mode. Ctrl-C cancels whatever
+ * jobs are running.
+ *
+ * @return 1 once a whole line is in buf, 0 otherwise
  */
-void get_line(char* buf, int8_t buf_size) {
-    char c;
-    int8_t i = 0;
-    gpio_put(PICO_DEFAULT_LED_PIN, 1);
-    printf("> ");
-    do {
-        scanf("%c", &c);
-        printf("%c", c);
+uint8_t get_line(char* buf, int8_t buf_size) {
+    int c;
+    line_buf = buf;
+    if (!line_prompted) {
+        gpio_put(PICO_DEFAULT_LED_PIN, 1);
+        printf("> ");
+        line_prompted = 1;
+        line_len = 0;
+    }
+    while ((c = console_getc()) >= 0) {
+        if (c == CTRL_C) {
+            if (job_cancel_all() == 0) {
+                printf("^C");
+            }
+            continue;
+        }
+        if (c == PROTO_ESCAPE && line_len == 0) {
+            buf[0] = c;
+            buf[1] = '\0';
+            line_prompted = 0;
+            gpio_put(PICO_DEFAULT_LED_PIN, 0);
+            return 1;
+        }
         if (c == 127 || c == '\b') {
-            if (i != 0) {
-                i--;
+            if (line_len != 0) {
+                line_len--;
                 printf("\b \b");
             }
-        } else if (c != '\n' && c != '\r')
-            buf[i++] = c;
-    } while ((c != '\n' && c != '\r') && i < buf_size - 1);
-    if (i != 0)
-        buf[i] = '\0';
-    printf("\n");
-    gpio_put(PICO_DEFAULT_LED_PIN, 0);
+            continue;
+        }
+        if (c != '\n' && c != '\r') {
+            printf("%c", c);
+            buf[line_len++] = c;
+            if (line_len < buf_size - 1) {
+                continue;
+            }
+        }
+        // An empty line leaves buf alone, which repeats the last command
+        if (line_len != 0)
+            buf[line_len] = '\0';
+        printf("\n");
+        line_prompted = 0;
+        gpio_put(PICO_DEFAULT_LED_PIN, 0);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Print the prompt and the line being edited again
+ *
+ * For background work that printed something in the middle of a line.
+ */
+void redraw_line() {
+    if (line_prompted) {
+        printf("> %.*s", line_len, line_buf);
+    }
 }
 
 /**
@@ -96,12 +152,7 @@ void get_line(char* buf, int8_t buf_size) {
  * @return Even parity (0 if number of 1's even)
  */
 uint8_t calc_parity(uint32_t data) {
-    uint8_t counter = 0;
-    while (data) {
-        data &= (data - 1);
-        counter += 1;
-    }
-    return counter % 2;
+    return __builtin_parity(data);
 }
 
 /**
@@ -0,0 +1,471 @@
+/**
+ * @file watchpoint.c
+ * @author Min Kang
+ * @brief Data watchpoints through the DWT
+ *
+ * The comparator format depends on the architecture. ARMv7-M watches an
+ * aligned power of two through DWT_MASK, and only comparator 1 matches
+ * values, linked to an address comparator through DATAVADDR0. ARMv8-M has
+ * no mask: sizes up to a word go in DATAVSIZE, longer ranges take a
+ * second comparator as the limit, and a value takes a second comparator
+ * linked to the one before it.
+ *
+ * Like breakpoint.c, only the table changes until wp_sync() writes the
+ * comparators that changed when the core is about to run.
+ */
+#include "watchpoint.h"
+#include "mem.h"
+#include "macros.h"
+#include "swd_request.h"
+#include <string.h>
+
+#define DWT_CTRL_NUMCOMP(ctrl) (((ctrl) >> 28) & 0xF)
+#define DWT_REG(base, n) ((base) + 16 * (n))
+
+// ARMv7-M DWT_FUNCTION
+#define V7_FUNC_READ      0x5
+#define V7_FUNC_WRITE     0x6
+#define V7_FUNC_ACCESS    0x7
+#define V7_DATAVMATCH     (1 << 8)
+#define V7_DATAVADDR0(n)  ((n) << 12)
+
+// ARMv8-M DWT_FUNCTION, MATCH is the access type plus one of these
+#define V8_MATCH_ADDR     0x4
+#define V8_MATCH_LIMIT    0x7
+#define V8_MATCH_LINKED   0xB
+#define V8_ACTION_HALT    (1 << 4)
+// DWT_FUNCTION.ID, what each comparator can match
+#define V8_ID_VALUE       (1u << 31)
+#define V8_ID_LIMIT       (1u << 29)
+
+// Both: bytes compared, 0 for a byte, 1 for a halfword, 2 for a word
+#define DATAVSIZE(size)   ((size) << 10)
+
+static uint8_t dwt_num;
+static uint8_t dwt_v8m;
+static uint8_t wp_probed;
+// What each comparator can do on ARMv8-M
+static uint32_t dwt_id[DWT_MAX];
+// What each comparator should hold, and which of them are in use
+static uint32_t dwt_comp[DWT_MAX];
+static uint32_t dwt_mask[DWT_MAX];
+static uint32_t dwt_func[DWT_MAX];
+static uint16_t dwt_busy;
+// Comparators that differ from the table, and whether DEMCR.TRCENA needs setting
+static uint16_t dwt_dirty;
+static uint8_t trcena_dirty;
+
+static wp_t wps[WP_MAX];
+static uint8_t wp_used[WP_MAX];
+
+/**
+ * @brief Read the DWT's comparator count and what each can match
+ *
+ * Keeps the watchpoint table, but every comparator is written again on
+ * the next wp_sync(), which also clears whatever an earlier session left.
+ *
+ * @return ACK of request
+ */
+uint8_t wp_init() {
+    uint32_t ctrl, devarch, demcr;
+    uint8_t ack, i;
+    // The DWT reads as zero until TRCENA powers it
+    if ((ack = mem_read(CORE_DEMCR, &demcr)) != SWD_ACK_OK) {
+        return ack;
+    }
+    if ((ack = mem_write(CORE_DEMCR, demcr | DEMCR_TRCENA)) != SWD_ACK_OK) {
+        return ack;
+    }
+    if ((ack = mem_read(DWT_CTRL, &ctrl)) != SWD_ACK_OK) {
+        return ack;
+    }
+    if ((ack = mem_read(DWT_DEVARCH, &devarch)) != SWD_ACK_OK) {
+        return ack;
+    }
+    dwt_num = DWT_CTRL_NUMCOMP(ctrl);
+    dwt_v8m = devarch == DWT_DEVARCH_V8M;
+    for (i = 0; i < dwt_num && dwt_v8m; ++i) {
+        if ((ack = mem_read(DWT_REG(DWT_FUNCTION0, i), &dwt_id[i])) != SWD_ACK_OK) {
+            return ack;
+        }
+    }
+    // A different TARGET may have fewer comparators
+    for (i = 0; i < WP_MAX; ++i) {
+        if (wp_used[i] && wps[i].comps >> dwt_num) {
+            wp_used[i] = 0;
+            dwt_busy &= ~wps[i].comps;
+        }
+    }
+    wp_probed = 1;
+    wp_invalidate();
+    return ack;
+}
+
+/**
+ * @brief Find count free comparators in a row
+ *
+ * @param count 1 or 2
+ * @param need DWT_FUNCTION.ID bits the last of them must have on ARMv8-M
+ *
+ * @return First comparator, or DWT_MAX if there is no room
+ */
+static uint8_t find_free(uint8_t count, uint32_t need) {
+    uint32_t bits = (1u << count) - 1;
+    uint8_t i;
+    for (i = 0; i + count <= dwt_num; ++i) {
+        if (dwt_busy & (bits << i)) {
+            continue;
+        }
+        if (dwt_v8m && (dwt_id[i + count - 1] & need) != need) {
+            continue;
+        }
+        return i;
+    }
+    return DWT_MAX;
+}
+
+/**
+ * @brief Byte, halfword or word, as DATAVSIZE has it
+ *
+ * @return DATAVSIZE, or 3 if len isn't 1, 2 or 4
+ */
+static uint8_t value_size(uint32_t len) {
+    switch (len) {
+    case 1: return 0;
+    case 2: return 1;
+    case 4: return 2;
+    }
+    return 3;
+}
+
+/**
+ * @brief Repeat a byte or halfword across the word, the way DWT_COMP wants it
+ */
+static uint32_t replicate(uint32_t value, uint8_t size) {
+    if (size == 0) {
+        value = (value & 0xFF) * 0x01010101;
+    } else if (size == 1) {
+        value = (value & 0xFFFF) * 0x00010001;
+    }
+    return value;
+}
+
+/**
+ * @brief Fill in the comparators for an ARMv7-M watchpoint
+ *
+ * The mask covers the smallest aligned power of two holding the range.
+ */
+static uint8_t build_v7m(wp_t* wp) {
+    uint32_t func = wp->type == WP_READ ? V7_FUNC_READ : wp->type == WP_WRITE ? V7_FUNC_WRITE : V7_FUNC_ACCESS;
+    uint32_t mask = 0;
+    uint8_t size = value_size(wp->len);
+    uint8_t c;
+
+    while (mask < 31 && (wp->addr >> mask) != ((wp->addr + wp->len - 1) >> mask)) {
+        mask++;
+    }
+    if (!wp->match_value) {
+        if ((c = find_free(1, 0)) == DWT_MAX) {
+            return 0;
+        }
+        dwt_comp[c] = wp->addr & ~((1u << mask) - 1);
+        dwt_mask[c] = mask;
+        dwt_func[c] = func;
+        wp->comps = 1u << c;
+        return 1;
+    }
+    // Only comparator 1 matches values, any other one holds the address
+    if (dwt_num < 2 || (dwt_busy & 2) || size == 3) {
+        return 0;
+    }
+    dwt_busy |= 2;
+    c = find_free(1, 0);
+    dwt_busy &= ~2;
+    if (c == DWT_MAX) {
+        return 0;
+    }
+    dwt_comp[c] = wp->addr & ~((1u << mask) - 1);
+    dwt_mask[c] = mask;
+    dwt_func[c] = 0;
+    dwt_comp[1] = replicate(wp->value, size);
+    dwt_mask[1] = 0;
+    dwt_func[1] = func | V7_DATAVMATCH | DATAVSIZE(size) | V7_DATAVADDR0(c);
+    wp->comps = (1u << c) | 2;
+    return 1;
+}
+
+/**
+ * @brief Fill in the comparators for an ARMv8-M watchpoint
+ */
+static uint8_t build_v8m(wp_t* wp) {
+    // Read or write from the access type, 0 for both
+    uint32_t access = wp->type == WP_READ ? 2 : wp->type == WP_WRITE ? 1 : 0;
+    uint8_t size = value_size(wp->len);
+    uint8_t c;
+
+    if (size == 3 || wp->addr & (wp->len - 1)) {
+        // Not an aligned byte, halfword or word, the next comparator is the limit
+        if (wp->match_value || (c = find_free(2, V8_ID_LIMIT)) == DWT_MAX) {
+            return 0;
+        }
+        dwt_comp[c] = wp->addr;
+        dwt_func[c] = (V8_MATCH_ADDR + access) | V8_ACTION_HALT;
+        dwt_comp[c + 1] = wp->addr + wp->len - 1;
+        dwt_func[c + 1] = V8_MATCH_LIMIT | V8_ACTION_HALT;
+        wp->comps = 3u << c;
+    } else if (wp->match_value) {
+        // The address comparator only triggers the value comparator after it
+        if ((c = find_free(2, V8_ID_VALUE)) == DWT_MAX) {
+            return 0;
+        }
+        dwt_comp[c] = wp->addr;
+        dwt_func[c] = (V8_MATCH_ADDR + access) | DATAVSIZE(size);
+        dwt_comp[c + 1] = replicate(wp->value, size);
+        dwt_func[c + 1] = V8_MATCH_LINKED | V8_ACTION_HALT | DATAVSIZE(size);
+        wp->comps = 3u << c;
+    } else {
+        if ((c = find_free(1, 0)) == DWT_MAX) {
+            return 0;
+        }
+        dwt_comp[c] = wp->addr;
+        dwt_func[c] = (V8_MATCH_ADDR + access) | V8_ACTION_HALT | DATAVSIZE(size);
+        wp->comps = 1u << c;
+    }
+    return 1;
+}
+
+/**
+ * @brief Set a data watchpoint
+ *
+ * @param addr First byte watched
+ * @param len Bytes watched, 1, 2 or 4 to match a value
+ * @param type Accesses that trigger it
+ * @param match_value Only trigger when the value accessed is value
+ * @param value Value to match, len bytes of it
+ *
+ * @return ACK of request, or SWD_ACK_FAULT if the DWT can't do it
+ */
+uint8_t wp_set(uint32_t addr, uint32_t len, wp_type_t type, uint8_t match_value, uint32_t value) {
+    uint32_t func[DWT_MAX];
+    uint16_t busy, dirty, bits;
+    uint8_t i, ack, free = WP_MAX, old = WP_MAX;
+    wp_t wp;
+
+    if (!wp_probed && (ack = wp_init()) != SWD_ACK_OK) {
+        return ack;
+    }
+    if (len == 0) {
+        return SWD_ACK_FAULT;
+    }
+    for (i = 0; i < WP_MAX; ++i) {
+        if (wp_used[i] && wps[i].addr == addr) {
+            old = i;
+        } else if (!wp_used[i] && free == WP_MAX) {
+            free = i;
+        }
+    }
+    if (old != WP_MAX) {
+        free = old;
+    }
+    if (free == WP_MAX) {
+        return SWD_ACK_FAULT;
+    }
+    wp.addr = addr;
+    wp.len = len;
+    wp.type = type;
+    wp.match_value = match_value;
+    wp.value = value;
+    // A replaced watchpoint's comparators are free for the new one, but it
+    // stays as it was if the new one doesn't fit
+    memcpy(func, dwt_func, sizeof(func));
+    busy = dwt_busy;
+    dirty = dwt_dirty;
+    if (old != WP_MAX) {
+        wp_clear(addr);
+    }
+    if (!(dwt_v8m ? build_v8m(&wp) : build_v7m(&wp))) {
+        memcpy(dwt_func, func, sizeof(func));
+        dwt_busy = busy;
+        dwt_dirty = dirty;
+        if (old != WP_MAX) {
+            wp_used[old] = 1;
+        }
+        return SWD_ACK_FAULT;
+    }
+    bits = wp.comps;
+    dwt_busy |= bits;
+    dwt_dirty |= bits;
+    trcena_dirty = 1;
+    wps[free] = wp;
+    wp_used[free] = 1;
+    return SWD_ACK_OK;
+}
+
+/**
+ * @brief Remove the watchpoint on an address
+ *
+ * @param addr Address the watchpoint was set on
+ *
+ * @return ACK of request, or SWD_ACK_FAULT if there was none
+ */
+uint8_t wp_clear(uint32_t addr) {
+    uint16_t bits;
+    uint8_t i, c;
+    for (i = 0; i < WP_MAX; ++i) {
+        if (wp_used[i] && wps[i].addr == addr) {
+            bits = wps[i].comps;
+            for (c = 0; c < DWT_MAX; ++c) {
+                if (bits & (1u << c)) {
+                    dwt_func[c] = 0;
+                }
+            }
+            dwt_busy &= ~bits;
+            dwt_dirty |= bits;
+            wp_used[i] = 0;
+            return SWD_ACK_OK;
+        }
+    }
+    return SWD_ACK_FAULT;
+}
+
+/**
+ * @brief Remove every watchpoint
+ *
+ * @return ACK of request
+ */
+uint8_t wp_clear_all() {
+    uint8_t i;
+    for (i = 0; i < WP_MAX; ++i) {
+        if (wp_used[i]) {
+            wp_clear(wps[i].addr);
+        }
+    }
+    return SWD_ACK_OK;
+}
+
+/**
+ * @brief Write every comparator that changed since the last sync
+ *
+ * Called before the core runs. Does nothing if no watchpoint was ever set.
+ *
+ * @return ACK of request
+ */
+uint8_t wp_sync() {
+    uint32_t demcr;
+    uint8_t i, ack;
+    if (!wp_probed) {
+        return SWD_ACK_OK;
+    }
+    if (trcena_dirty && dwt_busy) {
+        // Only a power cycle clears it, but DEMCR may have been written since wp_init()
+        if ((ack = mem_read(CORE_DEMCR, &demcr)) != SWD_ACK_OK) {
+            return ack;
+        }
+        if ((ack = mem_write(CORE_DEMCR, demcr | DEMCR_TRCENA)) != SWD_ACK_OK) {
+            return ack;
+        }
+        trcena_dirty = 0;
+    }
+    for (i = 0; i < dwt_num; ++i) {
+        if (!(dwt_dirty & (1u << i))) {
+            continue;
+        }
+        // Off while it changes, so a half written comparator never matches
+        if ((ack = mem_write(DWT_REG(DWT_FUNCTION0, i), 0)) != SWD_ACK_OK) {
+            return ack;
+        }
+        if (dwt_busy & (1u << i)) {
+            if ((ack = mem_write(DWT_REG(DWT_COMP0, i), dwt_comp[i])) != SWD_ACK_OK) {
+                return ack;
+            }
+            if (!dwt_v8m && (ack = mem_write(DWT_REG(DWT_MASK0, i), dwt_mask[i])) != SWD_ACK_OK) {
+                return ack;
+            }
+            if ((ack = mem_write(DWT_REG(DWT_FUNCTION0, i), dwt_func[i])) != SWD_ACK_OK) {
+                return ack;
+            }
+        }
+        dwt_dirty &= ~(1u << i);
+    }
+    return SWD_ACK_OK;
+}
+
+/**
+ * @brief Forget what the comparators hold, for after a reset
+ */
+void wp_invalidate() {
+    dwt_dirty = (1u << dwt_num) - 1;
+}
+
+/**
+ * @brief Find the watchpoint that halted the core
+ *
+ * Reads and clears DFSR.DWTTRAP, then looks for the comparator that
+ * matched. The core halts an instruction or so after the access.
+ *
+ * @param hit Where the watchpoint is copied
+ *
+ * @return 1 if a watchpoint halted the core
+ */
+uint8_t wp_hit(wp_t* hit) {
+    uint32_t dfsr, func;
+    uint8_t i, c;
+    if (!wp_probed || !dwt_busy) {
+        return 0;
+    }
+    if (mem_read(CORE_DFSR, &dfsr) != SWD_ACK_OK || !(dfsr & DFSR_DWTTRAP)) {
+        return 0;
+    }
+    // Write one to clear
+    mem_write(CORE_DFSR, DFSR_DWTTRAP);
+    for (c = 0; c < dwt_num; ++c) {
+        if (!(dwt_busy & (1u << c))) {
+            continue;
+        }
+        // MATCHED clears on read
+        if (mem_read(DWT_REG(DWT_FUNCTION0, c), &func) != SWD_ACK_OK || !(func & DWT_FUNCTION_MATCHED)) {
+            continue;
+        }
+        for (i = 0; i < WP_MAX; ++i) {
+            if (wp_used[i] && (wps[i].comps & (1u << c))) {
+                *hit = wps[i];
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Get the DWT's comparator count and architecture
+ *
+ * @param num Where the number of comparators is stored
+ * @param v8m Where 1 is stored for an ARMv8-M DWT, 0 for ARMv7-M
+ *
+ * @return ACK of request
+ */
+uint8_t wp_get_info(uint8_t* num, uint8_t* v8m) {
+    uint8_t ack;
+    if (!wp_probed && (ack = wp_init()) != SWD_ACK_OK) {
+        return ack;
+    }
+    *num = dwt_num;
+    *v8m = dwt_v8m;
+    return SWD_ACK_OK;
+}
+
+/**
+ * @brief Get a watchpoint from the table
+ *
+ * @param i Watchpoint number
+ * @param wp Where the watchpoint is copied
+ *
+ * @return 1 if there is a watchpoint i
+ */
+uint8_t wp_get(uint8_t i, wp_t* wp) {
+    if (i >= WP_MAX || !wp_used[i]) {
+        return 0;
+    }
+    *wp = wps[i];
+    return 1;
+}
@@ -0,0 +1,373 @@
+/**
+ * @file bench_swd.c
+ * @author Min Kang
+ * @brief Host benchmark of the per-bit SWD path against swd_transfer()
+ *
+ * Both paths are built here against the same counting SIO stub: the old
+ * one calls gpio_put, gpio_get and gpio_set_dir per pin change, which go
+ * to the SIO registers as the SDK's do, and the real data_transfer.c
+ * writes them itself. Every register access goes through sio_hw_access()
+ * and is counted, along with the delay calls, and a small TARGET model on
+ * the pins ACKs, answers IDCODE reads and records the bits the host clocks
+ * out.
+ *
+ * Both paths have to put the same bits on the wire. The counts and timings
+ * are printed for each, run it with ctest -V or on its own to see them.
+ * Cycles are the host's TSC, or nanoseconds where there isn't one, the
+ * quickest of BENCH_ROUNDS rounds. They include the stub and the model,
+ * which the "stub only" row times on its own with as many accesses as a
+ * read, so differences smaller than the run to run noise mean nothing.
+ */
+#include "test.h"
+#include "bench_swd_old.h"
+#include "data_transfer.h"
+#include "swd_pio.h"
+#include "swd_cache.h"
+#include "swd_engine.h"
+#include "setup.h"
+#include "utils.h"
+#include "macros.h"
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/structs/sio.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLE_UNIT "TSC cycles"
+#else
+#define CYCLE_UNIT "ns"
+#endif
+
+#define IDCODE 0x0BE12477
+#define WRITE_DATA 0x12345678
+#define BENCH_TRANSACTIONS 10000
+#define BENCH_ROUNDS 20
+// As many accesses as a DP read
+#define BASELINE_PULSES 72
+#define WIRE_BITS 64
+
+typedef struct {
+    uint8_t clk;
+    uint8_t dio_out;
+    uint8_t dio_oe;
+    uint8_t dio_in;
+    uint32_t pos;              // Bits the TARGET drove since the host let go of SWDIO
+    uint8_t wire[WIRE_BITS];   // Bits the host clocked out, in order
+    uint32_t wire_len;
+} pins_t;
+
+typedef struct {
+    uint32_t accesses;         // SIO register accesses
+    uint32_t delays;           // sleep_us or busy wait calls
+    uint64_t cycles;           // Per transaction, stub and TARGET model included
+    uint8_t wire[WIRE_BITS];
+    uint32_t wire_len;
+} result_t;
+
+typedef struct {
+    const char* name;
+    uint8_t (*read)(uint32_t* data);
+    uint8_t (*write)(uint32_t data);
+} path_t;
+
+static pins_t pins = { .clk = 1, .dio_out = 1, .dio_oe = 1 };
+static sio_hw_t sio;
+static uint32_t accesses;
+static uint32_t delays;
+
+// ------------------------- TARGET ------------------------- //
+
+/**
+ * @brief What the TARGET drives for a bit after the host lets go of SWDIO
+ *
+ * Turnaround, ACK OK, then IDCODE and its parity. A write only gets as far
+ * as the turnaround after the ACK.
+ */
+static uint8_t target_bit(uint32_t pos) {
+    if (pos == 1) {
+        return 1;
+    }
+    if (pos == 2 || pos == 3) {
+        return 0;
+    }
+    if (pos >= 4 && pos < 36) {
+        return (IDCODE >> (pos - 4)) & 1;
+    }
+    if (pos == 36) {
+        return __builtin_parity(IDCODE);
+    }
+    return 1;
+}
+
+static void pin_out(uint32_t pin, uint8_t value) {
+    if (pin == SWDIO) {
+        pins.dio_out = value;
+        return;
+    }
+    if (pin != SWCLK) {
+        return;
+    }
+    // The TARGET changes SWDIO on the falling edge and the host samples it
+    // while SWCLK is low, the host's own bits are taken on the rising edge
+    if (pins.clk && !value && !pins.dio_oe) {
+        pins.dio_in = target_bit(pins.pos++);
+    }
+    if (!pins.clk && value && pins.dio_oe && pins.wire_len < WIRE_BITS) {
+        pins.wire[pins.wire_len++] = pins.dio_out;
+    }
+    pins.clk = value;
+}
+
+static void pin_dir(uint32_t pin, uint8_t out) {
+    if (pin != SWDIO) {
+        return;
+    }
+    if (out && !pins.dio_oe) {
+        pins.pos = 0;
+    }
+    pins.dio_oe = out;
+}
+
+// ------------------------- STUBS ------------------------- //
+
+/**
+ * @brief Act on whatever was written to sio since the last access
+ *
+ * data_transfer.c only ever writes one pin at a time.
+ */
+static void sio_apply() {
+    if (sio.gpio_oe_set & (1u << SWDIO)) {
+        pin_dir(SWDIO, 1);
+    } else if (sio.gpio_oe_clr & (1u << SWDIO)) {
+        pin_dir(SWDIO, 0);
+    } else if (sio.gpio_set) {
+        pin_out(sio.gpio_set == (1u << SWCLK) ? SWCLK : SWDIO, 1);
+    } else if (sio.gpio_clr) {
+        pin_out(sio.gpio_clr == (1u << SWCLK) ? SWCLK : SWDIO, 0);
+    }
+    sio.gpio_oe_set = sio.gpio_oe_clr = sio.gpio_set = sio.gpio_clr = 0;
+    sio.gpio_in = (uint32_t)pins.dio_in << SWDIO;
+}
+
+sio_hw_t* sio_hw_access() {
+    sio_apply();
+    accesses++;
+    return &sio;
+}
+
+// As the SDK has them, so both paths pay the same for an access
+
+void gpio_put(unsigned int gpio, bool value) {
+    *(value ? &sio_hw->gpio_set : &sio_hw->gpio_clr) = 1u << gpio;
+}
+
+bool gpio_get(unsigned int gpio) {
+    return (sio_hw->gpio_in >> gpio) & 1;
+}
+
+void gpio_set_dir(unsigned int gpio, bool out) {
+    *(out ? &sio_hw->gpio_oe_set : &sio_hw->gpio_oe_clr) = 1u << gpio;
+}
+
+void sleep_us(uint64_t us) {
+    delays++;
+}
+
+void busy_wait_at_least_cycles(uint32_t minimum_cycles) {
+    delays++;
+}
+
+void busy_wait_us_32(uint32_t delay_us) {
+    delays++;
+}
+
+uint64_t time_us_64() {
+    return 0;
+}
+
+uint32_t clock_get_hz(enum clock_index clk_index) {
+    return 150000000;
+}
+
+uint32_t save_and_disable_interrupts() {
+    return 0;
+}
+
+void restore_interrupts(uint32_t status) {
+}
+
+uint8_t calc_parity(uint32_t data) {
+    return __builtin_parity(data);
+}
+
+void error(char* msg) {
+}
+
+void pin_setup() {
+}
+
+uint32_t swd_pio_init(uint32_t freq_hz) {
+    return freq_hz;
+}
+
+uint32_t swd_pio_set_freq(uint32_t freq_hz) {
+    return freq_hz;
+}
+
+void swd_pio_deinit() {
+}
+
+void swd_pio_write_bits(uint32_t data, uint8_t len) {
+}
+
+uint32_t swd_pio_read_bits(uint8_t len) {
+    return 0;
+}
+
+void swd_pio_transfer_stream(const uint8_t* reqs, uint32_t* data, uint8_t* acks, uint32_t n) {
+}
+
+uint8_t swd_cache_write_redundant(uint8_t req, uint32_t data) {
+    return 0;
+}
+
+void swd_cache_update(uint8_t req, uint32_t data, uint8_t ack) {
+}
+
+void swd_cache_invalidate() {
+}
+
+uint8_t swd_engine_forward() {
+    return 0;
+}
+
+uint8_t swd_engine_run(swd_op_t* ops, uint32_t num_ops, uint8_t raw) {
+    return SWD_ACK_OK;
+}
+
+// ------------------------- PATHS ------------------------- //
+
+static uint8_t old_read(uint32_t* data) {
+    return old_SWD_DP_read(DP_IDCODE, data);
+}
+
+static uint8_t old_write(uint32_t data) {
+    return old_SWD_DP_write(DP_SELECT, data);
+}
+
+static uint8_t new_read(uint32_t* data) {
+    return SWD_DP_read(DP_IDCODE, data);
+}
+
+static uint8_t new_write(uint32_t data) {
+    return SWD_DP_write(DP_SELECT, data);
+}
+
+static uint64_t now_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Nothing but clock pulses, what the stub and TARGET model cost alone
+ */
+static uint8_t pulses(uint32_t data) {
+    uint32_t i;
+    for (i = 0; i < BASELINE_PULSES; ++i) {
+        sio_hw->gpio_clr = 1u << SWCLK;
+        sio_hw->gpio_set = 1u << SWCLK;
+    }
+    return SWD_ACK_OK;
+}
+
+/**
+ * @brief Time a transaction, the quickest of BENCH_ROUNDS rounds
+ */
+static uint64_t time_transaction(uint8_t (*write)(uint32_t), uint8_t (*read)(uint32_t*)) {
+    uint64_t start, cycles, best = UINT64_MAX;
+    uint32_t data, round, i;
+    for (round = 0; round < BENCH_ROUNDS; ++round) {
+        start = now_cycles();
+        for (i = 0; i < BENCH_TRANSACTIONS; ++i) {
+            if (write) {
+                write(WRITE_DATA);
+            } else {
+                read(&data);
+            }
+        }
+        cycles = (now_cycles() - start) / BENCH_TRANSACTIONS;
+        if (cycles < best) {
+            best = cycles;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Run one transaction and see what it did, then time it
+ *
+ * @param write 1 for the write, 0 for the IDCODE read
+ */
+static void bench(const path_t* path, uint8_t write, result_t* result) {
+    uint32_t data = 0;
+    uint8_t ack;
+
+    // Whatever the last run left pending isn't part of this one
+    sio_apply();
+    pins.wire_len = 0;
+    accesses = delays = 0;
+    ack = write ? path->write(WRITE_DATA) : path->read(&data);
+    sio_apply();
+    CHECK_EQ(ack, SWD_ACK_OK);
+    if (!write) {
+        CHECK_EQ(data, IDCODE);
+    }
+    result->accesses = accesses;
+    result->delays = delays;
+    result->wire_len = pins.wire_len;
+    memcpy(result->wire, pins.wire, pins.wire_len);
+    result->cycles = time_transaction(write ? path->write : NULL, write ? NULL : path->read);
+}
+
+int main() {
+    static const path_t paths[] = {
+        { "per-bit", old_read, old_write },
+        { "transaction", new_read, new_write },
+    };
+    static const char* kinds[] = { "DP read", "DP write" };
+    result_t results[2][2];
+    uint64_t baseline;
+    uint32_t p, w;
+
+    baseline = time_transaction(pulses, NULL);
+    printf("%-12s %-9s %9s %7s %12s\n", "path", "", "accesses", "delays", CYCLE_UNIT);
+    printf("%-12s %-9s %9u %7u %12llu\n", "stub only", "", 2 * BASELINE_PULSES, 0,
+           (unsigned long long)baseline);
+    for (w = 0; w < 2; ++w) {
+        for (p = 0; p < 2; ++p) {
+            bench(&paths[p], w, &results[p][w]);
+            printf("%-12s %-9s %9u %7u %12llu\n", paths[p].name, kinds[w],
+                   results[p][w].accesses, results[p][w].delays,
+                   (unsigned long long)results[p][w].cycles);
+        }
+    }
+
+    for (w = 0; w < 2; ++w) {
+        // Header, then data and parity for a write
+        CHECK_EQ(results[0][w].wire_len, w ? 8 + 32 + 1 : 8);
+        CHECK_EQ(results[1][w].wire_len, results[0][w].wire_len);
+        CHECK(!memcmp(results[0][w].wire, results[1][w].wire, results[0][w].wire_len));
+        // Three accesses a bit either way, the old path also slept every half period
+        CHECK(results[1][w].accesses <= results[0][w].accesses);
+        CHECK_EQ(results[1][w].delays, 0);
+    }
+    return TEST_RESULT();
+}
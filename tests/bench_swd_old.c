@@ -0,0 +1,190 @@
+/**
+ * @file bench_swd_old.c
+ * @author Min Kang
+ * @brief The per-bit SWD path from before swd_transfer(), kept for bench_swd
+ *
+ * The bit-bang half of data_transfer.c as it was before the transaction
+ * core replaced it: a request struct built and packed per transaction,
+ * parity by counting bits, and a gpio_put or gpio_get per pin change.
+ * Only renamed, and the PIO branches dropped.
+ */
+#include "bench_swd_old.h"
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "macros.h"
+
+// What macros.h had, sleep_us() doesn't wait on the host
+#define CLOCK_DELAY 100
+
+typedef struct _swd_req
+{
+    uint8_t start : 1;  // Always 1
+    uint8_t APnDP : 1;  // Selects DPACC or APACC, 0 for DPACC, 1 for APACC
+    uint8_t RnW : 1;    // Selects read or write, 0 for write, 1 for read
+    uint8_t A : 2;      // Different meaning based on APnDP
+    uint8_t parity : 1; // Parity check on APnDP,RnW,A bits, if num of 1's are even, parity is 0
+    uint8_t stop : 1;   // Must always be 0 unless SWD is async which is never
+    uint8_t park : 1;   // Always 1
+} swd_req_t;
+
+static uint8_t calc_parity(uint32_t data) {
+    uint8_t counter = 0;
+    while (data) {
+        data &= (data - 1);
+        counter += 1;
+    }
+    return counter % 2;
+}
+
+static void single_pulse() {
+    gpio_put(SWCLK, 0);
+    sleep_us(CLOCK_DELAY);
+    gpio_put(SWCLK, 1);
+    sleep_us(CLOCK_DELAY);
+}
+
+static void turnaround() {
+    gpio_set_dir(SWDIO, GPIO_IN);
+    single_pulse();
+}
+
+static void take_swdio() {
+    gpio_set_dir(SWDIO, GPIO_OUT);
+    gpio_put(SWDIO, 1);
+}
+
+static void send_data(uint16_t data, uint8_t len) {
+    int8_t pos;
+    gpio_set_dir(SWDIO, GPIO_OUT);
+    for (pos = len - 1; pos >= 0; --pos) {
+        gpio_put(SWCLK, 0);
+        gpio_put(SWDIO, ((data & (1 << pos)) >> pos));
+        sleep_us(CLOCK_DELAY);
+        gpio_put(SWCLK, 1);
+        sleep_us(CLOCK_DELAY);
+    }
+}
+
+static void send_data_lsb(uint32_t data, uint8_t len) {
+    gpio_set_dir(SWDIO, GPIO_OUT);
+    int i;
+    for (i = 0; i < len; ++i) {
+        gpio_put(SWCLK, 0);
+        gpio_put(SWDIO, data & 1);
+        data >>= 1;
+        sleep_us(CLOCK_DELAY);
+        gpio_put(SWCLK, 1);
+        sleep_us(CLOCK_DELAY);
+    }
+    gpio_put(SWDIO, 1);
+}
+
+static uint32_t read_data(uint8_t len) {
+    gpio_set_dir(SWDIO, GPIO_IN);
+    uint32_t data = 0;
+    int8_t pos;
+    for (pos = 0; pos < len; ++pos) {
+        gpio_put(SWCLK, 0);
+        sleep_us(CLOCK_DELAY);
+        data |= (gpio_get(SWDIO) << pos);
+        gpio_put(SWCLK, 1);
+        sleep_us(CLOCK_DELAY);
+    }
+    return data;
+}
+
+static swd_req_t create_swd_packet(uint8_t APnDP, uint8_t RnW, uint8_t A) {
+    // For calculating parity
+    uint8_t num_1s = 0;
+    num_1s += APnDP;
+    num_1s += RnW;
+    num_1s += ((A & (1 << 1)) >> 1) + (A & 1);
+
+    swd_req_t packet = {
+        .start = 1,
+        .APnDP = APnDP,
+        .RnW = RnW,
+        .A = A,
+        .parity = num_1s % 2,
+        .stop = 0,
+        .park = 1,
+    };
+
+    return packet;
+}
+
+static uint8_t conv_swd_packet_to_bin(swd_req_t packet) {
+    uint8_t data = 0;
+    data |= (packet.start << 7);
+    data |= (packet.APnDP << 6);
+    data |= (packet.RnW << 5);
+    data |= (packet.A << 3);
+    data |= (packet.parity << 2);
+    data |= (packet.stop << 1);
+    data |= (packet.park << 0);
+    return data;
+}
+
+static void send_swd_packet(uint8_t APnDP, uint8_t RnW, uint8_t A) {
+    swd_req_t packet = create_swd_packet(APnDP, RnW, A);
+    uint8_t data = conv_swd_packet_to_bin(packet);
+    send_data(data, 8);
+}
+
+uint8_t old_SWD_DP_read(uint8_t A, uint32_t* data) {
+	// Send SWD packet
+    send_swd_packet(0, 1, A);
+
+    // Turnaround cycle while passing control to TARGET
+    turnaround();
+
+    // Read ACK
+    uint8_t ack = read_data(3);
+    // If ACK isn't OK, return Error (indicated by 1)
+    if (ack != 0b001) {
+        turnaround();
+        take_swdio();
+        return ack;
+    }
+
+    // Read data sent from TARGET
+    *data = read_data(32);
+    // NOTE: Parity isn't being checked, clock it in and turn the line around
+    read_data(1);
+    turnaround();
+
+    take_swdio();
+
+    return ack;
+}
+
+uint8_t old_SWD_DP_write(uint8_t A, uint32_t data) {
+    // Calculate data parity for later
+    uint8_t data_parity = calc_parity(data);
+
+	// Send SWD packet
+    send_swd_packet(0, 0, A);
+
+    // Turnaround cycle while passing control to TARGET
+    turnaround();
+
+    // Read ACK
+    uint8_t ack = read_data(3);
+    // If ACK isn't OK, return Error (indicated by 1)
+    if (ack != 0b001) {
+        turnaround();
+        take_swdio();
+        return ack;
+    }
+
+    // Turnaround cycle for control to return back to HOST
+    turnaround();
+
+    // Send data to target
+    send_data_lsb(data, 32);
+    send_data(data_parity, 1);
+
+    take_swdio();
+
+    return ack;
+}
@@ -0,0 +1,14 @@
+/**
+ * @file bench_swd_old.h
+ * @author Min Kang
+ * @brief The per-bit SWD path from before swd_transfer(), kept for bench_swd
+ */
+#ifndef BENCH_SWD_OLD_H
+#define BENCH_SWD_OLD_H
+
+#include <stdint.h>
+
+uint8_t old_SWD_DP_read(uint8_t A, uint32_t* data);
+uint8_t old_SWD_DP_write(uint8_t A, uint32_t data);
+
+#endif
@@ -0,0 +1,76 @@
+/**
+ * @file fake_core.c
+ * @author Min Kang
+ * @brief Core, breakpoints and watchpoints faked for the GDB stub
+ */
+#include "fake_core.h"
+#include "core.h"
+#include "breakpoint.h"
+#include "watchpoint.h"
+#include "swd_request.h"
+
+uint32_t fake_regs[FAKE_REGSEL_XPSR + 1];
+
+uint8_t core_halt() {
+    return SWD_ACK_OK;
+}
+
+uint8_t core_continue() {
+    return SWD_ACK_OK;
+}
+
+uint8_t core_step() {
+    return SWD_ACK_OK;
+}
+
+uint8_t core_reg_snapshot(const uint8_t* regsels, uint32_t n) {
+    return SWD_ACK_OK;
+}
+
+uint8_t core_reg_read(uint8_t regsel, uint32_t* value) {
+    if (regsel > FAKE_REGSEL_XPSR) {
+        return SWD_ACK_FAULT;
+    }
+    *value = fake_regs[regsel];
+    return SWD_ACK_OK;
+}
+
+uint8_t core_reg_write(uint8_t regsel, uint32_t value) {
+    if (regsel > FAKE_REGSEL_XPSR) {
+        return SWD_ACK_FAULT;
+    }
+    fake_regs[regsel] = value;
+    return SWD_ACK_OK;
+}
+
+uint8_t bp_init() {
+    return SWD_ACK_OK;
+}
+
+uint8_t bp_set(uint32_t addr) {
+    return SWD_ACK_OK;
+}
+
+uint8_t bp_clear(uint32_t addr) {
+    return SWD_ACK_OK;
+}
+
+uint8_t bp_clear_all() {
+    return SWD_ACK_OK;
+}
+
+uint8_t wp_set(uint32_t addr, uint32_t len, wp_type_t type, uint8_t match_value, uint32_t value) {
+    return SWD_ACK_OK;
+}
+
+uint8_t wp_clear(uint32_t addr) {
+    return SWD_ACK_OK;
+}
+
+uint8_t wp_clear_all() {
+    return SWD_ACK_OK;
+}
+
+uint8_t wp_hit(wp_t* hit) {
+    return 0;
+}
@@ -0,0 +1,20 @@
+/**
+ * @file fake_core.h
+ * @author Min Kang
+ * @brief Core, breakpoints and watchpoints faked for the GDB stub
+ *
+ * Stands in for core.c, breakpoint.c and watchpoint.c. The core is a
+ * register file that every halt, continue and step leaves alone, and
+ * breakpoints and watchpoints are accepted and forgotten.
+ */
+#ifndef FAKE_CORE_H
+#define FAKE_CORE_H
+
+#include <stdint.h>
+
+#define FAKE_NUM_REGS 17
+#define FAKE_REGSEL_XPSR 0x10
+
+extern uint32_t fake_regs[FAKE_REGSEL_XPSR + 1];
+
+#endif
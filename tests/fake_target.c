@@ -0,0 +1,141 @@
+/**
+ * @file fake_target.c
+ * @author Min Kang
+ * @brief TARGET memory and USB ports faked for the host tests
+ */
+#include "fake_target.h"
+#include "mem.h"
+#include "swd_request.h"
+#include <string.h>
+
+uint8_t fake_ram[FAKE_RAM_SIZE];
+fake_mem_stats_t fake_mem_stats;
+fake_port_t fake_ports[USB_CDC_PORTS];
+
+/**
+ * @brief Zero the RAM, the counters and the ports
+ */
+void fake_target_reset() {
+    memset(fake_ram, 0, sizeof(fake_ram));
+    memset(&fake_mem_stats, 0, sizeof(fake_mem_stats));
+    memset(fake_ports, 0, sizeof(fake_ports));
+}
+
+/**
+ * @brief Where a TARGET address lives in fake_ram
+ *
+ * @return Pointer into fake_ram, or NULL if len bytes from addr aren't RAM
+ */
+uint8_t* fake_ram_at(uint32_t addr, uint32_t len) {
+    if (addr < FAKE_RAM_BASE || addr - FAKE_RAM_BASE > FAKE_RAM_SIZE ||
+        len > FAKE_RAM_SIZE - (addr - FAKE_RAM_BASE)) {
+        return NULL;
+    }
+    return &fake_ram[addr - FAKE_RAM_BASE];
+}
+
+/**
+ * @brief Write a little endian word to fake_ram
+ */
+void fake_put_u32(uint32_t addr, uint32_t value) {
+    uint8_t* p = fake_ram_at(addr, 4);
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+/**
+ * @brief Read a little endian word from fake_ram
+ */
+uint32_t fake_get_u32(uint32_t addr) {
+    const uint8_t* p = fake_ram_at(addr, 4);
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * @brief Queue bytes for a port to receive
+ */
+void fake_port_receive(uint8_t port, const void* bytes, uint32_t len) {
+    fake_port_t* p = &fake_ports[port];
+    memcpy(&p->rx[p->rx_len], bytes, len);
+    p->rx_len += len;
+}
+
+uint8_t mem_read_bytes(uint32_t addr, uint8_t* buf, uint32_t len) {
+    const uint8_t* p = fake_ram_at(addr, len);
+    if (!p) {
+        return SWD_ACK_FAULT;
+    }
+    memcpy(buf, p, len);
+    fake_mem_stats.reads++;
+    fake_mem_stats.bytes_read += len;
+    return SWD_ACK_OK;
+}
+
+uint8_t mem_write_bytes(uint32_t addr, const uint8_t* buf, uint32_t len) {
+    uint8_t* p = fake_ram_at(addr, len);
+    if (!p) {
+        return SWD_ACK_FAULT;
+    }
+    memcpy(p, buf, len);
+    fake_mem_stats.writes++;
+    fake_mem_stats.bytes_written += len;
+    return SWD_ACK_OK;
+}
+
+uint8_t mem_read_block(uint32_t addr, uint32_t* buf, uint32_t n) {
+    uint32_t i;
+    if (!fake_ram_at(addr, 4 * n)) {
+        return SWD_ACK_FAULT;
+    }
+    for (i = 0; i < n; ++i) {
+        buf[i] = fake_get_u32(addr + 4 * i);
+    }
+    fake_mem_stats.reads++;
+    fake_mem_stats.bytes_read += 4 * n;
+    return SWD_ACK_OK;
+}
+
+uint8_t mem_write_block(uint32_t addr, const uint32_t* buf, uint32_t n) {
+    uint32_t i;
+    if (!fake_ram_at(addr, 4 * n)) {
+        return SWD_ACK_FAULT;
+    }
+    for (i = 0; i < n; ++i) {
+        fake_put_u32(addr + 4 * i, buf[i]);
+    }
+    fake_mem_stats.writes++;
+    fake_mem_stats.bytes_written += 4 * n;
+    return SWD_ACK_OK;
+}
+
+uint8_t mem_read(uint32_t addr, uint32_t* data) {
+    return mem_read_block(addr, data, 1);
+}
+
+uint8_t mem_write(uint32_t addr, uint32_t data) {
+    return mem_write_block(addr, &data, 1);
+}
+
+int usb_cdc_getc(uint8_t port) {
+    fake_port_t* p = &fake_ports[port];
+    return p->rx_pos < p->rx_len ? p->rx[p->rx_pos++] : -1;
+}
+
+uint32_t usb_cdc_available(uint8_t port) {
+    return fake_ports[port].rx_len - fake_ports[port].rx_pos;
+}
+
+void usb_cdc_write(uint8_t port, const void* buf, uint32_t len) {
+    fake_port_t* p = &fake_ports[port];
+    if (p->tx_len + len > FAKE_PORT_SIZE) {
+        len = FAKE_PORT_SIZE - p->tx_len;
+    }
+    memcpy(&p->tx[p->tx_len], buf, len);
+    p->tx_len += len;
+}
+
+uint8_t usb_cdc_connected(uint8_t port) {
+    return 1;
+}
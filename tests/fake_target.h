@@ -0,0 +1,67 @@
+/**
+ * @file fake_target.h
+ * @author Min Kang
+ * @brief TARGET memory and USB ports faked for the host tests
+ *
+ * Stands in for mem.c and usb_cdc.c. The TARGET is FAKE_RAM_SIZE bytes of
+ * RAM at FAKE_RAM_BASE, anything outside it FAULTs. Bytes sent on a port
+ * are kept for the test to look at, and bytes to receive are queued up
+ * by the test.
+ */
+#ifndef FAKE_TARGET_H
+#define FAKE_TARGET_H
+
+#include <stdint.h>
+#include "usb_cdc.h"
+
+#define FAKE_RAM_BASE 0x20000000
+#define FAKE_RAM_SIZE 0x10000
+#define FAKE_PORT_SIZE 0x10000
+
+typedef struct {
+    uint32_t reads;       // Calls that read the TARGET
+    uint32_t writes;      // Calls that wrote the TARGET
+    uint32_t bytes_read;
+    uint32_t bytes_written;
+} fake_mem_stats_t;
+
+typedef struct {
+    uint8_t tx[FAKE_PORT_SIZE]; // Everything sent on the port
+    uint32_t tx_len;
+    uint8_t rx[FAKE_PORT_SIZE]; // Waiting to be received
+    uint32_t rx_len;
+    uint32_t rx_pos;
+} fake_port_t;
+
+extern uint8_t fake_ram[FAKE_RAM_SIZE];
+extern fake_mem_stats_t fake_mem_stats;
+extern fake_port_t fake_ports[USB_CDC_PORTS];
+
+/**
+ * @brief Zero the RAM, the counters and the ports
+ */
+void fake_target_reset();
+
+/**
+ * @brief Where a TARGET address lives in fake_ram
+ *
+ * @return Pointer into fake_ram, or NULL if len bytes from addr aren't RAM
+ */
+uint8_t* fake_ram_at(uint32_t addr, uint32_t len);
+
+/**
+ * @brief Write a little endian word to fake_ram
+ */
+void fake_put_u32(uint32_t addr, uint32_t value);
+
+/**
+ * @brief Read a little endian word from fake_ram
+ */
+uint32_t fake_get_u32(uint32_t addr);
+
+/**
+ * @brief Queue bytes for a port to receive
+ */
+void fake_port_receive(uint8_t port, const void* bytes, uint32_t len);
+
+#endif
@@ -0,0 +1,83 @@
+/**
+ * @file gdb_server.c
+ * @author Min Kang
+ * @brief The GDB stub on the host, speaking RSP on stdin and stdout
+ *
+ * Runs gdb.c against the fake TARGET and core, so a real GDB can be
+ * pointed at it without a probe:
+ *
+ *   target remote | ./gdb_server
+ *
+ * RAM holds GDB_SERVER_WORD at GDB_SERVER_WORD_ADDR and the pc is
+ * GDB_SERVER_PC, for gdb_session.cmake to look for. It exits when GDB
+ * detaches, kills the session or closes the pipe.
+ */
+#include "fake_target.h"
+#include "fake_core.h"
+#include "gdb.h"
+#include "swd_request.h"
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <unistd.h>
+
+#define GDB_SERVER_WORD_ADDR 0x20000100
+#define GDB_SERVER_WORD 0xdeadbeef
+#define GDB_SERVER_PC 0x20000200
+
+void error(char* msg) {
+    fprintf(stderr, "gdb_server: %s\n", msg);
+}
+
+int getchar_timeout_us(uint32_t timeout_us) {
+    return PICO_ERROR_TIMEOUT;
+}
+
+uint64_t time_us_64() {
+    return 0;
+}
+
+/**
+ * @brief Send what the stub put on the host port since the last flush
+ *
+ * @return 0, or 1 if GDB has gone
+ */
+static int flush() {
+    fake_port_t* p = &fake_ports[USB_CDC_HOST];
+    uint32_t sent = 0;
+    ssize_t n;
+    while (sent < p->tx_len) {
+        n = write(STDOUT_FILENO, p->tx + sent, p->tx_len - sent);
+        if (n <= 0) {
+            return 1;
+        }
+        sent += n;
+    }
+    p->tx_len = 0;
+    return 0;
+}
+
+int main() {
+    uint8_t buf[256];
+    ssize_t n, i;
+
+    fake_target_reset();
+    fake_put_u32(GDB_SERVER_WORD_ADDR, GDB_SERVER_WORD);
+    fake_regs[15] = GDB_SERVER_PC;
+    if (gdb_attach(USB_CDC_HOST) != SWD_ACK_OK) {
+        fprintf(stderr, "gdb_server: attach failed\n");
+        return 1;
+    }
+    while (gdb_active()) {
+        n = read(STDIN_FILENO, buf, sizeof(buf));
+        if (n <= 0) {
+            break;
+        }
+        for (i = 0; i < n; ++i) {
+            gdb_feed(buf[i]);
+        }
+        if (flush()) {
+            break;
+        }
+    }
+    return 0;
+}
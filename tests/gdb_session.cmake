@@ -0,0 +1,43 @@
+# Runs a real GDB against gdb_server and checks what it saw
+#
+#   cmake -DGDB=<gdb> -DSERVER=<gdb_server> -P gdb_session.cmake
+#
+# GDB starts gdb_server itself and talks RSP to it over a pipe. The values
+# looked for are the ones gdb_server.c puts in the fake TARGET.
+
+execute_process(
+    COMMAND ${GDB} -batch -nx
+        -ex "set remotetimeout 5"
+        -ex "target remote | ${SERVER}"
+        -ex "info mem"
+        -ex "x/wx 0x20000100"
+        -ex "set {unsigned int}0x20000104 = 0x12345678"
+        -ex "x/wx 0x20000104"
+        -ex "p/x $pc"
+        -ex "x/wx 0x40000000"
+        -ex "detach"
+    OUTPUT_VARIABLE out
+    ERROR_VARIABLE out
+    RESULT_VARIABLE result
+    TIMEOUT 30
+)
+message("${out}")
+
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "GDB exited with ${result}")
+endif()
+
+foreach(want
+        # The memory map reached GDB and runs past RAM to the top
+        "flash blocksize 0x1000"
+        "0x20040000[ \t]+0x100000000"
+        # Reads, a write and a read back, and a register
+        "0x20000100:[ \t]+0xdeadbeef"
+        "0x20000104:[ \t]+0x12345678"
+        "= 0x20000200"
+        # Peripheral space is in the map, so GDB asks the TARGET, which FAULTs
+        "Cannot access memory at address 0x40000000")
+    if(NOT out MATCHES "${want}")
+        message(FATAL_ERROR "GDB output has nothing matching \"${want}\"")
+    endif()
+endforeach()
@@ -0,0 +1,17 @@
+/**
+ * @file clocks.h
+ * @author Min Kang
+ * @brief Host stand-in for the parts of hardware/clocks.h the tests build against
+ */
+#ifndef HARDWARE_CLOCKS_H
+#define HARDWARE_CLOCKS_H
+
+#include <stdint.h>
+
+enum clock_index {
+    clk_sys,
+};
+
+uint32_t clock_get_hz(enum clock_index clk_index);
+
+#endif
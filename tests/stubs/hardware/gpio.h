@@ -0,0 +1,23 @@
+/**
+ * @file gpio.h
+ * @author Min Kang
+ * @brief Host stand-in for the parts of hardware/gpio.h the tests build against
+ */
+#ifndef HARDWARE_GPIO_H
+#define HARDWARE_GPIO_H
+
+#include <stdbool.h>
+
+// Comes from the board header on the Pico
+#ifndef PICO_DEFAULT_LED_PIN
+#define PICO_DEFAULT_LED_PIN 25
+#endif
+
+#define GPIO_OUT 1
+#define GPIO_IN 0
+
+void gpio_put(unsigned int gpio, bool value);
+bool gpio_get(unsigned int gpio);
+void gpio_set_dir(unsigned int gpio, bool out);
+
+#endif
@@ -0,0 +1,27 @@
+/**
+ * @file sio.h
+ * @author Min Kang
+ * @brief Host stand-in for the parts of hardware/structs/sio.h the tests build against
+ *
+ * Every sio_hw access is a call to sio_hw_access(), which the test
+ * defines, so it can count accesses and act on the last write before
+ * handing back the registers.
+ */
+#ifndef HARDWARE_STRUCTS_SIO_H
+#define HARDWARE_STRUCTS_SIO_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t gpio_in;
+    uint32_t gpio_set;
+    uint32_t gpio_clr;
+    uint32_t gpio_oe_set;
+    uint32_t gpio_oe_clr;
+} sio_hw_t;
+
+sio_hw_t* sio_hw_access();
+
+#define sio_hw (sio_hw_access())
+
+#endif
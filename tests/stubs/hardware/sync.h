@@ -0,0 +1,15 @@
+/**
+ * @file sync.h
+ * @author Min Kang
+ * @brief Host stand-in for the parts of hardware/sync.h the tests build against
+ */
+#ifndef HARDWARE_SYNC_H
+#define HARDWARE_SYNC_H
+
+#include <stdint.h>
+
+uint32_t save_and_disable_interrupts();
+void restore_interrupts(uint32_t status);
+void busy_wait_at_least_cycles(uint32_t minimum_cycles);
+
+#endif
@@ -0,0 +1,16 @@
+/**
+ * @file stdlib.h
+ * @author Min Kang
+ * @brief Host stand-in for the parts of pico/stdlib.h the tests build against
+ */
+#ifndef PICO_STDLIB_H
+#define PICO_STDLIB_H
+
+#include <stdint.h>
+#include "pico/time.h"
+
+#define PICO_ERROR_TIMEOUT (-1)
+
+int getchar_timeout_us(uint32_t timeout_us);
+
+#endif
@@ -0,0 +1,17 @@
+/**
+ * @file time.h
+ * @author Min Kang
+ * @brief Host stand-in for the parts of pico/time.h the tests build against
+ *
+ * The tests define these themselves, usually as a clock they move by hand.
+ */
+#ifndef PICO_TIME_H
+#define PICO_TIME_H
+
+#include <stdint.h>
+
+uint64_t time_us_64();
+void busy_wait_us_32(uint32_t delay_us);
+void sleep_us(uint64_t us);
+
+#endif
@@ -0,0 +1,276 @@
+/**
+ * @file test_dap.c
+ * @author Min Kang
+ * @brief Host test of the CMSIS-DAP processor against canned packets
+ *
+ * swd_transfer_batch() is replaced by a fake that logs every access and
+ * answers reads from a list, so the tests see exactly what dap.c asked
+ * the SWD layer for.
+ */
+#include "test.h"
+#include "dap.h"
+#include "swd_batch.h"
+#include "data_transfer.h"
+#include "swd_cache.h"
+#include "hardware/gpio.h"
+#include "pico/time.h"
+#include <string.h>
+
+#define LOG_LEN 256
+
+// Every access dap.c asked for, in order
+static uint8_t log_req[LOG_LEN];
+static uint32_t log_data[LOG_LEN];
+static uint32_t log_n;
+static uint32_t batches;
+// What reads return, in order, then 0
+static uint32_t reads[LOG_LEN];
+static uint32_t num_reads;
+static uint32_t read_pos;
+// Access that gets fail_ack instead of running, LOG_LEN for none
+static uint32_t fail_at = LOG_LEN;
+static uint8_t fail_ack;
+
+static void fake_reset(uint32_t fail, uint8_t ack) {
+    log_n = batches = num_reads = read_pos = 0;
+    fail_at = fail;
+    fail_ack = ack;
+}
+
+uint8_t swd_transfer_batch(swd_op_t* ops, uint32_t num_ops) {
+    uint32_t i;
+    batches++;
+    for (i = 0; i < num_ops; ++i) {
+        ops[i].ack = 0;
+    }
+    for (i = 0; i < num_ops; ++i) {
+        if (log_n == fail_at) {
+            ops[i].ack = fail_ack;
+            return fail_ack;
+        }
+        if (ops[i].req & SWD_REQ_RnW) {
+            ops[i].data = read_pos < num_reads ? reads[read_pos++] : 0;
+        }
+        log_req[log_n] = ops[i].req;
+        log_data[log_n++] = ops[i].data;
+        ops[i].ack = SWD_ACK_OK;
+    }
+    return SWD_ACK_OK;
+}
+
+uint8_t swd_transfer(uint8_t req, uint32_t* data) {
+    swd_op_t op = { .req = req, .data = *data };
+    uint8_t ack = swd_transfer_batch(&op, 1);
+    *data = op.data;
+    return ack;
+}
+
+void send_data_lsb(uint32_t data, uint8_t len) {
+}
+
+void swd_cache_invalidate() {
+}
+
+uint32_t swd_set_clock(uint32_t freq_hz) {
+    return freq_hz;
+}
+
+void gpio_put(unsigned int gpio, bool value) {
+}
+
+bool gpio_get(unsigned int gpio) {
+    return 0;
+}
+
+void busy_wait_us_32(uint32_t delay_us) {
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * @brief DAP request bits to SWD_REQ(), including the A2/A3 swap
+ */
+static void test_request_encoding() {
+    static const uint8_t req[] = {
+        ID_DAP_Transfer, 0, 4,
+        0x02,                         // DP read IDCODE
+        0x08, 0xF0, 0x00, 0x00, 0x00, // DP write SELECT
+        0x05, 0x00, 0x10, 0x00, 0x20, // AP write TAR
+        0x0F,                         // AP read DRW
+    };
+    uint8_t resp[DAP_PACKET_SIZE];
+    uint32_t len;
+
+    fake_reset(LOG_LEN, 0);
+    reads[num_reads++] = 0x0BE12477;
+    reads[num_reads++] = 0xCAFEF00D;
+    len = dap_process(req, sizeof(req), resp);
+
+    CHECK_EQ(len, 11);
+    CHECK_EQ(resp[0], ID_DAP_Transfer);
+    CHECK_EQ(resp[1], 4);
+    CHECK_EQ(resp[2], SWD_ACK_OK);
+    CHECK_EQ(get_u32(&resp[3]), 0x0BE12477);
+    CHECK_EQ(get_u32(&resp[7]), 0xCAFEF00D);
+    // Plain accesses go out as one batch
+    CHECK_EQ(batches, 1);
+    CHECK_EQ(log_n, 4);
+    CHECK_EQ(log_req[0], DP_READ(DP_IDCODE));
+    CHECK_EQ(log_req[1], DP_WRITE(DP_SELECT));
+    CHECK_EQ(log_data[1], 0xF0);
+    CHECK_EQ(log_req[2], AP_WRITE(AP_TAR));
+    CHECK_EQ(log_data[2], 0x20001000);
+    CHECK_EQ(log_req[3], AP_READ(AP_DRW));
+}
+
+/**
+ * @brief A FAULT part way through reports what ran before it
+ */
+static void test_fault() {
+    static const uint8_t req[] = {
+        ID_DAP_Transfer, 0, 4, 0x0F, 0x0F, 0x0F, 0x0F,
+    };
+    uint8_t resp[DAP_PACKET_SIZE];
+    uint32_t len;
+
+    fake_reset(2, SWD_ACK_FAULT);
+    reads[num_reads++] = 1;
+    reads[num_reads++] = 2;
+    len = dap_process(req, sizeof(req), resp);
+
+    CHECK_EQ(len, 3 + 2 * 4);
+    CHECK_EQ(resp[1], 2);
+    CHECK_EQ(resp[2], SWD_ACK_FAULT);
+    CHECK_EQ(get_u32(&resp[3]), 1);
+    CHECK_EQ(get_u32(&resp[7]), 2);
+
+    fake_reset(0, SWD_ERR_PARITY);
+    len = dap_process(req, sizeof(req), resp);
+    CHECK_EQ(len, 3);
+    CHECK_EQ(resp[1], 0);
+    CHECK_EQ(resp[2], DAP_TRANSFER_ERROR);
+}
+
+/**
+ * @brief Value match retries up to match_retry times, then reports MISMATCH
+ */
+static void test_match() {
+    static const uint8_t configure[] = { ID_DAP_TransferConfigure, 0, 0, 0, 3, 0 };
+    static const uint8_t req[] = {
+        ID_DAP_Transfer, 0, 3,
+        0x20, 0x01, 0x00, 0x00, 0x00, // Match mask 1
+        0x16, 0x01, 0x00, 0x00, 0x00, // DP read CTRL/STAT until bit 0 is set
+        0x02,                         // DP read IDCODE
+    };
+    uint8_t resp[DAP_PACKET_SIZE];
+    uint32_t len;
+
+    fake_reset(LOG_LEN, 0);
+    CHECK_EQ(dap_process(configure, sizeof(configure), resp), 2);
+    CHECK_EQ(resp[1], DAP_OK);
+
+    // Matches on the third read, the mask drops the other bits
+    reads[num_reads++] = 0x10;
+    reads[num_reads++] = 0xF0;
+    reads[num_reads++] = 0xF1;
+    reads[num_reads++] = 0x0BE12477;
+    len = dap_process(req, sizeof(req), resp);
+    CHECK_EQ(len, 3 + 4);
+    CHECK_EQ(resp[1], 3);
+    CHECK_EQ(resp[2], SWD_ACK_OK);
+    CHECK_EQ(get_u32(&resp[3]), 0x0BE12477);
+    CHECK_EQ(log_n, 4);
+    CHECK_EQ(log_req[0], DP_READ(DP_CTRL_STAT));
+
+    // Never matches, one read and three retries
+    fake_reset(LOG_LEN, 0);
+    len = dap_process(req, sizeof(req), resp);
+    CHECK_EQ(len, 3);
+    CHECK_EQ(resp[1], 1);
+    CHECK_EQ(resp[2], SWD_ACK_OK | DAP_TRANSFER_MISMATCH);
+    CHECK_EQ(log_n, 4);
+}
+
+/**
+ * @brief Reads that don't fit in the response are cut off
+ */
+static void test_transfer_truncation() {
+    uint8_t req[3 + 20];
+    uint8_t resp[DAP_PACKET_SIZE];
+    uint32_t len;
+
+    req[0] = ID_DAP_Transfer;
+    req[1] = 0;
+    req[2] = 20;
+    memset(&req[3], 0x0F, 20);
+    fake_reset(LOG_LEN, 0);
+    len = dap_process(req, sizeof(req), resp);
+    CHECK_EQ(len, 3 + 15 * 4);
+    CHECK_EQ(resp[1], 15);
+    CHECK_EQ(resp[2], DAP_TRANSFER_ERROR);
+    CHECK_EQ(log_n, 15);
+
+    // A write whose data is cut off is an error too
+    req[2] = 2;
+    req[3] = 0x05;
+    fake_reset(LOG_LEN, 0);
+    len = dap_process(req, 3 + 1 + 2, resp);
+    CHECK_EQ(len, 3);
+    CHECK_EQ(resp[1], 0);
+    CHECK_EQ(resp[2], DAP_TRANSFER_ERROR);
+    CHECK_EQ(log_n, 0);
+}
+
+/**
+ * @brief DAP_TransferBlock reads and writes, cut to what fits
+ */
+static void test_transfer_block() {
+    uint8_t req[5 + 3 * 4] = { ID_DAP_TransferBlock, 0, 100, 0, 0x0F };
+    uint8_t resp[DAP_PACKET_SIZE];
+    uint32_t len, i;
+
+    fake_reset(LOG_LEN, 0);
+    for (i = 0; i < 20; ++i) {
+        reads[num_reads++] = i;
+    }
+    len = dap_process(req, 5, resp);
+    CHECK_EQ(len, 4 + 15 * 4);
+    CHECK_EQ(resp[1], 15);
+    CHECK_EQ(resp[2], 0);
+    CHECK_EQ(resp[3], SWD_ACK_OK);
+    CHECK_EQ(get_u32(&resp[4 + 14 * 4]), 14);
+    CHECK_EQ(log_n, 15);
+
+    // Ten writes asked for, only three words of data
+    req[2] = 10;
+    req[4] = 0x0D;
+    for (i = 0; i < 3 * 4; ++i) {
+        req[5 + i] = i;
+    }
+    fake_reset(LOG_LEN, 0);
+    len = dap_process(req, sizeof(req), resp);
+    CHECK_EQ(len, 4);
+    CHECK_EQ(resp[1], 3);
+    CHECK_EQ(resp[3], SWD_ACK_OK);
+    CHECK_EQ(log_n, 3);
+    CHECK_EQ(log_req[2], AP_WRITE(AP_DRW));
+    CHECK_EQ(log_data[2], 0x0B0A0908);
+
+    // A WAIT that outlasted the retries stops the block where it happened
+    req[2] = 3;
+    fake_reset(1, SWD_ACK_WAIT);
+    len = dap_process(req, sizeof(req), resp);
+    CHECK_EQ(resp[1], 1);
+    CHECK_EQ(resp[3], SWD_ACK_WAIT);
+}
+
+int main() {
+    test_request_encoding();
+    test_fault();
+    test_match();
+    test_transfer_truncation();
+    test_transfer_block();
+    return TEST_RESULT();
+}
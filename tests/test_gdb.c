@@ -0,0 +1,296 @@
+/**
+ * @file test_gdb.c
+ * @author Min Kang
+ * @brief Host test of the GDB stub's packet handling
+ *
+ * Packets are fed to gdb_feed() and the replies read back off the fake
+ * host port. Memory is the fake TARGET's RAM and the core is a register
+ * file here, so register and memory packets run end to end.
+ */
+#include "test.h"
+#include "fake_target.h"
+#include "gdb.h"
+#include "fake_core.h"
+#include "utils.h"
+#include "swd_request.h"
+#include "pico/stdlib.h"
+#include <string.h>
+
+void error(char* msg) {
+}
+
+int getchar_timeout_us(uint32_t timeout_us) {
+    return PICO_ERROR_TIMEOUT;
+}
+
+uint64_t time_us_64() {
+    return 0;
+}
+
+/**
+ * @brief Feed raw bytes, as they come off the wire
+ */
+static void feed(const char* bytes, uint32_t len) {
+    uint32_t i;
+    for (i = 0; i < len; ++i) {
+        gdb_feed(bytes[i]);
+    }
+}
+
+/**
+ * @brief Frame data the way GDB does and feed it
+ *
+ * @param corrupt Send a checksum that is one off
+ */
+static void feed_packet(const char* data, uint32_t len, uint8_t corrupt) {
+    char trailer[4];
+    uint8_t sum = 0;
+    uint32_t i;
+    for (i = 0; i < len; ++i) {
+        sum += data[i];
+    }
+    snprintf(trailer, sizeof(trailer), "#%02x", (uint8_t)(sum + corrupt));
+    feed("$", 1);
+    feed(data, len);
+    feed(trailer, 3);
+}
+
+static void feed_str(const char* data) {
+    feed_packet(data, strlen(data), 0);
+}
+
+/**
+ * @brief Check what was sent to GDB since the last check, then forget it
+ *
+ * @param ack "+", "-" or "" for what should come before the reply
+ * @param reply Reply data, or NULL for no reply
+ */
+static void check_sent(const char* ack, const char* reply, int line) {
+    fake_port_t* p = &fake_ports[USB_CDC_HOST];
+    char want[256];
+    uint8_t sum = 0;
+    uint32_t i, len;
+
+    len = snprintf(want, sizeof(want), "%s", ack);
+    if (reply) {
+        for (i = 0; reply[i]; ++i) {
+            sum += reply[i];
+        }
+        len += snprintf(want + len, sizeof(want) - len, "$%s#%02x", reply, sum);
+    }
+    if (p->tx_len != len || memcmp(p->tx, want, len)) {
+        fprintf(stderr, "%s:%d: sent \"%.*s\", wanted \"%s\"\n", __FILE__, line, (int)p->tx_len,
+                p->tx, want);
+        test_failures++;
+    }
+    p->tx_len = 0;
+}
+
+#define CHECK_SENT(ack, reply) check_sent(ack, reply, __LINE__)
+
+static void start() {
+    fake_target_reset();
+    memset(fake_regs, 0, sizeof(fake_regs));
+    CHECK_EQ(gdb_attach(USB_CDC_HOST), SWD_ACK_OK);
+}
+
+/**
+ * @brief ACK, NAK, and resending the last reply when GDB NAKs it
+ */
+static void test_checksum() {
+    start();
+    feed_str("?");
+    CHECK_SENT("+", "S05");
+
+    // A bad checksum is NAK'd and the packet isn't run
+    feed_packet("M20000000,1:aa", 14, 1);
+    CHECK_SENT("-", NULL);
+    CHECK_EQ(fake_mem_stats.writes, 0);
+
+    // GDB NAKs the reply, it goes out again
+    feed_str("p0");
+    CHECK_SENT("+", "00000000");
+    feed("-", 1);
+    CHECK_SENT("", "00000000");
+
+    // A plain ACK needs nothing back
+    feed("+", 1);
+    CHECK_SENT("", NULL);
+
+    // Upper case checksum digits are fine too
+    feed("$?#3F", 5);
+    CHECK_SENT("+", "S05");
+}
+
+/**
+ * @brief Escaped bytes in an X packet land in memory unescaped
+ */
+static void test_escape() {
+    // '#', '$', '}' and '*' all have to be escaped on the wire
+    static const char wire[] = "X20000100,5:}\x03}\x04}]}\x0a!";
+    static const uint8_t data[] = { '#', '$', '}', '*', '!' };
+
+    start();
+    feed_packet(wire, sizeof(wire) - 1, 0);
+    CHECK_SENT("+", "OK");
+    CHECK(!memcmp(fake_ram_at(0x20000100, 5), data, 5));
+}
+
+/**
+ * @brief QStartNoAckMode: neither side ACKs after the OK
+ */
+static void test_no_ack() {
+    start();
+    feed_str("QStartNoAckMode");
+    CHECK_SENT("+", "OK");
+    feed("+", 1);
+    feed_str("?");
+    CHECK_SENT("", "S05");
+    // Checksums aren't checked any more either, the link is reliable
+    feed_packet("?", 1, 1);
+    CHECK_SENT("", "S05");
+
+    // A new session starts with ACKs again
+    start();
+    feed_str("?");
+    CHECK_SENT("+", "S05");
+}
+
+/**
+ * @brief M and X bounds: length, data present, and the fake RAM's edges
+ */
+static void test_write_mem_bounds() {
+    char packet[GDB_PACKET_SIZE];
+    uint32_t len;
+
+    start();
+    feed_str("M20000000,4:01020304");
+    CHECK_SENT("+", "OK");
+    CHECK_EQ(fake_get_u32(0x20000000), 0x04030201);
+    feed_str("X20000004,2:ab");
+    CHECK_SENT("+", "OK");
+    CHECK(!memcmp(fake_ram_at(0x20000004, 2), "ab", 2));
+    // GDB probes for X with an empty write
+    feed_str("X20000000,0:");
+    CHECK_SENT("+", "OK");
+    CHECK_EQ(fake_mem_stats.writes, 2);
+
+    // Less data than the length says
+    feed_str("M20000010,4:010203");
+    CHECK_SENT("+", "E01");
+    feed_str("X20000010,4:ab");
+    CHECK_SENT("+", "E01");
+    // No colon, no length
+    feed_str("M20000010,4");
+    CHECK_SENT("+", "E01");
+    feed_str("M20000010");
+    CHECK_SENT("+", "E01");
+    feed_str("X20000010");
+    CHECK_SENT("+", "E01");
+    CHECK_EQ(fake_mem_stats.writes, 2);
+    // Nothing left over from a longer packet before it is used
+    feed_str("M20000020,4:05060708");
+    CHECK_SENT("+", "OK");
+    feed_str("M20000030");
+    CHECK_SENT("+", "E01");
+    CHECK_EQ(fake_get_u32(0x20000030), 0);
+    CHECK_EQ(fake_mem_stats.writes, 3);
+
+    // More than mem_buf holds
+    len = snprintf(packet, sizeof(packet), "X20000000,%x:", GDB_PACKET_SIZE / 2 + 1);
+    memset(packet + len, 'z', GDB_PACKET_SIZE / 2 + 1);
+    feed_packet(packet, len + GDB_PACKET_SIZE / 2 + 1, 0);
+    CHECK_SENT("+", "E01");
+    CHECK_EQ(fake_mem_stats.writes, 3);
+
+    // Off the end of RAM, the TARGET FAULTs
+    snprintf(packet, sizeof(packet), "M%x,2:0102", FAKE_RAM_BASE + FAKE_RAM_SIZE - 1);
+    feed_str(packet);
+    CHECK_SENT("+", "E01");
+}
+
+/**
+ * @brief Registers and memory reads against the register file and RAM
+ */
+static void test_target() {
+    char want[FAKE_NUM_REGS * 8 + 1];
+    uint32_t i;
+
+    start();
+    for (i = 0; i <= FAKE_REGSEL_XPSR; ++i) {
+        fake_regs[i] = 0x11111111 * (i & 0xF);
+    }
+    for (i = 0; i < FAKE_NUM_REGS; ++i) {
+        snprintf(&want[i * 8], 9, "%02x%02x%02x%02x", fake_regs[i] & 0xFF,
+                 (fake_regs[i] >> 8) & 0xFF, (fake_regs[i] >> 16) & 0xFF, fake_regs[i] >> 24);
+    }
+    feed_str("g");
+    CHECK_SENT("+", want);
+
+    feed_str("Pf=00010020");
+    CHECK_SENT("+", "OK");
+    CHECK_EQ(fake_regs[15], 0x20000100);
+    feed_str("p10");
+    CHECK_SENT("+", "00000000");
+    feed_str("p20");
+    CHECK_SENT("+", "xxxxxxxx");
+
+    fake_put_u32(0x20000100, 0xdeadbeef);
+    feed_str("m20000100,4");
+    CHECK_SENT("+", "efbeadde");
+    feed_str("m30000000,4");
+    CHECK_SENT("+", "E01");
+}
+
+/**
+ * @brief The memory map covers the whole 4 GB, peripherals and system space too
+ */
+static void test_memory_map() {
+    fake_port_t* p = &fake_ports[USB_CDC_HOST];
+    char map[1024], packet[64];
+    const char* region;
+    uint32_t map_len = 0, start_addr, length, regions = 0;
+    uint64_t next = 0;
+    uint8_t last = 0;
+
+    start();
+    // Read it a piece at a time, as GDB does
+    while (!last) {
+        snprintf(packet, sizeof(packet), "qXfer:memory-map:read::%x,40", map_len);
+        feed_str(packet);
+        // "+$" then 'm' or 'l', the data, and "#xx"
+        CHECK(p->tx_len >= 6 && p->tx_len - 6 + map_len < sizeof(map));
+        if (p->tx_len < 6 || p->tx_len - 6 + map_len >= sizeof(map)) {
+            return;
+        }
+        last = p->tx[2] == 'l';
+        memcpy(map + map_len, p->tx + 3, p->tx_len - 6);
+        map_len += p->tx_len - 6;
+        p->tx_len = 0;
+    }
+    map[map_len] = '\0';
+    CHECK(!strncmp(map, "<memory-map>", 12));
+
+    // Regions follow each other with no gaps from 0 to the top
+    for (region = strstr(map, "<memory "); region; region = strstr(region + 1, "<memory ")) {
+        CHECK_EQ(sscanf(strstr(region, "start="), "start=\"0x%x\" length=\"0x%x\"", &start_addr,
+                        &length), 2);
+        CHECK_EQ(start_addr, next);
+        next = (uint64_t)start_addr + length;
+        regions++;
+    }
+    CHECK_EQ(next, 0x100000000ULL);
+    // Flash, the gap, RAM, and everything above it
+    CHECK_EQ(regions, 4);
+    CHECK(strstr(map, "<memory type=\"ram\" start=\"0x20040000\" length=\"0xdffc0000\"/>"));
+}
+
+int main() {
+    test_checksum();
+    test_escape();
+    test_no_ack();
+    test_write_mem_bounds();
+    test_target();
+    test_memory_map();
+    return TEST_RESULT();
+}
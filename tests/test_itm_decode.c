@@ -0,0 +1,170 @@
+/**
+ * @file test_itm_decode.c
+ * @author Min Kang
+ * @brief Host test of the ITM decoder against recorded SWO streams
+ */
+#include "test.h"
+#include "itm_decode.h"
+
+#define MAX_PACKETS 32
+
+typedef struct {
+    itm_packet_type_t type;
+    uint8_t port;
+    uint8_t size;
+    uint32_t value;
+} expected_t;
+
+// A capture as the probe sees it after swo start: printf() output on two
+// ports, then every kind of packet the DWT sends with PC sampling,
+// exception trace and a data trace comparator on
+static const uint8_t stream[] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x80, // Sync
+    0x01, 'H',                          // Stimulus 0, one byte
+    0x03, 'e', 'l', 'l', 'o',           // Stimulus 0, a word
+    0x2A, 0x34, 0x12,                   // Stimulus 5, a halfword
+    0x70,                               // Overflow
+    0x30,                               // Short local timestamp
+    0xC0, 0x85, 0x01,                   // Long local timestamp
+    0x17, 0x34, 0x12, 0x00, 0x10,       // PC sample
+    0x15, 0x00,                         // PC sample while sleeping
+    0x0E, 0x0F, 0x10,                   // Exception 15 entry
+    0x94, 0x81, 0x02,                   // Global timestamp
+    0x08,                               // Extension, no payload
+    0x47, 0x78, 0x56, 0x34, 0x12,       // Data trace from comparator 0
+    0x05, 0x03,                         // Event counter wrap
+};
+
+static const expected_t expected[] = {
+    { ITM_PKT_SYNC,          0,  0, 0 },
+    { ITM_PKT_STIMULUS,      0,  1, 'H' },
+    { ITM_PKT_STIMULUS,      0,  4, 0x6f6c6c65 },
+    { ITM_PKT_STIMULUS,      5,  2, 0x1234 },
+    { ITM_PKT_OVERFLOW,      0,  0, 0 },
+    { ITM_PKT_TIMESTAMP,     0,  0, 3 },
+    { ITM_PKT_TIMESTAMP,     0,  2, 0x85 },
+    { ITM_PKT_PC_SAMPLE,     2,  4, 0x10001234 },
+    { ITM_PKT_PC_SAMPLE,     2,  1, 0 },
+    { ITM_PKT_EXCEPTION,     1,  2, 0x100f },
+    { ITM_PKT_GLOBAL_TS,     0,  2, 0x101 },
+    { ITM_PKT_EXTENSION,     0,  0, 0 },
+    { ITM_PKT_DATA_TRACE,    8,  4, 0x12345678 },
+    { ITM_PKT_EVENT_COUNTER, 0,  1, 3 },
+};
+
+/**
+ * @brief Decode bytes, appending what comes out to packets
+ */
+static void decode(itm_decoder_t* d, const uint8_t* bytes, uint32_t len, itm_packet_t* packets,
+                   uint32_t* n) {
+    uint32_t i;
+    for (i = 0; i < len; ++i) {
+        if (itm_decode_byte(d, bytes[i], &packets[*n]) && *n < MAX_PACKETS - 1) {
+            (*n)++;
+        }
+    }
+}
+
+static void check_packets(const itm_packet_t* packets, uint32_t n, const expected_t* want,
+                          uint32_t num_want) {
+    uint32_t i;
+    CHECK_EQ(n, num_want);
+    for (i = 0; i < n && i < num_want; ++i) {
+        CHECK_EQ(packets[i].type, want[i].type);
+        CHECK_EQ(packets[i].port, want[i].port);
+        CHECK_EQ(packets[i].size, want[i].size);
+        CHECK_EQ(packets[i].value, want[i].value);
+    }
+}
+
+/**
+ * @brief The whole stream in one go
+ */
+static void test_stream() {
+    itm_packet_t packets[MAX_PACKETS];
+    itm_decoder_t d;
+    uint32_t n = 0;
+    itm_decoder_init(&d);
+    decode(&d, stream, sizeof(stream), packets, &n);
+    check_packets(packets, n, expected, sizeof(expected) / sizeof(expected[0]));
+}
+
+/**
+ * @brief The stream split at every byte, the way the DMA ring wraps
+ */
+static void test_split() {
+    itm_packet_t packets[MAX_PACKETS];
+    itm_decoder_t d;
+    uint32_t split, n;
+    for (split = 1; split < sizeof(stream); ++split) {
+        n = 0;
+        itm_decoder_init(&d);
+        decode(&d, stream, split, packets, &n);
+        decode(&d, stream + split, sizeof(stream) - split, packets, &n);
+        check_packets(packets, n, expected, sizeof(expected) / sizeof(expected[0]));
+    }
+}
+
+/**
+ * @brief Back to back overflows, and a sync longer than the minimum
+ */
+static void test_overflow() {
+    static const uint8_t bytes[] = {
+        0x01, 'a', 0x70, 0x70, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x70, 0x01, 'b',
+    };
+    static const expected_t want[] = {
+        { ITM_PKT_STIMULUS, 0, 1, 'a' },
+        { ITM_PKT_OVERFLOW, 0, 0, 0 },
+        { ITM_PKT_OVERFLOW, 0, 0, 0 },
+        { ITM_PKT_SYNC,     0, 0, 0 },
+        { ITM_PKT_OVERFLOW, 0, 0, 0 },
+        { ITM_PKT_STIMULUS, 0, 1, 'b' },
+    };
+    itm_packet_t packets[MAX_PACKETS];
+    itm_decoder_t d;
+    uint32_t n = 0;
+    itm_decoder_init(&d);
+    decode(&d, bytes, sizeof(bytes), packets, &n);
+    check_packets(packets, n, want, sizeof(want) / sizeof(want[0]));
+}
+
+/**
+ * @brief Too few zeros for a sync, the byte after them is still a header
+ */
+static void test_short_sync() {
+    static const uint8_t bytes[] = { 0x00, 0x00, 0x00, 0x01, 'x', 0x00, 0x00, 0x00, 0x00, 0x80 };
+    static const expected_t want[] = {
+        { ITM_PKT_STIMULUS, 0, 1, 'x' },
+    };
+    itm_packet_t packets[MAX_PACKETS];
+    itm_decoder_t d;
+    uint32_t n = 0;
+    itm_decoder_init(&d);
+    decode(&d, bytes, sizeof(bytes), packets, &n);
+    check_packets(packets, n, want, sizeof(want) / sizeof(want[0]));
+}
+
+/**
+ * @brief A timestamp longer than 32 bits keeps the low 32
+ */
+static void test_long_timestamp() {
+    static const uint8_t bytes[] = { 0x94, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x7F };
+    static const expected_t want[] = {
+        { ITM_PKT_GLOBAL_TS, 0, 6, 0xFFFFFFFF },
+    };
+    itm_packet_t packets[MAX_PACKETS];
+    itm_decoder_t d;
+    uint32_t n = 0;
+    itm_decoder_init(&d);
+    decode(&d, bytes, sizeof(bytes), packets, &n);
+    check_packets(packets, n, want, sizeof(want) / sizeof(want[0]));
+}
+
+int main() {
+    test_stream();
+    test_split();
+    test_overflow();
+    test_short_sync();
+    test_long_timestamp();
+    return TEST_RESULT();
+}
@@ -0,0 +1,126 @@
+/**
+ * @file test_jobs.c
+ * @author Min Kang
+ * @brief Host test of the job scheduler's fairness and latency
+ *
+ * Each step moves a fake clock on by what the job says a step costs, so
+ * how long the console waits between passes of the main loop is known
+ * exactly.
+ */
+#include "test.h"
+#include "jobs.h"
+#include "utils.h"
+#include "pico/time.h"
+
+#define PASSES 1000
+
+typedef struct {
+    job_t job;
+    uint32_t steps;     // Times step was called
+    uint32_t limit;     // Done after this many steps, 0 for never
+    uint32_t cost_us;   // Clock time a step takes
+    uint32_t last_pass; // Pass it last ran in
+    uint32_t max_gap;   // Most passes between two of its steps
+} test_job_t;
+
+static uint64_t now_us;
+static uint32_t pass;
+
+uint64_t time_us_64() {
+    return now_us;
+}
+
+void redraw_line() {
+}
+
+static job_status_t step(job_t* job) {
+    test_job_t* t = (test_job_t*)job;
+    if (t->steps && pass - t->last_pass > t->max_gap) {
+        t->max_gap = pass - t->last_pass;
+    }
+    t->last_pass = pass;
+    t->steps++;
+    t->job.done = t->steps;
+    now_us += t->cost_us;
+    return t->limit && t->steps == t->limit ? JOB_DONE : JOB_RUNNING;
+}
+
+static void init(test_job_t* t, const char* name, uint32_t limit, uint32_t cost_us) {
+    *t = (test_job_t){ .limit = limit, .cost_us = cost_us };
+    t->job.name = name;
+    t->job.step = step;
+    t->job.total = limit;
+}
+
+/**
+ * @brief Every job gets one step per pass, whatever its steps cost
+ */
+static void test_fairness() {
+    test_job_t jobs[JOBS_MAX];
+    static const char* names[JOBS_MAX] = { "a", "b", "c", "d" };
+    uint64_t before, longest = 0;
+    uint32_t i;
+
+    for (i = 0; i < JOBS_MAX; ++i) {
+        init(&jobs[i], names[i], 0, 10 * (i + 1));
+        CHECK(job_start(&jobs[i].job));
+    }
+    for (pass = 0; pass < PASSES; ++pass) {
+        before = now_us;
+        CHECK_EQ(job_run(), JOBS_MAX);
+        if (now_us - before > longest) {
+            longest = now_us - before;
+        }
+    }
+    for (i = 0; i < JOBS_MAX; ++i) {
+        CHECK_EQ(jobs[i].steps, PASSES);
+        CHECK_EQ(jobs[i].max_gap, 1);
+    }
+    // A command typed mid pass waits for at most one step of each job
+    CHECK_EQ(longest, 10 + 20 + 30 + 40);
+    CHECK_EQ(job_cancel_all(), JOBS_MAX);
+    CHECK_EQ(job_run(), 0);
+    for (i = 0; i < JOBS_MAX; ++i) {
+        CHECK(!jobs[i].job.active);
+    }
+}
+
+/**
+ * @brief Finished jobs leave at once and their slot is free again
+ */
+static void test_slots() {
+    test_job_t short_job, long_job, extra[JOBS_MAX];
+    uint32_t i;
+
+    init(&short_job, "short", 3, 1);
+    init(&long_job, "long", 0, 1);
+    CHECK(job_start(&short_job.job));
+    CHECK(job_start(&long_job.job));
+    // Already running
+    CHECK(!job_start(&short_job.job));
+    for (i = 0; i < JOBS_MAX - 2; ++i) {
+        init(&extra[i], "extra", 0, 1);
+        CHECK(job_start(&extra[i].job));
+    }
+    // No room
+    init(&extra[JOBS_MAX - 2], "extra", 0, 1);
+    CHECK(!job_start(&extra[JOBS_MAX - 2].job));
+
+    for (pass = 0; pass < 3; ++pass) {
+        job_run();
+    }
+    CHECK_EQ(short_job.steps, 3);
+    CHECK(!short_job.job.active);
+    CHECK(job_start(&extra[JOBS_MAX - 2].job));
+    CHECK_EQ(job_run(), JOBS_MAX);
+    // Nothing runs a finished job again
+    CHECK_EQ(short_job.steps, 3);
+    CHECK_EQ(long_job.steps, 4);
+    CHECK_EQ(job_cancel_all(), JOBS_MAX);
+}
+
+int main() {
+    test_fairness();
+    test_slots();
+    return TEST_RESULT();
+}
@@ -0,0 +1,402 @@
+/**
+ * @file test_proto.c
+ * @author Min Kang
+ * @brief Host test of the framed binary protocol
+ *
+ * Frames go through proto_feed() against the fake TARGET. For the stall
+ * timeout, proto_run() reads from a pipe that a second thread writes to
+ * with a gap in the middle, the way a host that died mid-frame would.
+ */
+#include "test.h"
+#include "fake_target.h"
+#include "proto.h"
+#include "swd_batch.h"
+#include "swd_init.h"
+#include "data_transfer.h"
+#include "dap.h"
+#include "core.h"
+#include "pico/stdlib.h"
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#define IDCODE 0x0BE12477
+
+static uint32_t batches;
+static uint32_t clock_hz = 1000000;
+static int pipe_fds[2];
+
+uint8_t swd_transfer_batch(swd_op_t* ops, uint32_t num_ops) {
+    uint32_t i;
+    batches++;
+    for (i = 0; i < num_ops; ++i) {
+        if (ops[i].req & SWD_REQ_RnW) {
+            ops[i].data = IDCODE;
+        }
+        ops[i].ack = SWD_ACK_OK;
+    }
+    return SWD_ACK_OK;
+}
+
+uint32_t swd_set_clock(uint32_t freq_hz) {
+    return clock_hz = freq_hz;
+}
+
+uint32_t swd_get_clock() {
+    return clock_hz;
+}
+
+uint32_t negotiate_swd_clock() {
+    return clock_hz;
+}
+
+void initialize_swd() {
+}
+
+uint8_t setup_dp_and_mem_ap() {
+    return SWD_ACK_OK;
+}
+
+uint32_t dap_process(const uint8_t* req, uint32_t req_len, uint8_t* resp) {
+    return 0;
+}
+
+void core_reg_cache_invalidate() {
+}
+
+/**
+ * @brief Receive a byte from the pipe, the way stdio does from USB
+ */
+int getchar_timeout_us(uint32_t timeout_us) {
+    struct pollfd pfd = { .fd = pipe_fds[0], .events = POLLIN };
+    uint8_t c;
+    if (poll(&pfd, 1, timeout_us / 1000) <= 0 || read(pipe_fds[0], &c, 1) != 1) {
+        return PICO_ERROR_TIMEOUT;
+    }
+    return c;
+}
+
+/**
+ * @brief Build a frame
+ *
+ * @return Length of the frame
+ */
+static uint32_t build_frame(uint8_t* out, uint8_t cmd, const void* payload, uint16_t len) {
+    uint16_t crc;
+    out[0] = PROTO_SOF;
+    out[1] = len;
+    out[2] = len >> 8;
+    out[3] = cmd;
+    memcpy(&out[4], payload, len);
+    crc = proto_crc16(&out[1], 3 + len);
+    out[4 + len] = crc;
+    out[5 + len] = crc >> 8;
+    return 6 + len;
+}
+
+/**
+ * @brief Build a frame and feed it to the parser
+ *
+ * @return What proto_feed() returned for the last byte
+ */
+static uint8_t send_frame(uint8_t cmd, const void* payload, uint16_t len) {
+    static uint8_t frame[6 + PROTO_MAX_PAYLOAD];
+    uint32_t n = build_frame(frame, cmd, payload, len), i;
+    uint8_t exit = 0;
+    for (i = 0; i < n; ++i) {
+        exit = proto_feed(frame[i]);
+    }
+    return exit;
+}
+
+/**
+ * @brief Take the next response frame off a port and check its framing
+ *
+ * @return Pointer to the payload, status first, or NULL if there is none
+ */
+static const uint8_t* next_response(uint8_t port, uint32_t* pos, uint8_t cmd, uint16_t* len) {
+    const fake_port_t* p = &fake_ports[port];
+    const uint8_t* f = &p->tx[*pos];
+    uint16_t crc;
+    if (*pos + 6 > p->tx_len || f[0] != PROTO_SOF) {
+        return NULL;
+    }
+    *len = f[1] | (f[2] << 8);
+    if (*pos + 6 + *len > p->tx_len) {
+        return NULL;
+    }
+    crc = proto_crc16(&f[1], 3 + *len);
+    CHECK_EQ(f[3], cmd | PROTO_RESPONSE);
+    CHECK_EQ(f[4 + *len] | (f[5 + *len] << 8), crc);
+    *pos += 6 + *len;
+    return &f[4];
+}
+
+static void start() {
+    fake_target_reset();
+    proto_reset();
+    proto_set_port(USB_CDC_HOST);
+    batches = 0;
+}
+
+/**
+ * @brief The CRC-16/CCITT-FALSE check value
+ */
+static void test_crc() {
+    CHECK_EQ(proto_crc16((const uint8_t*)"123456789", 9), 0x29B1);
+}
+
+static void test_ping() {
+    const uint8_t* resp;
+    uint32_t pos = 0;
+    uint16_t len;
+
+    start();
+    CHECK_EQ(send_frame(PROTO_CMD_PING, "abc", 3), 0);
+    CHECK((resp = next_response(USB_CDC_HOST, &pos, PROTO_CMD_PING, &len)) != NULL);
+    if (resp) {
+        CHECK_EQ(len, 5);
+        CHECK_EQ(resp[0], PROTO_OK);
+        CHECK_EQ(resp[1], PROTO_VERSION);
+        CHECK(!memcmp(&resp[2], "abc", 3));
+    }
+    CHECK(proto_idle());
+}
+
+/**
+ * @brief A bad CRC is answered with PROTO_ERR_CRC and the frame isn't run
+ */
+static void test_crc_reject() {
+    uint8_t payload[6 + 4] = { 0x00, 0x01, 0x00, 0x20, 4, 0, 1, 2, 3, 4 };
+    uint8_t frame[6 + sizeof(payload)];
+    const uint8_t* resp;
+    uint32_t n, i, pos = 0;
+    uint16_t len;
+
+    start();
+    n = build_frame(frame, PROTO_CMD_WRITE, payload, sizeof(payload));
+    frame[n - 1] ^= 0x40;
+    for (i = 0; i < n; ++i) {
+        CHECK_EQ(proto_feed(frame[i]), 0);
+    }
+    CHECK((resp = next_response(USB_CDC_HOST, &pos, PROTO_CMD_WRITE, &len)) != NULL);
+    if (resp) {
+        CHECK_EQ(len, 1);
+        CHECK_EQ(resp[0], PROTO_ERR_CRC);
+    }
+    CHECK_EQ(fake_mem_stats.writes, 0);
+    CHECK_EQ(fake_get_u32(0x20000100), 0);
+
+    // The next frame goes through
+    send_frame(PROTO_CMD_PING, NULL, 0);
+    CHECK((resp = next_response(USB_CDC_HOST, &pos, PROTO_CMD_PING, &len)) != NULL);
+    if (resp) {
+        CHECK_EQ(resp[0], PROTO_OK);
+    }
+}
+
+/**
+ * @brief A LEN too big to hold is dropped without an answer
+ */
+static void test_oversized() {
+    static const uint8_t header[] = {
+        PROTO_SOF, (PROTO_MAX_PAYLOAD + 1) & 0xFF, (PROTO_MAX_PAYLOAD + 1) >> 8,
+    };
+    const uint8_t* resp;
+    uint32_t i, pos = 0;
+    uint16_t len;
+
+    start();
+    for (i = 0; i < sizeof(header); ++i) {
+        proto_feed(header[i]);
+    }
+    CHECK(proto_idle());
+    CHECK_EQ(fake_ports[USB_CDC_HOST].tx_len, 0);
+    send_frame(PROTO_CMD_PING, NULL, 0);
+    CHECK((resp = next_response(USB_CDC_HOST, &pos, PROTO_CMD_PING, &len)) != NULL);
+}
+
+static void test_transfer() {
+    static const uint8_t good[] = {
+        DP_READ(DP_IDCODE),
+        AP_WRITE(AP_TAR), 0x00, 0x00, 0x00, 0x20,
+    };
+    // A write with only three bytes of data
+    static const uint8_t short_write[] = { DP_READ(DP_IDCODE), AP_WRITE(AP_TAR), 0x00, 0x00, 0x00 };
+    uint8_t too_many[PROTO_MAX_OPS + 1];
+    const uint8_t* resp;
+    uint32_t pos = 0;
+    uint16_t len;
+
+    start();
+    send_frame(PROTO_CMD_TRANSFER, good, sizeof(good));
+    CHECK((resp = next_response(USB_CDC_HOST, &pos, PROTO_CMD_TRANSFER, &len)) != NULL);
+    if (resp) {
+        CHECK_EQ(len, 1 + 5 + 1);
+        CHECK_EQ(resp[0], PROTO_OK);
+        CHECK_EQ(resp[1], SWD_ACK_OK);
+        CHECK_EQ(resp[2] | (resp[3] << 8) | (resp[4] << 16) | ((uint32_t)resp[5] << 24), IDCODE);
+        CHECK_EQ(resp[6], SWD_ACK_OK);
+    }
+    CHECK_EQ(batches, 1);
+
+    send_frame(PROTO_CMD_TRANSFER, short_write, sizeof(short_write));
+    CHECK((resp = next_response(USB_CDC_HOST, &pos, PROTO_CMD_TRANSFER, &len)) != NULL);
+    if (resp) {
+        CHECK_EQ(len, 1);
+        CHECK_EQ(resp[0], PROTO_ERR_LEN);
+    }
+
+    memset(too_many, DP_READ(DP_IDCODE), sizeof(too_many));
+    send_frame(PROTO_CMD_TRANSFER, too_many, sizeof(too_many));
+    CHECK((resp = next_response(USB_CDC_HOST, &pos, PROTO_CMD_TRANSFER, &len)) != NULL);
+    if (resp) {
+        CHECK_EQ(len, 1);
+        CHECK_EQ(resp[0], PROTO_ERR_LEN);
+    }
+    // Neither bad request reached the wire
+    CHECK_EQ(batches, 1);
+}
+
+static void test_read() {
+    static const uint8_t good[] = { 0x00, 0x01, 0x00, 0x20, 3, 0, 0x10, 0x01, 0x00, 0x20, 2, 0 };
+    static const uint8_t ragged[] = { 0x00, 0x01, 0x00, 0x20, 3, 0, 0x10 };
+    // Two ranges that together don't fit in a response
+    static const uint8_t too_big[] = {
+        0x00, 0x00, 0x00, 0x20, 0x00, 0x02, 0x00, 0x02, 0x00, 0x20, 0x00, 0x02,
+    };
+    const uint8_t* resp;
+    uint32_t pos = 0;
+    uint16_t len;
+
+    start();
+    memcpy(fake_ram_at(0x20000100, 3), "xyz", 3);
+    memcpy(fake_ram_at(0x20000110, 2), "pq", 2);
+    send_frame(PROTO_CMD_READ, good, sizeof(good));
+    CHECK((resp = next_response(USB_CDC_HOST, &pos, PROTO_CMD_READ, &len)) != NULL);
+    if (resp) {
+        CHECK_EQ(len, 1 + 5);
+        CHECK_EQ(resp[0], PROTO_OK);
+        CHECK(!memcmp(&resp[1], "xyzpq", 5));
+    }
+
+    send_frame(PROTO_CMD_READ, ragged, sizeof(ragged));
+    CHECK((resp = next_response(USB_CDC_HOST, &pos, PROTO_CMD_READ, &len)) != NULL);
+    if (resp) {
+        CHECK_EQ(len, 1);
+        CHECK_EQ(resp[0], PROTO_ERR_LEN);
+    }
+
+    send_frame(PROTO_CMD_READ, too_big, sizeof(too_big));
+    CHECK((resp = next_response(USB_CDC_HOST, &pos, PROTO_CMD_READ, &len)) != NULL);
+    if (resp) {
+        CHECK_EQ(len, 1);
+        CHECK_EQ(resp[0], PROTO_ERR_LEN);
+    }
+}
+
+static void test_write() {
+    static const uint8_t good[] = { 0x00, 0x01, 0x00, 0x20, 4, 0, 'a', 'b', 'c', 'd' };
+    static const uint8_t short_header[] = { 0x00, 0x01, 0x00, 0x20, 4 };
+    // LEN of the range says eight bytes, four follow
+    static const uint8_t short_data[] = { 0x00, 0x02, 0x00, 0x20, 8, 0, 'e', 'f', 'g', 'h' };
+    const uint8_t* resp;
+    uint32_t pos = 0;
+    uint16_t len;
+
+    start();
+    send_frame(PROTO_CMD_WRITE, good, sizeof(good));
+    CHECK((resp = next_response(USB_CDC_HOST, &pos, PROTO_CMD_WRITE, &len)) != NULL);
+    if (resp) {
+        CHECK_EQ(len, 1);
+        CHECK_EQ(resp[0], PROTO_OK);
+    }
+    CHECK(!memcmp(fake_ram_at(0x20000100, 4), "abcd", 4));
+
+    send_frame(PROTO_CMD_WRITE, short_header, sizeof(short_header));
+    CHECK((resp = next_response(USB_CDC_HOST, &pos, PROTO_CMD_WRITE, &len)) != NULL);
+    if (resp) {
+        CHECK_EQ(resp[0], PROTO_ERR_LEN);
+    }
+
+    send_frame(PROTO_CMD_WRITE, short_data, sizeof(short_data));
+    CHECK((resp = next_response(USB_CDC_HOST, &pos, PROTO_CMD_WRITE, &len)) != NULL);
+    if (resp) {
+        CHECK_EQ(resp[0], PROTO_ERR_LEN);
+    }
+    CHECK_EQ(fake_mem_stats.writes, 1);
+    CHECK_EQ(fake_get_u32(0x20000200), 0);
+}
+
+static void test_unknown() {
+    const uint8_t* resp;
+    uint32_t pos = 0;
+    uint16_t len;
+
+    start();
+    send_frame(0x33, NULL, 0);
+    CHECK((resp = next_response(USB_CDC_HOST, &pos, 0x33, &len)) != NULL);
+    if (resp) {
+        CHECK_EQ(resp[0], PROTO_ERR_CMD);
+    }
+}
+
+/**
+ * @brief The host side of the pipe: half a frame, a stall, then two frames
+ */
+static void* host(void* arg) {
+    uint8_t frame[6 + 8];
+    uint32_t n;
+
+    n = build_frame(frame, PROTO_CMD_PING, "12345678", 8);
+    // Dies after the first two payload bytes
+    CHECK_EQ(write(pipe_fds[1], frame, 6), 6);
+    usleep(3 * PROTO_BYTE_TIMEOUT_US);
+    n = build_frame(frame, PROTO_CMD_PING, "ok", 2);
+    CHECK_EQ(write(pipe_fds[1], frame, n), n);
+    n = build_frame(frame, PROTO_CMD_EXIT, NULL, 0);
+    CHECK_EQ(write(pipe_fds[1], frame, n), n);
+    return NULL;
+}
+
+/**
+ * @brief A frame that stalls is dropped, and the next one still parses
+ */
+static void test_stall() {
+    const uint8_t* resp;
+    pthread_t thread;
+    uint32_t pos = 0;
+    uint16_t len;
+
+    start();
+    CHECK_EQ(pipe(pipe_fds), 0);
+    CHECK_EQ(pthread_create(&thread, NULL, host, NULL), 0);
+    CHECK_EQ(proto_run(), 0);
+    pthread_join(thread, NULL);
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+
+    // Without the reset the new frame would be eaten as payload of the old
+    CHECK((resp = next_response(USB_CDC_CONSOLE, &pos, PROTO_CMD_PING, &len)) != NULL);
+    if (resp) {
+        CHECK_EQ(len, 4);
+        CHECK_EQ(resp[0], PROTO_OK);
+        CHECK(!memcmp(&resp[2], "ok", 2));
+    }
+    CHECK((resp = next_response(USB_CDC_CONSOLE, &pos, PROTO_CMD_EXIT, &len)) != NULL);
+    CHECK_EQ(pos, fake_ports[USB_CDC_CONSOLE].tx_len);
+}
+
+int main() {
+    test_crc();
+    test_ping();
+    test_crc_reject();
+    test_oversized();
+    test_transfer();
+    test_read();
+    test_write();
+    test_unknown();
+    test_stall();
+    return TEST_RESULT();
+}
@@ -0,0 +1,225 @@
+/**
+ * @file test_rtt.c
+ * @author Min Kang
+ * @brief Host test of RTT against a control block in the fake TARGET's RAM
+ *
+ * The test plays the TARGET: it lays out the control block and rings in
+ * fake_ram and moves the TARGET's side of the offsets by hand. The find
+ * job is stepped here instead of by jobs.c, and the clock only moves when
+ * the test moves it.
+ */
+#include "test.h"
+#include "fake_target.h"
+#include "rtt.h"
+#include "jobs.h"
+#include "macros.h"
+#include "utils.h"
+#include "debug_interface.h"
+#include "swd_request.h"
+#include "pico/time.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Control block layout, as the TARGET has it
+#define CB_NUM_UP   16
+#define CB_NUM_DOWN 20
+#define CB_RINGS    24
+#define RING_DESC_SIZE 24
+#define RING_BUFFER    4
+#define RING_SIZE      8
+#define RING_WROFF     12
+#define RING_RDOFF     16
+
+#define UP_BUF   0x20002000
+#define DOWN_BUF 0x20002100
+
+static job_t* started;
+static uint64_t now_us;
+
+uint8_t job_start(job_t* job) {
+    started = job;
+    job->active = 1;
+    return 1;
+}
+
+void job_printf(job_t* job, const char* fmt, ...) {
+}
+
+void error(char* msg) {
+}
+
+void error_ack(char* msg, uint8_t ack) {
+}
+
+void redraw_line() {
+}
+
+int parse_str_to_hex(char* str, uint32_t* hex) {
+    char* end;
+    *hex = strtoul(str, &end, 16);
+    return *end != '\0';
+}
+
+int32_t str_to_int(char* str) {
+    return atoi(str);
+}
+
+uint64_t time_us_64() {
+    return now_us;
+}
+
+/**
+ * @brief Lay out a control block with one up and one down ring
+ */
+static void put_control_block(uint32_t cb, uint32_t up_size, uint32_t down_size) {
+    uint32_t up = cb + CB_RINGS, down = up + RING_DESC_SIZE;
+    memcpy(fake_ram_at(cb, sizeof(RTT_ID)), RTT_ID, sizeof(RTT_ID));
+    fake_put_u32(cb + CB_NUM_UP, 1);
+    fake_put_u32(cb + CB_NUM_DOWN, 1);
+    fake_put_u32(up + RING_BUFFER, UP_BUF);
+    fake_put_u32(up + RING_SIZE, up_size);
+    fake_put_u32(down + RING_BUFFER, DOWN_BUF);
+    fake_put_u32(down + RING_SIZE, down_size);
+}
+
+/**
+ * @brief rtt start over size bytes from addr, stepping the find job to the end
+ *
+ * @return Steps the job took, 0 if it didn't find the control block
+ */
+static uint32_t start(uint32_t addr, uint32_t size) {
+    char addr_str[16], size_str[16];
+    char* args[] = { "rtt", "start", addr_str, size_str };
+    job_status_t status;
+    uint32_t steps = 0;
+
+    snprintf(addr_str, sizeof(addr_str), "0x%08x", addr);
+    snprintf(size_str, sizeof(size_str), "%u", size);
+    started = NULL;
+    CHECK_EQ(rtt_run(args, 4), 0);
+    CHECK(started != NULL);
+    do {
+        status = started->step(started);
+        steps++;
+    } while (status == JOB_RUNNING && steps < 1000);
+    started->active = 0;
+    return status == JOB_DONE ? steps : 0;
+}
+
+/**
+ * @brief A control block whose ID straddles two scan chunks is still found
+ */
+static void test_find_straddling() {
+    // Half the ID in the first chunk and half in the second
+    uint32_t cb = FAKE_RAM_BASE + RTT_SCAN_CHUNK - RTT_ID_LEN / 2;
+
+    fake_target_reset();
+    // Garbage counts after the ID, not a control block
+    memcpy(fake_ram_at(FAKE_RAM_BASE + 0x40, sizeof(RTT_ID)), RTT_ID, sizeof(RTT_ID));
+    fake_put_u32(FAKE_RAM_BASE + 0x40 + CB_NUM_UP, 0xFFFFFFFF);
+    put_control_block(cb, 16, 16);
+    CHECK_EQ(start(FAKE_RAM_BASE, 0x1000), 2);
+    CHECK_EQ(rtt_get_stats()->polls, 0);
+
+    // Found at the very end of the range too
+    fake_target_reset();
+    put_control_block(FAKE_RAM_BASE + 0x1000 - CB_RINGS - 2 * RING_DESC_SIZE, 16, 16);
+    CHECK(start(FAKE_RAM_BASE, 0x1000));
+
+    // Nothing there at all
+    fake_target_reset();
+    CHECK_EQ(start(FAKE_RAM_BASE, 0x1000), 0);
+}
+
+/**
+ * @brief Data across the end of the up ring comes out in order, RdOff follows
+ */
+static void test_up_wraparound() {
+    static const char data[] = "wrapped!";
+    uint32_t cb = FAKE_RAM_BASE + 0x100, up = cb + CB_RINGS, reads;
+    fake_port_t* stream = &fake_ports[USB_CDC_STREAM];
+
+    fake_target_reset();
+    put_control_block(cb, 16, 16);
+    // The TARGET's reader got as far as 12 before the probe attached
+    fake_put_u32(up + RING_WROFF, 12);
+    fake_put_u32(up + RING_RDOFF, 12);
+    CHECK(start(cb, 0x100));
+
+    // Nothing new, one word read and nothing written
+    reads = fake_mem_stats.reads;
+    fake_mem_stats.writes = 0;
+    rtt_task();
+    CHECK_EQ(fake_mem_stats.reads, reads + 1);
+    CHECK_EQ(fake_mem_stats.writes, 0);
+    CHECK_EQ(rtt_get_stats()->idle_polls, 1);
+    // Not polled again until the backed off interval is up
+    now_us += RTT_POLL_MIN_US;
+    rtt_task();
+    CHECK_EQ(rtt_get_stats()->polls, 1);
+    now_us += RTT_POLL_MIN_US;
+
+    // Four bytes up to the end of the buffer, four after the wrap
+    memcpy(fake_ram_at(UP_BUF + 12, 4), data, 4);
+    memcpy(fake_ram_at(UP_BUF, 4), data + 4, 4);
+    fake_put_u32(up + RING_WROFF, 4);
+    rtt_task();
+    CHECK_EQ(stream->tx_len, 8);
+    CHECK(!memcmp(stream->tx, data, 8));
+    CHECK_EQ(fake_get_u32(up + RING_RDOFF), 4);
+    CHECK_EQ(rtt_get_stats()->bytes_up, 8);
+
+    // The TARGET writes up to one short of RdOff, the ring is full
+    memcpy(fake_ram_at(UP_BUF + 4, 12), "0123456789ab", 12);
+    memcpy(fake_ram_at(UP_BUF, 3), "cde", 3);
+    fake_put_u32(up + RING_WROFF, 3);
+    now_us += RTT_POLL_MIN_US;
+    rtt_task();
+    CHECK_EQ(stream->tx_len, 8 + 15);
+    CHECK(!memcmp(stream->tx + 8, "0123456789abcde", 15));
+    CHECK_EQ(fake_get_u32(up + RING_RDOFF), 3);
+}
+
+/**
+ * @brief Only what fits goes down, one byte always stays free
+ */
+static void test_down_one_free() {
+    uint32_t cb = FAKE_RAM_BASE + 0x100, down = cb + CB_RINGS + RING_DESC_SIZE;
+
+    fake_target_reset();
+    put_control_block(cb, 16, 8);
+    // WrOff 1 and RdOff 3, one byte left before the ring is full
+    fake_put_u32(down + RING_WROFF, 1);
+    fake_put_u32(down + RING_RDOFF, 3);
+    CHECK(start(cb, 0x100));
+
+    fake_port_receive(USB_CDC_STREAM, "abcd", 4);
+    now_us += RTT_POLL_MAX_US;
+    rtt_task();
+    CHECK_EQ(*fake_ram_at(DOWN_BUF + 1, 1), 'a');
+    CHECK_EQ(*fake_ram_at(DOWN_BUF + 2, 1), 0);
+    CHECK_EQ(fake_get_u32(down + RING_WROFF), 2);
+    CHECK_EQ(rtt_get_stats()->bytes_down, 1);
+
+    // Full now, nothing more is written
+    fake_mem_stats.writes = 0;
+    now_us += RTT_POLL_MAX_US;
+    rtt_task();
+    CHECK_EQ(fake_mem_stats.writes, 0);
+    CHECK_EQ(rtt_get_stats()->bytes_down, 1);
+
+    // The TARGET reads everything, the rest goes down
+    fake_put_u32(down + RING_RDOFF, 2);
+    now_us += RTT_POLL_MAX_US;
+    rtt_task();
+    CHECK(!memcmp(fake_ram_at(DOWN_BUF + 2, 3), "bcd", 3));
+    CHECK_EQ(fake_get_u32(down + RING_WROFF), 5);
+    CHECK_EQ(rtt_get_stats()->bytes_down, 4);
+}
+
+int main() {
+    test_find_straddling();
+    test_up_wraparound();
+    test_down_one_free();
+    return TEST_RESULT();
+}
@@ -0,0 +1,147 @@
+/**
+ * @file test_spsc.c
+ * @author Min Kang
+ * @brief Threaded stress test of the SPSC queue
+ *
+ * Sets up the queues the way swd_engine.c does: jobs go one way on a
+ * command queue and come back on a result queue, with each thread the
+ * producer of one queue and the consumer of the other. Every job carries
+ * data written before it is pushed, so a missing release or acquire shows
+ * up as stale data on the other side, and a lost or reordered job shows up
+ * as a gap in the sequence numbers.
+ */
+#include "test.h"
+#include "spsc.h"
+#include <pthread.h>
+#include <sched.h>
+
+#define NUM_JOBS 1000000
+// More jobs than fit in a queue, so both of them fill up
+#define POOL_SIZE (2 * SPSC_SIZE)
+#define JOB_WORDS 4
+
+typedef struct {
+    uint32_t seq;
+    uint32_t data[JOB_WORDS]; // Filled in from seq by the producer
+    uint32_t done;            // seq + 1 once the consumer checked it
+} job_t;
+
+static spsc_queue_t cmd_queue;
+static spsc_queue_t result_queue;
+static job_t pool[POOL_SIZE];
+// Only written by the consumer, read after it is joined
+static uint32_t bad_order;
+static uint32_t bad_data;
+// Set by the consumer once it pushed back the last job
+static uint32_t finished;
+
+static uint32_t job_word(uint32_t seq, uint32_t i) {
+    return (seq * 2654435761u) ^ (i * 0x9E3779B9u);
+}
+
+/**
+ * @brief The other core: check each job in order and send it back
+ */
+static void* consumer(void* arg) {
+    uint32_t expected = 0, i;
+    job_t* job;
+    while (expected < NUM_JOBS) {
+        if (!(job = spsc_pop(&cmd_queue))) {
+            sched_yield();
+            continue;
+        }
+        if (job->seq != expected) {
+            bad_order++;
+        }
+        for (i = 0; i < JOB_WORDS; ++i) {
+            if (job->data[i] != job_word(job->seq, i)) {
+                bad_data++;
+            }
+        }
+        job->done = job->seq + 1;
+        expected = job->seq + 1;
+        while (!spsc_push(&result_queue, job)) {
+            sched_yield();
+        }
+    }
+    __atomic_store_n(&finished, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/**
+ * @brief Push every job, reusing the ones that come back
+ */
+static void test_stress() {
+    uint32_t seq, used = 0, returned = 0, stale = 0, i;
+    pthread_t thread;
+    job_t* job;
+
+    spsc_init(&cmd_queue);
+    spsc_init(&result_queue);
+    CHECK_EQ(pthread_create(&thread, NULL, consumer, NULL), 0);
+
+    for (seq = 0; seq < NUM_JOBS; ++seq) {
+        if (used < POOL_SIZE) {
+            job = &pool[used++];
+        } else {
+            while (!(job = spsc_pop(&result_queue))) {
+                sched_yield();
+            }
+            // The consumer's write must be visible along with the job
+            if (job->done != job->seq + 1) {
+                stale++;
+            }
+            returned++;
+        }
+        job->seq = seq;
+        for (i = 0; i < JOB_WORDS; ++i) {
+            job->data[i] = job_word(seq, i);
+        }
+        while (!spsc_push(&cmd_queue, job)) {
+            sched_yield();
+        }
+    }
+    // The last jobs only come back while someone takes them
+    while (!__atomic_load_n(&finished, __ATOMIC_ACQUIRE)) {
+        if (spsc_pop(&result_queue)) {
+            returned++;
+        } else {
+            sched_yield();
+        }
+    }
+    pthread_join(thread, NULL);
+    while (spsc_pop(&result_queue)) {
+        returned++;
+    }
+
+    CHECK_EQ(bad_order, 0);
+    CHECK_EQ(bad_data, 0);
+    CHECK_EQ(stale, 0);
+    // Every job came back exactly once
+    CHECK_EQ(returned, NUM_JOBS);
+    CHECK(spsc_pop(&cmd_queue) == NULL);
+}
+
+/**
+ * @brief Full and empty on a single thread
+ */
+static void test_full_empty() {
+    spsc_queue_t q;
+    uint32_t i;
+    spsc_init(&q);
+    CHECK(spsc_pop(&q) == NULL);
+    for (i = 0; i < SPSC_SIZE; ++i) {
+        CHECK(spsc_push(&q, &pool[i]));
+    }
+    CHECK(!spsc_push(&q, &pool[SPSC_SIZE]));
+    for (i = 0; i < SPSC_SIZE; ++i) {
+        CHECK(spsc_pop(&q) == &pool[i]);
+    }
+    CHECK(spsc_pop(&q) == NULL);
+}
+
+int main() {
+    test_full_empty();
+    test_stress();
+    return TEST_RESULT();
+}
@@ -0,0 +1,213 @@
+/**
+ * @file test_swd_init.c
+ * @author Min Kang
+ * @brief Host test of SWCLK negotiation against a stub DP
+ *
+ * The DP and MEM-AP are a handful of registers and one RAM word behind
+ * swd_transfer(). Above link_max_hz the link goes bad, either with read
+ * data that comes back wrong or with parity errors that a retry would have
+ * hidden. swd_set_clock() tops out at backend_max_hz like a real backend.
+ */
+#include "test.h"
+#include "swd_init.h"
+#include "data_transfer.h"
+#include "swd_cache.h"
+#include "mem.h"
+#include "macros.h"
+#include "utils.h"
+#include "pico/time.h"
+
+#define IDCODE 0x0BE12477
+#define RAM_WORD 0x12345678
+#define MAX_CLOCKS 32
+
+typedef enum {
+    LINK_CORRUPT, // Reads come back with a bit flipped
+    LINK_PARITY,  // Reads come back right after a parity error retry
+    LINK_DEAD,    // Every ACK is a FAULT
+} link_t;
+
+static uint32_t backend_max_hz;
+static uint32_t link_max_hz;
+static link_t link_failure;
+static uint32_t clock_hz;
+// Every frequency set, in order
+static uint32_t clocks[MAX_CLOCKS];
+static uint32_t num_clocks;
+
+static uint32_t ctrl_stat;
+static uint32_t tar;
+static uint32_t ram_word;
+static uint32_t rdbuff;
+static uint32_t aborts;
+static swd_error_stats_t errors;
+
+static void fake_reset(uint32_t link_hz, uint32_t backend_hz, link_t failure) {
+    link_max_hz = link_hz;
+    backend_max_hz = backend_hz;
+    link_failure = failure;
+    num_clocks = 0;
+    ctrl_stat = tar = rdbuff = aborts = 0;
+    ram_word = RAM_WORD;
+    errors = (swd_error_stats_t){ 0 };
+}
+
+uint8_t swd_transfer(uint8_t req, uint32_t* data) {
+    uint8_t bad = clock_hz > link_max_hz;
+    uint32_t value = 0;
+
+    if (link_failure == LINK_DEAD) {
+        return SWD_ACK_FAULT;
+    }
+    if (!(req & SWD_REQ_RnW)) {
+        if (req == DP_WRITE(DP_ABORT)) {
+            aborts++;
+        } else if (req == DP_WRITE(DP_CTRL_STAT)) {
+            ctrl_stat = *data;
+        } else if (req == AP_WRITE(AP_TAR)) {
+            tar = *data;
+        } else if (req == AP_WRITE(AP_DRW) && tar == SWD_NEGOTIATE_RAM_ADDR) {
+            ram_word = *data;
+        }
+        return SWD_ACK_OK;
+    }
+
+    if (req == DP_READ(DP_IDCODE)) {
+        value = IDCODE;
+    } else if (req == DP_READ(DP_CTRL_STAT)) {
+        // Every power up request is acknowledged right away
+        value = ctrl_stat | ((ctrl_stat & 0x50000000) << 1);
+    } else if (req == DP_READ(DP_RDBUFF)) {
+        value = rdbuff;
+    } else if (req == AP_READ(AP_DRW)) {
+        // Posted, this returns the last AP read and the new one goes to RDBUFF
+        value = rdbuff;
+        rdbuff = tar == SWD_NEGOTIATE_RAM_ADDR ? ram_word : 0;
+    } else if (req & SWD_REQ_APnDP) {
+        value = rdbuff;
+        rdbuff = 0;
+    }
+    if (bad && link_failure == LINK_CORRUPT) {
+        value ^= 0x100;
+    }
+    if (bad && link_failure == LINK_PARITY) {
+        errors.parity++;
+    }
+    *data = value;
+    return SWD_ACK_OK;
+}
+
+uint8_t SWD_DP_read(uint8_t A, uint32_t* data) {
+    return swd_transfer(DP_READ(A), data);
+}
+
+uint8_t SWD_DP_write(uint8_t A, uint32_t data) {
+    return swd_transfer(DP_WRITE(A), &data);
+}
+
+uint8_t SWD_AP_write(uint8_t A, uint32_t data) {
+    return swd_transfer(AP_WRITE(A), &data);
+}
+
+uint32_t swd_set_clock(uint32_t freq_hz) {
+    clock_hz = freq_hz > backend_max_hz ? backend_max_hz : freq_hz;
+    if (num_clocks < MAX_CLOCKS) {
+        clocks[num_clocks++] = clock_hz;
+    }
+    return clock_hz;
+}
+
+const swd_error_stats_t* swd_get_error_stats() {
+    return &errors;
+}
+
+void send_data_lsb(uint32_t data, uint8_t len) {
+}
+
+void swd_cache_invalidate() {
+}
+
+uint8_t mem_probe_caps() {
+    return SWD_ACK_OK;
+}
+
+const mem_caps_t* mem_get_caps() {
+    static const mem_caps_t caps = { 1, 1, 1 };
+    return &caps;
+}
+
+void error(char* msg) {
+}
+
+void error_ack(char* msg, uint8_t ack) {
+}
+
+uint64_t time_us_64() {
+    return 0;
+}
+
+/**
+ * @brief Check the frequencies set, in order
+ */
+static void check_clocks(const uint32_t* want, uint32_t n) {
+    uint32_t i;
+    CHECK_EQ(num_clocks, n);
+    for (i = 0; i < n && i < num_clocks; ++i) {
+        CHECK_EQ(clocks[i], want[i]);
+    }
+}
+
+/**
+ * @brief The link fails above 12 MHz: every step up to it, one past, then 75%
+ */
+static void test_ladder() {
+    static const uint32_t want[] = {
+        SWD_NEGOTIATE_START_HZ, 250000, 500000, 1000000, 2000000, 4000000, 6000000,
+        8000000, 12000000, 16000000, 9000000,
+    };
+    fake_reset(12000000, SWD_MAX_FREQ_HZ, LINK_CORRUPT);
+    CHECK_EQ(negotiate_swd_clock(), 9000000);
+    check_clocks(want, sizeof(want) / sizeof(want[0]));
+    CHECK_EQ(clock_hz, 9000000);
+    // The RAM word the check walked patterns over is put back
+    CHECK_EQ(ram_word, RAM_WORD);
+    // Sticky errors from the failed step are cleared
+    CHECK(aborts > 0);
+}
+
+/**
+ * @brief Parity errors fail a step even though the data came back right
+ */
+static void test_parity() {
+    fake_reset(4000000, SWD_MAX_FREQ_HZ, LINK_PARITY);
+    CHECK_EQ(negotiate_swd_clock(), 3000000);
+    CHECK_EQ(clocks[num_clocks - 2], 6000000);
+}
+
+/**
+ * @brief The backend tops out before the link does
+ */
+static void test_backend_limit() {
+    fake_reset(SWD_MAX_FREQ_HZ, 25000000, LINK_CORRUPT);
+    CHECK_EQ(negotiate_swd_clock(), 25000000 / 100 * SWD_NEGOTIATE_MARGIN_PCT);
+    // 30 MHz came back as 25 MHz, nothing faster was tried
+    CHECK_EQ(clocks[num_clocks - 2], 25000000);
+    CHECK_EQ(clocks[num_clocks - 3], 25000000);
+}
+
+/**
+ * @brief Nothing at the start frequency
+ */
+static void test_unreachable() {
+    fake_reset(SWD_MAX_FREQ_HZ, SWD_MAX_FREQ_HZ, LINK_DEAD);
+    CHECK_EQ(negotiate_swd_clock(), 0);
+    CHECK_EQ(num_clocks, 1);
+}
+
+int main() {
+    test_ladder();
+    test_parity();
+    test_backend_limit();
+    test_unreachable();
+    return TEST_RESULT();
+}
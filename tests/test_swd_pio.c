@@ -0,0 +1,139 @@
+/**
+ * @file test_swd_pio.c
+ * @author Min Kang
+ * @brief Host test of the PIO SWD command words
+ *
+ * Command words are run through a model of swd.pio: get_next_cmd's three
+ * outs from a right shifting OSR, write_cmd shifting data out LSB first,
+ * and read_cmd shifting SWDIO into the top of a right shifting ISR. The
+ * routine addresses are counted off swd.pio by hand and need updating
+ * along with it.
+ */
+#include "test.h"
+#include "swd_pio.h"
+#include "swd_request.h"
+
+// Addresses within the program, see swd.pio
+#define PROG_WRITE_CMD 0
+#define PROG_READ_CMD 8
+#define PROG_LEN 11
+// Instruction memory of a PIO block
+#define PIO_INSTRUCTIONS 32
+
+#define MAX_BITS 256
+
+typedef struct {
+    uint32_t offset;            // Where the program was loaded
+    uint8_t pindir;             // Last SWDIO direction set, 1 for output
+    uint8_t wire[MAX_BITS];     // Bits driven onto SWDIO, in order
+    uint32_t wire_len;
+    const uint8_t* target;      // Bits the TARGET drives on reads, in order
+    uint32_t target_pos;
+    uint32_t rx[8];             // Words pushed to the RX FIFO
+    uint32_t rx_len;
+    uint8_t bad;                // Set if a command jumped somewhere odd
+} sm_t;
+
+/**
+ * @brief Run one command, and its data word for a write
+ */
+static void run_cmd(sm_t* sm, uint32_t cmd, uint32_t data) {
+    uint32_t osr = cmd, x, isr = 0, pc;
+
+    // out x, 8 / out pindirs, 1 / out pc, 5
+    x = osr & 0xFF;
+    osr >>= 8;
+    sm->pindir = osr & 1;
+    osr >>= 1;
+    pc = osr & 0x1F;
+    osr >>= 5;
+    // Anything left would be lost, a sign fields moved
+    if (osr) {
+        sm->bad = 1;
+    }
+
+    if (pc == sm->offset + PROG_WRITE_CMD) {
+        if (!sm->pindir) {
+            sm->bad = 1;
+        }
+        // pull, then out pins, 1 until x-- falls through
+        osr = data;
+        do {
+            sm->wire[sm->wire_len++] = osr & 1;
+            osr >>= 1;
+        } while (x--);
+    } else if (pc == sm->offset + PROG_READ_CMD) {
+        if (sm->pindir) {
+            sm->bad = 1;
+        }
+        // in pins, 1 until x-- falls through, then push
+        do {
+            isr = (isr >> 1) | ((uint32_t)sm->target[sm->target_pos++] << 31);
+        } while (x--);
+        sm->rx[sm->rx_len++] = isr;
+    } else {
+        sm->bad = 1;
+    }
+}
+
+/**
+ * @brief Every length, direction and load offset decodes back to itself
+ */
+static void test_fields() {
+    static const uint8_t zeros[32];
+    uint32_t offset, len, host;
+    sm_t sm;
+
+    for (offset = 0; offset + PROG_LEN <= PIO_INSTRUCTIONS; ++offset) {
+        for (len = 1; len <= 32; ++len) {
+            for (host = 0; host <= 1; ++host) {
+                sm = (sm_t){ .offset = offset, .target = zeros };
+                run_cmd(&sm, swd_pio_cmd_word(len, host,
+                                              offset + (host ? PROG_WRITE_CMD : PROG_READ_CMD)), 0);
+                CHECK_EQ(sm.bad, 0);
+                CHECK_EQ(sm.pindir, host);
+                CHECK_EQ(host ? sm.wire_len : sm.rx_len, host ? len : 1);
+            }
+        }
+    }
+}
+
+/**
+ * @brief A DP read of IDCODE, phase by phase as swd_pio_transfer_stream lays it out
+ */
+static void test_read_transaction() {
+    static const uint8_t header[] = { 1, 0, 1, 0, 0, 1, 0, 1 };
+    uint8_t target[4 + 32 + 2] = { 0, 1, 0, 0 }; // Turnaround and ACK OK
+    sm_t sm = { .offset = 5, .target = target };
+    uint32_t idcode = 0x0BE12477, i;
+
+    // IDCODE LSB first, its parity and the turnaround
+    for (i = 0; i < 32; ++i) {
+        target[4 + i] = (idcode >> i) & 1;
+    }
+    target[36] = __builtin_parity(idcode);
+
+    run_cmd(&sm, swd_pio_cmd_word(8, 1, sm.offset + PROG_WRITE_CMD),
+            swd_req_headers[DP_READ(DP_IDCODE)]);
+    run_cmd(&sm, swd_pio_cmd_word(4, 0, sm.offset + PROG_READ_CMD), 0);
+    run_cmd(&sm, swd_pio_cmd_word(32, 0, sm.offset + PROG_READ_CMD), 0);
+    run_cmd(&sm, swd_pio_cmd_word(2, 0, sm.offset + PROG_READ_CMD), 0);
+
+    CHECK_EQ(sm.bad, 0);
+    CHECK_EQ(sm.wire_len, 8);
+    for (i = 0; i < 8; ++i) {
+        CHECK_EQ(sm.wire[i], header[i]);
+    }
+    CHECK_EQ(sm.target_pos, sizeof(target));
+    CHECK_EQ(sm.rx_len, 3);
+    // Reads come back left justified, the way swd_pio_transfer_stream takes them
+    CHECK_EQ((sm.rx[0] >> 29) & 0b111, SWD_ACK_OK);
+    CHECK_EQ(sm.rx[1], idcode);
+    CHECK_EQ((sm.rx[2] >> 30) & 1, __builtin_parity(idcode));
+}
+
+int main() {
+    test_fields();
+    test_read_transaction();
+    return TEST_RESULT();
+}
@@ -0,0 +1,49 @@
+/**
+ * @file test_swd_request.c
+ * @author Min Kang
+ * @brief Host test of the SWD request header table
+ */
+#include "test.h"
+#include "swd_request.h"
+
+/**
+ * @brief Every header has its fields where the wire wants them
+ */
+static void test_fields() {
+    uint8_t req, h, a;
+    for (req = 0; req < 16; ++req) {
+        h = swd_req_headers[req];
+        a = req >> SWD_REQ_A_SHIFT;
+        // Start, stop and park
+        CHECK_EQ(h & 0xC1, 0x81);
+        CHECK_EQ((h >> 1) & 1, req & SWD_REQ_APnDP ? 1 : 0);
+        CHECK_EQ((h >> 2) & 1, req & SWD_REQ_RnW ? 1 : 0);
+        // A[2] goes out before A[3]
+        CHECK_EQ((h >> 3) & 1, a >> 1);
+        CHECK_EQ((h >> 4) & 1, a & 1);
+        // Even parity over APnDP, RnW, A[2] and A[3]
+        CHECK_EQ(__builtin_parity(h & 0x3E), 0);
+    }
+}
+
+/**
+ * @brief Headers against the values in the ADIv5 spec
+ */
+static void test_spec() {
+    CHECK_EQ(swd_req_headers[DP_READ(DP_IDCODE)], 0xA5);
+    CHECK_EQ(swd_req_headers[DP_WRITE(DP_ABORT)], 0x81);
+    CHECK_EQ(swd_req_headers[DP_READ(DP_CTRL_STAT)], 0x8D);
+    CHECK_EQ(swd_req_headers[DP_WRITE(DP_CTRL_STAT)], 0xA9);
+    CHECK_EQ(swd_req_headers[DP_WRITE(DP_SELECT)], 0xB1);
+    CHECK_EQ(swd_req_headers[DP_READ(DP_RDBUFF)], 0xBD);
+    CHECK_EQ(swd_req_headers[AP_READ(AP_CSW)], 0x87);
+    CHECK_EQ(swd_req_headers[AP_WRITE(AP_TAR)], 0x8B);
+    CHECK_EQ(swd_req_headers[AP_READ(AP_DRW)], 0x9F);
+    CHECK_EQ(swd_req_headers[AP_WRITE(AP_DRW)], 0xBB);
+}
+
+int main() {
+    test_fields();
+    test_spec();
+    return TEST_RESULT();
+}
@@ -0,0 +1,138 @@
+/**
+ * @file test_watchpoint.c
+ * @author Min Kang
+ * @brief Host test of the watchpoint table against a two comparator DWT
+ *
+ * The DWT is an ARMv7-M one with comparators 0 and 1, as on a Cortex-M0+
+ * class part with the DWT data match option. Only DEMCR and the DWT
+ * registers exist, anything else FAULTs.
+ */
+#include "test.h"
+#include "watchpoint.h"
+#include "mem.h"
+#include "macros.h"
+#include "swd_request.h"
+
+#define NUM_COMPS 2
+
+// ARMv7-M DWT_FUNCTION, as watchpoint.c writes it
+#define FUNC_READ  0x5
+#define FUNC_WRITE 0x6
+
+static uint32_t demcr;
+static uint32_t comp[NUM_COMPS];
+static uint32_t mask[NUM_COMPS];
+static uint32_t func[NUM_COMPS];
+
+/**
+ * @brief Where a DWT register of the fake lives
+ *
+ * @return Pointer to it, or NULL if addr isn't one
+ */
+static uint32_t* reg(uint32_t addr) {
+    uint32_t n = (addr - DWT_COMP0) / 16;
+    if (addr == CORE_DEMCR) {
+        return &demcr;
+    }
+    if (addr < DWT_COMP0 || n >= NUM_COMPS) {
+        return NULL;
+    }
+    switch ((addr - DWT_COMP0) % 16) {
+    case 0: return &comp[n];
+    case DWT_MASK0 - DWT_COMP0: return &mask[n];
+    case DWT_FUNCTION0 - DWT_COMP0: return &func[n];
+    }
+    return NULL;
+}
+
+uint8_t mem_read(uint32_t addr, uint32_t* data) {
+    uint32_t* r = reg(addr);
+    if (addr == DWT_CTRL) {
+        *data = (uint32_t)NUM_COMPS << 28;
+        return SWD_ACK_OK;
+    }
+    if (addr == DWT_DEVARCH) {
+        *data = 0;
+        return SWD_ACK_OK;
+    }
+    if (!r) {
+        return SWD_ACK_FAULT;
+    }
+    *data = *r;
+    return SWD_ACK_OK;
+}
+
+uint8_t mem_write(uint32_t addr, uint32_t data) {
+    uint32_t* r = reg(addr);
+    if (!r) {
+        return SWD_ACK_FAULT;
+    }
+    *r = data;
+    return SWD_ACK_OK;
+}
+
+/**
+ * @brief A watchpoint that doesn't fit leaves the one it would replace alone
+ */
+static void test_replace() {
+    wp_t wp;
+
+    CHECK_EQ(wp_init(), SWD_ACK_OK);
+    CHECK_EQ(wp_set(0x20000000, 4, WP_WRITE, 0, 0), SWD_ACK_OK);
+    CHECK_EQ(wp_set(0x20000100, 4, WP_READ, 0, 0), SWD_ACK_OK);
+    CHECK_EQ(wp_sync(), SWD_ACK_OK);
+    CHECK_EQ(func[0], FUNC_WRITE);
+    CHECK_EQ(func[1], FUNC_READ);
+    CHECK(demcr & DEMCR_TRCENA);
+
+    // A value match needs comparator 1, which the other one holds
+    CHECK_EQ(wp_set(0x20000000, 4, WP_WRITE, 1, 0x1234), SWD_ACK_FAULT);
+    CHECK(wp_get(0, &wp));
+    CHECK_EQ(wp.addr, 0x20000000);
+    CHECK_EQ(wp.type, WP_WRITE);
+    CHECK_EQ(wp.match_value, 0);
+    func[0] = func[1] = 0xdead;
+    CHECK_EQ(wp_sync(), SWD_ACK_OK);
+    // Nothing changed, nothing written
+    CHECK_EQ(func[0], 0xdead);
+    CHECK_EQ(func[1], 0xdead);
+
+    // One that fits takes over the comparator of the one it replaces
+    CHECK_EQ(wp_set(0x20000000, 2, WP_READ, 0, 0), SWD_ACK_OK);
+    CHECK(wp_get(0, &wp));
+    CHECK_EQ(wp.type, WP_READ);
+    CHECK_EQ(wp.comps, 1);
+    CHECK(!wp_get(2, &wp));
+    CHECK_EQ(wp_sync(), SWD_ACK_OK);
+    CHECK_EQ(func[0], FUNC_READ);
+    CHECK_EQ(mask[0], 1);
+    CHECK_EQ(func[1], 0xdead);
+
+    // Full, and a length of 0 is never a watchpoint
+    CHECK_EQ(wp_set(0x20000200, 4, WP_WRITE, 0, 0), SWD_ACK_FAULT);
+    CHECK_EQ(wp_set(0x20000000, 0, WP_WRITE, 0, 0), SWD_ACK_FAULT);
+    CHECK(wp_get(0, &wp));
+    CHECK_EQ(wp.len, 2);
+}
+
+/**
+ * @brief A value match once comparator 1 is free
+ */
+static void test_value_match() {
+    CHECK_EQ(wp_clear(0x20000100), SWD_ACK_OK);
+    CHECK_EQ(wp_set(0x20000000, 2, WP_WRITE, 1, 0xBEEF), SWD_ACK_OK);
+    CHECK_EQ(wp_sync(), SWD_ACK_OK);
+    CHECK_EQ(comp[1], 0xBEEFBEEF);
+    CHECK_EQ(func[1] & 0xF, FUNC_WRITE);
+    CHECK_EQ(comp[0], 0x20000000);
+    CHECK_EQ(wp_clear_all(), SWD_ACK_OK);
+    CHECK_EQ(wp_sync(), SWD_ACK_OK);
+    CHECK_EQ(func[0], 0);
+    CHECK_EQ(func[1], 0);
+}
+
+int main() {
+    test_replace();
+    test_value_match();
+    return TEST_RESULT();
+}